@@ -0,0 +1,1290 @@
+// Microbenchmarks of the internal data structures of UDT.
+// This program uses the library internals and is linked with the static library.
+
+#ifndef WIN32
+   #include <cstdlib>
+   #include <cstring>
+   #include <pthread.h>
+   #include <unistd.h>
+   #include <arpa/inet.h>
+#endif
+#ifdef LINUX
+   #include <cstdio>
+   #include <malloc.h>
+#endif
+#include <iostream>
+#include <vector>
+
+#include "list.h"
+#include "queue.h"
+
+using namespace std;
+
+
+// the socket hash table before it was replaced by the open addressing one: 1024 chained buckets
+class CChainHash
+{
+public:
+   CChainHash(int size): m_pBucket(new CBucket* [size]), m_iHashSize(size)
+   {
+      for (int i = 0; i < size; ++ i)
+         m_pBucket[i] = NULL;
+   }
+
+   ~CChainHash()
+   {
+      for (int i = 0; i < m_iHashSize; ++ i)
+      {
+         while (NULL != m_pBucket[i])
+         {
+            CBucket* n = m_pBucket[i]->m_pNext;
+            delete m_pBucket[i];
+            m_pBucket[i] = n;
+         }
+      }
+      delete [] m_pBucket;
+   }
+
+   CUDT* lookup(int32_t id)
+   {
+      for (CBucket* b = m_pBucket[id % m_iHashSize]; NULL != b; b = b->m_pNext)
+         if (id == b->m_iID)
+            return b->m_pUDT;
+      return NULL;
+   }
+
+   void insert(int32_t id, CUDT* u)
+   {
+      CBucket* n = new CBucket;
+      n->m_iID = id;
+      n->m_pUDT = u;
+      n->m_pNext = m_pBucket[id % m_iHashSize];
+      m_pBucket[id % m_iHashSize] = n;
+   }
+
+private:
+   struct CBucket
+   {
+      int32_t m_iID;
+      CUDT* m_pUDT;
+      CBucket* m_pNext;
+   } **m_pBucket;
+
+   int m_iHashSize;
+};
+
+// socket IDs are allocated downwards from a random number
+void makeIDs(vector<int32_t>& ids, int num)
+{
+   int32_t id = 1 + rand() % 0x3FFFFFFF;
+   for (int i = 0; i < num; ++ i)
+      ids.push_back(id --);
+}
+
+// random lookup sequence of the existing IDs, as packets of many connections arrive
+void makeLookups(vector<int32_t>& seq, const vector<int32_t>& ids, int num)
+{
+   for (int i = 0; i < num; ++ i)
+      seq.push_back(ids[rand() % ids.size()]);
+}
+
+template <class T>
+double timeLookups(T& table, const vector<int32_t>& seq)
+{
+   uint64_t start = CTimer::getTime();
+   intptr_t sum = 0;
+   for (vector<int32_t>::const_iterator i = seq.begin(); i != seq.end(); ++ i)
+      sum += (intptr_t)table.lookup(*i);
+   uint64_t end = CTimer::getTime();
+
+   // use the result, so that the lookups are not optimized away
+   if (0 == sum)
+      cout << "";
+
+   return double(end - start) * 1000.0 / seq.size();
+}
+
+void benchHash()
+{
+   const int lookups = 2000000;
+   const int sizes[] = {1000, 10000, 100000};
+
+   cout << "socket hash table, ns per lookup" << endl;
+   cout << "sockets\tchained\topen" << endl;
+
+   for (unsigned int s = 0; s < sizeof(sizes) / sizeof(int); ++ s)
+   {
+      vector<int32_t> ids, seq;
+      makeIDs(ids, sizes[s]);
+      makeLookups(seq, ids, lookups);
+
+      CChainHash chain(1024);
+      CHash open;
+      open.init(1024);
+      for (vector<int32_t>::iterator i = ids.begin(); i != ids.end(); ++ i)
+      {
+         chain.insert(*i, (CUDT*)(intptr_t)*i);
+         open.insert(*i, (CUDT*)(intptr_t)*i);
+      }
+
+      double tc = timeLookups(chain, seq);
+      double to = timeLookups(open, seq);
+
+      cout << sizes[s] << "\t" << tc << "\t" << to << endl;
+   }
+}
+
+// the sending list before it was replaced by the timing wheel: a binary heap of the nodes by time stamp
+class CHeapList
+{
+public:
+   CHeapList(int size): m_pHeap(new CWheelNode* [size]), m_iLastEntry(-1) {}
+   ~CHeapList() {delete [] m_pHeap;}
+
+   CWheelNode* top() {return (m_iLastEntry >= 0) ? m_pHeap[0] : NULL;}
+
+   void insert(CWheelNode* n)
+   {
+      m_pHeap[++ m_iLastEntry] = n;
+
+      int q = m_iLastEntry;
+      while (q != 0)
+      {
+         int p = (q - 1) >> 1;
+         if (m_pHeap[p]->m_llTimeStamp <= m_pHeap[q]->m_llTimeStamp)
+            break;
+         swap(p, q);
+         q = p;
+      }
+      n->m_iSlot = q;
+   }
+
+   void remove(CWheelNode* n)
+   {
+      int q = n->m_iSlot;
+      m_pHeap[q] = m_pHeap[m_iLastEntry --];
+      m_pHeap[q]->m_iSlot = q;
+
+      int p = q * 2 + 1;
+      while (p <= m_iLastEntry)
+      {
+         if ((p + 1 <= m_iLastEntry) && (m_pHeap[p]->m_llTimeStamp > m_pHeap[p + 1]->m_llTimeStamp))
+            p ++;
+         if (m_pHeap[q]->m_llTimeStamp <= m_pHeap[p]->m_llTimeStamp)
+            break;
+         swap(p, q);
+         q = p;
+         p = q * 2 + 1;
+      }
+      n->m_iSlot = -1;
+   }
+
+private:
+   void swap(int p, int q)
+   {
+      CWheelNode* t = m_pHeap[p];
+      m_pHeap[p] = m_pHeap[q];
+      m_pHeap[q] = t;
+      m_pHeap[p]->m_iSlot = p;
+      m_pHeap[q]->m_iSlot = q;
+   }
+
+   CWheelNode** m_pHeap;
+   int m_iLastEntry;
+};
+
+// paced connections, each sending a packet every "period" microseconds; every 4th packet, one random
+// connection is rescheduled to now, as an application send() does
+void makePeriods(vector<uint64_t>& period, int num)
+{
+   for (int i = 0; i < num; ++ i)
+      period.push_back(10 + rand() % 10000);
+}
+
+double runHeap(vector<CWheelNode>& node, const vector<uint64_t>& period, int ops)
+{
+   CHeapList heap(node.size());
+   for (unsigned int i = 0; i < node.size(); ++ i)
+   {
+      node[i].m_llTimeStamp = rand() % period[i];
+      heap.insert(&node[i]);
+   }
+
+   uint64_t start = CTimer::getTime();
+   for (int i = 0; i < ops; ++ i)
+   {
+      CWheelNode* n = heap.top();
+      uint64_t now = n->m_llTimeStamp;
+      heap.remove(n);
+      n->m_llTimeStamp = now + period[n - &node[0]];
+      heap.insert(n);
+
+      if (0 == (i & 3))
+      {
+         n = &node[rand() % node.size()];
+         heap.remove(n);
+         n->m_llTimeStamp = now;
+         heap.insert(n);
+      }
+   }
+
+   return ops / double(CTimer::getTime() - start);
+}
+
+double runWheel(vector<CWheelNode>& node, const vector<uint64_t>& period, int ops)
+{
+   CTimerWheel wheel;
+   wheel.init(0, 1);
+   for (unsigned int i = 0; i < node.size(); ++ i)
+   {
+      node[i].m_llTimeStamp = rand() % period[i];
+      wheel.insert(&node[i]);
+   }
+
+   uint64_t start = CTimer::getTime();
+   for (int i = 0; i < ops;)
+   {
+      uint64_t now = wheel.next();
+      CWheelNode* n = wheel.due(now);
+      if (NULL == n)
+         continue;
+
+      wheel.remove(n);
+      n->m_llTimeStamp = now + period[n - &node[0]];
+      wheel.insert(n);
+
+      if (0 == (i & 3))
+      {
+         n = &node[rand() % node.size()];
+         wheel.remove(n);
+         n->m_llTimeStamp = now;
+         wheel.insert(n);
+      }
+
+      ++ i;
+   }
+
+   return ops / double(CTimer::getTime() - start);
+}
+
+void benchSched()
+{
+   const int ops = 2000000;
+   const int sizes[] = {1000, 10000, 100000};
+
+   cout << "sending scheduler, million packets scheduled per second" << endl;
+   cout << "sockets\theap\twheel" << endl;
+
+   for (unsigned int s = 0; s < sizeof(sizes) / sizeof(int); ++ s)
+   {
+      vector<uint64_t> period;
+      makePeriods(period, sizes[s]);
+      vector<CWheelNode> node(sizes[s]);
+
+      double th = runHeap(node, period, ops);
+      double tw = runWheel(node, period, ops);
+
+      cout << sizes[s] << "\t" << th << "\t" << tw << endl;
+   }
+}
+
+// the sender loss list before it was replaced by the bitmap: a linked list of sequence ranges in a static array
+class CArrayLossList
+{
+public:
+   CArrayLossList(int size);
+   ~CArrayLossList();
+
+   int insert(int32_t seqno1, int32_t seqno2);
+   void remove(int32_t seqno);
+   int getLossLength();
+   int32_t getLostSeq();
+
+private:
+   int32_t* m_piData1;
+   int32_t* m_piData2;
+   int* m_piNext;
+
+   int m_iHead;
+   int m_iLength;
+   int m_iSize;
+   int m_iLastInsertPos;
+
+   pthread_mutex_t m_ListLock;
+};
+
+CArrayLossList::CArrayLossList(int size):
+m_piData1(NULL),
+m_piData2(NULL),
+m_piNext(NULL),
+m_iHead(-1),
+m_iLength(0),
+m_iSize(size),
+m_iLastInsertPos(-1),
+m_ListLock()
+{
+   m_piData1 = new int32_t [m_iSize];
+   m_piData2 = new int32_t [m_iSize];
+   m_piNext = new int [m_iSize];
+
+   // -1 means there is no data in the node
+   for (int i = 0; i < size; ++ i)
+   {
+      m_piData1[i] = -1;
+      m_piData2[i] = -1;
+   }
+
+   // sender list needs mutex protection
+   #ifndef WIN32
+      pthread_mutex_init(&m_ListLock, 0);
+   #else
+      m_ListLock = CreateMutex(NULL, false, NULL);
+   #endif
+}
+
+CArrayLossList::~CArrayLossList()
+{
+   delete [] m_piData1;
+   delete [] m_piData2;
+   delete [] m_piNext;
+
+   #ifndef WIN32
+      pthread_mutex_destroy(&m_ListLock);
+   #else
+      CloseHandle(m_ListLock);
+   #endif
+}
+
+int CArrayLossList::insert(int32_t seqno1, int32_t seqno2)
+{
+   CGuard listguard(m_ListLock);
+
+   if (0 == m_iLength)
+   {
+      // insert data into an empty list
+
+      m_iHead = 0;
+      m_piData1[m_iHead] = seqno1;
+      if (seqno2 != seqno1)
+         m_piData2[m_iHead] = seqno2;
+
+      m_piNext[m_iHead] = -1;
+      m_iLastInsertPos = m_iHead;
+
+      m_iLength += CSeqNo::seqlen(seqno1, seqno2);
+
+      return m_iLength;
+   }
+
+   // otherwise find the position where the data can be inserted
+   int origlen = m_iLength;
+   int offset = CSeqNo::seqoff(m_piData1[m_iHead], seqno1);
+   int loc = (m_iHead + offset + m_iSize) % m_iSize;
+
+   if (offset < 0)
+   {
+      // Insert data prior to the head pointer
+
+      m_piData1[loc] = seqno1;
+      if (seqno2 != seqno1)
+         m_piData2[loc] = seqno2;
+
+      // new node becomes head
+      m_piNext[loc] = m_iHead;
+      m_iHead = loc;
+      m_iLastInsertPos = loc;
+
+      m_iLength += CSeqNo::seqlen(seqno1, seqno2);
+   }
+   else if (offset > 0)
+   {
+      if (seqno1 == m_piData1[loc])
+      {
+         m_iLastInsertPos = loc;
+
+         // first seqno is equivlent, compare the second
+         if (-1 == m_piData2[loc])
+         {
+            if (seqno2 != seqno1)
+            {
+               m_iLength += CSeqNo::seqlen(seqno1, seqno2) - 1;
+               m_piData2[loc] = seqno2;
+            }
+         }
+         else if (CSeqNo::seqcmp(seqno2, m_piData2[loc]) > 0)
+         {
+            // new seq pair is longer than old pair, e.g., insert [3, 7] to [3, 5], becomes [3, 7]
+            m_iLength += CSeqNo::seqlen(m_piData2[loc], seqno2) - 1;
+            m_piData2[loc] = seqno2;
+         }
+         else
+            // Do nothing if it is already there
+            return 0;
+      }
+      else
+      {
+         // searching the prior node
+         int i;
+         if ((-1 != m_iLastInsertPos) && (CSeqNo::seqcmp(m_piData1[m_iLastInsertPos], seqno1) < 0))
+            i = m_iLastInsertPos;
+         else
+            i = m_iHead;
+
+         while ((-1 != m_piNext[i]) && (CSeqNo::seqcmp(m_piData1[m_piNext[i]], seqno1) < 0))
+            i = m_piNext[i];
+
+         if ((-1 == m_piData2[i]) || (CSeqNo::seqcmp(m_piData2[i], seqno1) < 0))
+         {
+            m_iLastInsertPos = loc;
+
+            // no overlap, create new node
+            m_piData1[loc] = seqno1;
+            if (seqno2 != seqno1)
+               m_piData2[loc] = seqno2;
+
+            m_piNext[loc] = m_piNext[i];
+            m_piNext[i] = loc;
+
+            m_iLength += CSeqNo::seqlen(seqno1, seqno2);
+         }
+         else
+         {
+            m_iLastInsertPos = i;
+
+            // overlap, coalesce with prior node, insert(3, 7) to [2, 5], ... becomes [2, 7]
+            if (CSeqNo::seqcmp(m_piData2[i], seqno2) < 0)
+            {
+               m_iLength += CSeqNo::seqlen(m_piData2[i], seqno2) - 1;
+               m_piData2[i] = seqno2;
+
+               loc = i;
+            }
+            else
+               return 0;
+         }
+      }
+   }
+   else
+   {
+      m_iLastInsertPos = m_iHead;
+
+      // insert to head node
+      if (seqno2 != seqno1)
+      {
+         if (-1 == m_piData2[loc])
+         {
+            m_iLength += CSeqNo::seqlen(seqno1, seqno2) - 1;
+            m_piData2[loc] = seqno2;
+         }
+         else if (CSeqNo::seqcmp(seqno2, m_piData2[loc]) > 0)
+         {
+            m_iLength += CSeqNo::seqlen(m_piData2[loc], seqno2) - 1;
+            m_piData2[loc] = seqno2;
+         }
+         else 
+            return 0;
+      }
+      else
+         return 0;
+   }
+
+   // coalesce with next node. E.g., [3, 7], ..., [6, 9] becomes [3, 9] 
+   while ((-1 != m_piNext[loc]) && (-1 != m_piData2[loc]))
+   {
+      int i = m_piNext[loc];
+
+      if (CSeqNo::seqcmp(m_piData1[i], CSeqNo::incseq(m_piData2[loc])) <= 0)
+      {
+         // coalesce if there is overlap
+         if (-1 != m_piData2[i])
+         {
+            if (CSeqNo::seqcmp(m_piData2[i], m_piData2[loc]) > 0)
+            {
+               if (CSeqNo::seqcmp(m_piData2[loc], m_piData1[i]) >= 0)
+                  m_iLength -= CSeqNo::seqlen(m_piData1[i], m_piData2[loc]);
+
+               m_piData2[loc] = m_piData2[i];
+            }
+            else
+               m_iLength -= CSeqNo::seqlen(m_piData1[i], m_piData2[i]);
+         }
+         else
+         {
+            if (m_piData1[i] == CSeqNo::incseq(m_piData2[loc]))
+               m_piData2[loc] = m_piData1[i];
+            else
+               m_iLength --;
+         }
+
+         m_piData1[i] = -1;
+         m_piData2[i] = -1;
+         m_piNext[loc] = m_piNext[i];
+      }
+      else
+         break;
+   }
+
+   return m_iLength - origlen;
+}
+
+void CArrayLossList::remove(int32_t seqno)
+{
+   CGuard listguard(m_ListLock);
+
+   if (0 == m_iLength)
+      return;
+
+   // Remove all from the head pointer to a node with a larger seq. no. or the list is empty
+   int offset = CSeqNo::seqoff(m_piData1[m_iHead], seqno);
+   int loc = (m_iHead + offset + m_iSize) % m_iSize;
+
+   if (0 == offset)
+   {
+      // It is the head. Remove the head and point to the next node
+      loc = (loc + 1) % m_iSize;
+
+      if (-1 == m_piData2[m_iHead])
+         loc = m_piNext[m_iHead];
+      else
+      {
+         m_piData1[loc] = CSeqNo::incseq(seqno);
+         if (CSeqNo::seqcmp(m_piData2[m_iHead], CSeqNo::incseq(seqno)) > 0)
+            m_piData2[loc] = m_piData2[m_iHead];
+
+         m_piData2[m_iHead] = -1;
+
+         m_piNext[loc] = m_piNext[m_iHead];
+      }
+
+      m_piData1[m_iHead] = -1;
+
+      if (m_iLastInsertPos == m_iHead)
+         m_iLastInsertPos = -1;
+
+      m_iHead = loc;
+
+      m_iLength --;
+   }
+   else if (offset > 0)
+   {
+      int h = m_iHead;
+
+      if (seqno == m_piData1[loc])
+      {
+         // target node is not empty, remove part/all of the seqno in the node.
+         int temp = loc;
+         loc = (loc + 1) % m_iSize;
+
+         if (-1 == m_piData2[temp])
+            m_iHead = m_piNext[temp];
+         else
+         {
+            // remove part, e.g., [3, 7] becomes [], [4, 7] after remove(3)
+            m_piData1[loc] = CSeqNo::incseq(seqno);
+            if (CSeqNo::seqcmp(m_piData2[temp], m_piData1[loc]) > 0)
+               m_piData2[loc] = m_piData2[temp];
+            m_iHead = loc;
+            m_piNext[loc] = m_piNext[temp];
+            m_piNext[temp] = loc;
+            m_piData2[temp] = -1;
+         }
+      }
+      else
+      {
+         // target node is empty, check prior node
+         int i = m_iHead;
+         while ((-1 != m_piNext[i]) && (CSeqNo::seqcmp(m_piData1[m_piNext[i]], seqno) < 0))
+            i = m_piNext[i];
+
+         loc = (loc + 1) % m_iSize;
+
+         if (-1 == m_piData2[i])
+            m_iHead = m_piNext[i];
+         else if (CSeqNo::seqcmp(m_piData2[i], seqno) > 0)
+         {
+            // remove part/all seqno in the prior node
+            m_piData1[loc] = CSeqNo::incseq(seqno);
+            if (CSeqNo::seqcmp(m_piData2[i], m_piData1[loc]) > 0)
+               m_piData2[loc] = m_piData2[i];
+
+            m_piData2[i] = seqno;
+
+            m_piNext[loc] = m_piNext[i];
+            m_piNext[i] = loc;
+
+            m_iHead = loc;
+         }
+         else
+            m_iHead = m_piNext[i];
+      }
+
+      // Remove all nodes prior to the new head
+      while (h != m_iHead)
+      {
+         if (m_piData2[h] != -1)
+         {
+            m_iLength -= CSeqNo::seqlen(m_piData1[h], m_piData2[h]);
+            m_piData2[h] = -1;
+         }
+         else
+            m_iLength --;
+
+         m_piData1[h] = -1;
+
+         if (m_iLastInsertPos == h)
+            m_iLastInsertPos = -1;
+
+         h = m_piNext[h];
+      }
+   }
+}
+
+int CArrayLossList::getLossLength()
+{
+   CGuard listguard(m_ListLock);
+
+   return m_iLength;
+}
+
+int32_t CArrayLossList::getLostSeq()
+{
+   if (0 == m_iLength)
+     return -1;
+
+   CGuard listguard(m_ListLock);
+
+   if (0 == m_iLength)
+     return -1;
+
+   if (m_iLastInsertPos == m_iHead)
+      m_iLastInsertPos = -1;
+
+   // return the first loss seq. no.
+   int32_t seqno = m_piData1[m_iHead];
+
+   // head moves to the next node
+   if (-1 == m_piData2[m_iHead])
+   {
+      //[3, -1] becomes [], and head moves to next node in the list
+      m_piData1[m_iHead] = -1;
+      m_iHead = m_piNext[m_iHead];
+   }
+   else
+   {
+      // shift to next node, e.g., [3, 7] becomes [], [4, 7]
+      int loc = (m_iHead + 1) % m_iSize;
+
+      m_piData1[loc] = CSeqNo::incseq(seqno);
+      if (CSeqNo::seqcmp(m_piData2[m_iHead], m_piData1[loc]) > 0)
+         m_piData2[loc] = m_piData2[m_iHead];
+
+      m_piData1[m_iHead] = -1;
+      m_piData2[m_iHead] = -1;
+
+      m_piNext[loc] = m_piNext[m_iHead];
+      m_iHead = loc;
+   }
+
+   m_iLength --;
+
+   return seqno;
+}
+
+// a loss event replayed against a loss list: NAK ranges, retransmissions and ACKs as a sender sees them
+struct CLossOp
+{
+   enum {INSERT, POP, ACK} m_iType;
+   int32_t m_iSeq1;
+   int32_t m_iSeq2;
+};
+
+// a sender with a full window of "window" packets on a long link: each round, "window / 64" new packets are sent,
+// losses of the newly sent packets are reported by NAKs one round trip later, in "burst" long runs at a
+// "rate" per mille, the lost packets are retransmitted, and the acknowledged packets are removed; lost
+// retransmissions are reported again anywhere in the window
+void makeLossTrace(vector<CLossOp>& trace, int window, int rate, int burst, bool timeout)
+{
+   const int rounds = 2000;
+   const int step = window / 64;
+   int32_t sent = CSeqNo::m_iMaxSeqNo - window;   // start close to the wrap around
+   int32_t acked = sent;
+   vector< pair<int32_t, int32_t> > pending;
+
+   for (int r = 0; r < rounds; ++ r)
+   {
+      for (int i = 0; i < step; ++ i)
+      {
+         if (rand() % 1000 < rate)
+         {
+            int len = 1 + rand() % burst;
+            pending.push_back(make_pair(CSeqNo::incseq(sent, i), CSeqNo::incseq(sent, i + len - 1)));
+            i += len;
+         }
+      }
+      sent = CSeqNo::incseq(sent, step);
+
+      for (int i = 0; i < step; ++ i)
+      {
+         if (rand() % 1000 < rate)
+         {
+            int32_t seq = CSeqNo::incseq(acked, rand() % CSeqNo::seqlen(acked, sent));
+            pending.push_back(make_pair(seq, seq));
+         }
+      }
+
+      // NAKs arrive in the order the losses are detected, with some reordering
+      while (!pending.empty())
+      {
+         int k = rand() % (pending.size() < 4 ? pending.size() : 4);
+         // as the sender does, the acknowledged part of a NAK is ignored
+         CLossOp op = {CLossOp::INSERT, pending[k].first, pending[k].second};
+         if (CSeqNo::seqcmp(op.m_iSeq1, acked) < 0)
+            op.m_iSeq1 = acked;
+         if (CSeqNo::seqcmp(op.m_iSeq1, op.m_iSeq2) <= 0)
+            trace.push_back(op);
+         pending.erase(pending.begin() + k);
+      }
+
+      // a timeout puts the whole window back to the list
+      if (timeout && (0 == r % 100))
+      {
+         CLossOp op = {CLossOp::INSERT, acked, CSeqNo::decseq(sent)};
+         trace.push_back(op);
+      }
+
+      // retransmissions share the sending rate with the new packets
+      for (int i = 0; i < step / 4; ++ i)
+      {
+         CLossOp op = {CLossOp::POP, 0, 0};
+         trace.push_back(op);
+      }
+
+      // keep the window full
+      if (CSeqNo::seqlen(acked, sent) > window)
+      {
+         acked = CSeqNo::incseq(acked, step);
+         CLossOp op = {CLossOp::ACK, CSeqNo::decseq(acked), 0};
+         trace.push_back(op);
+      }
+   }
+}
+
+template <class T>
+double replayLossTrace(T& list, const vector<CLossOp>& trace, int64_t& check)
+{
+   uint64_t start = CTimer::getTime();
+   for (vector<CLossOp>::const_iterator i = trace.begin(); i != trace.end(); ++ i)
+   {
+      if (CLossOp::INSERT == i->m_iType)
+         check += list.insert(i->m_iSeq1, i->m_iSeq2);
+      else if (CLossOp::POP == i->m_iType)
+         check += list.getLostSeq();
+      else
+         list.remove(i->m_iSeq1);
+   }
+   return double(CTimer::getTime() - start) * 1000.0 / trace.size();
+}
+
+void benchLoss()
+{
+   const int windows[] = {25600, 1000000};
+
+   cout << "sender loss list, ns per operation" << endl;
+   cout << "window\tpattern\tarray\tbitmap" << endl;
+
+   for (unsigned int w = 0; w < sizeof(windows) / sizeof(int); ++ w)
+   {
+      for (int p = 0; p < 4; ++ p)
+      {
+         const char* name[] = {"random", "heavy", "burst", "timeout"};
+         const int rate[] = {10, 100, 1, 1};
+         const int burst[] = {1, 1, 64, 1};
+         vector<CLossOp> trace;
+         makeLossTrace(trace, windows[w], rate[p], burst[p], 3 == p);
+
+         // the same sizes as a connection of the window uses
+         CArrayLossList array(windows[w] * 2);
+         CSndLossList bitmap(windows[w] * 2);
+
+         int64_t ca = 0, cb = 0;
+         double ta = replayLossTrace(array, trace, ca);
+         double tb = replayLossTrace(bitmap, trace, cb);
+
+         cout << windows[w] << "\t" << name[p] << "\t" << ta << "\t" << tb;
+         if (ca != cb)
+            cout << "\tMISMATCH";
+         cout << endl;
+      }
+   }
+}
+
+#ifdef LINUX
+// resident memory of the process in KB, after the free heap memory is returned to the system
+long getResidentKB()
+{
+   malloc_trim(0);
+
+   long size = 0, resident = 0;
+   FILE* f = fopen("/proc/self/statm", "r");
+   if ((NULL == f) || (2 != fscanf(f, "%ld %ld", &size, &resident)))
+      resident = 0;
+   if (NULL != f)
+      fclose(f);
+
+   return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+struct CAcceptParam
+{
+   UDTSOCKET m_Listener;
+   vector<UDTSOCKET>* m_pSocket;
+   int m_iNum;
+};
+
+void* acceptConn(void* p)
+{
+   CAcceptParam* param = (CAcceptParam*)p;
+   for (int i = 0; i < param->m_iNum; ++ i)
+   {
+      UDTSOCKET s = UDT::accept(param->m_Listener, NULL, NULL);
+      if (UDT::INVALID_SOCK == s)
+         break;
+      param->m_pSocket->push_back(s);
+   }
+   return NULL;
+}
+
+void benchConn(int num)
+{
+   const int idletime = 1000;
+   const int datasize = 65536;
+
+   UDT::startup();
+
+   // all the connections share one UDP port on each side, both sides are in this process
+   sockaddr_in addr;
+   memset(&addr, 0, sizeof(sockaddr_in));
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   UDTSOCKET listener = UDT::socket(AF_INET, SOCK_STREAM, 0);
+   UDT::setsockopt(listener, 0, UDT_IDLETIME, &idletime, sizeof(int));
+   if ((UDT::ERROR == UDT::bind(listener, (sockaddr*)&addr, sizeof(sockaddr_in))) || (UDT::ERROR == UDT::listen(listener, num)))
+   {
+      cout << "listen: " << UDT::getlasterror().getErrorMessage() << endl;
+      return;
+   }
+   sockaddr_in server;
+   int len = sizeof(sockaddr_in);
+   UDT::getsockname(listener, (sockaddr*)&server, &len);
+
+   long base = getResidentKB();
+
+   vector<UDTSOCKET> accepted, client;
+   CAcceptParam param = {listener, &accepted, num};
+   pthread_t t;
+   pthread_create(&t, NULL, acceptConn, &param);
+
+   for (int i = 0; i < num; ++ i)
+   {
+      UDTSOCKET s = UDT::socket(AF_INET, SOCK_STREAM, 0);
+      UDT::setsockopt(s, 0, UDT_IDLETIME, &idletime, sizeof(int));
+      UDT::bind(s, (sockaddr*)&addr, sizeof(sockaddr_in));
+      if (0 == i)
+      {
+         len = sizeof(sockaddr_in);
+         UDT::getsockname(s, (sockaddr*)&addr, &len);
+      }
+
+      if (UDT::ERROR == UDT::connect(s, (sockaddr*)&server, sizeof(sockaddr_in)))
+      {
+         cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+         UDT::close(s);
+         break;
+      }
+      client.push_back(s);
+   }
+   pthread_join(t, NULL);
+
+   long connected = getResidentKB();
+
+   // move some data over each connection, then leave them idle
+   vector<char> data(datasize);
+   for (unsigned int i = 0; i < client.size(); ++ i)
+      UDT::send(client[i], &data[0], datasize, 0);
+   for (unsigned int i = 0; i < accepted.size(); ++ i)
+      for (int r = 0, n = 0; (r < datasize) && (n >= 0); r += n)
+         n = UDT::recv(accepted[i], &data[0], datasize - r, 0);
+
+   long active = getResidentKB();
+
+   sleep(idletime / 1000 + 2);
+
+   long idle = getResidentKB();
+
+   int conns = accepted.size();
+   if (conns > 0)
+   {
+      cout << "memory per connection (both ends), KB, " << conns << " connections" << endl;
+      cout << "connected\tafter data\tidle" << endl;
+      cout << (connected - base) / double(conns) << "\t" << (active - base) / double(conns) << "\t" << (idle - base) / double(conns) << endl;
+   }
+
+   for (unsigned int i = 0; i < client.size(); ++ i)
+      UDT::close(client[i]);
+   for (unsigned int i = 0; i < accepted.size(); ++ i)
+      UDT::close(accepted[i]);
+   UDT::close(listener);
+
+   UDT::cleanup();
+}
+#endif
+
+#ifndef WIN32
+struct CCallParam
+{
+   UDTSOCKET m_Socket;
+   int m_iCalls;
+   volatile bool* m_pbStart;
+};
+
+void* callAPI(void* p)
+{
+   CCallParam* param = (CCallParam*)p;
+   while (!*param->m_pbStart)
+      usleep(100);
+
+   int64_t size;
+   int len;
+   for (int i = 0; i < param->m_iCalls; ++ i)
+   {
+      len = sizeof(int64_t);
+      UDT::getsockopt(param->m_Socket, 0, UDT_SNDDATA, &size, &len);
+   }
+   return NULL;
+}
+
+void* churnSockets(void* p)
+{
+   volatile bool* stop = (volatile bool*)p;
+   while (!*stop)
+      UDT::close(UDT::socket(AF_INET, SOCK_STREAM, 0));
+   return NULL;
+}
+
+// rate of API calls that only look up their sockets, from many threads, while other sockets are created and closed
+void benchAPI()
+{
+   const int calls = 200000;
+   const int sockets = 10000;
+
+   UDT::startup();
+
+   vector<UDTSOCKET> other;
+   for (int i = 0; i < sockets; ++ i)
+      other.push_back(UDT::socket(AF_INET, SOCK_STREAM, 0));
+
+   cout << "socket lookups by API calls, with " << sockets << " sockets, million calls per second" << endl;
+   cout << "threads\tcalls/s" << endl;
+
+   for (int threads = 1; threads <= 64; threads *= 4)
+   {
+      volatile bool start = false;
+      volatile bool stop = false;
+      vector<pthread_t> t(threads);
+      vector<CCallParam> param(threads);
+      for (int i = 0; i < threads; ++ i)
+      {
+         param[i].m_Socket = other[i * (sockets / threads)];
+         param[i].m_iCalls = calls;
+         param[i].m_pbStart = &start;
+         pthread_create(&t[i], NULL, callAPI, &param[i]);
+      }
+      pthread_t churn;
+      pthread_create(&churn, NULL, churnSockets, (void*)&stop);
+
+      uint64_t begin = CTimer::getTime();
+      start = true;
+      for (int i = 0; i < threads; ++ i)
+         pthread_join(t[i], NULL);
+      uint64_t end = CTimer::getTime();
+
+      stop = true;
+      pthread_join(churn, NULL);
+
+      cout << threads << "\t" << double(calls) * threads / (end - begin) << endl;
+   }
+
+   for (int i = 0; i < sockets; ++ i)
+      UDT::close(other[i]);
+
+   UDT::cleanup();
+}
+#endif
+
+#ifdef LINUX
+struct CPingParam
+{
+   UDTSOCKET m_Socket;
+   int m_iRounds;
+   bool m_bFirst;
+};
+
+// bounce one byte back and forth, waiting for each one on an epoll
+void* pingPong(void* p)
+{
+   CPingParam* param = (CPingParam*)p;
+
+   int eid = UDT::epoll_create();
+   UDT::epoll_add_usock(eid, param->m_Socket, NULL);
+
+   char c = 0;
+   if (param->m_bFirst)
+      UDT::send(param->m_Socket, &c, 1, 0);
+
+   set<UDTSOCKET> readfds;
+   for (int i = 0; i < param->m_iRounds; ++ i)
+   {
+      if (UDT::epoll_wait(eid, &readfds, NULL, 1000) < 0)
+         break;
+      UDT::recv(param->m_Socket, &c, 1, 0);
+      if (!param->m_bFirst || (i < param->m_iRounds - 1))
+         UDT::send(param->m_Socket, &c, 1, 0);
+   }
+
+   UDT::epoll_release(eid);
+   return NULL;
+}
+
+// cost of epoll_wait with one ready socket among many idle ones being watched, and wakeup latency of epoll_wait
+void benchEPoll()
+{
+   const int calls = 100000;
+   const int rounds = 2000;
+
+   UDT::startup();
+
+   sockaddr_in addr;
+   memset(&addr, 0, sizeof(sockaddr_in));
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   UDTSOCKET listener = UDT::socket(AF_INET, SOCK_STREAM, 0);
+   UDT::bind(listener, (sockaddr*)&addr, sizeof(sockaddr_in));
+   UDT::listen(listener, 1);
+   sockaddr_in server;
+   int len = sizeof(sockaddr_in);
+   UDT::getsockname(listener, (sockaddr*)&server, &len);
+
+   UDTSOCKET client = UDT::socket(AF_INET, SOCK_STREAM, 0);
+   if (UDT::ERROR == UDT::connect(client, (sockaddr*)&server, sizeof(sockaddr_in)))
+   {
+      cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+      return;
+   }
+   UDTSOCKET peer = UDT::accept(listener, NULL, NULL);
+
+   cout << "epoll_wait with one ready socket, thousand calls per second" << endl;
+   cout << "watched	calls/s" << endl;
+
+   char c = 0;
+   UDT::send(client, &c, 1, 0);
+
+   for (int watched = 1; watched <= 10000; watched *= 10)
+   {
+      int eid = UDT::epoll_create();
+      vector<UDTSOCKET> idle;
+      for (int i = 1; i < watched; ++ i)
+      {
+         idle.push_back(UDT::socket(AF_INET, SOCK_STREAM, 0));
+         UDT::epoll_add_usock(eid, idle.back(), NULL);
+      }
+      UDT::epoll_add_usock(eid, peer, NULL);
+
+      set<UDTSOCKET> readfds;
+      uint64_t begin = CTimer::getTime();
+      for (int i = 0; i < calls; ++ i)
+         UDT::epoll_wait(eid, &readfds, NULL, 1000);
+      uint64_t end = CTimer::getTime();
+
+      cout << watched << "\t" << double(calls) * 1000 / (end - begin) << endl;
+
+      UDT::epoll_release(eid);
+      for (unsigned int i = 0; i < idle.size(); ++ i)
+         UDT::close(idle[i]);
+   }
+
+   UDT::recv(peer, &c, 1, 0);
+
+   CPingParam first = {client, rounds, true};
+   CPingParam second = {peer, rounds, false};
+   pthread_t t1, t2;
+   uint64_t begin = CTimer::getTime();
+   pthread_create(&t1, NULL, pingPong, &first);
+   pthread_create(&t2, NULL, pingPong, &second);
+   pthread_join(t1, NULL);
+   pthread_join(t2, NULL);
+   uint64_t end = CTimer::getTime();
+
+   cout << "round trip through epoll_wait, us" << endl;
+   cout << double(end - begin) / rounds << endl;
+
+   UDT::close(client);
+   UDT::close(peer);
+   UDT::close(listener);
+
+   UDT::cleanup();
+}
+
+// drain the connection with blocking receives
+void* drain(void* p)
+{
+   CPingParam* param = (CPingParam*)p;
+
+   char* buf = new char[65536];
+   int64_t left = int64_t(param->m_iRounds) * 65536;
+   while (left > 0)
+   {
+      int r = UDT::recv(param->m_Socket, buf, 65536, 0);
+      if (r <= 0)
+         break;
+      left -= r;
+   }
+   delete [] buf;
+
+   return NULL;
+}
+
+// throughput of a stream sent by non-blocking send driven by epoll_wait, and by requests posted to a completion queue
+void benchAIO()
+{
+   const int chunks = 1024;
+   const int size = 65536;
+   const int window = 64;
+
+   UDT::startup();
+
+   sockaddr_in addr;
+   memset(&addr, 0, sizeof(sockaddr_in));
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   UDTSOCKET listener = UDT::socket(AF_INET, SOCK_STREAM, 0);
+   UDT::bind(listener, (sockaddr*)&addr, sizeof(sockaddr_in));
+   UDT::listen(listener, 2);
+   sockaddr_in server;
+   int len = sizeof(sockaddr_in);
+   UDT::getsockname(listener, (sockaddr*)&server, &len);
+
+   char* data = new char[size * window];
+   memset(data, 0, size * window);
+
+   cout << "64MB stream over loopback" << endl;
+   cout << "method	MB/s	send errors" << endl;
+
+   for (int method = 0; method < 2; ++ method)
+   {
+      UDTSOCKET client = UDT::socket(AF_INET, SOCK_STREAM, 0);
+      if (UDT::ERROR == UDT::connect(client, (sockaddr*)&server, sizeof(sockaddr_in)))
+      {
+         cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+         break;
+      }
+      UDTSOCKET peer = UDT::accept(listener, NULL, NULL);
+
+      CPingParam param = {peer, chunks, false};
+      pthread_t t;
+      pthread_create(&t, NULL, drain, &param);
+
+      int errors = 0;
+      uint64_t begin = CTimer::getTime();
+
+      if (0 == method)
+      {
+         bool block = false;
+         UDT::setsockopt(client, 0, UDT_SNDSYN, &block, sizeof(bool));
+         int eid = UDT::epoll_create();
+         int events = UDT_EPOLL_OUT;
+         UDT::epoll_add_usock(eid, client, &events);
+         set<UDTSOCKET> writefds;
+
+         // a non-blocking send may take only part of the chunk
+         for (int64_t sent = 0; sent < int64_t(chunks) * size; )
+         {
+            int offset = int(sent % size);
+            int r = UDT::send(client, data + (sent / size % window) * size + offset, size - offset, 0);
+            if (UDT::ERROR == r)
+            {
+               ++ errors;
+               UDT::epoll_wait(eid, NULL, &writefds, 1000);
+            }
+            else
+               sent += r;
+         }
+
+         UDT::epoll_release(eid);
+      }
+      else
+      {
+         int qid = UDT::aio_create(window);
+         UDT::AIORESULT res[window];
+         int posted = 0;
+         int done = 0;
+
+         while (done < chunks)
+         {
+            for (; (posted < chunks) && (posted - done < window); ++ posted)
+               UDT::aio_send(qid, client, data + (posted % window) * size, size, NULL);
+            int n = UDT::aio_wait(qid, res, window, 1000);
+            for (int i = 0; i < n; ++ i)
+               if (res[i].result < 0)
+                  ++ errors;
+            done += (n > 0) ? n : 0;
+         }
+
+         UDT::aio_release(qid);
+      }
+
+      pthread_join(t, NULL);
+      uint64_t end = CTimer::getTime();
+
+      cout << ((0 == method) ? "epoll" : "aio") << "\t" << double(chunks) * size / (end - begin) << "\t" << errors << endl;
+
+      UDT::close(client);
+      UDT::close(peer);
+   }
+
+   delete [] data;
+   UDT::close(listener);
+
+   UDT::cleanup();
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+   srand(1);
+
+   string name = (argc > 1) ? argv[1] : "all";
+
+   if (("all" == name) || ("hash" == name))
+      benchHash();
+   if (("all" == name) || ("sched" == name))
+      benchSched();
+   if (("all" == name) || ("loss" == name))
+      benchLoss();
+#ifndef WIN32
+   if (("all" == name) || ("api" == name))
+      benchAPI();
+#endif
+#ifdef LINUX
+   if (("all" == name) || ("conn" == name))
+      benchConn((argc > 2) ? atoi(argv[2]) : 1000);
+   if (("all" == name) || ("epoll" == name))
+      benchEPoll();
+   if (("all" == name) || ("aio" == name))
+      benchAIO();
+#endif
+
+   return 0;
+}
@@ -0,0 +1,269 @@
+#ifndef WIN32
+   #include <arpa/inet.h>
+   #include <fcntl.h>
+   #include <unistd.h>
+#else
+   #include <winsock2.h>
+   #include <ws2tcpip.h>
+#endif
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "udt.h"
+#include "coro.h"
+
+using namespace std;
+
+// Test of the coroutine interface: connect, accept, send, recv and sendfile from several sources, all through a
+// CReactor resuming the coroutines on a CQueueExecutor run by the main thread.
+
+const int g_Server_Port = 9100;
+const int g_Rounds = 1000;                   // request/response round trips
+const int g_FileSize = 3000000;              // size of each sendfile
+const int g_ShortSize = 1000000;             // size of the source that ends before the sendfile
+const char g_SrcFile[] = "corotest.dat";
+
+// Source lending its memory with a release function, counting the blocks lent and given back.
+class CLendingSource: public CMemSource
+{
+public:
+   CLendingSource(const char* data, int64_t size): CMemSource(data, size), m_iLent(0), m_iReleased(0) {}
+
+   virtual const char* lend(int64_t offset, int len, UDTSENDCB& release, void*& arg)
+   {
+      const char* data = CMemSource::lend(offset, len, release, arg);
+      if (NULL != data)
+      {
+         ++ m_iLent;
+         release = released;
+         arg = this;
+      }
+      return data;
+   }
+
+   static void released(UDTSOCKET, const char*, int, bool, void* arg)
+   {
+      ++ ((CLendingSource*)arg)->m_iReleased;
+   }
+
+   atomic<int> m_iLent;
+   atomic<int> m_iReleased;
+};
+
+UDT::CQueueExecutor g_Executor;
+UDT::CReactor* g_Reactor = NULL;
+char g_Data[g_FileSize];
+CLendingSource g_Lending(g_Data, g_FileSize);
+int g_iErrors = 0;
+int g_iRunning = 2;
+
+void finish()
+{
+   if (0 == -- g_iRunning)
+      g_Executor.stop();
+}
+
+UDT::CTask<int> recvAll(UDTSOCKET u, char* buf, int len)
+{
+   for (int pos = 0; pos < len; )
+   {
+      int r = co_await g_Reactor->recv(u, buf + pos, len - pos);
+      if (UDT::ERROR == r)
+         co_return UDT::ERROR;
+      pos += r;
+   }
+   co_return len;
+}
+
+UDT::CTask<void> server(UDTSOCKET serv)
+{
+   UDTSOCKET s = co_await g_Reactor->accept(serv, NULL, NULL);
+   if (UDT::INVALID_SOCK == s)
+   {
+      cout << "accept: " << UDT::getlasterror().getErrorMessage() << endl;
+      ++ g_iErrors;
+      finish();
+      co_return;
+   }
+
+   for (int i = 0; i < g_Rounds; ++ i)
+   {
+      int n;
+      if ((co_await recvAll(s, (char*)&n, sizeof(int)) < 0) || (n != i) || (co_await g_Reactor->send(s, (char*)&n, sizeof(int)) != sizeof(int)))
+      {
+         cout << "ROUND TRIP ERROR " << i << endl;
+         ++ g_iErrors;
+         break;
+      }
+   }
+
+   // four full sendfiles, then the short source
+   vector<char> buf(g_FileSize);
+   const int size[5] = {g_FileSize, g_FileSize, g_FileSize, g_FileSize, g_ShortSize};
+   for (int i = 0; i < 5; ++ i)
+   {
+      if ((co_await recvAll(s, &buf[0], size[i]) < 0) || (0 != memcmp(&buf[0], g_Data, size[i])))
+      {
+         cout << "DATA ERROR " << i << endl;
+         ++ g_iErrors;
+         break;
+      }
+   }
+
+   // tell the client everything has arrived, then wait for it to close
+   char c = 'c';
+   co_await g_Reactor->send(s, &c, 1);
+   if ((UDT::ERROR != co_await g_Reactor->recv(s, &c, 1)) || (CUDTException::ECONNLOST != UDT::getlasterror_code()))
+   {
+      cout << "PEER CLOSE ERROR" << endl;
+      ++ g_iErrors;
+   }
+
+   g_Reactor->close(s);
+   finish();
+}
+
+UDT::CTask<void> client()
+{
+   UDTSOCKET s = UDT::socket(AF_INET, SOCK_STREAM, 0);
+
+   // smaller than a sendfile block, so that the blocks are queued in pieces as the buffer drains
+   int snd_buf = 100000;
+   UDT::setsockopt(s, 0, UDT_SNDBUF, &snd_buf, sizeof(int));
+
+   sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(g_Server_Port);
+   addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+   if (UDT::ERROR == co_await g_Reactor->connect(s, (sockaddr*)&addr, sizeof(addr)))
+   {
+      cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+      ++ g_iErrors;
+      finish();
+      co_return;
+   }
+
+   for (int i = 0; i < g_Rounds; ++ i)
+   {
+      int n = i;
+      if ((co_await g_Reactor->send(s, (char*)&n, sizeof(int)) != sizeof(int)) || (co_await recvAll(s, (char*)&n, sizeof(int)) < 0) || (n != i))
+      {
+         cout << "ROUND TRIP ERROR " << i << endl;
+         ++ g_iErrors;
+         break;
+      }
+   }
+
+   // a stream read into a buffer, a mapped file and memory lent until acknowledged, memory copied, and a source too short
+   fstream ifs(g_SrcFile, ios::in | ios::binary);
+   int64_t offset = 0;
+   if ((co_await g_Reactor->sendfile(s, ifs, offset, g_FileSize) != g_FileSize) || (offset != g_FileSize))
+   {
+      cout << "SENDFILE ERROR stream" << endl;
+      ++ g_iErrors;
+   }
+
+#ifndef WIN32
+   int fd = ::open(g_SrcFile, O_RDONLY);
+   CFileSource file(fd, true);
+#else
+   CMemSource file(g_Data, g_FileSize);
+#endif
+   offset = 0;
+   if ((co_await g_Reactor->sendfile(s, file, offset, g_FileSize) != g_FileSize) || (offset != g_FileSize))
+   {
+      cout << "SENDFILE ERROR file" << endl;
+      ++ g_iErrors;
+   }
+
+   offset = 0;
+   if ((co_await g_Reactor->sendfile(s, g_Lending, offset, g_FileSize) != g_FileSize) || (offset != g_FileSize))
+   {
+      cout << "SENDFILE ERROR lent memory" << endl;
+      ++ g_iErrors;
+   }
+
+   CMemSource mem(g_Data, g_FileSize);
+   offset = 0;
+   if ((co_await g_Reactor->sendfile(s, mem, offset, g_FileSize) != g_FileSize) || (offset != g_FileSize))
+   {
+      cout << "SENDFILE ERROR memory" << endl;
+      ++ g_iErrors;
+   }
+
+   CMemSource part(g_Data, g_ShortSize);
+   offset = 0;
+   if ((co_await g_Reactor->sendfile(s, part, offset, g_FileSize) != g_ShortSize) || (offset != g_ShortSize))
+   {
+      cout << "SENDFILE ERROR short source" << endl;
+      ++ g_iErrors;
+   }
+
+   char c;
+   co_await g_Reactor->recv(s, &c, 1);
+   g_Reactor->close(s);
+
+#ifndef WIN32
+   ::close(fd);
+#endif
+
+   finish();
+}
+
+int main()
+{
+   for (int i = 0; i < g_FileSize; ++ i)
+      g_Data[i] = char(i * 7 + i / 251);
+
+   ofstream ofs(g_SrcFile, ios::out | ios::binary | ios::trunc);
+   ofs.write(g_Data, g_FileSize);
+   ofs.close();
+
+   UDT::startup();
+
+   UDTSOCKET serv = UDT::socket(AF_INET, SOCK_STREAM, 0);
+
+   sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(g_Server_Port);
+   addr.sin_addr.s_addr = INADDR_ANY;
+
+   if ((UDT::ERROR == UDT::bind(serv, (sockaddr*)&addr, sizeof(addr))) || (UDT::ERROR == UDT::listen(serv, 10)))
+   {
+      cout << "bind: " << UDT::getlasterror().getErrorMessage() << endl;
+      return 1;
+   }
+
+   g_Reactor = new UDT::CReactor(g_Executor);
+   g_Reactor->spawn(server(serv));
+   g_Reactor->spawn(client());
+
+   // resume the coroutines in this thread until both are done
+   g_Executor.run();
+
+   g_Reactor->close(serv);
+   delete g_Reactor;
+
+   UDT::cleanup();
+   remove(g_SrcFile);
+
+   // each block lent is given back once, at the latest when the socket is released
+   if ((0 == g_Lending.m_iLent) || (g_Lending.m_iLent != g_Lending.m_iReleased))
+   {
+      cout << "LEND ERROR " << g_Lending.m_iLent << " " << g_Lending.m_iReleased << endl;
+      ++ g_iErrors;
+   }
+
+   if (0 != g_iErrors)
+      return 1;
+
+   cout << "Coroutine test completed." << endl;
+   return 0;
+}
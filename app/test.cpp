@@ -2,6 +2,7 @@
    #include <cstdlib>
    #include <cstring>
    #include <netdb.h>
+   #include <poll.h>
    #include <signal.h>
    #include <unistd.h>
 #else
@@ -10,6 +11,9 @@
    #include <wspiapi.h>
 #endif
 #include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
 #include <iostream>
 
 #include "udt.h"
@@ -23,14 +27,14 @@ const char g_Localhost[] = "127.0.0.1";
 const int g_Server_Port = 9000;
 
 
-int createUDTSocket(UDTSOCKET& usock, int port = 0, bool rendezvous = false)
+int createUDTSocket(UDTSOCKET& usock, int port = 0, bool rendezvous = false, int workers = 1, int type = g_Socket_Type)
 {
    addrinfo hints;
    addrinfo* res;
    memset(&hints, 0, sizeof(struct addrinfo));
    hints.ai_flags = AI_PASSIVE;
    hints.ai_family = g_IP_Version;
-   hints.ai_socktype = g_Socket_Type;
+   hints.ai_socktype = type;
 
    char service[16];
    sprintf(service, "%d", port);
@@ -57,6 +61,7 @@ int createUDTSocket(UDTSOCKET& usock, int port = 0, bool rendezvous = false)
    bool reuse = true;
    UDT::setsockopt(usock, 0, UDT_REUSEADDR, &reuse, sizeof(bool));
    UDT::setsockopt(usock, 0, UDT_RENDEZVOUS, &rendezvous, sizeof(bool));
+   UDT::setsockopt(usock, 0, UDT_WORKERS, &workers, sizeof(int));
 
    if (UDT::ERROR == UDT::bind(usock, res->ai_addr, res->ai_addrlen))
    {
@@ -690,9 +695,1099 @@ DWORD WINAPI Test_4_Cli(LPVOID)
 }
 
 
+// Test UDT connections sharing ports served by multiple worker threads.
+
+const int g_UDTNum5 = 64;
+const int g_Workers5 = 4;
+const int g_TotalNum5 = 1000;
+
+#ifndef WIN32
+void* Test_5_Srv(void* param)
+#else
+DWORD WINAPI Test_5_Srv(LPVOID param)
+#endif
+{
+   cout << "Test UDT with multiple workers per port.\n";
+
+   UDTSOCKET serv;
+   if (createUDTSocket(serv, g_Server_Port, false, g_Workers5) < 0)
+      return NULL;
+
+   UDT::listen(serv, 1024);
+
+   vector<UDTSOCKET> new_socks;
+   new_socks.resize(g_UDTNum5);
+
+   for (int i = 0; i < g_UDTNum5; ++ i)
+   {
+      sockaddr_storage clientaddr;
+      int addrlen = sizeof(clientaddr);
+      new_socks[i] = UDT::accept(serv, (sockaddr*)&clientaddr, &addrlen);
+
+      if (new_socks[i] == UDT::INVALID_SOCK)
+      {
+         cout << "accept: " << UDT::getlasterror().getErrorMessage() << endl;
+         return NULL;
+      }
+   }
+
+   for (vector<UDTSOCKET>::iterator i = new_socks.begin(); i != new_socks.end(); ++ i)
+   {
+      int32_t buffer[g_TotalNum5];
+
+      int torecv = g_TotalNum5 * 4;
+      while (torecv > 0)
+      {
+         int rcvd = UDT::recv(*i, (char*)buffer + g_TotalNum5 * 4 - torecv, torecv, 0);
+         if (rcvd < 0)
+         {
+            cout << "recv: " << UDT::getlasterror().getErrorMessage() << endl;
+            return NULL;
+         }
+         torecv -= rcvd;
+      }
+
+      for (int j = 0; j < g_TotalNum5; ++ j)
+      {
+         if (buffer[j] != j)
+         {
+            cout << "DATA ERROR " << j << " " << buffer[j] << endl;
+            break;
+         }
+      }
+   }
+
+   for (vector<UDTSOCKET>::iterator i = new_socks.begin(); i != new_socks.end(); ++ i)
+   {
+      UDT::close(*i);
+   }
+
+   UDT::close(serv);
+
+   return NULL;
+}
+
+#ifndef WIN32
+void* Test_5_Cli(void* param)
+#else
+DWORD WINAPI Test_5_Cli(LPVOID param)
+#endif
+{
+   vector<UDTSOCKET> cli_socks;
+   cli_socks.resize(g_UDTNum5);
+
+   if (createUDTSocket(cli_socks[0], 0, false, g_Workers5) < 0)
+   {
+      cout << "socket: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   sockaddr_storage addr;
+   int size = sizeof(sockaddr_in);
+   UDT::getsockname(cli_socks[0], (sockaddr*)&addr, &size);
+   char sharedport[NI_MAXSERV];
+   getnameinfo((sockaddr*)&addr, size, NULL, 0, sharedport, sizeof(sharedport), NI_NUMERICSERV);
+
+   for (int i = 1; i < g_UDTNum5; ++ i)
+   {
+      if (createUDTSocket(cli_socks[i], atoi(sharedport), false, g_Workers5) < 0)
+      {
+         cout << "socket: " << UDT::getlasterror().getErrorMessage() << endl;
+         return NULL;
+      }
+   }
+
+   for (vector<UDTSOCKET>::iterator i = cli_socks.begin(); i != cli_socks.end(); ++ i)
+   {
+      if (connect(*i, g_Server_Port) < 0)
+      {
+         cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+         return NULL;
+      }
+   }
+
+   int32_t buffer[g_TotalNum5];
+   for (int i = 0; i < g_TotalNum5; ++ i)
+      buffer[i] = i;
+
+   for (vector<UDTSOCKET>::iterator i = cli_socks.begin(); i != cli_socks.end(); ++ i)
+   {
+      int tosend = g_TotalNum5 * 4;
+      while (tosend > 0)
+      {
+         int sent = UDT::send(*i, (char*)buffer + g_TotalNum5 * 4 - tosend, tosend, 0);
+         if (sent < 0)
+         {
+            cout << "send: " << UDT::getlasterror().getErrorMessage() << endl;
+            return NULL;
+         }
+         tosend -= sent;
+      }
+   }
+
+   for (vector<UDTSOCKET>::iterator i = cli_socks.begin(); i != cli_socks.end(); ++ i)
+   {
+      UDT::close(*i);
+   }
+
+   return NULL;
+}
+
+
+// Test zero-copy sending with user buffers lent to UDT, and zero-copy receiving with borrowed buffers.
+
+const int g_TotalNum6 = 1000000;
+volatile int64_t g_Acked6 = 0;
+volatile int g_Lost6 = 0;
+
+void sendbufDone(UDTSOCKET, const char*, int len, bool acked, void*)
+{
+   // called by the UDT worker thread, while the sending thread is only polling the counters
+   if (acked)
+      g_Acked6 += len;
+   else
+      ++ g_Lost6;
+}
+
+#ifndef WIN32
+void* Test_6_Srv(void* param)
+#else
+DWORD WINAPI Test_6_Srv(LPVOID param)
+#endif
+{
+   cout << "Test zero-copy sending and receiving.\n";
+
+   UDTSOCKET serv;
+   if (createUDTSocket(serv, g_Server_Port) < 0)
+      return NULL;
+
+   UDT::listen(serv, 1024);
+
+   sockaddr_storage clientaddr;
+   int addrlen = sizeof(clientaddr);
+   UDTSOCKET new_sock = UDT::accept(serv, (sockaddr*)&clientaddr, &addrlen);
+   UDT::close(serv);
+
+   if (new_sock == UDT::INVALID_SOCK)
+   {
+      cout << "accept: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   int32_t* buffer = new int32_t[g_TotalNum6];
+
+   // the received data is read in place from the borrowed vectors, and then released back to UDT
+   int torecv = g_TotalNum6 * 4;
+   while (torecv > 0)
+   {
+      iovec vec[16];
+      int n = UDT::recvbuf(new_sock, vec, 16);
+      if (n < 0)
+      {
+         cout << "recvbuf: " << UDT::getlasterror().getErrorMessage() << endl;
+         break;
+      }
+
+      int rcvd = 0;
+      for (int i = 0; (i < n) && (rcvd < torecv); ++ i)
+      {
+         int size = (int)vec[i].iov_len;
+         if (size > torecv - rcvd)
+            size = torecv - rcvd;
+         memcpy((char*)buffer + g_TotalNum6 * 4 - torecv + rcvd, vec[i].iov_base, size);
+         rcvd += size;
+      }
+
+      if (UDT::recvrelease(new_sock, rcvd) != rcvd)
+      {
+         cout << "recvrelease: " << UDT::getlasterror().getErrorMessage() << endl;
+         break;
+      }
+      torecv -= rcvd;
+   }
+
+   for (int i = 0; (torecv == 0) && (i < g_TotalNum6); ++ i)
+   {
+      if (buffer[i] != i)
+      {
+         cout << "DATA ERROR " << i << " " << buffer[i] << endl;
+         break;
+      }
+   }
+
+   delete [] buffer;
+
+   // the sender checks that all its buffers are acknowledged, wait until it closes the connection
+   char c;
+   UDT::recv(new_sock, &c, 1, 0);
+
+   UDT::close(new_sock);
+
+   return NULL;
+}
+
+#ifndef WIN32
+void* Test_6_Cli(void* param)
+#else
+DWORD WINAPI Test_6_Cli(LPVOID param)
+#endif
+{
+   UDTSOCKET client;
+   if (createUDTSocket(client, 0) < 0)
+      return NULL;
+
+   if (connect(client, g_Server_Port) < 0)
+   {
+      cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   int32_t* buffer = new int32_t[g_TotalNum6];
+   for (int i = 0; i < g_TotalNum6; ++ i)
+      buffer[i] = i;
+
+   // the buffer is lent to UDT piece by piece, it must stay untouched until all pieces are acknowledged
+   int tosend = g_TotalNum6 * 4;
+   while (tosend > 0)
+   {
+      int sent = UDT::sendbuf(client, (char*)buffer + g_TotalNum6 * 4 - tosend, tosend, sendbufDone, NULL);
+      if (sent < 0)
+      {
+         cout << "sendbuf: " << UDT::getlasterror().getErrorMessage() << endl;
+         break;
+      }
+      tosend -= sent;
+   }
+
+   for (int i = 0; (i < 1000) && (g_Acked6 < g_TotalNum6 * 4); ++ i)
+   {
+      #ifndef WIN32
+         usleep(10000);
+      #else
+         Sleep(10);
+      #endif
+   }
+
+   if ((g_Acked6 != g_TotalNum6 * 4) || (g_Lost6 != 0))
+      cout << "SENDBUF ERROR " << g_Acked6 << " bytes acknowledged, " << g_Lost6 << " buffers returned unacknowledged" << endl;
+
+   UDT::close(client);
+
+   delete [] buffer;
+
+   return NULL;
+}
+
+
+// Test sendfile2() and recvfile2(), with the sender asking for more data than the file holds.
+
+const int g_FileSize7 = 3000000;
+const char g_SrcFile7[] = "udt_test7.src";
+const char g_DstFile7[] = "udt_test7.dst";
+
+#ifndef WIN32
+void* Test_7_Srv(void* param)
+#else
+DWORD WINAPI Test_7_Srv(LPVOID param)
+#endif
+{
+   cout << "Test file transfer by path.\n";
+
+   UDTSOCKET serv;
+   if (createUDTSocket(serv, g_Server_Port) < 0)
+      return NULL;
+
+   UDT::listen(serv, 1024);
+
+   sockaddr_storage clientaddr;
+   int addrlen = sizeof(clientaddr);
+   UDTSOCKET new_sock = UDT::accept(serv, (sockaddr*)&clientaddr, &addrlen);
+   UDT::close(serv);
+
+   if (new_sock == UDT::INVALID_SOCK)
+   {
+      cout << "accept: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   int64_t offset = 0;
+   int64_t recvd = UDT::recvfile2(new_sock, g_DstFile7, &offset, g_FileSize7);
+   if ((recvd != g_FileSize7) || (offset != g_FileSize7))
+      cout << "RECVFILE2 ERROR " << recvd << " " << offset << " " << UDT::getlasterror().getErrorMessage() << endl;
+
+   ifstream ifs(g_DstFile7, ios::in | ios::binary);
+   char* buffer = new char[g_FileSize7];
+   ifs.read(buffer, g_FileSize7);
+   if (ifs.gcount() != g_FileSize7)
+      cout << "FILE SIZE ERROR " << ifs.gcount() << endl;
+   for (int i = 0; i < ifs.gcount(); ++ i)
+   {
+      if (buffer[i] != char(i % 251))
+      {
+         cout << "DATA ERROR " << i << endl;
+         break;
+      }
+   }
+   ifs.close();
+   delete [] buffer;
+
+   remove(g_DstFile7);
+
+   UDT::close(new_sock);
+
+   return NULL;
+}
+
+#ifndef WIN32
+void* Test_7_Cli(void* param)
+#else
+DWORD WINAPI Test_7_Cli(LPVOID param)
+#endif
+{
+   ofstream ofs(g_SrcFile7, ios::out | ios::binary | ios::trunc);
+   for (int i = 0; i < g_FileSize7; ++ i)
+      ofs.put(char(i % 251));
+   ofs.close();
+
+   UDTSOCKET client;
+   if (createUDTSocket(client, 0) < 0)
+      return NULL;
+
+   if (connect(client, g_Server_Port) < 0)
+   {
+      cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   // the file is shorter than requested: sendfile2 stops at its end and reports what was sent
+   int64_t offset = 0;
+   int64_t sent = UDT::sendfile2(client, g_SrcFile7, &offset, g_FileSize7 + 100000);
+   if ((sent != g_FileSize7) || (offset != g_FileSize7))
+      cout << "SENDFILE2 ERROR " << sent << " " << offset << " " << UDT::getlasterror().getErrorMessage() << endl;
+
+   UDT::close(client);
+
+   remove(g_SrcFile7);
+
+   return NULL;
+}
+
+
+// Test recvfile2() with the asynchronous disk writer, on a file size that is not a multiple of the direct I/O block.
+
+const int g_FileSize8 = 3000000 + 1234;
+const int g_DiskBuf8 = 256000;
+const char g_SrcFile8[] = "udt_test8.src";
+const char g_DstFile8[] = "udt_test8.dst";
+
+#ifndef WIN32
+void* Test_8_Srv(void* param)
+#else
+DWORD WINAPI Test_8_Srv(LPVOID param)
+#endif
+{
+   cout << "Test asynchronous disk writes.\n";
+
+   UDTSOCKET serv;
+   if (createUDTSocket(serv, g_Server_Port) < 0)
+      return NULL;
+
+   // inherited by the accepted socket
+   UDT::setsockopt(serv, 0, UDT_DISKBUF, &g_DiskBuf8, sizeof(int));
+
+   UDT::listen(serv, 1024);
+
+   sockaddr_storage clientaddr;
+   int addrlen = sizeof(clientaddr);
+   UDTSOCKET new_sock = UDT::accept(serv, (sockaddr*)&clientaddr, &addrlen);
+   UDT::close(serv);
+
+   if (new_sock == UDT::INVALID_SOCK)
+   {
+      cout << "accept: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   int64_t offset = 0;
+   int64_t recvd = UDT::recvfile2(new_sock, g_DstFile8, &offset, g_FileSize8);
+   if ((recvd != g_FileSize8) || (offset != g_FileSize8))
+      cout << "RECVFILE2 ERROR " << recvd << " " << offset << " " << UDT::getlasterror().getErrorMessage() << endl;
+
+   // the file must be complete when recvfile2 returns, including the unaligned tail
+   ifstream ifs(g_DstFile8, ios::in | ios::binary);
+   char* buffer = new char[g_FileSize8 + 1];
+   ifs.read(buffer, g_FileSize8 + 1);
+   if (ifs.gcount() != g_FileSize8)
+      cout << "FILE SIZE ERROR " << ifs.gcount() << endl;
+   for (int i = 0; i < ifs.gcount(); ++ i)
+   {
+      if (buffer[i] != char(i % 251))
+      {
+         cout << "DATA ERROR " << i << endl;
+         break;
+      }
+   }
+   ifs.close();
+   delete [] buffer;
+
+   remove(g_DstFile8);
+
+   UDT::close(new_sock);
+
+   return NULL;
+}
+
+#ifndef WIN32
+void* Test_8_Cli(void* param)
+#else
+DWORD WINAPI Test_8_Cli(LPVOID param)
+#endif
+{
+   ofstream ofs(g_SrcFile8, ios::out | ios::binary | ios::trunc);
+   for (int i = 0; i < g_FileSize8; ++ i)
+      ofs.put(char(i % 251));
+   ofs.close();
+
+   UDTSOCKET client;
+   if (createUDTSocket(client, 0) < 0)
+      return NULL;
+
+   if (connect(client, g_Server_Port) < 0)
+   {
+      cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   int64_t offset = 0;
+   int64_t sent = UDT::sendfile2(client, g_SrcFile8, &offset, g_FileSize8);
+   if (sent != g_FileSize8)
+      cout << "SENDFILE2 ERROR " << sent << " " << UDT::getlasterror().getErrorMessage() << endl;
+
+   UDT::close(client);
+
+   remove(g_SrcFile8);
+
+   return NULL;
+}
+
+
+// Test sendfile() and recvfile() with memory sources and sinks, with the sender asking for more data than the source holds.
+
+const int g_DataSize9 = 1000000 + 13;
+
+#ifndef WIN32
+void* Test_9_Srv(void* param)
+#else
+DWORD WINAPI Test_9_Srv(LPVOID param)
+#endif
+{
+   cout << "Test memory sources and sinks.\n";
+
+   UDTSOCKET serv;
+   if (createUDTSocket(serv, g_Server_Port) < 0)
+      return NULL;
+
+   UDT::listen(serv, 1024);
+
+   sockaddr_storage clientaddr;
+   int addrlen = sizeof(clientaddr);
+   UDTSOCKET new_sock = UDT::accept(serv, (sockaddr*)&clientaddr, &addrlen);
+   UDT::close(serv);
+
+   if (new_sock == UDT::INVALID_SOCK)
+   {
+      cout << "accept: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   char* buffer = new char[g_DataSize9];
+   CMemSink sink(buffer, g_DataSize9);
+
+   int64_t offset = 0;
+   int64_t recvd = UDT::recvfile(new_sock, sink, offset, g_DataSize9);
+   if ((recvd != g_DataSize9) || (offset != g_DataSize9))
+      cout << "RECVFILE ERROR " << recvd << " " << offset << " " << UDT::getlasterror().getErrorMessage() << endl;
+
+   for (int i = 0; (recvd == g_DataSize9) && (i < g_DataSize9); ++ i)
+   {
+      if (buffer[i] != char(i % 251))
+      {
+         cout << "DATA ERROR " << i << endl;
+         break;
+      }
+   }
+
+   delete [] buffer;
+
+   // sendfile waits for the lent memory to be acknowledged, wait until the sender closes the connection
+   char c;
+   UDT::recv(new_sock, &c, 1, 0);
+
+   UDT::close(new_sock);
+
+   return NULL;
+}
+
+#ifndef WIN32
+void* Test_9_Cli(void* param)
+#else
+DWORD WINAPI Test_9_Cli(LPVOID param)
+#endif
+{
+   UDTSOCKET client;
+   if (createUDTSocket(client, 0) < 0)
+      return NULL;
+
+   if (connect(client, g_Server_Port) < 0)
+   {
+      cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   char* buffer = new char[g_DataSize9];
+   for (int i = 0; i < g_DataSize9; ++ i)
+      buffer[i] = char(i % 251);
+
+   // the full blocks are lent to UDT without copying, the short last block is read from the source
+   CMemSource src(buffer, g_DataSize9);
+   int64_t offset = 0;
+   int64_t sent = UDT::sendfile(client, src, offset, g_DataSize9 + 100000, 100000);
+   if ((sent != g_DataSize9) || (offset != g_DataSize9))
+      cout << "SENDFILE ERROR " << sent << " " << offset << " " << UDT::getlasterror().getErrorMessage() << endl;
+
+   UDT::close(client);
+
+   delete [] buffer;
+
+   return NULL;
+}
+
+
+// Test the edge-triggered and one-shot epoll modes, and releasing an epoll while a call is waiting on it.
+
+int g_EID10 = -1;
+
+// send a message each time the peer asks for one, return the first other request, or 0 if the connection is closed
+char sendOnRequest(UDTSOCKET u)
+{
+   char cmd;
+   while (UDT::recv(u, &cmd, 1, 0) > 0)
+   {
+      if ('n' != cmd)
+         return cmd;
+      if (UDT::send(u, "data", 4, 0) < 0)
+         break;
+   }
+   return 0;
+}
+
+bool isReported(int eid, UDTSOCKET u, int64_t timeout)
+{
+   set<UDTSOCKET> readfds;
+   return (UDT::epoll_wait(eid, &readfds, NULL, timeout) > 0) && (readfds.count(u) > 0);
+}
+
+#ifndef WIN32
+void* Test_10_Srv(void* param)
+#else
+DWORD WINAPI Test_10_Srv(LPVOID param)
+#endif
+{
+   cout << "Test epoll modes.\n";
+
+   UDTSOCKET serv;
+   if (createUDTSocket(serv, g_Server_Port) < 0)
+      return NULL;
+
+   UDT::listen(serv, 1024);
+
+   sockaddr_storage clientaddr;
+   int addrlen = sizeof(clientaddr);
+   UDTSOCKET new_sock = UDT::accept(serv, (sockaddr*)&clientaddr, &addrlen);
+   UDT::close(serv);
+
+   if (new_sock == UDT::INVALID_SOCK)
+   {
+      cout << "accept: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   int eid = UDT::epoll_create();
+   g_EID10 = eid;
+
+   // edge-triggered: the socket is reported once for each new message, although none of them is read
+   int events = UDT_EPOLL_IN | UDT_EPOLL_ET;
+   UDT::epoll_add_usock(eid, new_sock, &events);
+   if (isReported(eid, new_sock, 100))
+      cout << "EPOLL ET ERROR: reported without data" << endl;
+   for (int i = 0; i < 2; ++ i)
+   {
+      UDT::send(new_sock, "n", 1, 0);
+      if (!isReported(eid, new_sock, 1000))
+         cout << "EPOLL ET ERROR: new data not reported" << endl;
+      if (isReported(eid, new_sock, 100))
+         cout << "EPOLL ET ERROR: the same data reported again" << endl;
+   }
+
+   // one-shot: the socket is reported once, then again only after it is added again
+   events = UDT_EPOLL_IN | UDT_EPOLL_ONESHOT;
+   UDT::epoll_add_usock(eid, new_sock, &events);
+   if (!isReported(eid, new_sock, 1000))
+      cout << "EPOLL ONESHOT ERROR: pending data not reported" << endl;
+   if (isReported(eid, new_sock, 100))
+      cout << "EPOLL ONESHOT ERROR: reported again before re-arming" << endl;
+   UDT::epoll_add_usock(eid, new_sock, &events);
+   if (!isReported(eid, new_sock, 1000))
+      cout << "EPOLL ONESHOT ERROR: not reported after re-arming" << endl;
+
+   // the socket stays disarmed in the epoll, the client waits on it until the epoll is released
+   UDT::send(new_sock, "w", 1, 0);
+   #ifndef WIN32
+      usleep(200000);
+   #else
+      Sleep(200);
+   #endif
+   UDT::epoll_release(eid);
+
+   char c;
+   UDT::recv(new_sock, &c, 1, 0);
+
+   UDT::close(new_sock);
+
+   return NULL;
+}
+
+#ifndef WIN32
+void* Test_10_Cli(void* param)
+#else
+DWORD WINAPI Test_10_Cli(LPVOID param)
+#endif
+{
+   UDTSOCKET client;
+   if (createUDTSocket(client, 0) < 0)
+      return NULL;
+
+   if (connect(client, g_Server_Port) < 0)
+   {
+      cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   if ('w' == sendOnRequest(client))
+   {
+      // a waiting call must return as soon as the epoll is released, not at its time-out
+      time_t start = time(NULL);
+      set<UDTSOCKET> readfds;
+      int res = UDT::epoll_wait(g_EID10, &readfds, NULL, 10000);
+      if ((res >= 0) || (UDT::getlasterror().getErrorCode() != CUDTException::EINVPOLLID) || (time(NULL) - start > 5))
+         cout << "EPOLL RELEASE ERROR " << res << " " << UDT::getlasterror().getErrorMessage() << endl;
+   }
+   else
+      cout << "EPOLL ERROR: connection closed early" << endl;
+
+   UDT::close(client);
+
+   return NULL;
+}
+
+
+// Test the descriptor of an epoll, readable while the epoll has ready sockets (Linux only).
+
+#ifdef LINUX
+bool isReadable(int fd)
+{
+   pollfd p;
+   p.fd = fd;
+   p.events = POLLIN;
+   p.revents = 0;
+   return ::poll(&p, 1, 200) > 0;
+}
+#endif
+
+#ifndef WIN32
+void* Test_11_Srv(void* param)
+#else
+DWORD WINAPI Test_11_Srv(LPVOID param)
+#endif
+{
+   cout << "Test epoll descriptor.\n";
+
+   UDTSOCKET serv;
+   if (createUDTSocket(serv, g_Server_Port) < 0)
+      return NULL;
+
+   UDT::listen(serv, 1024);
+
+   sockaddr_storage clientaddr;
+   int addrlen = sizeof(clientaddr);
+   UDTSOCKET new_sock = UDT::accept(serv, (sockaddr*)&clientaddr, &addrlen);
+   UDT::close(serv);
+
+   if (new_sock == UDT::INVALID_SOCK)
+   {
+      cout << "accept: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+#ifdef LINUX
+   int eid = UDT::epoll_create();
+   int events = UDT_EPOLL_IN;
+   UDT::epoll_add_usock(eid, new_sock, &events);
+
+   int fd = UDT::epoll_getfd(eid);
+   if (fd < 0)
+      cout << "epoll_getfd: " << UDT::getlasterror().getErrorMessage() << endl;
+   else
+   {
+      if (isReadable(fd))
+         cout << "EPOLL FD ERROR: readable without ready socket" << endl;
+
+      // the first ready socket signals the descriptor
+      UDT::send(new_sock, "n", 1, 0);
+      if (!isReadable(fd))
+         cout << "EPOLL FD ERROR: not readable with a ready socket" << endl;
+
+      UDTSOCKET readfds[4];
+      int rnum = 4;
+      if ((UDT::epoll_wait2(eid, readfds, &rnum, NULL, NULL, 0) != 1) || (rnum != 1) || (readfds[0] != new_sock))
+         cout << "EPOLL FD ERROR: ready socket not returned" << endl;
+
+      // once the data is read, the ready list is empty and the descriptor is drained
+      char buffer[4];
+      UDT::recv(new_sock, buffer, 4, 0);
+      if (isReadable(fd))
+         cout << "EPOLL FD ERROR: still readable after the ready list is empty" << endl;
+   }
+
+   UDT::epoll_release(eid);
+#endif
+
+   UDT::send(new_sock, "q", 1, 0);
+
+   char c;
+   UDT::recv(new_sock, &c, 1, 0);
+
+   UDT::close(new_sock);
+
+   return NULL;
+}
+
+#ifndef WIN32
+void* Test_11_Cli(void* param)
+#else
+DWORD WINAPI Test_11_Cli(LPVOID param)
+#endif
+{
+   UDTSOCKET client;
+   if (createUDTSocket(client, 0) < 0)
+      return NULL;
+
+   if (connect(client, g_Server_Port) < 0)
+   {
+      cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   sendOnRequest(client);
+
+   UDT::close(client);
+
+   return NULL;
+}
+
+
+// Test asynchronous stream operations: a send completed once for all its data, receives posted before the data arrives,
+// a full completion queue, and operations failed by a closed or broken connection.
+
+const int g_DataSize12 = 1000000;
+const int g_Depth12 = 4;
+
+#ifndef WIN32
+void* Test_12_Srv(void* param)
+#else
+DWORD WINAPI Test_12_Srv(LPVOID param)
+#endif
+{
+   cout << "Test asynchronous stream operations.\n";
+
+   UDTSOCKET serv;
+   if (createUDTSocket(serv, g_Server_Port) < 0)
+      return NULL;
+
+   UDT::listen(serv, 1024);
+
+   sockaddr_storage clientaddr;
+   int addrlen = sizeof(clientaddr);
+   UDTSOCKET new_sock = UDT::accept(serv, (sockaddr*)&clientaddr, &addrlen);
+   UDT::close(serv);
+
+   if (new_sock == UDT::INVALID_SOCK)
+   {
+      cout << "accept: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   int qid = UDT::aio_create();
+   char* buffer = new char[g_DataSize12];
+
+   // a stream receive may complete with part of the data, so one is outstanding at a time, and the first one is
+   // posted before the client starts sending
+   int recvd = 0;
+   UDT::aio_recv(qid, new_sock, buffer, g_DataSize12, NULL);
+   UDT::send(new_sock, "g", 1, 0);
+
+   while (recvd < g_DataSize12)
+   {
+      UDT::AIORESULT res;
+      if ((UDT::aio_wait(qid, &res, 1, 5000) != 1) || (res.op != UDT_AIO_RECV) || (res.socket != new_sock) || (res.result <= 0))
+      {
+         cout << "AIO RECV ERROR after " << recvd << " bytes" << endl;
+         break;
+      }
+
+      recvd += res.result;
+      if (recvd < g_DataSize12)
+         UDT::aio_recv(qid, new_sock, buffer + recvd, g_DataSize12 - recvd, NULL);
+   }
+
+   for (int i = 0; (recvd == g_DataSize12) && (i < g_DataSize12); ++ i)
+   {
+      if (buffer[i] != char(i % 251))
+      {
+         cout << "DATA ERROR " << i << endl;
+         break;
+      }
+   }
+
+   // a receive still outstanding when the peer closes the connection fails with ECONNLOST
+   char c;
+   UDT::aio_recv(qid, new_sock, &c, 1, NULL);
+   UDT::send(new_sock, "c", 1, 0);
+   UDT::AIORESULT res;
+   if ((UDT::aio_wait(qid, &res, 1, 10000) != 1) || (res.result != -CUDTException::ECONNLOST))
+      cout << "AIO ERROR: outstanding receive not failed by the peer closing" << endl;
+
+   UDT::aio_release(qid);
+   delete [] buffer;
+
+   UDT::close(new_sock);
+
+   return NULL;
+}
+
+#ifndef WIN32
+void* Test_12_Cli(void* param)
+#else
+DWORD WINAPI Test_12_Cli(LPVOID param)
+#endif
+{
+   UDTSOCKET client;
+   if (createUDTSocket(client, 0) < 0)
+      return NULL;
+
+   if (connect(client, g_Server_Port) < 0)
+   {
+      cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   char* buffer = new char[g_DataSize12];
+   for (int i = 0; i < g_DataSize12; ++ i)
+      buffer[i] = char(i % 251);
+
+   int qid = UDT::aio_create(g_Depth12);
+
+   char c;
+   UDT::recv(client, &c, 1, 0);
+
+   // the data is much larger than the sending buffer and lent in many pieces, but the send completes once
+   UDT::AIORESULT res[g_Depth12];
+   if (UDT::aio_send(qid, client, buffer, g_DataSize12, buffer) < 0)
+      cout << "aio_send: " << UDT::getlasterror().getErrorMessage() << endl;
+   else if ((UDT::aio_wait(qid, res, g_Depth12, 10000) != 1) || (res[0].op != UDT_AIO_SEND) || (res[0].result != g_DataSize12) || (res[0].arg != buffer))
+      cout << "AIO SEND ERROR " << res[0].result << endl;
+   else if (UDT::aio_wait(qid, res, g_Depth12, 100) != 0)
+      cout << "AIO SEND ERROR: completed more than once" << endl;
+
+   // the queue holds no more operations than its depth
+   UDT::recv(client, &c, 1, 0);
+   for (int i = 0; i < g_Depth12; ++ i)
+   {
+      if (UDT::aio_recv(qid, client, &c, 1, NULL) < 0)
+         cout << "aio_recv: " << UDT::getlasterror().getErrorMessage() << endl;
+   }
+   if ((UDT::aio_recv(qid, client, &c, 1, NULL) >= 0) || (UDT::getlasterror().getErrorCode() != CUDTException::EAIOFULL))
+      cout << "AIO ERROR: full queue accepted an operation" << endl;
+
+   // closing the socket fails its outstanding operations with ECONNLOST
+   UDT::close(client);
+
+   int n = 0;
+   while (n < g_Depth12)
+   {
+      int r = UDT::aio_wait(qid, res + n, g_Depth12 - n, 1000);
+      if (r <= 0)
+         break;
+      n += r;
+   }
+   if (n != g_Depth12)
+      cout << "AIO ERROR: " << n << " of " << g_Depth12 << " outstanding receives failed by closing" << endl;
+   for (int i = 0; i < n; ++ i)
+   {
+      if (res[i].result != -CUDTException::ECONNLOST)
+         cout << "AIO ERROR: closing completed a receive with " << res[i].result << endl;
+   }
+
+   UDT::aio_release(qid);
+   delete [] buffer;
+
+   return NULL;
+}
+
+
+// Test asynchronous message operations, completed in order, and a queue released with operations in flight.
+
+const int g_MsgNum13 = 3;
+const int g_MsgSize13[g_MsgNum13] = {1000, 10000, 7};
+
+#ifndef WIN32
+void* Test_13_Srv(void* param)
+#else
+DWORD WINAPI Test_13_Srv(LPVOID param)
+#endif
+{
+   cout << "Test asynchronous message operations.\n";
+
+   UDTSOCKET serv;
+   if (createUDTSocket(serv, g_Server_Port, false, 1, SOCK_DGRAM) < 0)
+      return NULL;
+
+   UDT::listen(serv, 1024);
+
+   sockaddr_storage clientaddr;
+   int addrlen = sizeof(clientaddr);
+   UDTSOCKET new_sock = UDT::accept(serv, (sockaddr*)&clientaddr, &addrlen);
+   UDT::close(serv);
+
+   if (new_sock == UDT::INVALID_SOCK)
+   {
+      cout << "accept: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   int qid = UDT::aio_create();
+
+   // all the receives are posted before the client starts sending, each one takes a whole message
+   char* buffer[g_MsgNum13];
+   for (int i = 0; i < g_MsgNum13; ++ i)
+   {
+      buffer[i] = new char[g_MsgSize13[i]];
+      UDT::aio_recvmsg(qid, new_sock, buffer[i], g_MsgSize13[i], buffer[i]);
+   }
+   UDT::sendmsg(new_sock, "g", 1);
+
+   for (int i = 0; i < g_MsgNum13; ++ i)
+   {
+      UDT::AIORESULT res;
+      if ((UDT::aio_wait(qid, &res, 1, 5000) != 1) || (res.op != UDT_AIO_RECVMSG) || (res.arg != buffer[i]) || (res.result != g_MsgSize13[i]))
+      {
+         cout << "AIO RECVMSG ERROR " << i << endl;
+         break;
+      }
+
+      for (int j = 0; j < g_MsgSize13[i]; ++ j)
+      {
+         if (buffer[i][j] != char(i + j))
+         {
+            cout << "DATA ERROR " << i << " " << j << endl;
+            break;
+         }
+      }
+   }
+
+   // the outstanding receive is discarded with the queue, its buffer stays valid until the socket is closed
+   char c;
+   UDT::aio_recvmsg(qid, new_sock, &c, 1, NULL);
+   UDT::aio_release(qid);
+   if ((UDT::aio_recvmsg(qid, new_sock, &c, 1, NULL) >= 0) || (UDT::getlasterror().getErrorCode() != CUDTException::EINVAIOID))
+      cout << "AIO ERROR: released queue accepted an operation" << endl;
+
+   // wait until the client closes the connection
+   UDT::sendmsg(new_sock, "c", 1);
+   UDT::recvmsg(new_sock, &c, 1);
+
+   UDT::close(new_sock);
+
+   for (int i = 0; i < g_MsgNum13; ++ i)
+      delete [] buffer[i];
+
+   return NULL;
+}
+
+#ifndef WIN32
+void* Test_13_Cli(void* param)
+#else
+DWORD WINAPI Test_13_Cli(LPVOID param)
+#endif
+{
+   UDTSOCKET client;
+   if (createUDTSocket(client, 0, false, 1, SOCK_DGRAM) < 0)
+      return NULL;
+
+   if (connect(client, g_Server_Port) < 0)
+   {
+      cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+      return NULL;
+   }
+
+   char* buffer[g_MsgNum13];
+   for (int i = 0; i < g_MsgNum13; ++ i)
+   {
+      buffer[i] = new char[g_MsgSize13[i]];
+      for (int j = 0; j < g_MsgSize13[i]; ++ j)
+         buffer[i][j] = char(i + j);
+   }
+
+   int qid = UDT::aio_create();
+
+   char c;
+   UDT::recvmsg(client, &c, 1);
+
+   // in order, otherwise a lost packet of a large message lets the next one be delivered first
+   for (int i = 0; i < g_MsgNum13; ++ i)
+   {
+      if (UDT::aio_sendmsg(qid, client, buffer[i], g_MsgSize13[i], buffer[i], -1, true) < 0)
+         cout << "aio_sendmsg: " << UDT::getlasterror().getErrorMessage() << endl;
+   }
+
+   // the messages of a socket are completed in the order they are posted
+   for (int i = 0; i < g_MsgNum13; ++ i)
+   {
+      UDT::AIORESULT res;
+      if ((UDT::aio_wait(qid, &res, 1, 5000) != 1) || (res.op != UDT_AIO_SENDMSG) || (res.arg != buffer[i]) || (res.result != g_MsgSize13[i]))
+      {
+         cout << "AIO SENDMSG ERROR " << i << endl;
+         break;
+      }
+   }
+
+   // release the queue with a receive in flight, then close the socket that still holds it
+   UDT::recvmsg(client, &c, 1);
+   UDT::aio_recvmsg(qid, client, &c, 1, NULL);
+   UDT::aio_release(qid);
+
+   UDT::close(client);
+
+   for (int i = 0; i < g_MsgNum13; ++ i)
+      delete [] buffer[i];
+
+   return NULL;
+}
+
+
 int main()
 {
-   const int test_case = 4;
+   const int test_case = 13;
 
 #ifndef WIN32
    void* (*Test_Srv[test_case])(void*);
@@ -710,6 +1805,24 @@ int main()
    Test_Cli[2] = Test_3_Cli;
    Test_Srv[3] = Test_4_Srv;
    Test_Cli[3] = Test_4_Cli;
+   Test_Srv[4] = Test_5_Srv;
+   Test_Cli[4] = Test_5_Cli;
+   Test_Srv[5] = Test_6_Srv;
+   Test_Cli[5] = Test_6_Cli;
+   Test_Srv[6] = Test_7_Srv;
+   Test_Cli[6] = Test_7_Cli;
+   Test_Srv[7] = Test_8_Srv;
+   Test_Cli[7] = Test_8_Cli;
+   Test_Srv[8] = Test_9_Srv;
+   Test_Cli[8] = Test_9_Cli;
+   Test_Srv[9] = Test_10_Srv;
+   Test_Cli[9] = Test_10_Cli;
+   Test_Srv[10] = Test_11_Srv;
+   Test_Cli[10] = Test_11_Cli;
+   Test_Srv[11] = Test_12_Srv;
+   Test_Cli[11] = Test_12_Cli;
+   Test_Srv[12] = Test_13_Srv;
+   Test_Cli[12] = Test_13_Cli;
 
    for (int i = 0; i < test_case; ++ i)
    {
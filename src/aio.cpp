@@ -0,0 +1,312 @@
+/*****************************************************************************
+Copyright (c) 2001 - 2011, The Board of Trustees of the University of Illinois.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the
+  above copyright notice, this list of conditions
+  and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the University of Illinois
+  nor the names of its contributors may be used to
+  endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef WIN32
+   #include <sys/time.h>
+#endif
+#include "common.h"
+#include "aio.h"
+
+using namespace std;
+
+CAsyncQueue::CAsyncQueue(int id, int depth):
+m_iID(id),
+m_iDepth(depth),
+m_pRing(NULL),
+m_iHead(0),
+m_iCount(0),
+m_iPending(0),
+m_iRefCount(1),
+m_bReleased(false)
+{
+   m_pRing = new CAIOResult[m_iDepth];
+   CGuard::createMutex(m_Lock);
+   CGuard::createCond(m_Cond);
+}
+
+CAsyncQueue::~CAsyncQueue()
+{
+   delete [] m_pRing;
+   CGuard::releaseMutex(m_Lock);
+   CGuard::releaseCond(m_Cond);
+}
+
+void CAsyncQueue::complete(CAsyncOp* op, int result)
+{
+   CGuard::enterCS(m_Lock);
+
+   -- m_iPending;
+
+   // the place in the ring has been reserved when the operation was posted
+   if (!m_bReleased)
+   {
+      CAIOResult& r = m_pRing[(m_iHead + m_iCount) % m_iDepth];
+      r.socket = op->m_Socket;
+      r.op = op->m_iType;
+      r.result = result;
+      r.arg = op->m_pArg;
+      ++ m_iCount;
+
+      #ifndef WIN32
+         pthread_cond_signal(&m_Cond);
+      #else
+         SetEvent(m_Cond);
+      #endif
+   }
+
+   delete op;
+
+   unlock();
+}
+
+void CAsyncQueue::account(CAsyncOp* op, int len, int error)
+{
+   CGuard::enterCS(m_Lock);
+   op->m_iDone += len;
+   if ((0 != error) && (0 == op->m_iError))
+      op->m_iError = error;
+   bool done = (op->m_iDone == op->m_iLength);
+   CGuard::leaveCS(m_Lock);
+
+   if (done)
+      complete(op, (0 == op->m_iError) ? op->m_iLength : -op->m_iError);
+}
+
+void CAsyncQueue::sendDone(UDTSOCKET, const char*, int len, bool acked, void* arg)
+{
+   CAsyncOp* op = (CAsyncOp*)arg;
+   op->m_pQueue->account(op, len, acked ? 0 : CUDTException::ECONNLOST);
+}
+
+void CAsyncQueue::unlock()
+{
+   // the queue is deleted after it is released, when no call uses it and no operation is in progress
+   bool last = m_bReleased && (0 == m_iRefCount) && (0 == m_iPending);
+   CGuard::leaveCS(m_Lock);
+
+   if (last)
+      delete this;
+}
+
+CAsyncIO::CAsyncIO():
+m_iIDSeed(0),
+m_mQueues()
+{
+   CGuard::createMutex(m_Lock);
+}
+
+CAsyncIO::~CAsyncIO()
+{
+   for (map<int, CAsyncQueue*>::iterator i = m_mQueues.begin(); i != m_mQueues.end(); ++ i)
+   {
+      CGuard::enterCS(i->second->m_Lock);
+      i->second->m_bReleased = true;
+      -- i->second->m_iRefCount;
+      i->second->unlock();
+   }
+
+   CGuard::releaseMutex(m_Lock);
+}
+
+int CAsyncIO::create(int depth)
+{
+   if (depth <= 0)
+      throw CUDTException(5, 3, 0);
+
+   CGuard ag(m_Lock);
+
+   if (++ m_iIDSeed >= 0x7FFFFFFF)
+      m_iIDSeed = 0;
+
+   m_mQueues[m_iIDSeed] = new CAsyncQueue(m_iIDSeed, depth);
+
+   return m_iIDSeed;
+}
+
+CAsyncOp* CAsyncIO::post(int qid, int type, UDTSOCKET u, char* data, int len, void* arg)
+{
+   CAsyncQueue* q = acquire(qid);
+
+   // the completions of all the operations in progress must fit in the ring
+   if (q->m_iPending + q->m_iCount >= q->m_iDepth)
+   {
+      -- q->m_iRefCount;
+      q->unlock();
+      throw CUDTException(6, 4, 0);
+   }
+   ++ q->m_iPending;
+
+   // the operation holds the queue until it is completed
+   -- q->m_iRefCount;
+   CGuard::leaveCS(q->m_Lock);
+
+   CAsyncOp* op = new CAsyncOp;
+   op->m_iType = type;
+   op->m_Socket = u;
+   op->m_pQueue = q;
+   op->m_pcData = data;
+   op->m_iLength = len;
+   op->m_iOffset = 0;
+   op->m_iDone = 0;
+   op->m_iError = 0;
+   op->m_iTTL = -1;
+   op->m_bInOrder = false;
+   op->m_pArg = arg;
+
+   return op;
+}
+
+void CAsyncIO::cancel(CAsyncOp* op)
+{
+   CAsyncQueue* q = op->m_pQueue;
+   delete op;
+
+   CGuard::enterCS(q->m_Lock);
+   -- q->m_iPending;
+   q->unlock();
+}
+
+int CAsyncIO::wait(int qid, CAIOResult* results, int num, int64_t msTimeOut)
+{
+   if ((NULL == results) || (num <= 0))
+      throw CUDTException(5, 3, 0);
+
+   CAsyncQueue* q = acquire(qid);
+
+   uint64_t entertime = CTimer::getTime();
+   while ((0 == q->m_iCount) && !q->m_bReleased && (0 != msTimeOut))
+   {
+      int64_t interval = -1;
+      if (msTimeOut > 0)
+      {
+         int64_t elapsed = CTimer::getTime() - entertime;
+         if (elapsed >= msTimeOut * 1000LL)
+            break;
+         interval = msTimeOut * 1000LL - elapsed;
+      }
+
+      #ifndef WIN32
+         if (interval < 0)
+            pthread_cond_wait(&q->m_Cond, &q->m_Lock);
+         else
+         {
+            timeval now;
+            timespec timeout;
+            gettimeofday(&now, 0);
+            uint64_t expire = now.tv_sec * 1000000ULL + now.tv_usec + interval;
+            timeout.tv_sec = expire / 1000000;
+            timeout.tv_nsec = (expire % 1000000) * 1000;
+
+            pthread_cond_timedwait(&q->m_Cond, &q->m_Lock, &timeout);
+         }
+      #else
+         CGuard::leaveCS(q->m_Lock);
+         WaitForSingleObject(q->m_Cond, (interval < 0) ? INFINITE : DWORD((interval + 999) / 1000));
+         CGuard::enterCS(q->m_Lock);
+      #endif
+   }
+
+   if (q->m_bReleased)
+   {
+      -- q->m_iRefCount;
+      q->unlock();
+      throw CUDTException(5, 14, 0);
+   }
+
+   int n = 0;
+   for (; (n < num) && (q->m_iCount > 0); ++ n)
+   {
+      results[n] = q->m_pRing[q->m_iHead];
+      q->m_iHead = (q->m_iHead + 1) % q->m_iDepth;
+      -- q->m_iCount;
+   }
+
+   // there may be more completions for another waiting call
+   #ifndef WIN32
+      if (q->m_iCount > 0)
+         pthread_cond_signal(&q->m_Cond);
+   #else
+      if (q->m_iCount > 0)
+         SetEvent(q->m_Cond);
+   #endif
+
+   -- q->m_iRefCount;
+   q->unlock();
+
+   return n;
+}
+
+int CAsyncIO::release(int qid)
+{
+   CAsyncQueue* q;
+
+   {
+      CGuard ag(m_Lock);
+
+      map<int, CAsyncQueue*>::iterator i = m_mQueues.find(qid);
+      if (i == m_mQueues.end())
+         throw CUDTException(5, 14, 0);
+
+      q = i->second;
+      m_mQueues.erase(i);
+   }
+
+   CGuard::enterCS(q->m_Lock);
+   q->m_bReleased = true;
+   -- q->m_iRefCount;
+   #ifndef WIN32
+      pthread_cond_broadcast(&q->m_Cond);
+   #else
+      SetEvent(q->m_Cond);
+   #endif
+   q->unlock();
+
+   return 0;
+}
+
+CAsyncQueue* CAsyncIO::acquire(int qid)
+{
+   CGuard ag(m_Lock);
+
+   map<int, CAsyncQueue*>::iterator i = m_mQueues.find(qid);
+   if (i == m_mQueues.end())
+      throw CUDTException(5, 14, 0);
+
+   // the queue is returned locked, with a reference
+   CGuard::enterCS(i->second->m_Lock);
+   ++ i->second->m_iRefCount;
+
+   return i->second;
+}
@@ -0,0 +1,200 @@
+/*****************************************************************************
+Copyright (c) 2001 - 2011, The Board of Trustees of the University of Illinois.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the
+  above copyright notice, this list of conditions
+  and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the University of Illinois
+  nor the names of its contributors may be used to
+  endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef __UDT_AIO_H__
+#define __UDT_AIO_H__
+
+
+#include <map>
+#include "udt.h"
+#include "common.h"
+
+
+class CAsyncQueue;
+
+// An asynchronous operation posted to a UDT socket, until its completion is queued.
+struct CAsyncOp
+{
+   int m_iType;                         // type of the operation, see AIOOpt
+   UDTSOCKET m_Socket;                  // UDT socket of the operation
+   CAsyncQueue* m_pQueue;               // completion queue
+
+   char* m_pcData;                      // user buffer
+   int m_iLength;                       // size of the user buffer
+   int m_iOffset;                       // size of the data handed to the sending buffer
+   int m_iDone;                         // size of the data acknowledged, or dropped
+   int m_iError;                        // error code if any data has been dropped, otherwise 0
+
+   int m_iTTL;                          // time-to-live of a message
+   bool m_bInOrder;                     // if a message must be delivered in order
+   void* m_pArg;                        // user argument returned with the completion
+};
+
+// Completion queue: a ring of completed operations, and the count of operations still in progress.
+class CAsyncQueue
+{
+friend class CAsyncIO;
+
+public:
+
+      // Functionality:
+      //    Queue the completion of an operation, which is deleted.
+      // Parameters:
+      //    0) [in] op: the operation.
+      //    1) [in] result: size of the data sent or received, or the negative error code.
+      // Returned value:
+      //    None.
+
+   void complete(CAsyncOp* op, int result);
+
+      // Functionality:
+      //    Account for data of a send operation that has been acknowledged or dropped,
+      //    and complete the operation when all its data is accounted for.
+      // Parameters:
+      //    0) [in] op: the send operation.
+      //    1) [in] len: size of the data.
+      //    2) [in] error: 0 if the data has been acknowledged, otherwise the error code.
+      // Returned value:
+      //    None.
+
+   void account(CAsyncOp* op, int len, int error);
+
+      // Functionality:
+      //    Callback of the buffers lent to the sending buffer by send operations.
+      // Parameters:
+      //    See UDTSENDCB, arg is the operation.
+      // Returned value:
+      //    None.
+
+   static void sendDone(UDTSOCKET u, const char* buf, int len, bool acked, void* arg);
+
+private:
+   CAsyncQueue(int id, int depth);
+   ~CAsyncQueue();
+
+   void unlock();
+
+private:
+   int m_iID;                           // completion queue ID
+   int m_iDepth;                        // maximum number of operations, in progress and completed
+
+   CAIOResult* m_pRing;                 // completed operations, not retrieved yet
+   int m_iHead;                         // position of the first completion in the ring
+   int m_iCount;                        // number of completions in the ring
+   int m_iPending;                      // number of operations in progress
+
+   int m_iRefCount;                     // references from the queue table and the calls using the queue
+   bool m_bReleased;                    // if the queue has been released by the application
+
+   pthread_mutex_t m_Lock;              // protects all of the above, and the fields of the operations being completed
+   pthread_cond_t m_Cond;               // signaled when an operation is completed or the queue is released
+
+private:
+   CAsyncQueue(const CAsyncQueue&);
+   CAsyncQueue& operator=(const CAsyncQueue&);
+};
+
+class CAsyncIO
+{
+public:
+   CAsyncIO();
+   ~CAsyncIO();
+
+public:
+
+      // Functionality:
+      //    Create a new completion queue.
+      // Parameters:
+      //    0) [in] depth: maximum number of operations, in progress and completed but not retrieved.
+      // Returned value:
+      //    new completion queue ID.
+
+   int create(int depth);
+
+      // Functionality:
+      //    Reserve a place in a completion queue for a new operation.
+      // Parameters:
+      //    0) [in] qid: completion queue ID.
+      //    1) [in] type: type of the operation, see AIOOpt.
+      //    2) [in] u: UDT socket ID.
+      //    3) [in] data: user buffer.
+      //    4) [in] len: size of the user buffer.
+      //    5) [in] arg: user argument returned with the completion.
+      // Returned value:
+      //    the new operation, to be posted to the socket or cancelled.
+
+   CAsyncOp* post(int qid, int type, UDTSOCKET u, char* data, int len, void* arg);
+
+      // Functionality:
+      //    Cancel an operation that could not be posted to its socket.
+      // Parameters:
+      //    0) [in] op: the operation.
+      // Returned value:
+      //    None.
+
+   void cancel(CAsyncOp* op);
+
+      // Functionality:
+      //    Retrieve completed operations, waiting for them if there is none.
+      // Parameters:
+      //    0) [in] qid: completion queue ID.
+      //    1) [out] results: array to store the completions.
+      //    2) [in] num: size of the array.
+      //    3) [in] msTimeOut: timeout threshold, in milliseconds, negative for infinite.
+      // Returned value:
+      //    number of completions, 0 if timeout.
+
+   int wait(int qid, CAIOResult* results, int num, int64_t msTimeOut);
+
+      // Functionality:
+      //    Release a completion queue; operations in progress are completed into nowhere.
+      // Parameters:
+      //    0) [in] qid: completion queue ID.
+      // Returned value:
+      //    0 if success, otherwise an error number.
+
+   int release(int qid);
+
+private:
+   CAsyncQueue* acquire(int qid);
+
+private:
+   int m_iIDSeed;                       // seed to generate a new ID
+   std::map<int, CAsyncQueue*> m_mQueues;       // all completion queues
+   pthread_mutex_t m_Lock;              // protects m_mQueues and m_iIDSeed, each queue has its own lock
+};
+
+
+#endif
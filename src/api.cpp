@@ -46,10 +46,12 @@ written by
    #endif
 #else
    #include <unistd.h>
+   #include <fcntl.h>
 #endif
 #include <cstring>
 #include "api.h"
 #include "core.h"
+#include "file.h"
 
 using namespace std;
 
@@ -112,8 +114,381 @@ CUDTSocket::~CUDTSocket()
    #endif
 }
 
+// full memory barrier, orders the accesses to the socket table against the lock-free readers
+static inline void memoryBarrier()
+{
+   #ifndef WIN32
+      __sync_synchronize();
+   #else
+      MemoryBarrier();
+   #endif
+}
+
+// load with acquire semantics, the later loads cannot be reordered before it (a plain load on x86)
+template <class T>
+static inline T loadAcquire(const volatile T& v)
+{
+   #ifndef WIN32
+      return __atomic_load_n(&v, __ATOMIC_ACQUIRE);
+   #else
+      // volatile accesses have acquire semantics with MSVC
+      return v;
+   #endif
+}
+
+CSocketTable::CSocketTable():
+m_pTable(NULL),
+m_pRetired(NULL),
+m_iCount(0),
+m_iUsed(0),
+m_pHazard(NULL),
+m_HazardKey()
+{
+   m_pTable = alloc(64);
+
+   #ifndef WIN32
+      pthread_key_create(&m_HazardKey, releaseHazard);
+   #else
+      m_HazardKey = TlsAlloc();
+   #endif
+}
+
+CSocketTable::~CSocketTable()
+{
+   #ifndef WIN32
+      pthread_key_delete(m_HazardKey);
+   #else
+      TlsFree(m_HazardKey);
+   #endif
+
+   while (NULL != m_pHazard)
+   {
+      CHazard* h = m_pHazard;
+      m_pHazard = h->m_pNext;
+      delete h;
+   }
+
+   dealloc(m_pTable);
+
+   while (NULL != m_pRetired)
+   {
+      CTable* t = m_pRetired;
+      m_pRetired = t->m_pNext;
+      dealloc(t);
+   }
+}
+
+CUDTSocket* CSocketTable::lookup(UDTSOCKET id)
+{
+   CHazard* h = getHazard();
+   CUDTSocket* s;
+
+   while (true)
+   {
+      // protect the table, it must still be the current one when the protection is visible to the writers
+      CTable* t = loadAcquire(m_pTable);
+      h->m_pTable = t;
+      memoryBarrier();
+      if (t != loadAcquire(m_pTable))
+         continue;
+
+      int i = probe(t, id);
+      s = (i < 0) ? NULL : loadAcquire(t->m_pBucket[i].m_pSocket);
+
+      h->m_pSocket = s;
+      memoryBarrier();
+
+      // the socket may have been removed before the protection became visible, in which case it must not be used
+      if ((NULL == s) || ((t == loadAcquire(m_pTable)) && (id == loadAcquire(t->m_pBucket[i].m_iID)) && (s == loadAcquire(t->m_pBucket[i].m_pSocket))))
+         break;
+   }
+
+   h->m_pTable = NULL;
+
+   return s;
+}
+
+void CSocketTable::enter()
+{
+   ++ getHazard()->m_iDepth;
+}
+
+void CSocketTable::leave()
+{
+   CHazard* h = getHazard();
+
+   if (0 == -- h->m_iDepth)
+      h->m_pSocket = NULL;
+}
+
+bool CSocketTable::isProtected(const CUDTSocket* s) const
+{
+   // the socket has been removed from the table, any thread that protects it from now on will not use it
+   memoryBarrier();
+
+   for (CHazard* h = loadAcquire(m_pHazard); NULL != h; h = h->m_pNext)
+   {
+      if (s == loadAcquire(h->m_pSocket))
+         return true;
+   }
+
+   return false;
+}
+
+CUDTSocket* CSocketTable::find(UDTSOCKET id) const
+{
+   int i = probe(m_pTable, id);
+
+   return (i < 0) ? NULL : m_pTable->m_pBucket[i].m_pSocket;
+}
+
+void CSocketTable::insert(UDTSOCKET id, CUDTSocket* s)
+{
+   // keep at least half of the buckets empty, the table is rebuilt in a larger size or in the same size
+   // if most of the used buckets are removed entries
+   if ((m_iUsed + 1) * 2 > m_pTable->m_iSize)
+   {
+      int size = m_pTable->m_iSize;
+      while ((m_iCount + 1) * 4 > size)
+         size <<= 1;
+      resize(size);
+   }
+
+   CBucket* b = m_pTable->m_pBucket;
+   int mask = m_pTable->m_iSize - 1;
+   int i = hash(id, m_pTable->m_iSize);
+   while ((0 != b[i].m_iID) && (-1 != b[i].m_iID))
+      i = (i + 1) & mask;
+
+   if (0 == b[i].m_iID)
+      ++ m_iUsed;
+   ++ m_iCount;
+
+   // the socket must be visible before the ID, for the readers
+   b[i].m_pSocket = s;
+   memoryBarrier();
+   b[i].m_iID = id;
+
+   reclaim();
+}
+
+void CSocketTable::remove(UDTSOCKET id)
+{
+   int i = probe(m_pTable, id);
+   if (i < 0)
+      return;
+
+   CBucket* b = m_pTable->m_pBucket;
+   int mask = m_pTable->m_iSize - 1;
+
+   b[i].m_iID = -1;
+   -- m_iCount;
+
+   // a removed entry followed by an empty bucket is not in the probe sequence of any entry, it can be emptied
+   while ((-1 == b[i].m_iID) && (0 == b[(i + 1) & mask].m_iID))
+   {
+      b[i].m_iID = 0;
+      -- m_iUsed;
+      i = (i - 1) & mask;
+   }
+
+   reclaim();
+}
+
+void CSocketTable::getSockets(vector<CUDTSocket*>& sockets) const
+{
+   sockets.clear();
+   for (int i = 0; i < m_pTable->m_iSize; ++ i)
+   {
+      CUDTSocket* s = m_pTable->m_pBucket[i].m_pSocket;
+      if ((0 != m_pTable->m_pBucket[i].m_iID) && (-1 != m_pTable->m_pBucket[i].m_iID))
+         sockets.push_back(s);
+   }
+}
+
+int CSocketTable::hash(UDTSOCKET id, int size)
+{
+   // mix the bits, the IDs are allocated in sequence
+   uint32_t h = id;
+   h ^= h >> 16;
+   h *= 0x45d9f3b;
+   h ^= h >> 16;
+
+   return h & (size - 1);
+}
+
+int CSocketTable::probe(const CTable* t, UDTSOCKET id)
+{
+   const CBucket* b = t->m_pBucket;
+   int mask = t->m_iSize - 1;
+
+   for (int i = hash(id, t->m_iSize), n = 0; n < t->m_iSize; i = (i + 1) & mask, ++ n)
+   {
+      UDTSOCKET k = loadAcquire(b[i].m_iID);
+
+      // an empty bucket ends the probe sequence
+      if (0 == k)
+         return -1;
+
+      if (id == k)
+         return i;
+   }
+
+   return -1;
+}
+
+CSocketTable::CTable* CSocketTable::alloc(int size)
+{
+   CTable* t = new CTable;
+   t->m_pBucket = new CBucket[size];
+   for (int i = 0; i < size; ++ i)
+   {
+      t->m_pBucket[i].m_iID = 0;
+      t->m_pBucket[i].m_pSocket = NULL;
+   }
+   t->m_iSize = size;
+   t->m_pNext = NULL;
+
+   return t;
+}
+
+void CSocketTable::dealloc(CTable* t)
+{
+   delete [] t->m_pBucket;
+   delete t;
+}
+
+#ifndef WIN32
+void CSocketTable::releaseHazard(void* h)
+{
+   // the thread exits, its record can be taken by another thread
+   ((CHazard*)h)->m_pTable = NULL;
+   ((CHazard*)h)->m_pSocket = NULL;
+   ((CHazard*)h)->m_iDepth = 0;
+   memoryBarrier();
+   ((CHazard*)h)->m_iOwned = 0;
+}
+#endif
+
+CSocketTable::CHazard* CSocketTable::getHazard()
+{
+   #ifndef WIN32
+      CHazard* h = (CHazard*)pthread_getspecific(m_HazardKey);
+   #else
+      CHazard* h = (CHazard*)TlsGetValue(m_HazardKey);
+   #endif
+
+   if (NULL != h)
+      return h;
+
+   // reuse the record of an exited thread, or add a new one
+   for (h = loadAcquire(m_pHazard); NULL != h; h = h->m_pNext)
+   {
+      #ifndef WIN32
+         if ((0 == h->m_iOwned) && __sync_bool_compare_and_swap(&h->m_iOwned, 0, 1))
+            break;
+      #else
+         if ((0 == h->m_iOwned) && (0 == InterlockedCompareExchange((LONG volatile*)&h->m_iOwned, 1, 0)))
+            break;
+      #endif
+   }
+
+   if (NULL == h)
+   {
+      h = new CHazard;
+      h->m_pTable = NULL;
+      h->m_pSocket = NULL;
+      h->m_iOwned = 1;
+      h->m_iDepth = 0;
+
+      #ifndef WIN32
+         do
+         {
+            h->m_pNext = m_pHazard;
+         } while (!__sync_bool_compare_and_swap(&m_pHazard, h->m_pNext, h));
+      #else
+         do
+         {
+            h->m_pNext = m_pHazard;
+         } while (InterlockedCompareExchangePointer((PVOID volatile*)&m_pHazard, h, h->m_pNext) != h->m_pNext);
+      #endif
+   }
+
+   #ifndef WIN32
+      pthread_setspecific(m_HazardKey, h);
+   #else
+      TlsSetValue(m_HazardKey, h);
+   #endif
+
+   return h;
+}
+
+void CSocketTable::resize(int size)
+{
+   CTable* t = alloc(size);
+   CTable* old = m_pTable;
+
+   int mask = size - 1;
+   for (int i = 0; i < old->m_iSize; ++ i)
+   {
+      if ((0 == old->m_pBucket[i].m_iID) || (-1 == old->m_pBucket[i].m_iID))
+         continue;
+
+      int j = hash(old->m_pBucket[i].m_iID, size);
+      while (0 != t->m_pBucket[j].m_iID)
+         j = (j + 1) & mask;
+
+      t->m_pBucket[j].m_iID = old->m_pBucket[i].m_iID;
+      t->m_pBucket[j].m_pSocket = old->m_pBucket[i].m_pSocket;
+   }
+   m_iUsed = m_iCount;
+
+   // publish the new table, the old one is kept until no thread is probing it
+   memoryBarrier();
+   m_pTable = t;
+
+   old->m_pNext = m_pRetired;
+   m_pRetired = old;
+}
+
+void CSocketTable::reclaim()
+{
+   if (NULL == m_pRetired)
+      return;
+
+   memoryBarrier();
+
+   CTable** p = &m_pRetired;
+   while (NULL != *p)
+   {
+      bool used = false;
+      for (CHazard* h = loadAcquire(m_pHazard); (NULL != h) && !used; h = h->m_pNext)
+         used = (*p == loadAcquire(h->m_pTable));
+
+      if (!used)
+      {
+         CTable* t = *p;
+         *p = t->m_pNext;
+         dealloc(t);
+      }
+      else
+         p = &(*p)->m_pNext;
+   }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
+// the socket looked up by an API call is protected until the call returns
+class CSocketGuard
+{
+public:
+   CSocketGuard(CSocketTable& table): m_Table(table) {m_Table.enter();}
+   ~CSocketGuard() {m_Table.leave();}
+
+private:
+   CSocketTable& m_Table;
+};
+
 CUDTUnited::CUDTUnited():
 m_Sockets(),
 m_ControlLock(),
@@ -296,7 +671,7 @@ UDTSOCKET CUDTUnited::newSocket(int af, int type)
    CGuard::enterCS(m_ControlLock);
    try
    {
-      m_Sockets[ns->m_SocketID] = ns;
+      m_Sockets.insert(ns->m_SocketID, ns);
    }
    catch (...)
    {
@@ -315,6 +690,9 @@ UDTSOCKET CUDTUnited::newSocket(int af, int type)
 
 int CUDTUnited::newConnection(const UDTSOCKET listen, const sockaddr* peer, CHandShake* hs)
 {
+   // also called by the workers, which do not return from an API call
+   CSocketGuard sg(m_Sockets);
+
    CUDTSocket* ns = NULL;
    CUDTSocket* ls = locate(listen);
 
@@ -416,7 +794,7 @@ int CUDTUnited::newConnection(const UDTSOCKET listen, const sockaddr* peer, CHan
    CGuard::enterCS(m_ControlLock);
    try
    {
-      m_Sockets[ns->m_SocketID] = ns;
+      m_Sockets.insert(ns->m_SocketID, ns);
       m_PeerRec[(ns->m_PeerID << 30) + ns->m_iISN].insert(ns->m_SocketID);
    }
    catch (...)
@@ -437,7 +815,7 @@ int CUDTUnited::newConnection(const UDTSOCKET listen, const sockaddr* peer, CHan
    CGuard::leaveCS(ls->m_AcceptLock);
 
    // acknowledge users waiting for new connections on the listening socket
-   m_EPoll.update_events(listen, ls->m_pUDT->m_sPollID, UDT_EPOLL_IN, true);
+   m_EPoll.update_events(listen, ls->m_pUDT->m_PollSet, UDT_EPOLL_IN, true);
 
    CTimer::triggerEvent();
 
@@ -465,36 +843,33 @@ int CUDTUnited::newConnection(const UDTSOCKET listen, const sockaddr* peer, CHan
 
 CUDT* CUDTUnited::lookup(const UDTSOCKET u)
 {
-   // protects the m_Sockets structure
-   CGuard cg(m_ControlLock);
-
-   map<UDTSOCKET, CUDTSocket*>::iterator i = m_Sockets.find(u);
+   CUDTSocket* s = m_Sockets.lookup(u);
 
-   if ((i == m_Sockets.end()) || (i->second->m_Status == CLOSED))
+   if ((NULL == s) || (s->m_Status == CLOSED))
       throw CUDTException(5, 4, 0);
 
-   return i->second->m_pUDT;
+   return s->m_pUDT;
 }
 
 UDTSTATUS CUDTUnited::getStatus(const UDTSOCKET u)
 {
-   // protects the m_Sockets structure
-   CGuard cg(m_ControlLock);
-
-   map<UDTSOCKET, CUDTSocket*>::iterator i = m_Sockets.find(u);
+   CUDTSocket* s = m_Sockets.lookup(u);
 
-   if (i == m_Sockets.end())
+   if (NULL == s)
    {
+      // protects the m_ClosedSockets structure
+      CGuard cg(m_ControlLock);
+
       if (m_ClosedSockets.find(u) != m_ClosedSockets.end())
          return CLOSED;
 
       return NONEXIST;
    }
 
-   if (i->second->m_pUDT->m_bBroken)
+   if (s->m_pUDT->m_bBroken)
       return BROKEN;
 
-   return i->second->m_Status;   
+   return s->m_Status;   
 }
 
 int CUDTUnited::bind(const UDTSOCKET u, const sockaddr* name, int namelen)
@@ -664,7 +1039,7 @@ UDTSOCKET CUDTUnited::accept(const UDTSOCKET listen, sockaddr* addr, int* addrle
             pthread_cond_wait(&(ls->m_AcceptCond), &(ls->m_AcceptLock));
 
          if (ls->m_pQueuedSockets->empty())
-            m_EPoll.update_events(listen, ls->m_pUDT->m_sPollID, UDT_EPOLL_IN, false);
+            m_EPoll.update_events(listen, ls->m_pUDT->m_PollSet, UDT_EPOLL_IN, false);
 
          pthread_mutex_unlock(&(ls->m_AcceptLock));
       }
@@ -697,7 +1072,7 @@ UDTSOCKET CUDTUnited::accept(const UDTSOCKET listen, sockaddr* addr, int* addrle
          }
 
          if (ls->m_pQueuedSockets->empty())
-            m_EPoll.update_events(listen, ls->m_pUDT->m_sPollID, UDT_EPOLL_IN, false);
+            m_EPoll.update_events(listen, ls->m_pUDT->m_PollSet, UDT_EPOLL_IN, false);
       }
    #endif
 
@@ -792,6 +1167,9 @@ int CUDTUnited::connect(const UDTSOCKET u, const sockaddr* name, int namelen)
 
 void CUDTUnited::connect_complete(const UDTSOCKET u)
 {
+   // also called by the workers, which do not return from an API call
+   CSocketGuard sg(m_Sockets);
+
    CUDTSocket* s = locate(u);
    if (NULL == s)
       throw CUDTException(5, 4, 0);
@@ -839,10 +1217,9 @@ int CUDTUnited::close(const UDTSOCKET u)
    CGuard manager_cg(m_ControlLock);
 
    // since "s" is located before m_ControlLock, locate it again in case it became invalid
-   map<UDTSOCKET, CUDTSocket*>::iterator i = m_Sockets.find(u);
-   if ((i == m_Sockets.end()) || (i->second->m_Status == CLOSED))
+   s = m_Sockets.find(u);
+   if ((NULL == s) || (s->m_Status == CLOSED))
       return 0;
-   s = i->second;
 
    s->m_Status = CLOSED;
 
@@ -851,7 +1228,7 @@ int CUDTUnited::close(const UDTSOCKET u)
    // a timer is started and the socket will be removed after approximately 1 second
    s->m_TimeStamp = CTimer::getTime();
 
-   m_Sockets.erase(s->m_SocketID);
+   m_Sockets.remove(s->m_SocketID);
    m_ClosedSockets.insert(pair<UDTSOCKET, CUDTSocket*>(s->m_SocketID, s));
 
    CTimer::triggerEvent();
@@ -1141,16 +1518,60 @@ int CUDTUnited::epoll_release(const int eid)
    return m_EPoll.release(eid);
 }
 
-CUDTSocket* CUDTUnited::locate(const UDTSOCKET u)
+int CUDTUnited::epoll_getfd(const int eid)
 {
-   CGuard cg(m_ControlLock);
+   return m_EPoll.getfd(eid);
+}
+
+int CUDTUnited::epoll_set_callback(const int eid, UDTEPOLLCB callback, void* arg)
+{
+   return m_EPoll.set_callback(eid, callback, arg);
+}
+
+int CUDTUnited::aio_create(const int depth)
+{
+   return m_AIO.create(depth);
+}
+
+int CUDTUnited::aio_post(const int qid, const int type, const UDTSOCKET u, char* buf, int len, void* arg, int ttl, bool inorder)
+{
+   CUDT* udt = lookup(u);
+
+   CAsyncOp* op = m_AIO.post(qid, type, u, buf, len, arg);
+   op->m_iTTL = ttl;
+   op->m_bInOrder = inorder;
+
+   try
+   {
+      udt->postAsync(op);
+   }
+   catch (...)
+   {
+      m_AIO.cancel(op);
+      throw;
+   }
+
+   return 0;
+}
 
-   map<UDTSOCKET, CUDTSocket*>::iterator i = m_Sockets.find(u);
+int CUDTUnited::aio_wait(const int qid, CAIOResult* results, int num, int64_t msTimeOut)
+{
+   return m_AIO.wait(qid, results, num, msTimeOut);
+}
+
+int CUDTUnited::aio_release(const int qid)
+{
+   return m_AIO.release(qid);
+}
+
+CUDTSocket* CUDTUnited::locate(const UDTSOCKET u)
+{
+   CUDTSocket* s = m_Sockets.lookup(u);
 
-   if ((i == m_Sockets.end()) || (i->second->m_Status == CLOSED))
+   if ((NULL == s) || (s->m_Status == CLOSED))
       return NULL;
 
-   return i->second;
+   return s;
 }
 
 CUDTSocket* CUDTUnited::locate(const sockaddr* peer, const UDTSOCKET id, int32_t isn)
@@ -1163,13 +1584,13 @@ CUDTSocket* CUDTUnited::locate(const sockaddr* peer, const UDTSOCKET id, int32_t
 
    for (set<UDTSOCKET>::iterator j = i->second.begin(); j != i->second.end(); ++ j)
    {
-      map<UDTSOCKET, CUDTSocket*>::iterator k = m_Sockets.find(*j);
+      CUDTSocket* s = m_Sockets.find(*j);
       // this socket might have been closed and moved m_ClosedSockets
-      if (k == m_Sockets.end())
+      if (NULL == s)
          continue;
 
-      if (CIPAddress::ipcmp(peer, k->second->m_pPeerAddr, k->second->m_iIPversion))
-         return k->second;
+      if (CIPAddress::ipcmp(peer, s->m_pPeerAddr, s->m_iIPversion))
+         return s;
    }
 
    return NULL;
@@ -1183,42 +1604,46 @@ void CUDTUnited::checkBrokenSockets()
    vector<UDTSOCKET> tbc;
    vector<UDTSOCKET> tbr;
 
-   for (map<UDTSOCKET, CUDTSocket*>::iterator i = m_Sockets.begin(); i != m_Sockets.end(); ++ i)
+   vector<CUDTSocket*> sockets;
+   m_Sockets.getSockets(sockets);
+
+   for (vector<CUDTSocket*>::iterator i = sockets.begin(); i != sockets.end(); ++ i)
    {
       // check broken connection
-      if (i->second->m_pUDT->m_bBroken)
+      if ((*i)->m_pUDT->m_bBroken)
       {
-         if (i->second->m_Status == LISTENING)
+         if ((*i)->m_Status == LISTENING)
          {
             // for a listening socket, it should wait an extra 3 seconds in case a client is connecting
-            if (CTimer::getTime() - i->second->m_TimeStamp < 3000000)
+            if (CTimer::getTime() - (*i)->m_TimeStamp < 3000000)
                continue;
          }
-         else if ((i->second->m_pUDT->m_pRcvBuffer != NULL) && (i->second->m_pUDT->m_pRcvBuffer->getRcvDataSize() > 0) && (i->second->m_pUDT->m_iBrokenCounter -- > 0))
+         else if (((*i)->m_pUDT->m_pRcvBuffer != NULL) && ((*i)->m_pUDT->m_pRcvBuffer->getRcvDataSize() > 0) && ((*i)->m_pUDT->m_iBrokenCounter -- > 0))
          {
             // if there is still data in the receiver buffer, wait longer
             continue;
          }
 
          //close broken connections and start removal timer
-         i->second->m_Status = CLOSED;
-         i->second->m_TimeStamp = CTimer::getTime();
-         tbc.push_back(i->first);
-         m_ClosedSockets[i->first] = i->second;
+         (*i)->m_Status = CLOSED;
+         (*i)->m_TimeStamp = CTimer::getTime();
+         tbc.push_back((*i)->m_SocketID);
+         m_ClosedSockets[(*i)->m_SocketID] = *i;
 
          // remove from listener's queue
-         map<UDTSOCKET, CUDTSocket*>::iterator ls = m_Sockets.find(i->second->m_ListenSocket);
-         if (ls == m_Sockets.end())
+         CUDTSocket* ls = m_Sockets.find((*i)->m_ListenSocket);
+         if (NULL == ls)
          {
-            ls = m_ClosedSockets.find(i->second->m_ListenSocket);
-            if (ls == m_ClosedSockets.end())
+            map<UDTSOCKET, CUDTSocket*>::iterator cls = m_ClosedSockets.find((*i)->m_ListenSocket);
+            if (cls == m_ClosedSockets.end())
                continue;
+            ls = cls->second;
          }
 
-         CGuard::enterCS(ls->second->m_AcceptLock);
-         ls->second->m_pQueuedSockets->erase(i->second->m_SocketID);
-         ls->second->m_pAcceptSockets->erase(i->second->m_SocketID);
-         CGuard::leaveCS(ls->second->m_AcceptLock);
+         CGuard::enterCS(ls->m_AcceptLock);
+         ls->m_pQueuedSockets->erase((*i)->m_SocketID);
+         ls->m_pAcceptSockets->erase((*i)->m_SocketID);
+         CGuard::leaveCS(ls->m_AcceptLock);
       }
    }
 
@@ -1236,7 +1661,9 @@ void CUDTUnited::checkBrokenSockets()
       }
 
       // timeout 1 second to destroy a socket AND it has been removed from RcvUList
-      if ((CTimer::getTime() - j->second->m_TimeStamp > 1000000) && ((NULL == j->second->m_pUDT->m_pRNode) || !j->second->m_pUDT->m_pRNode->m_bOnList))
+      // AND no API call is still using it (all calls have returned when the library is cleaned up)
+      if ((CTimer::getTime() - j->second->m_TimeStamp > 1000000) && ((NULL == j->second->m_pUDT->m_pRNode) || !j->second->m_pUDT->m_pRNode->m_bOnList) &&
+         (m_bClosing || !m_Sockets.isProtected(j->second)))
       {
          tbr.push_back(j->first);
       }
@@ -1244,7 +1671,7 @@ void CUDTUnited::checkBrokenSockets()
 
    // move closed sockets to the ClosedSockets structure
    for (vector<UDTSOCKET>::iterator k = tbc.begin(); k != tbc.end(); ++ k)
-      m_Sockets.erase(*k);
+      m_Sockets.remove(*k);
 
    // remove those timeout sockets
    for (vector<UDTSOCKET>::iterator l = tbr.begin(); l != tbr.end(); ++ l)
@@ -1269,12 +1696,16 @@ void CUDTUnited::removeSocket(const UDTSOCKET u)
       // if it is a listener, close all un-accepted sockets in its queue and remove them later
       for (set<UDTSOCKET>::iterator q = i->second->m_pQueuedSockets->begin(); q != i->second->m_pQueuedSockets->end(); ++ q)
       {
-         m_Sockets[*q]->m_pUDT->m_bBroken = true;
-         m_Sockets[*q]->m_pUDT->close();
-         m_Sockets[*q]->m_TimeStamp = CTimer::getTime();
-         m_Sockets[*q]->m_Status = CLOSED;
-         m_ClosedSockets[*q] = m_Sockets[*q];
-         m_Sockets.erase(*q);
+         CUDTSocket* s = m_Sockets.find(*q);
+         if (NULL == s)
+            continue;
+
+         s->m_pUDT->m_bBroken = true;
+         s->m_pUDT->close();
+         s->m_TimeStamp = CTimer::getTime();
+         s->m_Status = CLOSED;
+         m_ClosedSockets[*q] = s;
+         m_Sockets.remove(*q);
       }
 
       CGuard::leaveCS(i->second->m_AcceptLock);
@@ -1305,11 +1736,24 @@ void CUDTUnited::removeSocket(const UDTSOCKET u)
    m->second.m_iRefCount --;
    if (0 == m->second.m_iRefCount)
    {
-      m->second.m_pChannel->close();
-      delete m->second.m_pSndQueue;
-      delete m->second.m_pRcvQueue;
-      delete m->second.m_pTimer;
-      delete m->second.m_pChannel;
+      CMultiplexer& mux = m->second;
+
+      for (int k = 0; k < mux.m_iWorkers; ++ k)
+         mux.m_vChannel[k]->close();
+
+      // workers may look up each other, so all of them must stop before any is deleted
+      for (int k = 0; k < mux.m_iWorkers; ++ k)
+         mux.m_vRcvQueue[k]->stop();
+
+      for (int k = 0; k < mux.m_iWorkers; ++ k)
+      {
+         delete mux.m_vSndQueue[k];
+         delete mux.m_vRcvQueue[k];
+         delete mux.m_vTimer[k];
+         delete mux.m_vChannel[k];
+      }
+      delete mux.m_pBudget;
+
       m_mMultiplexer.erase(m);
    }
 }
@@ -1386,10 +1830,11 @@ void CUDTUnited::updateMux(CUDTSocket* s, const sockaddr* addr, const UDPSOCKET*
          {
             if (i->second.m_iPort == port)
             {
-               // reuse the existing multiplexer
+               // reuse the existing multiplexer, the worker is selected by socket ID
                ++ i->second.m_iRefCount;
-               s->m_pUDT->m_pSndQueue = i->second.m_pSndQueue;
-               s->m_pUDT->m_pRcvQueue = i->second.m_pRcvQueue;
+               int k = s->m_SocketID % i->second.m_iWorkers;
+               s->m_pUDT->m_pSndQueue = i->second.m_vSndQueue[k];
+               s->m_pUDT->m_pRcvQueue = i->second.m_vRcvQueue[k];
                s->m_iMuxID = i->second.m_iID;
                return;
             }
@@ -1405,60 +1850,136 @@ void CUDTUnited::updateMux(CUDTSocket* s, const sockaddr* addr, const UDPSOCKET*
    m.m_bReusable = s->m_pUDT->m_bReuseAddr;
    m.m_iID = s->m_SocketID;
 
-   m.m_pChannel = new CChannel(s->m_pUDT->m_iIPversion);
-   m.m_pChannel->setSndBufSize(s->m_pUDT->m_iUDPSndBufSize);
-   m.m_pChannel->setRcvBufSize(s->m_pUDT->m_iUDPRcvBufSize);
-
-   try
-   {
-      if (NULL != udpsock)
-         m.m_pChannel->open(*udpsock);
-      else
-         m.m_pChannel->open(addr);
-   }
-   catch (CUDTException& e)
-   {
-      m.m_pChannel->close();
-      delete m.m_pChannel;
-      throw e;
-   }
+   // additional workers need their own UDP sockets on the same port, sharded by the kernel
+   int workers = s->m_pUDT->m_iWorkers;
+   #ifndef LINUX
+      workers = 1;
+   #endif
+   if (NULL != udpsock)
+      workers = 1;
 
    sockaddr* sa = (AF_INET == s->m_pUDT->m_iIPversion) ? (sockaddr*) new sockaddr_in : (sockaddr*) new sockaddr_in6;
-   m.m_pChannel->getSockAddr(sa);
-   m.m_iPort = (AF_INET == s->m_pUDT->m_iIPversion) ? ntohs(((sockaddr_in*)sa)->sin_port) : ntohs(((sockaddr_in6*)sa)->sin6_port);
-   if (AF_INET == s->m_pUDT->m_iIPversion) delete (sockaddr_in*)sa; else delete (sockaddr_in6*)sa;
 
-   m.m_pTimer = new CTimer;
+   for (int k = 0; k < workers; ++ k)
+   {
+      CChannel* c = new CChannel(s->m_pUDT->m_iIPversion);
+      c->setSndBufSize(s->m_pUDT->m_iUDPSndBufSize);
+      c->setRcvBufSize(s->m_pUDT->m_iUDPRcvBufSize);
+      c->setGSO(s->m_pUDT->m_bGSO);
+      c->setGRO(s->m_pUDT->m_bGRO);
+      c->setReusePort(workers > 1);
 
-   m.m_pSndQueue = new CSndQueue;
-   m.m_pSndQueue->init(m.m_pChannel, m.m_pTimer);
-   m.m_pRcvQueue = new CRcvQueue;
-   m.m_pRcvQueue->init(32, s->m_pUDT->m_iPayloadSize, m.m_iIPversion, 1024, m.m_pChannel, m.m_pTimer);
+      try
+      {
+         if (NULL != udpsock)
+            c->open(*udpsock);
+         else if (0 == k)
+            c->open(addr);
+         else
+            c->open(sa);
+      }
+      catch (CUDTException& e)
+      {
+         c->close();
+         delete c;
 
-   m_mMultiplexer[m.m_iID] = m;
+         if (0 == k)
+         {
+            if (AF_INET == s->m_pUDT->m_iIPversion) delete (sockaddr_in*)sa; else delete (sockaddr_in6*)sa;
+            throw e;
+         }
 
-   s->m_pUDT->m_pSndQueue = m.m_pSndQueue;
-   s->m_pUDT->m_pRcvQueue = m.m_pRcvQueue;
-   s->m_iMuxID = m.m_iID;
-}
+         // the port cannot be shared, continue with the workers created so far
+         break;
+      }
 
-void CUDTUnited::updateMux(CUDTSocket* s, const CUDTSocket* ls)
-{
-   CGuard cg(m_ControlLock);
+      m.m_vChannel.push_back(c);
 
-   int port = (AF_INET == ls->m_iIPversion) ? ntohs(((sockaddr_in*)ls->m_pSelfAddr)->sin_port) : ntohs(((sockaddr_in6*)ls->m_pSelfAddr)->sin6_port);
+      // the other channels bind to the same address and port as the first one
+      if (0 == k)
+         c->getSockAddr(sa);
+   }
 
-   // find the listener's address
-   for (map<int, CMultiplexer>::iterator i = m_mMultiplexer.begin(); i != m_mMultiplexer.end(); ++ i)
+   m.m_iPort = (AF_INET == s->m_pUDT->m_iIPversion) ? ntohs(((sockaddr_in*)sa)->sin_port) : ntohs(((sockaddr_in6*)sa)->sin6_port);
+
+   // without the sharding filter packets would reach the wrong workers, fall back to a single one
+   if ((m.m_vChannel.size() > 1) && (m.m_vChannel[0]->setShardFilter(m.m_vChannel.size()) < 0))
    {
-      if (i->second.m_iPort == port)
+      for (vector<CChannel*>::iterator i = m.m_vChannel.begin() + 1; i != m.m_vChannel.end(); ++ i)
       {
-         // reuse the existing multiplexer
-         ++ i->second.m_iRefCount;
-         s->m_pUDT->m_pSndQueue = i->second.m_pSndQueue;
-         s->m_pUDT->m_pRcvQueue = i->second.m_pRcvQueue;
-         s->m_iMuxID = i->second.m_iID;
-         return;
+         (*i)->close();
+         delete *i;
+      }
+      m.m_vChannel.resize(1);
+   }
+
+   // a single worker must not leave the port open to other sockets: bind it again without SO_REUSEPORT
+   if ((workers > 1) && (1 == m.m_vChannel.size()))
+   {
+      CChannel* c = m.m_vChannel[0];
+      c->close();
+      c->setReusePort(false);
+
+      try
+      {
+         c->open(sa);
+      }
+      catch (CUDTException& e)
+      {
+         c->close();
+         delete c;
+         if (AF_INET == s->m_pUDT->m_iIPversion) delete (sockaddr_in*)sa; else delete (sockaddr_in6*)sa;
+         throw e;
+      }
+   }
+
+   if (AF_INET == s->m_pUDT->m_iIPversion) delete (sockaddr_in*)sa; else delete (sockaddr_in6*)sa;
+
+   m.m_iWorkers = m.m_vChannel.size();
+   m.m_pBudget = (s->m_pUDT->m_llMemBudget > 0) ? new CMemBudget(s->m_pUDT->m_llMemBudget) : NULL;
+
+   for (int k = 0; k < m.m_iWorkers; ++ k)
+   {
+      m.m_vTimer.push_back(new CTimer);
+      m.m_vSndQueue.push_back(new CSndQueue);
+      m.m_vRcvQueue.push_back(new CRcvQueue);
+   }
+
+   for (int k = 0; k < m.m_iWorkers; ++ k)
+   {
+      if (m.m_iWorkers > 1)
+         m.m_vRcvQueue[k]->m_vShard = m.m_vRcvQueue;
+
+      m.m_vSndQueue[k]->init(m.m_vChannel[k], m.m_vTimer[k], s->m_pUDT->m_iSndBatchSize, m.m_pBudget);
+      m.m_vRcvQueue[k]->init(32, s->m_pUDT->m_iPayloadSize, m.m_iIPversion, 1024, m.m_vChannel[k], m.m_vTimer[k], s->m_pUDT->m_iRcvBatchSize, m.m_pBudget);
+   }
+
+   m_mMultiplexer[m.m_iID] = m;
+
+   int k = s->m_SocketID % m.m_iWorkers;
+   s->m_pUDT->m_pSndQueue = m.m_vSndQueue[k];
+   s->m_pUDT->m_pRcvQueue = m.m_vRcvQueue[k];
+   s->m_iMuxID = m.m_iID;
+}
+
+void CUDTUnited::updateMux(CUDTSocket* s, const CUDTSocket* ls)
+{
+   CGuard cg(m_ControlLock);
+
+   int port = (AF_INET == ls->m_iIPversion) ? ntohs(((sockaddr_in*)ls->m_pSelfAddr)->sin_port) : ntohs(((sockaddr_in6*)ls->m_pSelfAddr)->sin6_port);
+
+   // find the listener's address
+   for (map<int, CMultiplexer>::iterator i = m_mMultiplexer.begin(); i != m_mMultiplexer.end(); ++ i)
+   {
+      if (i->second.m_iPort == port)
+      {
+         // reuse the existing multiplexer, the worker is selected by socket ID
+         ++ i->second.m_iRefCount;
+         int k = s->m_SocketID % i->second.m_iWorkers;
+         s->m_pUDT->m_pSndQueue = i->second.m_vSndQueue[k];
+         s->m_pUDT->m_pRcvQueue = i->second.m_vRcvQueue[k];
+         s->m_iMuxID = i->second.m_iID;
+         return;
       }
    }
 }
@@ -1496,29 +2017,33 @@ void CUDTUnited::updateMux(CUDTSocket* s, const CUDTSocket* ls)
 
    // remove all sockets and multiplexers
    CGuard::enterCS(self->m_ControlLock);
-   for (map<UDTSOCKET, CUDTSocket*>::iterator i = self->m_Sockets.begin(); i != self->m_Sockets.end(); ++ i)
+   vector<CUDTSocket*> sockets;
+   self->m_Sockets.getSockets(sockets);
+   for (vector<CUDTSocket*>::iterator i = sockets.begin(); i != sockets.end(); ++ i)
    {
-      i->second->m_pUDT->m_bBroken = true;
-      i->second->m_pUDT->close();
-      i->second->m_Status = CLOSED;
-      i->second->m_TimeStamp = CTimer::getTime();
-      self->m_ClosedSockets[i->first] = i->second;
+      (*i)->m_pUDT->m_bBroken = true;
+      (*i)->m_pUDT->close();
+      (*i)->m_Status = CLOSED;
+      (*i)->m_TimeStamp = CTimer::getTime();
+      self->m_ClosedSockets[(*i)->m_SocketID] = *i;
 
       // remove from listener's queue
-      map<UDTSOCKET, CUDTSocket*>::iterator ls = self->m_Sockets.find(i->second->m_ListenSocket);
-      if (ls == self->m_Sockets.end())
+      CUDTSocket* ls = self->m_Sockets.find((*i)->m_ListenSocket);
+      if (NULL == ls)
       {
-         ls = self->m_ClosedSockets.find(i->second->m_ListenSocket);
-         if (ls == self->m_ClosedSockets.end())
+         map<UDTSOCKET, CUDTSocket*>::iterator cls = self->m_ClosedSockets.find((*i)->m_ListenSocket);
+         if (cls == self->m_ClosedSockets.end())
             continue;
+         ls = cls->second;
       }
 
-      CGuard::enterCS(ls->second->m_AcceptLock);
-      ls->second->m_pQueuedSockets->erase(i->second->m_SocketID);
-      ls->second->m_pAcceptSockets->erase(i->second->m_SocketID);
-      CGuard::leaveCS(ls->second->m_AcceptLock);
+      CGuard::enterCS(ls->m_AcceptLock);
+      ls->m_pQueuedSockets->erase((*i)->m_SocketID);
+      ls->m_pAcceptSockets->erase((*i)->m_SocketID);
+      CGuard::leaveCS(ls->m_AcceptLock);
    }
-   self->m_Sockets.clear();
+   for (vector<CUDTSocket*>::iterator i = sockets.begin(); i != sockets.end(); ++ i)
+      self->m_Sockets.remove((*i)->m_SocketID);
 
    for (map<UDTSOCKET, CUDTSocket*>::iterator j = self->m_ClosedSockets.begin(); j != self->m_ClosedSockets.end(); ++ j)
    {
@@ -1587,6 +2112,8 @@ UDTSOCKET CUDT::socket(int af, int type, int)
 
 int CUDT::bind(UDTSOCKET u, const sockaddr* name, int namelen)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       return s_UDTUnited.bind(u, name, namelen);
@@ -1610,6 +2137,8 @@ int CUDT::bind(UDTSOCKET u, const sockaddr* name, int namelen)
 
 int CUDT::bind(UDTSOCKET u, UDPSOCKET udpsock)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       return s_UDTUnited.bind(u, udpsock);
@@ -1633,6 +2162,8 @@ int CUDT::bind(UDTSOCKET u, UDPSOCKET udpsock)
 
 int CUDT::listen(UDTSOCKET u, int backlog)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       return s_UDTUnited.listen(u, backlog);
@@ -1656,6 +2187,8 @@ int CUDT::listen(UDTSOCKET u, int backlog)
 
 UDTSOCKET CUDT::accept(UDTSOCKET u, sockaddr* addr, int* addrlen)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       return s_UDTUnited.accept(u, addr, addrlen);
@@ -1674,6 +2207,8 @@ UDTSOCKET CUDT::accept(UDTSOCKET u, sockaddr* addr, int* addrlen)
 
 int CUDT::connect(UDTSOCKET u, const sockaddr* name, int namelen)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       return s_UDTUnited.connect(u, name, namelen);
@@ -1697,6 +2232,8 @@ int CUDT::connect(UDTSOCKET u, const sockaddr* name, int namelen)
 
 int CUDT::close(UDTSOCKET u)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       return s_UDTUnited.close(u);
@@ -1715,6 +2252,8 @@ int CUDT::close(UDTSOCKET u)
 
 int CUDT::getpeername(UDTSOCKET u, sockaddr* name, int* namelen)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       return s_UDTUnited.getpeername(u, name, namelen);
@@ -1733,6 +2272,8 @@ int CUDT::getpeername(UDTSOCKET u, sockaddr* name, int* namelen)
 
 int CUDT::getsockname(UDTSOCKET u, sockaddr* name, int* namelen)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       return s_UDTUnited.getsockname(u, name, namelen);;
@@ -1751,6 +2292,8 @@ int CUDT::getsockname(UDTSOCKET u, sockaddr* name, int* namelen)
 
 int CUDT::getsockopt(UDTSOCKET u, int, UDTOpt optname, void* optval, int* optlen)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       CUDT* udt = s_UDTUnited.lookup(u);
@@ -1771,6 +2314,8 @@ int CUDT::getsockopt(UDTSOCKET u, int, UDTOpt optname, void* optval, int* optlen
 
 int CUDT::setsockopt(UDTSOCKET u, int, UDTOpt optname, const void* optval, int optlen)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       CUDT* udt = s_UDTUnited.lookup(u);
@@ -1791,6 +2336,8 @@ int CUDT::setsockopt(UDTSOCKET u, int, UDTOpt optname, const void* optval, int o
 
 int CUDT::send(UDTSOCKET u, const char* buf, int len, int)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       CUDT* udt = s_UDTUnited.lookup(u);
@@ -1815,6 +2362,8 @@ int CUDT::send(UDTSOCKET u, const char* buf, int len, int)
 
 int CUDT::recv(UDTSOCKET u, char* buf, int len, int)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       CUDT* udt = s_UDTUnited.lookup(u);
@@ -1834,6 +2383,8 @@ int CUDT::recv(UDTSOCKET u, char* buf, int len, int)
 
 int CUDT::sendmsg(UDTSOCKET u, const char* buf, int len, int ttl, bool inorder)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       CUDT* udt = s_UDTUnited.lookup(u);
@@ -1856,8 +2407,83 @@ int CUDT::sendmsg(UDTSOCKET u, const char* buf, int len, int ttl, bool inorder)
    }
 }
 
+int CUDT::sendbuf(UDTSOCKET u, const char* buf, int len, UDTSENDCB callback, void* arg, int ttl, bool inorder)
+{
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
+   try
+   {
+      if (NULL == callback)
+         throw CUDTException(5, 3, 0);
+
+      CUDT* udt = s_UDTUnited.lookup(u);
+      if (UDT_STREAM == udt->m_iSockType)
+         return udt->send(buf, len, callback, arg);
+      return udt->sendmsg(buf, len, ttl, inorder, callback, arg);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::recvbuf(UDTSOCKET u, iovec* vec, int num)
+{
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
+   try
+   {
+      CUDT* udt = s_UDTUnited.lookup(u);
+      return udt->recvbuf(vec, num);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::recvrelease(UDTSOCKET u, int len)
+{
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
+   try
+   {
+      CUDT* udt = s_UDTUnited.lookup(u);
+      return udt->recvrelease(len);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
 int CUDT::recvmsg(UDTSOCKET u, char* buf, int len)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       CUDT* udt = s_UDTUnited.lookup(u);
@@ -1877,10 +2503,24 @@ int CUDT::recvmsg(UDTSOCKET u, char* buf, int len)
 
 int64_t CUDT::sendfile(UDTSOCKET u, fstream& ifs, int64_t& offset, int64_t size, int block)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       CUDT* udt = s_UDTUnited.lookup(u);
-      return udt->sendfile(ifs, offset, size, block);
+
+      // positioning...
+      try
+      {
+         ifs.seekg((streamoff)offset);
+      }
+      catch (...)
+      {
+         throw CUDTException(4, 1);
+      }
+
+      CStreamSource src(ifs);
+      return udt->sendfile(src, offset, size, block);
    }
    catch (CUDTException e)
    {
@@ -1901,10 +2541,71 @@ int64_t CUDT::sendfile(UDTSOCKET u, fstream& ifs, int64_t& offset, int64_t size,
 
 int64_t CUDT::recvfile(UDTSOCKET u, fstream& ofs, int64_t& offset, int64_t size, int block)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
+   try
+   {
+      CUDT* udt = s_UDTUnited.lookup(u);
+
+      // positioning...
+      try
+      {
+         ofs.seekp((streamoff)offset);
+      }
+      catch (...)
+      {
+         throw CUDTException(4, 3);
+      }
+
+      CStreamSink sink(ofs);
+      return udt->recvfile(sink, offset, size, block);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int64_t CUDT::sendfile(UDTSOCKET u, CUDTSource& src, int64_t& offset, int64_t size, int block)
+{
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
+   try
+   {
+      CUDT* udt = s_UDTUnited.lookup(u);
+      return udt->sendfile(src, offset, size, block);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int64_t CUDT::recvfile(UDTSOCKET u, CUDTSink& sink, int64_t& offset, int64_t size, int block)
+{
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       CUDT* udt = s_UDTUnited.lookup(u);
-      return udt->recvfile(ofs, offset, size, block);
+      return udt->recvfile(sink, offset, size, block);
    }
    catch (CUDTException e)
    {
@@ -1918,8 +2619,127 @@ int64_t CUDT::recvfile(UDTSOCKET u, fstream& ofs, int64_t& offset, int64_t size,
    }
 }
 
+int64_t CUDT::sendfile2(UDTSOCKET u, const char* path, int64_t* offset, int64_t size, int block)
+{
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
+   try
+   {
+      CUDT* udt = s_UDTUnited.lookup(u);
+
+      #ifndef WIN32
+         int fd = ::open(path, O_RDONLY);
+         if (fd < 0)
+            throw CUDTException(4, 1);
+
+         // the blocks are mapped and sent in place
+         CFileSource src(fd, true);
+         int64_t ret;
+         try
+         {
+            ret = udt->sendfile(src, *offset, size, block);
+         }
+         catch (...)
+         {
+            ::close(fd);
+            throw;
+         }
+         ::close(fd);
+      #else
+         fstream ifs(path, ios::binary | ios::in);
+         CStreamSource src(ifs);
+         int64_t ret = udt->sendfile(src, *offset, size, block);
+         ifs.close();
+      #endif
+
+      return ret;
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int64_t CUDT::recvfile2(UDTSOCKET u, const char* path, int64_t* offset, int64_t size, int block)
+{
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
+   try
+   {
+      CUDT* udt = s_UDTUnited.lookup(u);
+
+      #ifndef WIN32
+         int flags = O_WRONLY | O_CREAT | O_TRUNC;
+         #ifdef LINUX
+            // the asynchronous writer bypasses the page cache, if the file system allows it
+            if (udt->m_iDiskBufSize > 0)
+               flags |= O_DIRECT;
+         #endif
+
+         int fd = ::open(path, flags, 0666);
+         #ifdef LINUX
+            if ((fd < 0) && (0 != (flags & O_DIRECT)))
+               fd = ::open(path, flags & ~O_DIRECT, 0666);
+         #endif
+         if (fd < 0)
+            throw CUDTException(4, 3);
+
+         // with a disk buffer, the data is written by a separate thread, so that a slow disk does not stall the receiver buffer
+         CUDTSink* sink = NULL;
+         int64_t ret;
+         try
+         {
+            if (udt->m_iDiskBufSize > 0)
+               sink = new CFileWriter(fd, udt->m_iDiskBufSize);
+            else
+               sink = new CFileSink(fd);
+
+            ret = udt->recvfile(*sink, *offset, size, block);
+         }
+         catch (...)
+         {
+            delete sink;
+            ::close(fd);
+            throw;
+         }
+         delete sink;
+         ::close(fd);
+      #else
+         fstream ofs(path, ios::binary | ios::out);
+         CStreamSink sink(ofs);
+         int64_t ret = udt->recvfile(sink, *offset, size, block);
+         ofs.close();
+      #endif
+
+      return ret;
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
 int CUDT::select(int, ud_set* readfds, ud_set* writefds, ud_set* exceptfds, const timeval* timeout)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    if ((NULL == readfds) && (NULL == writefds) && (NULL == exceptfds))
    {
       s_UDTUnited.setError(new CUDTException(5, 3, 0));
@@ -1949,6 +2769,8 @@ int CUDT::select(int, ud_set* readfds, ud_set* writefds, ud_set* exceptfds, cons
 
 int CUDT::selectEx(const vector<UDTSOCKET>& fds, vector<UDTSOCKET>* readfds, vector<UDTSOCKET>* writefds, vector<UDTSOCKET>* exceptfds, int64_t msTimeOut)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    if ((NULL == readfds) && (NULL == writefds) && (NULL == exceptfds))
    {
       s_UDTUnited.setError(new CUDTException(5, 3, 0));
@@ -1996,6 +2818,8 @@ int CUDT::epoll_create()
 
 int CUDT::epoll_add_usock(const int eid, const UDTSOCKET u, const int* events)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       return s_UDTUnited.epoll_add_usock(eid, u, events);
@@ -2032,6 +2856,8 @@ int CUDT::epoll_add_ssock(const int eid, const SYSSOCKET s, const int* events)
 
 int CUDT::epoll_remove_usock(const int eid, const UDTSOCKET u)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       return s_UDTUnited.epoll_remove_usock(eid, u);
@@ -2102,6 +2928,136 @@ int CUDT::epoll_release(const int eid)
    }
 }
 
+int CUDT::epoll_getfd(const int eid)
+{
+   try
+   {
+      return s_UDTUnited.epoll_getfd(eid);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::epoll_set_callback(const int eid, UDTEPOLLCB callback, void* arg)
+{
+   try
+   {
+      return s_UDTUnited.epoll_set_callback(eid, callback, arg);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::aio_create(int depth)
+{
+   try
+   {
+      return s_UDTUnited.aio_create(depth);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::aio_post(int qid, int type, UDTSOCKET u, char* buf, int len, void* arg, int ttl, bool inorder)
+{
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
+   try
+   {
+      return s_UDTUnited.aio_post(qid, type, u, buf, len, arg, ttl, inorder);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::aio_wait(int qid, CAIOResult* results, int num, int64_t msTimeOut)
+{
+   try
+   {
+      return s_UDTUnited.aio_wait(qid, results, num, msTimeOut);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::aio_release(int qid)
+{
+   try
+   {
+      return s_UDTUnited.aio_release(qid);
+   }
+   catch (const CUDTException& e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
 CUDTException& CUDT::getlasterror()
 {
    return *s_UDTUnited.getError();
@@ -2109,6 +3065,8 @@ CUDTException& CUDT::getlasterror()
 
 int CUDT::perfmon(UDTSOCKET u, CPerfMon* perf, bool clear)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       CUDT* udt = s_UDTUnited.lookup(u);
@@ -2129,6 +3087,8 @@ int CUDT::perfmon(UDTSOCKET u, CPerfMon* perf, bool clear)
 
 CUDT* CUDT::getUDTHandle(UDTSOCKET u)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       return s_UDTUnited.lookup(u);
@@ -2141,6 +3101,8 @@ CUDT* CUDT::getUDTHandle(UDTSOCKET u)
 
 UDTSTATUS CUDT::getsockstate(UDTSOCKET u)
 {
+   CSocketGuard sg(s_UDTUnited.m_Sockets);
+
    try
    {
       return s_UDTUnited.getStatus(u);
@@ -2238,6 +3200,21 @@ int sendmsg(UDTSOCKET u, const char* buf, int len, int ttl, bool inorder)
    return CUDT::sendmsg(u, buf, len, ttl, inorder);
 }
 
+int sendbuf(UDTSOCKET u, const char* buf, int len, UDTSENDCB callback, void* arg, int ttl, bool inorder)
+{
+   return CUDT::sendbuf(u, buf, len, callback, arg, ttl, inorder);
+}
+
+int recvbuf(UDTSOCKET u, iovec* vec, int num)
+{
+   return CUDT::recvbuf(u, vec, num);
+}
+
+int recvrelease(UDTSOCKET u, int len)
+{
+   return CUDT::recvrelease(u, len);
+}
+
 int recvmsg(UDTSOCKET u, char* buf, int len)
 {
    return CUDT::recvmsg(u, buf, len);
@@ -2253,20 +3230,24 @@ int64_t recvfile(UDTSOCKET u, fstream& ofs, int64_t& offset, int64_t size, int b
    return CUDT::recvfile(u, ofs, offset, size, block);
 }
 
+int64_t sendfile(UDTSOCKET u, CUDTSource& src, int64_t& offset, int64_t size, int block)
+{
+   return CUDT::sendfile(u, src, offset, size, block);
+}
+
+int64_t recvfile(UDTSOCKET u, CUDTSink& sink, int64_t& offset, int64_t size, int block)
+{
+   return CUDT::recvfile(u, sink, offset, size, block);
+}
+
 int64_t sendfile2(UDTSOCKET u, const char* path, int64_t* offset, int64_t size, int block)
 {
-   fstream ifs(path, ios::binary | ios::in);
-   int64_t ret = CUDT::sendfile(u, ifs, *offset, size, block);
-   ifs.close();
-   return ret;
+   return CUDT::sendfile2(u, path, offset, size, block);
 }
 
 int64_t recvfile2(UDTSOCKET u, const char* path, int64_t* offset, int64_t size, int block)
 {
-   fstream ofs(path, ios::binary | ios::out);
-   int64_t ret = CUDT::recvfile(u, ofs, *offset, size, block);
-   ofs.close();
-   return ret;
+   return CUDT::recvfile2(u, path, offset, size, block);
 }
 
 int select(int nfds, UDSET* readfds, UDSET* writefds, UDSET* exceptfds, const struct timeval* timeout)
@@ -2364,6 +3345,51 @@ int epoll_release(int eid)
    return CUDT::epoll_release(eid);
 }
 
+int epoll_getfd(int eid)
+{
+   return CUDT::epoll_getfd(eid);
+}
+
+int epoll_set_callback(int eid, UDTEPOLLCB callback, void* arg)
+{
+   return CUDT::epoll_set_callback(eid, callback, arg);
+}
+
+int aio_create(int depth)
+{
+   return CUDT::aio_create(depth);
+}
+
+int aio_send(int qid, UDTSOCKET u, const char* buf, int len, void* arg)
+{
+   return CUDT::aio_post(qid, UDT_AIO_SEND, u, (char*)buf, len, arg);
+}
+
+int aio_recv(int qid, UDTSOCKET u, char* buf, int len, void* arg)
+{
+   return CUDT::aio_post(qid, UDT_AIO_RECV, u, buf, len, arg);
+}
+
+int aio_sendmsg(int qid, UDTSOCKET u, const char* buf, int len, void* arg, int ttl, bool inorder)
+{
+   return CUDT::aio_post(qid, UDT_AIO_SENDMSG, u, (char*)buf, len, arg, ttl, inorder);
+}
+
+int aio_recvmsg(int qid, UDTSOCKET u, char* buf, int len, void* arg)
+{
+   return CUDT::aio_post(qid, UDT_AIO_RECVMSG, u, buf, len, arg);
+}
+
+int aio_wait(int qid, AIORESULT* results, int num, int64_t msTimeOut)
+{
+   return CUDT::aio_wait(qid, results, num, msTimeOut);
+}
+
+int aio_release(int qid)
+{
+   return CUDT::aio_release(qid);
+}
+
 ERRORINFO& getlasterror()
 {
    return CUDT::getlasterror();
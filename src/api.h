@@ -49,6 +49,7 @@ written by
 #include "queue.h"
 #include "cache.h"
 #include "epoll.h"
+#include "aio.h"
 
 class CUDT;
 
@@ -93,6 +94,143 @@ private:
 
 ////////////////////////////////////////////////////////////////////////////////
 
+class CSocketTable
+{
+public:
+   CSocketTable();
+   ~CSocketTable();
+
+public:
+
+      // Functionality:
+      //    Look up a socket without locking. The socket found is protected from being deleted
+      //    until the calling thread looks up another socket or leaves the API call.
+      // Parameters:
+      //    0) [in] id: socket ID.
+      // Returned value:
+      //    Pointer to the socket, or NULL if not found.
+
+   CUDTSocket* lookup(UDTSOCKET id);
+
+      // Functionality:
+      //    Start an API call in the calling thread, the calls can be nested.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void enter();
+
+      // Functionality:
+      //    Finish an API call in the calling thread, the socket looked up last is not protected any more
+      //    when the outermost call is finished.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void leave();
+
+      // Functionality:
+      //    Check if a socket that has been removed from the table is still protected by any thread.
+      // Parameters:
+      //    0) [in] s: pointer to the socket.
+      // Returned value:
+      //    true if the socket cannot be deleted yet, otherwise false.
+
+   bool isProtected(const CUDTSocket* s) const;
+
+      // Functionality:
+      //    Look up a socket, without protection. Only called by the thread that modifies the table.
+      // Parameters:
+      //    0) [in] id: socket ID.
+      // Returned value:
+      //    Pointer to the socket, or NULL if not found.
+
+   CUDTSocket* find(UDTSOCKET id) const;
+
+      // Functionality:
+      //    Insert a socket to the table. The modifications must be serialized by the caller.
+      // Parameters:
+      //    0) [in] id: socket ID.
+      //    1) [in] s: pointer to the socket.
+      // Returned value:
+      //    None.
+
+   void insert(UDTSOCKET id, CUDTSocket* s);
+
+      // Functionality:
+      //    Remove a socket from the table. The modifications must be serialized by the caller.
+      // Parameters:
+      //    0) [in] id: socket ID.
+      // Returned value:
+      //    None.
+
+   void remove(UDTSOCKET id);
+
+      // Functionality:
+      //    Copy all the sockets in the table, e.g., to be checked and removed one by one.
+      // Parameters:
+      //    0) [out] sockets: the sockets in the table.
+      // Returned value:
+      //    None.
+
+   void getSockets(std::vector<CUDTSocket*>& sockets) const;
+
+private:
+   struct CBucket
+   {
+      volatile UDTSOCKET m_iID;		// Socket ID, 0 if the bucket is empty, -1 if the entry has been removed
+      CUDTSocket* volatile m_pSocket;	// Socket structure
+   };
+
+   struct CTable
+   {
+      CBucket* m_pBucket;		// the buckets, in open addressing with linear probing
+      int m_iSize;			// number of buckets, power of 2
+      CTable* m_pNext;			// next retired table
+   };
+
+   struct CHazard
+   {
+      CTable* volatile m_pTable;	// table being probed by the thread
+      CUDTSocket* volatile m_pSocket;	// socket protected for the thread
+      volatile int m_iOwned;		// 1 if the record belongs to a running thread
+      int m_iDepth;			// number of nested API calls of the thread
+      CHazard* m_pNext;			// next record, the records are only freed with the table
+      char m_cPadding[28];		// keep each record in its own cache line
+   };
+
+   CTable* volatile m_pTable;		// current hash table
+   CTable* m_pRetired;			// replaced tables, freed when no thread is probing them
+
+   int m_iCount;			// number of entries
+   int m_iUsed;				// number of non-empty buckets, including removed entries
+
+   CHazard* volatile m_pHazard;		// protection records of the threads that have looked up sockets
+   pthread_key_t m_HazardKey;		// record of the calling thread
+
+private:
+   static int hash(UDTSOCKET id, int size);
+   static int probe(const CTable* t, UDTSOCKET id);
+   static CTable* alloc(int size);
+   static void dealloc(CTable* t);
+
+   #ifndef WIN32
+      static void releaseHazard(void* h);
+   #endif
+
+   CHazard* getHazard();
+   void resize(int size);
+   void reclaim();
+
+private:
+   CSocketTable(const CSocketTable&);
+   CSocketTable& operator=(const CSocketTable&);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
 class CUDTUnited
 {
 friend class CUDT;
@@ -180,6 +318,12 @@ public:
    int epoll_remove_ssock(const int eid, const SYSSOCKET s);
    int epoll_wait(const int eid, std::set<UDTSOCKET>* readfds, std::set<UDTSOCKET>* writefds, int64_t msTimeOut, std::set<SYSSOCKET>* lrfds = NULL, std::set<SYSSOCKET>* lwfds = NULL);
    int epoll_release(const int eid);
+   int epoll_getfd(const int eid);
+   int epoll_set_callback(const int eid, UDTEPOLLCB callback, void* arg);
+   int aio_create(const int depth);
+   int aio_post(const int qid, const int type, const UDTSOCKET u, char* buf, int len, void* arg, int ttl, bool inorder);
+   int aio_wait(const int qid, CAIOResult* results, int num, int64_t msTimeOut);
+   int aio_release(const int qid);
 
       // Functionality:
       //    record the UDT exception.
@@ -203,9 +347,9 @@ private:
 //   void init();
 
 private:
-   std::map<UDTSOCKET, CUDTSocket*> m_Sockets;       // stores all the socket structures
+   CSocketTable m_Sockets;                           // stores all the socket structures, looked up without locking
 
-   pthread_mutex_t m_ControlLock;                    // used to synchronize UDT API
+   pthread_mutex_t m_ControlLock;                    // used to synchronize UDT API, and the modifications of m_Sockets
 
    pthread_mutex_t m_IDLock;                         // used to synchronize ID generation
    UDTSOCKET m_SocketID;                             // seed to generate a new unique socket ID
@@ -259,6 +403,7 @@ private:
 
 private:
    CEPoll m_EPoll;                                     // handling epoll data structures and events
+   CAsyncIO m_AIO;                                     // completion queues of asynchronous operations
 
 private:
    CUDTUnited(const CUDTUnited&);
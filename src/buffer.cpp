@@ -38,91 +38,168 @@ written by
    Yunhong Gu, last updated 03/12/2011
 *****************************************************************************/
 
+#ifndef WIN32
+   #include <unistd.h>
+   #include <sys/uio.h>
+#endif
 #include <cstring>
 #include <cmath>
 #include "buffer.h"
 
 using namespace std;
 
-CSndBuffer::CSndBuffer(int size, int mss):
+CSndBuffer::CSndBuffer(int size, int mss, CMemBudget* budget):
 m_BufLock(),
-m_pBlock(NULL),
-m_pFirstBlock(NULL),
-m_pCurrBlock(NULL),
-m_pLastBlock(NULL),
+m_ppcData(NULL),
+m_piLength(NULL),
+m_ppcUserData(NULL),
+m_ppLend(NULL),
+m_piMsgNo(NULL),
+m_pullOriginTime(NULL),
+m_piTTL(NULL),
+m_iFirstBlock(0),
+m_iCurrBlock(0),
+m_iLastBlock(0),
 m_pBuffer(NULL),
 m_iNextMsgNo(1),
-m_iSize(size),
+m_iSize(1),
+m_iInitSize(),
 m_iMSS(mss),
-m_iCount(0)
+m_iCount(0),
+m_iLendCount(0),
+m_pBudget(budget)
 {
-   // initial physical buffer of "size"
-   m_pBuffer = new Buffer;
-   m_pBuffer->m_pcData = new char [m_iSize * m_iMSS];
-   m_pBuffer->m_iSize = m_iSize;
-   m_pBuffer->m_pNext = NULL;
-
-   // circular linked list for out bound packets
-   m_pBlock = new Block;
-   Block* pb = m_pBlock;
-   for (int i = 1; i < m_iSize; ++ i)
-   {
-      pb->m_pNext = new Block;
-      pb->m_iMsgNo = 0;
-      pb = pb->m_pNext;
-   }
-   pb->m_pNext = m_pBlock;
+   // the ring size must be a power of 2, so that an offset is located by masking
+   while (m_iSize < size)
+      m_iSize <<= 1;
+   m_iInitSize = m_iSize;
 
-   pb = m_pBlock;
-   char* pc = m_pBuffer->m_pcData;
-   for (int i = 0; i < m_iSize; ++ i)
+   #ifndef WIN32
+      pthread_mutex_init(&m_BufLock, NULL);
+   #else
+      m_BufLock = CreateMutex(NULL, false, NULL);
+   #endif
+}
+
+CSndBuffer::~CSndBuffer()
+{
+   // return the user buffers that have not been acknowledged yet
+   for (int i = m_iFirstBlock; (m_iLendCount > 0) && (i != m_iLastBlock); i = (i + 1) & (m_iSize - 1))
    {
-      pb->m_pcData = pc;
-      pb = pb->m_pNext;
-      pc += m_iMSS;
+      if (NULL != m_ppLend[i])
+      {
+         if (NULL != m_ppLend[i]->m_pCallback)
+            m_ppLend[i]->m_pCallback(m_ppLend[i]->m_iSocket, m_ppLend[i]->m_pcData, m_ppLend[i]->m_iLength, false, m_ppLend[i]->m_pArg);
+         delete m_ppLend[i];
+         -- m_iLendCount;
+      }
    }
 
-   m_pFirstBlock = m_pCurrBlock = m_pLastBlock = m_pBlock;
+   destroy();
 
    #ifndef WIN32
-      pthread_mutex_init(&m_BufLock, NULL);
+      pthread_mutex_destroy(&m_BufLock);
    #else
-      m_BufLock = CreateMutex(NULL, false, NULL);
+      CloseHandle(m_BufLock);
    #endif
 }
 
-CSndBuffer::~CSndBuffer()
+void CSndBuffer::create()
 {
-   Block* pb = m_pBlock->m_pNext;
-   while (pb != m_pBlock)
+   try
    {
-      Block* temp = pb;
-      pb = pb->m_pNext;
-      delete temp;
+      // initial physical buffer of "size"
+      m_pBuffer = new Buffer;
+      m_pBuffer->m_pcData = NULL;
+      m_pBuffer->m_iSize = m_iSize;
+      m_pBuffer->m_pNext = NULL;
+
+      // the initial buffer is always granted, so that every connection can make progress
+      if (NULL != m_pBudget)
+         m_pBudget->charge(m_iSize * m_iMSS);
+
+      m_pBuffer->m_pcData = CPktAllocator::allocate(m_iSize * m_iMSS);
+
+      m_ppcData = new char* [m_iSize];
+      m_piLength = new int [m_iSize];
+      m_ppcUserData = new char* [m_iSize];
+      m_ppLend = new Lend* [m_iSize];
+      m_piMsgNo = new int32_t [m_iSize];
+      m_pullOriginTime = new uint64_t [m_iSize];
+      m_piTTL = new int [m_iSize];
    }
-   delete m_pBlock;
+   catch (...)
+   {
+      destroy();
+      throw CUDTException(3, 2, 0);
+   }
+
+   char* pc = m_pBuffer->m_pcData;
+   for (int i = 0; i < m_iSize; ++ i)
+   {
+      m_ppcData[i] = pc;
+      m_ppcUserData[i] = NULL;
+      m_ppLend[i] = NULL;
+      m_piMsgNo[i] = 0;
+      pc += m_iMSS;
+   }
+}
+
+void CSndBuffer::destroy()
+{
+   delete [] m_ppcData;
+   delete [] m_piLength;
+   delete [] m_ppcUserData;
+   delete [] m_ppLend;
+   delete [] m_piMsgNo;
+   delete [] m_pullOriginTime;
+   delete [] m_piTTL;
 
    while (m_pBuffer != NULL)
    {
       Buffer* temp = m_pBuffer;
       m_pBuffer = m_pBuffer->m_pNext;
-      delete [] temp->m_pcData;
+      CPktAllocator::release(temp->m_pcData, temp->m_iSize * m_iMSS);
+      if (NULL != m_pBudget)
+         m_pBudget->release(temp->m_iSize * m_iMSS);
       delete temp;
    }
 
-   #ifndef WIN32
-      pthread_mutex_destroy(&m_BufLock);
-   #else
-      CloseHandle(m_BufLock);
-   #endif
+   m_ppcData = NULL;
+   m_piLength = NULL;
+   m_ppcUserData = NULL;
+   m_ppLend = NULL;
+   m_piMsgNo = NULL;
+   m_pullOriginTime = NULL;
+   m_piTTL = NULL;
 }
 
 void CSndBuffer::addBuffer(const char* data, int len, int ttl, bool order)
+{
+   insert(data, len, ttl, order, NULL);
+}
+
+void CSndBuffer::lendBuffer(const char* data, int len, int ttl, bool order, UDTSOCKET u, UDTSENDCB callback, void* arg)
+{
+   Lend* lend = new Lend;
+   lend->m_pcData = data;
+   lend->m_iLength = len;
+   lend->m_iSocket = u;
+   lend->m_pCallback = callback;
+   lend->m_pArg = arg;
+
+   insert(data, len, ttl, order, lend);
+}
+
+void CSndBuffer::insert(const char* data, int len, int ttl, bool order, Lend* lend)
 {
    int size = len / m_iMSS;
    if ((len % m_iMSS) != 0)
       size ++;
 
+   if (NULL == m_ppcData)
+      create();
+
    // dynamically increase sender buffer
    while (size + m_iCount >= m_iSize)
       increase();
@@ -131,31 +208,42 @@ void CSndBuffer::addBuffer(const char* data, int len, int ttl, bool order)
    int32_t inorder = order;
    inorder <<= 29;
 
-   Block* s = m_pLastBlock;
+   // the blocks after the last one are not visible to the other threads until the last block is moved
+   int s = m_iLastBlock;
    for (int i = 0; i < size; ++ i)
    {
       int pktlen = len - i * m_iMSS;
       if (pktlen > m_iMSS)
          pktlen = m_iMSS;
 
-      memcpy(s->m_pcData, data + i * m_iMSS, pktlen);
-      s->m_iLength = pktlen;
+      // a lent buffer is sent in place, it is only referenced by the block
+      if (NULL == lend)
+      {
+         memcpy(m_ppcData[s], data + i * m_iMSS, pktlen);
+         m_ppcUserData[s] = NULL;
+      }
+      else
+         m_ppcUserData[s] = const_cast<char*>(data) + i * m_iMSS;
+      m_ppLend[s] = (i == size - 1) ? lend : NULL;
+      m_piLength[s] = pktlen;
 
-      s->m_iMsgNo = m_iNextMsgNo | inorder;
+      m_piMsgNo[s] = m_iNextMsgNo | inorder;
       if (i == 0)
-         s->m_iMsgNo |= 0x80000000;
+         m_piMsgNo[s] |= 0x80000000;
       if (i == size - 1)
-         s->m_iMsgNo |= 0x40000000;
+         m_piMsgNo[s] |= 0x40000000;
 
-      s->m_OriginTime = time;
-      s->m_iTTL = ttl;
+      m_pullOriginTime[s] = time;
+      m_piTTL[s] = ttl;
 
-      s = s->m_pNext;
+      s = (s + 1) & (m_iSize - 1);
    }
-   m_pLastBlock = s;
 
    CGuard::enterCS(m_BufLock);
+   m_iLastBlock = s;
    m_iCount += size;
+   if (NULL != lend)
+      ++ m_iLendCount;
    CGuard::leaveCS(m_BufLock);
 
    m_iNextMsgNo ++;
@@ -163,48 +251,85 @@ void CSndBuffer::addBuffer(const char* data, int len, int ttl, bool order)
       m_iNextMsgNo = 1;
 }
 
-int CSndBuffer::addBufferFromFile(fstream& ifs, int len)
+int CSndBuffer::addBufferFromSource(CUDTSource& src, int64_t offset, int len)
 {
    int size = len / m_iMSS;
    if ((len % m_iMSS) != 0)
       size ++;
 
+   if (NULL == m_ppcData)
+      create();
+
    // dynamically increase sender buffer
    while (size + m_iCount >= m_iSize)
       increase();
 
-   Block* s = m_pLastBlock;
+   const int maxvec = 256;
+   iovec vec[maxvec];
+
+   int s = m_iLastBlock;
+   int last = -1;
    int total = 0;
-   for (int i = 0; i < size; ++ i)
+   int count = 0;
+   bool eof = false;
+   while ((count < size) && !eof)
    {
-      if (ifs.bad() || ifs.fail() || ifs.eof())
+      // let the source fill the blocks directly
+      int n = 0;
+      int expected = 0;
+      int p = s;
+      for (int i = count; (i < size) && (n < maxvec); ++ i, ++ n)
+      {
+         int pktlen = len - i * m_iMSS;
+         if (pktlen > m_iMSS)
+            pktlen = m_iMSS;
+
+         vec[n].iov_base = m_ppcData[p];
+         vec[n].iov_len = pktlen;
+         expected += pktlen;
+         p = (p + 1) & (m_iSize - 1);
+      }
+
+      int res = src.read(vec, n, offset + total);
+      if (res < 0)
+      {
+         if (0 == total)
+            return -1;
          break;
+      }
+      eof = (res < expected);
 
-      int pktlen = len - i * m_iMSS;
-      if (pktlen > m_iMSS)
-         pktlen = m_iMSS;
+      for (int i = 0; (i < n) && (res > 0); ++ i)
+      {
+         int pktlen = (res < (int)vec[i].iov_len) ? res : (int)vec[i].iov_len;
 
-      ifs.read(s->m_pcData, pktlen);
-      if ((pktlen = ifs.gcount()) <= 0)
-         break;
+         m_ppcUserData[s] = NULL;
+         m_ppLend[s] = NULL;
 
-      // currently file transfer is only available in streaming mode, message is always in order, ttl = infinite
-      s->m_iMsgNo = m_iNextMsgNo | 0x20000000;
-      if (i == 0)
-         s->m_iMsgNo |= 0x80000000;
-      if (i == size - 1)
-         s->m_iMsgNo |= 0x40000000;
+         // currently file transfer is only available in streaming mode, message is always in order, ttl = infinite
+         m_piMsgNo[s] = m_iNextMsgNo | 0x20000000;
+         if (count == 0)
+            m_piMsgNo[s] |= 0x80000000;
 
-      s->m_iLength = pktlen;
-      s->m_iTTL = -1;
-      s = s->m_pNext;
+         m_piLength[s] = pktlen;
+         m_piTTL[s] = -1;
+         last = s;
+         s = (s + 1) & (m_iSize - 1);
 
-      total += pktlen;
+         res -= pktlen;
+         total += pktlen;
+         ++ count;
+      }
    }
-   m_pLastBlock = s;
+
+   if (0 == count)
+      return 0;
+
+   m_piMsgNo[last] |= 0x40000000;
 
    CGuard::enterCS(m_BufLock);
-   m_iCount += size;
+   m_iLastBlock = s;
+   m_iCount += count;
    CGuard::leaveCS(m_BufLock);
 
    m_iNextMsgNo ++;
@@ -216,15 +341,19 @@ int CSndBuffer::addBufferFromFile(fstream& ifs, int len)
 
 int CSndBuffer::readData(char** data, int32_t& msgno)
 {
+   // the ring may be reallocated by a concurrent insertion
+   CGuard bufferguard(m_BufLock);
+
    // No data to read
-   if (m_pCurrBlock == m_pLastBlock)
+   if (m_iCurrBlock == m_iLastBlock)
       return 0;
 
-   *data = m_pCurrBlock->m_pcData;
-   int readlen = m_pCurrBlock->m_iLength;
-   msgno = m_pCurrBlock->m_iMsgNo;
+   int p = m_iCurrBlock;
+   *data = (NULL == m_ppcUserData[p]) ? m_ppcData[p] : m_ppcUserData[p];
+   int readlen = m_piLength[p];
+   msgno = m_piMsgNo[p];
 
-   m_pCurrBlock = m_pCurrBlock->m_pNext;
+   m_iCurrBlock = (p + 1) & (m_iSize - 1);
 
    return readlen;
 }
@@ -233,47 +362,70 @@ int CSndBuffer::readData(char** data, const int offset, int32_t& msgno, int& msg
 {
    CGuard bufferguard(m_BufLock);
 
-   Block* p = m_pFirstBlock;
+   // the block is beyond the data in the buffer
+   if (offset >= m_iCount)
+      return 0;
 
-   for (int i = 0; i < offset; ++ i)
-      p = p->m_pNext;
+   int p = (m_iFirstBlock + offset) & (m_iSize - 1);
 
-   if ((p->m_iTTL >= 0) && ((CTimer::getTime() - p->m_OriginTime) / 1000 > (uint64_t)p->m_iTTL))
+   if ((m_piTTL[p] >= 0) && ((CTimer::getTime() - m_pullOriginTime[p]) / 1000 > (uint64_t)m_piTTL[p]))
    {
-      msgno = p->m_iMsgNo & 0x1FFFFFFF;
+      msgno = m_piMsgNo[p] & 0x1FFFFFFF;
 
       msglen = 1;
-      p = p->m_pNext;
+      p = (p + 1) & (m_iSize - 1);
       bool move = false;
-      while (msgno == (p->m_iMsgNo & 0x1FFFFFFF))
+      while ((p != m_iLastBlock) && (msgno == (m_piMsgNo[p] & 0x1FFFFFFF)))
       {
-         if (p == m_pCurrBlock)
+         if (p == m_iCurrBlock)
             move = true;
-         p = p->m_pNext;
+         p = (p + 1) & (m_iSize - 1);
          if (move)
-            m_pCurrBlock = p;
+            m_iCurrBlock = p;
          msglen ++;
       }
 
       return -1;
    }
 
-   *data = p->m_pcData;
-   int readlen = p->m_iLength;
-   msgno = p->m_iMsgNo;
+   *data = (NULL == m_ppcUserData[p]) ? m_ppcData[p] : m_ppcUserData[p];
+   int readlen = m_piLength[p];
+   msgno = m_piMsgNo[p];
 
    return readlen;
 }
 
 void CSndBuffer::ackData(int offset)
 {
-   CGuard bufferguard(m_BufLock);
+   vector<Lend*> done;
+
+   CGuard::enterCS(m_BufLock);
 
-   for (int i = 0; i < offset; ++ i)
-      m_pFirstBlock = m_pFirstBlock->m_pNext;
+   // only the lent user buffers need to be visited, the copied blocks are simply released by moving the first block
+   for (int i = 0; (m_iLendCount > 0) && (i < offset); ++ i)
+   {
+      int p = (m_iFirstBlock + i) & (m_iSize - 1);
+      if (NULL != m_ppLend[p])
+      {
+         done.push_back(m_ppLend[p]);
+         m_ppLend[p] = NULL;
+         -- m_iLendCount;
+      }
+   }
 
+   m_iFirstBlock = (m_iFirstBlock + offset) & (m_iSize - 1);
    m_iCount -= offset;
 
+   CGuard::leaveCS(m_BufLock);
+
+   // return the fully acknowledged user buffers, outside the buffer lock
+   for (vector<Lend*>::iterator i = done.begin(); i != done.end(); ++ i)
+   {
+      if (NULL != (*i)->m_pCallback)
+         (*i)->m_pCallback((*i)->m_iSocket, (*i)->m_pcData, (*i)->m_iLength, true, (*i)->m_pArg);
+      delete *i;
+   }
+
    CTimer::triggerEvent();
 }
 
@@ -282,63 +434,138 @@ int CSndBuffer::getCurrBufSize() const
    return m_iCount;
 }
 
+bool CSndBuffer::compact()
+{
+   CGuard bufferguard(m_BufLock);
+
+   if ((NULL == m_ppcData) || (m_iCount > 0) || (m_iLendCount > 0))
+      return false;
+
+   destroy();
+
+   m_iSize = m_iInitSize;
+   m_iFirstBlock = m_iCurrBlock = m_iLastBlock = 0;
+
+   return true;
+}
+
+int CSndBuffer::getMaxBufSize(int limit) const
+{
+   if (NULL == m_pBudget)
+      return limit;
+
+   // the buffer grows by doubling, each step has to fit in the budget left;
+   // the ring is doubled as soon as it has no free block, so it holds one packet less than its size
+   int64_t avail = m_pBudget->getAvailable();
+   int size = m_iSize;
+   while ((size <= limit) && (avail >= (int64_t)size * m_iMSS))
+   {
+      avail -= (int64_t)size * m_iMSS;
+      size <<= 1;
+   }
+
+   return (size <= limit) ? size - 1 : limit;
+}
+
 void CSndBuffer::increase()
 {
-   int unitsize = m_pBuffer->m_iSize;
+   // the ring is doubled, the new physical buffer is as large as all the existing ones
+   int unitsize = m_iSize;
+   int size = m_iSize * 2;
 
-   // new physical buffer
    Buffer* nbuf = NULL;
+   char** data = NULL;
+   int* length = NULL;
+   char** userdata = NULL;
+   Lend** lend = NULL;
+   int32_t* msgno = NULL;
+   uint64_t* origintime = NULL;
+   int* ttl = NULL;
    try
    {
       nbuf  = new Buffer;
-      nbuf->m_pcData = new char [unitsize * m_iMSS];
+      nbuf->m_pcData = NULL;
+      nbuf->m_pcData = CPktAllocator::allocate(unitsize * m_iMSS);
+
+      data = new char* [size];
+      length = new int [size];
+      userdata = new char* [size];
+      lend = new Lend* [size];
+      msgno = new int32_t [size];
+      origintime = new uint64_t [size];
+      ttl = new int [size];
    }
    catch (...)
    {
+      if (NULL != nbuf)
+         CPktAllocator::release(nbuf->m_pcData, unitsize * m_iMSS);
       delete nbuf;
+      delete [] data;
+      delete [] length;
+      delete [] userdata;
+      delete [] lend;
+      delete [] msgno;
+      delete [] origintime;
+      delete [] ttl;
       throw CUDTException(3, 2, 0);
    }
    nbuf->m_iSize = unitsize;
-   nbuf->m_pNext = NULL;
 
-   // insert the buffer at the end of the buffer list
-   Buffer* p = m_pBuffer;
-   while (NULL != p->m_pNext)
-      p = p->m_pNext;
-   p->m_pNext = nbuf;
+   // send(), sendmsg() and sendfile() wait for getMaxBufSize() before adding data, but the sockets sharing
+   // the budget check it independently, so two of them growing at the same time may overshoot it by one step
+   if (NULL != m_pBudget)
+      m_pBudget->charge(unitsize * m_iMSS);
 
-   // new packet blocks
-   Block* nblk = NULL;
-   try
-   {
-      nblk = new Block;
-   }
-   catch (...)
-   {
-      delete nblk;
-      throw CUDTException(3, 2, 0);
-   }
-   Block* pb = nblk;
-   for (int i = 1; i < unitsize; ++ i)
+   // the new blocks follow the existing ones
+   char* pc = nbuf->m_pcData;
+   for (int i = unitsize; i < size; ++ i)
    {
-      pb->m_pNext = new Block;
-      pb = pb->m_pNext;
+      data[i] = pc;
+      userdata[i] = NULL;
+      lend[i] = NULL;
+      msgno[i] = 0;
+      pc += m_iMSS;
    }
 
-   // insert the new blocks onto the existing one
-   pb->m_pNext = m_pLastBlock->m_pNext;
-   m_pLastBlock->m_pNext = nblk;
+   CGuard bufferguard(m_BufLock);
 
-   pb = nblk;
-   char* pc = nbuf->m_pcData;
+   // the existing blocks are moved to the beginning of the new ring, starting from the first one
    for (int i = 0; i < unitsize; ++ i)
    {
-      pb->m_pcData = pc;
-      pb = pb->m_pNext;
-      pc += m_iMSS;
+      int p = (m_iFirstBlock + i) & (unitsize - 1);
+      data[i] = m_ppcData[p];
+      length[i] = m_piLength[p];
+      userdata[i] = m_ppcUserData[p];
+      lend[i] = m_ppLend[p];
+      msgno[i] = m_piMsgNo[p];
+      origintime[i] = m_pullOriginTime[p];
+      ttl[i] = m_piTTL[p];
    }
 
-   m_iSize += unitsize;
+   m_iCurrBlock = (m_iCurrBlock - m_iFirstBlock) & (unitsize - 1);
+   m_iLastBlock = (m_iLastBlock - m_iFirstBlock) & (unitsize - 1);
+   m_iFirstBlock = 0;
+
+   delete [] m_ppcData;
+   delete [] m_piLength;
+   delete [] m_ppcUserData;
+   delete [] m_ppLend;
+   delete [] m_piMsgNo;
+   delete [] m_pullOriginTime;
+   delete [] m_piTTL;
+
+   m_ppcData = data;
+   m_piLength = length;
+   m_ppcUserData = userdata;
+   m_ppLend = lend;
+   m_piMsgNo = msgno;
+   m_pullOriginTime = origintime;
+   m_piTTL = ttl;
+
+   nbuf->m_pNext = m_pBuffer;
+   m_pBuffer = nbuf;
+
+   m_iSize = size;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -352,19 +579,15 @@ m_iLastAckPos(0),
 m_iMaxPos(0),
 m_iNotch(0)
 {
-   m_pUnit = new CUnit* [m_iSize];
-   for (int i = 0; i < m_iSize; ++ i)
-      m_pUnit[i] = NULL;
 }
 
 CRcvBuffer::~CRcvBuffer()
 {
-   for (int i = 0; i < m_iSize; ++ i)
+   for (int i = 0; (NULL != m_pUnit) && (i < m_iSize); ++ i)
    {
       if (NULL != m_pUnit[i])
       {
-         m_pUnit[i]->m_iFlag = 0;
-         -- m_pUnitQueue->m_iCount;
+         m_pUnitQueue->makeUnitFree(m_pUnit[i]);
       }
    }
 
@@ -373,6 +596,22 @@ CRcvBuffer::~CRcvBuffer()
 
 int CRcvBuffer::addData(CUnit* unit, int offset)
 {
+   // the unit array is allocated when the first packet arrives
+   if (NULL == m_pUnit)
+   {
+      try
+      {
+         m_pUnit = new CUnit* [m_iSize];
+      }
+      catch (...)
+      {
+         return -1;
+      }
+
+      for (int i = 0; i < m_iSize; ++ i)
+         m_pUnit[i] = NULL;
+   }
+
    int pos = (m_iLastAckPos + offset) % m_iSize;
    if (offset > m_iMaxPos)
       m_iMaxPos = offset;
@@ -383,7 +622,6 @@ int CRcvBuffer::addData(CUnit* unit, int offset)
    m_pUnit[pos] = unit;
 
    unit->m_iFlag = 1;
-   ++ m_pUnitQueue->m_iCount;
 
    return 0;
 }
@@ -407,8 +645,7 @@ int CRcvBuffer::readBuffer(char* data, int len)
       {
          CUnit* tmp = m_pUnit[p];
          m_pUnit[p] = NULL;
-         tmp->m_iFlag = 0;
-         -- m_pUnitQueue->m_iCount;
+         m_pUnitQueue->makeUnitFree(tmp);
 
          if (++ p == m_iSize)
             p = 0;
@@ -425,7 +662,29 @@ int CRcvBuffer::readBuffer(char* data, int len)
    return len - rs;
 }
 
-int CRcvBuffer::readBufferToFile(fstream& ofs, int len)
+int CRcvBuffer::peekBuffer(iovec* vec, int num) const
+{
+   int p = m_iStartPos;
+   int lastack = m_iLastAckPos;
+   int notch = m_iNotch;
+   int n = 0;
+
+   while ((p != lastack) && (n < num))
+   {
+      vec[n].iov_base = m_pUnit[p]->m_Packet.m_pcData + notch;
+      vec[n].iov_len = m_pUnit[p]->m_Packet.getLength() - notch;
+      ++ n;
+
+      if (++ p == m_iSize)
+         p = 0;
+
+      notch = 0;
+   }
+
+   return n;
+}
+
+int CRcvBuffer::releaseBuffer(int len)
 {
    int p = m_iStartPos;
    int lastack = m_iLastAckPos;
@@ -435,27 +694,20 @@ int CRcvBuffer::readBufferToFile(fstream& ofs, int len)
    {
       int unitsize = m_pUnit[p]->m_Packet.getLength() - m_iNotch;
       if (unitsize > rs)
-         unitsize = rs;
-
-      ofs.write(m_pUnit[p]->m_Packet.m_pcData + m_iNotch, unitsize);
-      if (ofs.fail())
+      {
+         m_iNotch += rs;
+         rs = 0;
          break;
+      }
 
-      if ((rs > unitsize) || (rs == m_pUnit[p]->m_Packet.getLength() - m_iNotch))
-      {
-         CUnit* tmp = m_pUnit[p];
-         m_pUnit[p] = NULL;
-         tmp->m_iFlag = 0;
-         -- m_pUnitQueue->m_iCount;
+      CUnit* tmp = m_pUnit[p];
+      m_pUnit[p] = NULL;
+      m_pUnitQueue->makeUnitFree(tmp);
 
-         if (++ p == m_iSize)
-            p = 0;
-
-         m_iNotch = 0;
-      }
-      else
-         m_iNotch += rs;
+      if (++ p == m_iSize)
+         p = 0;
 
+      m_iNotch = 0;
       rs -= unitsize;
    }
 
@@ -464,6 +716,45 @@ int CRcvBuffer::readBufferToFile(fstream& ofs, int len)
    return len - rs;
 }
 
+int CRcvBuffer::readBufferToSink(CUDTSink& sink, int64_t offset, int len)
+{
+   const int maxvec = 256;
+   iovec vec[maxvec];
+   int rs = len;
+
+   while (rs > 0)
+   {
+      int n = peekBuffer(vec, maxvec);
+      if (0 == n)
+         break;
+
+      // do not write beyond the requested length
+      int size = 0;
+      for (int i = 0; i < n; ++ i)
+      {
+         if (size + (int)vec[i].iov_len >= rs)
+         {
+            vec[i].iov_len = rs - size;
+            n = i + 1;
+         }
+         size += vec[i].iov_len;
+      }
+
+      int written = sink.write(vec, n, offset);
+      if (written <= 0)
+         return (len == rs) ? -1 : len - rs;
+
+      releaseBuffer(written);
+      offset += written;
+      rs -= written;
+
+      if (written < size)
+         break;
+   }
+
+   return len - rs;
+}
+
 void CRcvBuffer::ackData(int len)
 {
    m_iLastAckPos = (m_iLastAckPos + len) % m_iSize;
@@ -480,6 +771,18 @@ int CRcvBuffer::getAvailBufSize() const
    return m_iSize - getRcvDataSize() - 1;
 }
 
+bool CRcvBuffer::compact()
+{
+   // the reader only visits the units before the ACK position, which are all gone when the buffer is empty
+   if ((NULL == m_pUnit) || (m_iStartPos != m_iLastAckPos) || (m_iMaxPos > 0) || (NULL != m_pUnit[m_iLastAckPos]))
+      return false;
+
+   delete [] m_pUnit;
+   m_pUnit = NULL;
+
+   return true;
+}
+
 int CRcvBuffer::getRcvDataSize() const
 {
    if (m_iLastAckPos >= m_iStartPos)
@@ -520,8 +823,7 @@ int CRcvBuffer::readMsg(char* data, int len)
       {
          CUnit* tmp = m_pUnit[p];
          m_pUnit[p] = NULL;
-         tmp->m_iFlag = 0;
-         -- m_pUnitQueue->m_iCount;
+         m_pUnitQueue->makeUnitFree(tmp);
       }
       else
          m_pUnit[p]->m_iFlag = 2;
@@ -585,8 +887,7 @@ bool CRcvBuffer::scanMsg(int& p, int& q, bool& passack)
 
       CUnit* tmp = m_pUnit[m_iStartPos];
       m_pUnit[m_iStartPos] = NULL;
-      tmp->m_iFlag = 0;
-      -- m_pUnitQueue->m_iCount;
+      m_pUnitQueue->makeUnitFree(tmp);
 
       if (++ m_iStartPos == m_iSize)
          m_iStartPos = 0;
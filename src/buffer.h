@@ -50,7 +50,7 @@ written by
 class CSndBuffer
 {
 public:
-   CSndBuffer(int size = 32, int mss = 1500);
+   CSndBuffer(int size = 32, int mss = 1500, CMemBudget* budget = NULL);
    ~CSndBuffer();
 
       // Functionality:
@@ -66,14 +66,30 @@ public:
    void addBuffer(const char* data, int len, int ttl = -1, bool order = false);
 
       // Functionality:
-      //    Read a block of data from file and insert it into the sending list.
+      //    Insert a user buffer into the sending list without copying it, the packets point into the user memory.
       // Parameters:
-      //    0) [in] ifs: input file stream.
+      //    0) [in] data: pointer to the user data block, which must not be changed or freed until the callback.
       //    1) [in] len: size of the block.
+      //    2) [in] ttl: time to live in milliseconds
+      //    3) [in] order: if the block should be delivered in order, for DGRAM only
+      //    4) [in] u: UDT socket ID passed to the callback.
+      //    5) [in] callback: called when all the packets of the block are acknowledged, or the buffer is released, may be NULL.
+      //    6) [in] arg: user argument passed to the callback.
+      // Returned value:
+      //    None.
+
+   void lendBuffer(const char* data, int len, int ttl, bool order, UDTSOCKET u, UDTSENDCB callback, void* arg);
+
+      // Functionality:
+      //    Read a block of data from a data source and insert it into the sending list.
+      // Parameters:
+      //    0) [in] src: the data source.
+      //    1) [in] offset: position of the block in the source.
+      //    2) [in] len: size of the block.
       // Returned value:
-      //    actual size of data added from the file.
+      //    actual size of data added, 0 at the end of the source, or -1 on read failure.
 
-   int addBufferFromFile(std::fstream& ifs, int len);
+   int addBufferFromSource(CUDTSource& src, int64_t offset, int len);
 
       // Functionality:
       //    Find data position to pack a DATA packet from the furthest reading point.
@@ -115,28 +131,59 @@ public:
 
    int getCurrBufSize() const;
 
+      // Functionality:
+      //    Query how many packets the buffer can hold without growing beyond the memory budget.
+      // Parameters:
+      //    0) [in] limit: the largest size wanted, in number of packets.
+      // Returned value:
+      //    Size of the buffer, not larger than the limit.
+
+   int getMaxBufSize(int limit) const;
+
+      // Functionality:
+      //    Release the memory of an empty buffer, it is allocated again when data is inserted.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    true if the memory is released, otherwise false.
+
+   bool compact();
+
 private:
+   void create();
+   void destroy();
    void increase();
 
+   struct Lend;
+   void insert(const char* data, int len, int ttl, bool order, Lend* lend);
+
 private:
    pthread_mutex_t m_BufLock;           // used to synchronize buffer operation
 
-   struct Block
+   struct Lend
    {
-      char* m_pcData;                   // pointer to the data block
-      int m_iLength;                    // length of the block
+      const char* m_pcData;             // the user buffer
+      int m_iLength;                    // size of the user buffer
+      UDTSOCKET m_iSocket;              // UDT socket ID
+      UDTSENDCB m_pCallback;            // completion callback
+      void* m_pArg;                     // user argument of the callback
+   };
 
-      int32_t m_iMsgNo;                 // message number
-      uint64_t m_OriginTime;            // original request time
-      int m_iTTL;                       // time to live (milliseconds)
+   // The blocks form a ring of a power-of-two size, located by their offset from the first block. Each field
+   // of the blocks is kept in its own array, so that scanning the message numbers and TTLs touches little memory.
 
-      Block* m_pNext;                   // next block
-   } *m_pBlock, *m_pFirstBlock, *m_pCurrBlock, *m_pLastBlock;
+   char** m_ppcData;                    // pointer to the data block, the arrays are NULL until data is inserted
+   int* m_piLength;                     // length of the block
+   char** m_ppcUserData;                // pointer to the lent user data, NULL if the data is copied into the data block
+   Lend** m_ppLend;                     // the lent user buffer that ends at the block, otherwise NULL
 
-   // m_pBlock:         The head pointer
-   // m_pFirstBlock:    The first block
-   // m_pCurrBlock:	The current block
-   // m_pLastBlock:     The last block (if first == last, buffer is empty)
+   int32_t* m_piMsgNo;                  // message number
+   uint64_t* m_pullOriginTime;          // original request time
+   int* m_piTTL;                        // time to live (milliseconds)
+
+   int m_iFirstBlock;                   // the first block
+   int m_iCurrBlock;                    // the current block
+   int m_iLastBlock;                    // the last block (if first == last, buffer is empty)
 
    struct Buffer
    {
@@ -147,10 +194,14 @@ private:
 
    int32_t m_iNextMsgNo;                // next message number
 
-   int m_iSize;				// buffer size (number of packets)
+   int m_iSize;				// buffer size (number of packets), a power of 2
+   int m_iInitSize;			// buffer size when the memory is allocated
    int m_iMSS;                          // maximum seqment/packet size
 
    int m_iCount;			// number of used blocks
+   int m_iLendCount;                    // number of lent user buffers not acknowledged yet
+
+   CMemBudget* m_pBudget;               // memory budget shared with the other buffers of the multiplexer
 
 private:
    CSndBuffer(const CSndBuffer&);
@@ -186,14 +237,34 @@ public:
    int readBuffer(char* data, int len);
 
       // Functionality:
-      //    Read data directly into file.
+      //    Write data directly into a data sink, without any intermediate copy.
       // Parameters:
-      //    0) [in] file: C++ file stream.
-      //    1) [in] len: expected length of data to write into the file.
+      //    0) [in] sink: the data sink.
+      //    1) [in] offset: position in the sink to write the data.
+      //    2) [in] len: expected length of data to write.
       // Returned value:
-      //    size of data read.
+      //    size of data written, or -1 on write failure.
+
+   int readBufferToSink(CUDTSink& sink, int64_t offset, int len);
+
+      // Functionality:
+      //    Expose the received data in place, without reading it out of the buffer.
+      // Parameters:
+      //    0) [out] vec: array of vectors pointing to the packet payloads, in order.
+      //    1) [in] num: size of the array.
+      // Returned value:
+      //    number of vectors filled.
 
-   int readBufferToFile(std::fstream& ofs, int len);
+   int peekBuffer(iovec* vec, int num) const;
+
+      // Functionality:
+      //    Remove data from the head of the buffer and return the fully consumed units to the unit queue.
+      // Parameters:
+      //    0) [in] len: size of data to be removed.
+      // Returned value:
+      //    size of data removed.
+
+   int releaseBuffer(int len);
 
       // Functionality:
       //    Update the ACK point of the buffer.
@@ -222,6 +293,15 @@ public:
 
    int getRcvDataSize() const;
 
+      // Functionality:
+      //    Release the unit array of an empty buffer, it is allocated again when a packet arrives.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    true if the array is released, otherwise false.
+
+   bool compact();
+
       // Functionality:
       //    mark the message to be dropped from the message list.
       // Parameters:
@@ -254,7 +334,7 @@ private:
    bool scanMsg(int& start, int& end, bool& passack);
 
 private:
-   CUnit** m_pUnit;                     // pointer to the protocol buffer
+   CUnit** m_pUnit;                     // pointer to the protocol buffer, NULL while the buffer is compacted
    int m_iSize;                         // size of the protocol buffer
    CUnitQueue* m_pUnitQueue;		// the shared unit queue
 
@@ -53,8 +53,14 @@ written by
       #include <wspiapi.h>
    #endif
 #endif
+#ifdef LINUX
+   #include <netinet/in.h>
+   #include <netinet/udp.h>
+   #include <linux/filter.h>
+#endif
 #include "channel.h"
 #include "packet.h"
+#include "common.h"
 
 #ifdef WIN32
    #define socklen_t int
@@ -66,13 +72,43 @@ written by
    #define NET_ERROR WSAGetLastError()
 #endif
 
+#ifdef LINUX
+   // offload options may be missing from old system headers, support is probed at run time
+   #ifndef UDP_SEGMENT
+      #define UDP_SEGMENT 103
+   #endif
+   #ifndef UDP_GRO
+      #define UDP_GRO 104
+   #endif
+   #ifndef SO_REUSEPORT
+      #define SO_REUSEPORT 15
+   #endif
+   #ifndef SO_ATTACH_REUSEPORT_CBPF
+      #define SO_ATTACH_REUSEPORT_CBPF 51
+   #endif
+#endif
+
+const int CChannel::m_iMaxBatchSize = 64;
+
+// maximum number of segments and bytes the kernel accepts in one GSO buffer
+static const int GSO_MAX_SEGMENTS = 64;
+static const int GSO_MAX_SIZE = 65507;
+
 
 CChannel::CChannel():
 m_iIPversion(AF_INET),
 m_iSockAddrSize(sizeof(sockaddr_in)),
 m_iSocket(),
 m_iSndBufSize(65536),
-m_iRcvBufSize(65536)
+m_iRcvBufSize(65536),
+m_bReusePort(false),
+m_bGSO(false),
+m_bGRO(false),
+m_pcGROBuffer(NULL),
+m_iGROLength(0),
+m_iGROOffset(0),
+m_iGROSegSize(0),
+m_pGROAddr(NULL)
 {
 }
 
@@ -80,13 +116,27 @@ CChannel::CChannel(int version):
 m_iIPversion(version),
 m_iSocket(),
 m_iSndBufSize(65536),
-m_iRcvBufSize(65536)
+m_iRcvBufSize(65536),
+m_bReusePort(false),
+m_bGSO(false),
+m_bGRO(false),
+m_pcGROBuffer(NULL),
+m_iGROLength(0),
+m_iGROOffset(0),
+m_iGROSegSize(0),
+m_pGROAddr(NULL)
 {
    m_iSockAddrSize = (AF_INET == m_iIPversion) ? sizeof(sockaddr_in) : sizeof(sockaddr_in6);
 }
 
 CChannel::~CChannel()
 {
+   delete [] m_pcGROBuffer;
+
+   if (AF_INET == m_iIPversion)
+      delete (sockaddr_in*)m_pGROAddr;
+   else
+      delete (sockaddr_in6*)m_pGROAddr;
 }
 
 void CChannel::open(const sockaddr* addr)
@@ -101,6 +151,16 @@ void CChannel::open(const sockaddr* addr)
    #endif
       throw CUDTException(1, 0, NET_ERROR);
 
+   #ifdef LINUX
+      if (m_bReusePort)
+      {
+         // without SO_REUSEPORT support the port will not be shared, the caller finds out when the next bind fails
+         int reuse = 1;
+         if (0 != ::setsockopt(m_iSocket, SOL_SOCKET, SO_REUSEPORT, (char*)&reuse, sizeof(int)))
+            m_bReusePort = false;
+      }
+   #endif
+
    if (NULL != addr)
    {
       socklen_t namelen = m_iSockAddrSize;
@@ -154,31 +214,61 @@ void CChannel::setUDPSockOpt()
          throw CUDTException(1, 3, NET_ERROR);
    #endif
 
-   timeval tv;
-   tv.tv_sec = 0;
-   #if defined (BSD) || defined (OSX)
-      // Known BSD bug as the day I wrote this code.
-      // A small time out value will cause the socket to block forever.
-      tv.tv_usec = 10000;
-   #else
-      tv.tv_usec = 100;
-   #endif
-
    #ifdef UNIX
       // Set non-blocking I/O
       // UNIX does not support SO_RCVTIMEO
       int opts = ::fcntl(m_iSocket, F_GETFL);
       if (-1 == ::fcntl(m_iSocket, F_SETFL, opts | O_NONBLOCK))
          throw CUDTException(1, 3, NET_ERROR);
+   #elif defined(LINUX)
+      // the receiving queue waits for the socket with its timer and reads with MSG_DONTWAIT,
+      // sends stay blocking so that a full socket buffer delays a burst instead of dropping it
    #elif WIN32
       DWORD ot = 1; //milliseconds
       if (0 != ::setsockopt(m_iSocket, SOL_SOCKET, SO_RCVTIMEO, (char *)&ot, sizeof(DWORD)))
          throw CUDTException(1, 3, NET_ERROR);
    #else
+      timeval tv;
+      tv.tv_sec = 0;
+      #if defined (BSD) || defined (OSX)
+         // Known BSD bug as the day I wrote this code.
+         // A small time out value will cause the socket to block forever.
+         tv.tv_usec = 10000;
+      #else
+         tv.tv_usec = 100;
+      #endif
+
       // Set receiving time-out value
       if (0 != ::setsockopt(m_iSocket, SOL_SOCKET, SO_RCVTIMEO, (char *)&tv, sizeof(timeval)))
          throw CUDTException(1, 3, NET_ERROR);
    #endif
+
+   #ifdef LINUX
+      // probe the segmentation offload support, fall back to regular datagrams silently if not available
+      if (m_bGSO)
+      {
+         int gso = 0;
+         socklen_t size = sizeof(int);
+         if (0 != ::getsockopt(m_iSocket, IPPROTO_UDP, UDP_SEGMENT, (char*)&gso, &size))
+            m_bGSO = false;
+      }
+
+      if (m_bGRO)
+      {
+         int gro = 1;
+         if (0 != ::setsockopt(m_iSocket, IPPROTO_UDP, UDP_GRO, (char*)&gro, sizeof(int)))
+            m_bGRO = false;
+      }
+
+      if (m_bGRO && (NULL == m_pcGROBuffer))
+      {
+         m_pcGROBuffer = new char[65536];
+         m_pGROAddr = (AF_INET == m_iIPversion) ? (sockaddr*) new sockaddr_in : (sockaddr*) new sockaddr_in6;
+      }
+   #else
+      m_bGSO = false;
+      m_bGRO = false;
+   #endif
 }
 
 void CChannel::close() const
@@ -214,12 +304,65 @@ void CChannel::setRcvBufSize(int size)
    m_iRcvBufSize = size;
 }
 
+void CChannel::setReusePort(bool reuse)
+{
+   m_bReusePort = reuse;
+}
+
+int CChannel::setShardFilter(int num)
+{
+   #ifdef LINUX
+      // the socket ID is the last field of the UDT header, offset 12 of the UDP payload
+      sock_filter code[] = {
+         {BPF_LD | BPF_W | BPF_ABS, 0, 0, 12},
+         {BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)num},
+         {BPF_RET | BPF_A, 0, 0, 0}
+      };
+
+      sock_fprog prog;
+      prog.len = sizeof(code) / sizeof(sock_filter);
+      prog.filter = code;
+
+      if (0 != ::setsockopt(m_iSocket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, (char*)&prog, sizeof(prog)))
+         return -1;
+
+      return 0;
+   #else
+      return -1;
+   #endif
+}
+
+void CChannel::setGSO(bool enable)
+{
+   m_bGSO = enable;
+}
+
+void CChannel::setGRO(bool enable)
+{
+   m_bGRO = enable;
+}
+
+bool CChannel::getGSO() const
+{
+   return m_bGSO;
+}
+
+bool CChannel::getGRO() const
+{
+   return m_bGRO;
+}
+
 void CChannel::getSockAddr(sockaddr* addr) const
 {
    socklen_t namelen = m_iSockAddrSize;
    ::getsockname(m_iSocket, addr, &namelen);
 }
 
+UDPSOCKET CChannel::getSocket() const
+{
+   return m_iSocket;
+}
+
 void CChannel::getPeerAddr(sockaddr* addr) const
 {
    socklen_t namelen = m_iSockAddrSize;
@@ -280,6 +423,135 @@ int CChannel::sendto(const sockaddr* addr, CPacket& packet) const
    return res;
 }
 
+int CChannel::sendto(sockaddr** addr, CPacket** packet, int num) const
+{
+   #ifdef LINUX
+      mmsghdr mh[m_iMaxBatchSize];
+      iovec iov[m_iMaxBatchSize * 2];
+      char control[m_iMaxBatchSize][CMSG_SPACE(sizeof(uint16_t))];
+      int first[m_iMaxBatchSize];
+      int count[m_iMaxBatchSize];
+      int sent = 0;
+
+      while (sent < num)
+      {
+         int n = num - sent;
+         if (n > m_iMaxBatchSize)
+            n = m_iMaxBatchSize;
+
+         CPacket** pkts = packet + sent;
+         sockaddr** addrs = addr + sent;
+
+         // convert the packets into network order
+         for (int i = 0; i < n; ++ i)
+            toNetworkOrder(*pkts[i]);
+
+         // build the messages, each one is either a single packet or a GSO buffer
+         int msgs = 0;
+         for (int i = 0; i < n; )
+         {
+            int segsize = CPacket::m_iPktHdrSize + pkts[i]->getLength();
+            int total = segsize;
+            int j = i + 1;
+
+            // all segments but the last one must have the same size
+            if (m_bGSO)
+            {
+               while ((j < n) && (j - i < GSO_MAX_SEGMENTS) && CIPAddress::ipcmp(addrs[i], addrs[j], m_iIPversion))
+               {
+                  int size = CPacket::m_iPktHdrSize + pkts[j]->getLength();
+                  if ((size > segsize) || (total + size > GSO_MAX_SIZE))
+                     break;
+
+                  total += size;
+                  ++ j;
+
+                  if (size < segsize)
+                     break;
+               }
+            }
+
+            for (int k = i; k < j; ++ k)
+            {
+               iov[k * 2] = pkts[k]->m_PacketVector[0];
+               iov[k * 2 + 1] = pkts[k]->m_PacketVector[1];
+            }
+
+            mh[msgs].msg_hdr.msg_name = addrs[i];
+            mh[msgs].msg_hdr.msg_namelen = m_iSockAddrSize;
+            mh[msgs].msg_hdr.msg_iov = iov + i * 2;
+            mh[msgs].msg_hdr.msg_iovlen = (j - i) * 2;
+            mh[msgs].msg_hdr.msg_control = NULL;
+            mh[msgs].msg_hdr.msg_controllen = 0;
+            mh[msgs].msg_hdr.msg_flags = 0;
+            mh[msgs].msg_len = 0;
+
+            if (j - i > 1)
+            {
+               mh[msgs].msg_hdr.msg_control = control[msgs];
+               mh[msgs].msg_hdr.msg_controllen = sizeof(control[msgs]);
+               cmsghdr* cm = CMSG_FIRSTHDR(&mh[msgs].msg_hdr);
+               cm->cmsg_level = IPPROTO_UDP;
+               cm->cmsg_type = UDP_SEGMENT;
+               cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+               *(uint16_t*)CMSG_DATA(cm) = segsize;
+            }
+
+            first[msgs] = i;
+            count[msgs] = j - i;
+            ++ msgs;
+
+            i = j;
+         }
+
+         // sendmmsg stops at the first failure; that packet is dropped, just like a failed sendmsg
+         int done = 0;
+         while (done < msgs)
+         {
+            int res = ::sendmmsg(m_iSocket, mh + done, msgs - done, 0);
+            if (res > 0)
+            {
+               done += res;
+               continue;
+            }
+
+            // the device may refuse the GSO buffer, then send its packets one by one
+            if (count[done] > 1)
+            {
+               for (int k = first[done]; k < first[done] + count[done]; ++ k)
+               {
+                  msghdr single;
+                  single.msg_name = addrs[k];
+                  single.msg_namelen = m_iSockAddrSize;
+                  single.msg_iov = pkts[k]->m_PacketVector;
+                  single.msg_iovlen = 2;
+                  single.msg_control = NULL;
+                  single.msg_controllen = 0;
+                  single.msg_flags = 0;
+                  ::sendmsg(m_iSocket, &single, 0);
+               }
+            }
+
+            ++ done;
+         }
+
+         // convert back into local host order
+         for (int i = 0; i < n; ++ i)
+            toHostOrder(*pkts[i]);
+
+         sent += n;
+      }
+
+      return sent;
+   #else
+      // no batched transmission on this platform, send one packet at a time
+      for (int i = 0; i < num; ++ i)
+         sendto(addr[i], *packet[i]);
+
+      return num;
+   #endif
+}
+
 int CChannel::recvfrom(sockaddr* addr, CPacket& packet) const
 {
    #ifndef WIN32
@@ -302,7 +574,11 @@ int CChannel::recvfrom(sockaddr* addr, CPacket& packet) const
          ::select(m_iSocket+1, &set, NULL, &set, &tv);
       #endif
 
-      int res = ::recvmsg(m_iSocket, &mh, 0);
+      #ifdef LINUX
+         int res = ::recvmsg(m_iSocket, &mh, MSG_DONTWAIT);
+      #else
+         int res = ::recvmsg(m_iSocket, &mh, 0);
+      #endif
    #else
       DWORD size = CPacket::m_iPktHdrSize + packet.getLength();
       DWORD flag = 0;
@@ -338,3 +614,164 @@ int CChannel::recvfrom(sockaddr* addr, CPacket& packet) const
 
    return packet.getLength();
 }
+
+int CChannel::recvfrom(sockaddr** addr, CPacket** packet, int num)
+{
+   if (num > m_iMaxBatchSize)
+      num = m_iMaxBatchSize;
+
+   if (m_bGRO)
+      return recvGRO(addr, packet, num);
+
+   if (num <= 1)
+   {
+      if ((num <= 0) || (recvfrom(addr[0], *packet[0]) < 0))
+         return -1;
+
+      return 1;
+   }
+
+   #ifdef LINUX
+      mmsghdr mh[m_iMaxBatchSize];
+      for (int i = 0; i < num; ++ i)
+      {
+         mh[i].msg_hdr.msg_name = addr[i];
+         mh[i].msg_hdr.msg_namelen = m_iSockAddrSize;
+         mh[i].msg_hdr.msg_iov = packet[i]->m_PacketVector;
+         mh[i].msg_hdr.msg_iovlen = 2;
+         mh[i].msg_hdr.msg_control = NULL;
+         mh[i].msg_hdr.msg_controllen = 0;
+         mh[i].msg_hdr.msg_flags = 0;
+         mh[i].msg_len = 0;
+      }
+
+      // the timer has already waited for the socket, take whatever is queued without blocking
+      int res = ::recvmmsg(m_iSocket, mh, num, MSG_WAITFORONE | MSG_DONTWAIT, NULL);
+
+      if (res <= 0)
+         return -1;
+
+      for (int i = 0; i < res; ++ i)
+      {
+         CPacket& pkt = *packet[i];
+
+         if ((int)mh[i].msg_len < CPacket::m_iPktHdrSize)
+         {
+            // runt datagram, mark it as invalid so that the caller will ignore it
+            pkt.setLength(-1);
+            continue;
+         }
+
+         pkt.setLength(mh[i].msg_len - CPacket::m_iPktHdrSize);
+         toHostOrder(pkt);
+      }
+
+      return res;
+   #else
+      // no batched receive on this platform, read one packet at a time
+      if (recvfrom(addr[0], *packet[0]) < 0)
+         return -1;
+
+      return 1;
+   #endif
+}
+
+int CChannel::recvGRO(sockaddr** addr, CPacket** packet, int num)
+{
+   #ifdef LINUX
+      if (m_iGROOffset >= m_iGROLength)
+      {
+         // nothing left from the previous datagram, read the next one, which may be coalesced
+         iovec iov;
+         iov.iov_base = m_pcGROBuffer;
+         iov.iov_len = 65536;
+
+         char control[CMSG_SPACE(sizeof(int))];
+
+         msghdr mh;
+         mh.msg_name = m_pGROAddr;
+         mh.msg_namelen = m_iSockAddrSize;
+         mh.msg_iov = &iov;
+         mh.msg_iovlen = 1;
+         mh.msg_control = control;
+         mh.msg_controllen = sizeof(control);
+         mh.msg_flags = 0;
+
+         int res = ::recvmsg(m_iSocket, &mh, MSG_DONTWAIT);
+         if (res <= 0)
+            return -1;
+
+         m_iGROLength = res;
+         m_iGROOffset = 0;
+         m_iGROSegSize = res;
+
+         for (cmsghdr* cm = CMSG_FIRSTHDR(&mh); NULL != cm; cm = CMSG_NXTHDR(&mh, cm))
+         {
+            if ((IPPROTO_UDP == cm->cmsg_level) && (UDP_GRO == cm->cmsg_type))
+               m_iGROSegSize = *(int*)CMSG_DATA(cm);
+         }
+
+         if (m_iGROSegSize <= 0)
+            m_iGROSegSize = res;
+      }
+
+      // split the datagram into packets, every segment but the last one has the same size
+      int n = 0;
+      while ((n < num) && (m_iGROOffset < m_iGROLength))
+      {
+         int size = m_iGROLength - m_iGROOffset;
+         if (size > m_iGROSegSize)
+            size = m_iGROSegSize;
+
+         CPacket& pkt = *packet[n];
+         memcpy(addr[n], m_pGROAddr, m_iSockAddrSize);
+
+         if ((size < CPacket::m_iPktHdrSize) || (size - CPacket::m_iPktHdrSize > pkt.getLength()))
+            pkt.setLength(-1);
+         else
+         {
+            memcpy(pkt.m_nHeader, m_pcGROBuffer + m_iGROOffset, CPacket::m_iPktHdrSize);
+            memcpy(pkt.m_pcData, m_pcGROBuffer + m_iGROOffset + CPacket::m_iPktHdrSize, size - CPacket::m_iPktHdrSize);
+            pkt.setLength(size - CPacket::m_iPktHdrSize);
+            toHostOrder(pkt);
+         }
+
+         m_iGROOffset += size;
+         ++ n;
+      }
+
+      return n;
+   #else
+      return -1;
+   #endif
+}
+
+void CChannel::toNetworkOrder(CPacket& packet)
+{
+   if (packet.getFlag())
+      for (int i = 0, n = packet.getLength() / 4; i < n; ++ i)
+         *((uint32_t *)packet.m_pcData + i) = htonl(*((uint32_t *)packet.m_pcData + i));
+
+   uint32_t* p = packet.m_nHeader;
+   for (int j = 0; j < 4; ++ j)
+   {
+      *p = htonl(*p);
+      ++ p;
+   }
+}
+
+void CChannel::toHostOrder(CPacket& packet)
+{
+   uint32_t* p = packet.m_nHeader;
+   for (int i = 0; i < 4; ++ i)
+   {
+      *p = ntohl(*p);
+      ++ p;
+   }
+
+   if (packet.getFlag())
+   {
+      for (int j = 0, n = packet.getLength() / 4; j < n; ++ j)
+         *((uint32_t *)packet.m_pcData + j) = ntohl(*((uint32_t *)packet.m_pcData + j));
+   }
+}
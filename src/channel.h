@@ -116,6 +116,61 @@ public:
 
    void setRcvBufSize(int size);
 
+      // Functionality:
+      //    Request UDP segmentation offload (GSO) for batched sending, probed when the channel is opened.
+      // Parameters:
+      //    0) [in] enable: if GSO should be used.
+      // Returned value:
+      //    None.
+
+   void setGSO(bool enable);
+
+      // Functionality:
+      //    Request UDP receive offload (GRO) for batched receiving, probed when the channel is opened.
+      // Parameters:
+      //    0) [in] enable: if GRO should be used.
+      // Returned value:
+      //    None.
+
+   void setGRO(bool enable);
+
+      // Functionality:
+      //    Query if GSO is in use, i.e., requested and supported by the system.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    true if GSO is in use, otherwise false.
+
+   bool getGSO() const;
+
+      // Functionality:
+      //    Query if GRO is in use, i.e., requested and supported by the system.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    true if GRO is in use, otherwise false.
+
+   bool getGRO() const;
+
+      // Functionality:
+      //    Allow other channels to bind to the same UDP port (SO_REUSEPORT), must be called before open.
+      // Parameters:
+      //    0) [in] reuse: if the port can be shared.
+      // Returned value:
+      //    None.
+
+   void setReusePort(bool reuse);
+
+      // Functionality:
+      //    Make the kernel deliver each packet to the channel of the port group selected by its
+      //    destination UDT socket ID (ID modulo the number of channels, in the order they were opened).
+      // Parameters:
+      //    0) [in] num: number of channels sharing the port.
+      // Returned value:
+      //    0 on success, -1 if not supported.
+
+   int setShardFilter(int num);
+
       // Functionality:
       //    Query the socket address that the channel is using.
       // Parameters:
@@ -134,6 +189,15 @@ public:
 
    void getPeerAddr(sockaddr* addr) const;
 
+      // Functionality:
+      //    Query the UDP socket descriptor of the channel, to wait for incoming packets.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    The UDP socket descriptor.
+
+   UDPSOCKET getSocket() const;
+
       // Functionality:
       //    Send a packet to the given address.
       // Parameters:
@@ -144,6 +208,18 @@ public:
 
    int sendto(const sockaddr* addr, CPacket& packet) const;
 
+      // Functionality:
+      //    Send a batch of packets, each to its own address, with as few system calls as possible.
+      //    With GSO, consecutive packets of the same size to the same address are sent as one buffer.
+      // Parameters:
+      //    0) [in] addr: array of pointers to the destination addresses, one per packet.
+      //    1) [in] packet: array of pointers to CPacket entities to be sent.
+      //    2) [in] num: number of entries in the arrays.
+      // Returned value:
+      //    Number of packets sent.
+
+   int sendto(sockaddr** addr, CPacket** packet, int num) const;
+
       // Functionality:
       //    Receive a packet from the channel and record the source address.
       // Parameters:
@@ -154,8 +230,27 @@ public:
 
    int recvfrom(sockaddr* addr, CPacket& packet) const;
 
+      // Functionality:
+      //    Receive a batch of packets from the channel with as few system calls as possible.
+      //    With GRO, coalesced datagrams are split into packets, and the remainder is kept for the next call.
+      // Parameters:
+      //    0) [in] addr: array of pointers to the source addresses, one per packet.
+      //    1) [in] packet: array of pointers to CPacket entities to be filled.
+      //    2) [in] num: number of entries in the arrays.
+      // Returned value:
+      //    Number of packets received, or -1 if nothing has been received.
+
+   int recvfrom(sockaddr** addr, CPacket** packet, int num);
+
+public:
+   static const int m_iMaxBatchSize;    // maximum number of packets handled by one batched system call
+
 private:
    void setUDPSockOpt();
+   int recvGRO(sockaddr** addr, CPacket** packet, int num);
+
+   static void toNetworkOrder(CPacket& packet);
+   static void toHostOrder(CPacket& packet);
 
 private:
    int m_iIPversion;                    // IP version
@@ -165,6 +260,17 @@ private:
 
    int m_iSndBufSize;                   // UDP sending buffer size
    int m_iRcvBufSize;                   // UDP receiving buffer size
+
+   bool m_bReusePort;                   // if the UDP port is shared by multiple channels
+
+   bool m_bGSO;                         // if UDP segmentation offload is used for sending
+   bool m_bGRO;                         // if UDP receive offload is used for receiving
+
+   char* m_pcGROBuffer;                 // buffer for coalesced datagrams
+   int m_iGROLength;                    // size of the coalesced datagram in the buffer
+   int m_iGROOffset;                    // position of the next packet to be split from the buffer
+   int m_iGROSegSize;                   // size of each packet in the coalesced datagram
+   sockaddr* m_pGROAddr;                // source address of the coalesced datagram
 };
 
 
@@ -43,9 +43,15 @@ written by
    #include <cstring>
    #include <cerrno>
    #include <unistd.h>
+   #include <sys/mman.h>
    #ifdef OSX
       #include <mach/mach_time.h>
    #endif
+   #ifdef LINUX
+      #include <sys/epoll.h>
+      #include <sys/eventfd.h>
+      #include <sys/timerfd.h>
+   #endif
 #else
    #include <winsock2.h>
    #include <ws2tcpip.h>
@@ -55,6 +61,7 @@ written by
 #endif
 
 #include <cmath>
+#include <new>
 #include "md5.h"
 #include "common.h"
 
@@ -80,10 +87,32 @@ m_TickLock()
       m_TickLock = CreateMutex(NULL, false, NULL);
       m_TickCond = CreateEvent(NULL, false, false, NULL);
    #endif
+
+   #ifdef LINUX
+      // the timer sleeps in epoll_wait, woken up by the timerfd (schedulled time) or the eventfd (interrupt)
+      m_iEPollFD = ::epoll_create(2);
+      m_iTimerFD = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+      m_iEventFD = ::eventfd(0, EFD_NONBLOCK);
+      m_iWatchFD = -1;
+
+      epoll_event ev;
+      memset(&ev, 0, sizeof(epoll_event));
+      ev.events = EPOLLIN;
+      ev.data.fd = m_iTimerFD;
+      ::epoll_ctl(m_iEPollFD, EPOLL_CTL_ADD, m_iTimerFD, &ev);
+      ev.data.fd = m_iEventFD;
+      ::epoll_ctl(m_iEPollFD, EPOLL_CTL_ADD, m_iEventFD, &ev);
+   #endif
 }
 
 CTimer::~CTimer()
 {
+   #ifdef LINUX
+      ::close(m_iEPollFD);
+      ::close(m_iTimerFD);
+      ::close(m_iEventFD);
+   #endif
+
    #ifndef WIN32
       pthread_mutex_destroy(&m_TickLock);
       pthread_cond_destroy(&m_TickCond);
@@ -190,7 +219,12 @@ void CTimer::sleepto(uint64_t nexttime)
 
    while (t < m_ullSchedTime)
    {
-      #ifndef NO_BUSY_WAITING
+      #ifdef LINUX
+         // no busy waiting and no fixed granularity, the timerfd fires at the schedulled time;
+         // the eventfd stays signalled, so an interrupt() that came before this call still stops the sleep
+         if (wait(m_ullSchedTime) < 0)
+            break;
+      #elif !defined(NO_BUSY_WAITING)
          #ifdef IA32
             __asm__ volatile ("pause; rep; nop; nop; nop; nop; nop;");
          #elif IA64
@@ -234,13 +268,82 @@ void CTimer::interrupt()
 
 void CTimer::tick()
 {
-   #ifndef WIN32
+   #ifdef LINUX
+      uint64_t one = 1;
+      if (sizeof(uint64_t) != ::write(m_iEventFD, &one, sizeof(uint64_t)))
+         return;
+   #elif !defined(WIN32)
       pthread_cond_signal(&m_TickCond);
    #else
       SetEvent(m_TickCond);
    #endif
 }
 
+#ifdef LINUX
+bool CTimer::waitfor(int fd, uint64_t nexttime)
+{
+   if (fd != m_iWatchFD)
+   {
+      epoll_event ev;
+      memset(&ev, 0, sizeof(epoll_event));
+      ev.events = EPOLLIN;
+      ev.data.fd = fd;
+      if (0 != ::epoll_ctl(m_iEPollFD, EPOLL_CTL_ADD, fd, &ev))
+         return false;
+
+      if (-1 != m_iWatchFD)
+         ::epoll_ctl(m_iEPollFD, EPOLL_CTL_DEL, m_iWatchFD, NULL);
+      m_iWatchFD = fd;
+   }
+
+   return wait(nexttime) > 0;
+}
+
+int CTimer::wait(uint64_t nexttime)
+{
+   // arm the timer, or disarm it if there is no deadline
+   itimerspec its;
+   memset(&its, 0, sizeof(itimerspec));
+   if (0 != nexttime)
+   {
+      uint64_t t;
+      rdtsc(t);
+
+      // a deadline in the past is not an error, just wake up as soon as possible
+      uint64_t interval = (nexttime > t) ? (nexttime - t) * 1000 / s_ullCPUFrequency : 0;
+      if (0 == interval)
+         interval = 1;
+      its.it_value.tv_sec = interval / 1000000000;
+      its.it_value.tv_nsec = interval % 1000000000;
+   }
+   ::timerfd_settime(m_iTimerFD, 0, &its, NULL);
+
+   epoll_event ev[3];
+   int n = ::epoll_wait(m_iEPollFD, ev, 3, -1);
+
+   // 1 if the watched descriptor is readable, -1 if interrupted, otherwise 0
+   int ready = 0;
+   for (int i = 0; i < n; ++ i)
+   {
+      if (ev[i].data.fd == m_iWatchFD)
+      {
+         ready = 1;
+         continue;
+      }
+
+      // clear the timerfd or the eventfd
+      uint64_t count;
+      if (sizeof(uint64_t) != ::read(ev[i].data.fd, &count, sizeof(uint64_t)))
+         continue;
+
+      if ((ev[i].data.fd == m_iEventFD) && (0 == ready))
+         ready = -1;
+   }
+
+   return ready;
+}
+#endif
+
 uint64_t CTimer::getTime()
 {
    //For Cygwin and other systems without microsecond level resolution, uncomment the following three lines
@@ -418,6 +521,16 @@ m_strMsg()
 {
 }
 
+CUDTException& CUDTException::operator=(const CUDTException& e)
+{
+   m_iMajor = e.m_iMajor;
+   m_iMinor = e.m_iMinor;
+   m_iErrno = e.m_iErrno;
+   m_strMsg.clear();
+
+   return *this;
+}
+
 CUDTException::~CUDTException()
 {
 }
@@ -579,6 +692,10 @@ const char* CUDTException::getErrorMessage()
            m_strMsg += ": Invalid epoll ID";
            break;
 
+        case 14:
+           m_strMsg += ": Invalid completion queue ID";
+           break;
+
         default:
            break;
         }
@@ -598,6 +715,10 @@ const char* CUDTException::getErrorMessage()
            m_strMsg += ": no data available for reading";
            break;
 
+        case 4:
+           m_strMsg += ": completion queue is full";
+           break;
+
         default:
            break;
         }
@@ -680,10 +801,12 @@ const int CUDTException::EDGRAMILL = 5010;
 const int CUDTException::EDUPLISTEN = 5011;
 const int CUDTException::ELARGEMSG = 5012;
 const int CUDTException::EINVPOLLID = 5013;
+const int CUDTException::EINVAIOID = 5014;
 const int CUDTException::EASYNCFAIL = 6000;
 const int CUDTException::EASYNCSND = 6001;
 const int CUDTException::EASYNCRCV = 6002;
 const int CUDTException::ETIMEOUT = 6003;
+const int CUDTException::EAIOFULL = 6004;
 const int CUDTException::EPEERERR = 7000;
 const int CUDTException::EUNKNOWN = -1;
 
@@ -763,3 +886,123 @@ void CMD5::compute(const char* input, unsigned char result[16])
    md5_append(&state, (const md5_byte_t *)input, strlen(input));
    md5_finish(&state, result);
 }
+
+//
+const int CPktAllocator::m_iHugePageSize = 1 << 21;
+
+#ifndef WIN32
+// slabs are mapped in whole huge pages
+static size_t slabSize(int size)
+{
+   size_t page = CPktAllocator::m_iHugePageSize;
+   return (size + page - 1) / page * page;
+}
+#endif
+
+char* CPktAllocator::allocate(int size)
+{
+   // small slabs come from the heap, a mapping for each would soon exhaust the mappings allowed for a process
+   if (size < m_iHugePageSize)
+      return new char [size];
+
+   #ifndef WIN32
+      size_t len = slabSize(size);
+      void* p = MAP_FAILED;
+
+      #ifdef MAP_HUGETLB
+         // pages from the reserved huge page pool
+         p = ::mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      #endif
+
+      if (MAP_FAILED == p)
+      {
+         // align the slab to a huge page, so that it can be backed by transparent huge pages
+         char* q = (char*)::mmap(NULL, len + m_iHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+         if ((char*)MAP_FAILED == q)
+            throw std::bad_alloc();
+
+         size_t head = (m_iHugePageSize - (size_t)q % m_iHugePageSize) % m_iHugePageSize;
+         if (head > 0)
+            ::munmap(q, head);
+         ::munmap(q + head + len, m_iHugePageSize - head);
+         p = q + head;
+
+         #ifdef MADV_HUGEPAGE
+            ::madvise(p, len, MADV_HUGEPAGE);
+         #endif
+      }
+
+      if (MAP_FAILED == p)
+         throw std::bad_alloc();
+
+      return (char*)p;
+   #else
+      return new char [size];
+   #endif
+}
+
+void CPktAllocator::release(char* slab, int size)
+{
+   if (NULL == slab)
+      return;
+
+   #ifndef WIN32
+      if (size >= m_iHugePageSize)
+      {
+         ::munmap(slab, slabSize(size));
+         return;
+      }
+   #endif
+
+   delete [] slab;
+}
+
+//
+CMemBudget::CMemBudget(int64_t limit):
+m_llLimit(limit),
+m_llUsed(0)
+{
+}
+
+bool CMemBudget::acquire(int64_t size)
+{
+   #ifndef WIN32
+      int64_t used;
+      do
+      {
+         used = m_llUsed;
+         if (used + size > m_llLimit)
+            return false;
+      } while (!__sync_bool_compare_and_swap(&m_llUsed, used, used + size));
+   #else
+      LONGLONG used;
+      do
+      {
+         used = m_llUsed;
+         if (used + size > m_llLimit)
+            return false;
+      } while (InterlockedCompareExchange64((LONGLONG volatile*)&m_llUsed, used + size, used) != used);
+   #endif
+
+   return true;
+}
+
+void CMemBudget::charge(int64_t size)
+{
+   #ifndef WIN32
+      __sync_fetch_and_add(&m_llUsed, size);
+   #else
+      InterlockedExchangeAdd64((LONGLONG volatile*)&m_llUsed, size);
+   #endif
+}
+
+void CMemBudget::release(int64_t size)
+{
+   charge(-size);
+}
+
+int64_t CMemBudget::getAvailable() const
+{
+   int64_t used = m_llUsed;
+   return (used < m_llLimit) ? m_llLimit - used : 0;
+}
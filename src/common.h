@@ -108,6 +108,18 @@ public:
 
    void tick();
 
+#ifdef LINUX
+      // Functionality:
+      //    Sleep until CC "nexttime" or until the file descriptor becomes readable.
+      // Parameters:
+      //    0) [in] fd: file descriptor to be watched, the same one for all calls.
+      //    1) [in] nexttime: next time the caller is waken up, 0 means no deadline.
+      // Returned value:
+      //    true if the file descriptor is readable, otherwise false.
+
+   bool waitfor(int fd, uint64_t nexttime);
+#endif
+
 public:
 
       // Functionality:
@@ -167,12 +179,23 @@ public:
 private:
    uint64_t getTimeInMicroSec();
 
+#ifdef LINUX
+   int wait(uint64_t nexttime);
+#endif
+
 private:
    uint64_t m_ullSchedTime;             // next schedulled time
 
    pthread_cond_t m_TickCond;
    pthread_mutex_t m_TickLock;
 
+#ifdef LINUX
+   int m_iEPollFD;                      // epoll instance waiting on all the descriptors below
+   int m_iTimerFD;                      // timerfd armed to the next schedulled time
+   int m_iEventFD;                      // eventfd signalled by interrupt() and tick()
+   int m_iWatchFD;                      // descriptor watched by waitfor(), -1 if none
+#endif
+
    static pthread_cond_t m_EventCond;
    static pthread_mutex_t m_EventLock;
 
@@ -209,6 +232,90 @@ private:
 
 
 
+////////////////////////////////////////////////////////////////////////////////
+
+// Memory for the packet payloads of the sending and receiving buffers, allocated in large slabs.
+
+class CPktAllocator
+{
+public:
+
+      // Functionality:
+      //    Allocate a slab of memory for packet payloads. Slabs of at least one huge page are backed by huge
+      //    pages if the system has them reserved, otherwise transparent huge pages are requested; smaller ones
+      //    come from the heap. The memory is not touched, so that its pages are placed on the NUMA node of the
+      //    thread that first writes them.
+      // Parameters:
+      //    0) [in] size: size of the slab.
+      // Returned value:
+      //    Pointer to the slab; std::bad_alloc is thrown on failure.
+
+   static char* allocate(int size);
+
+      // Functionality:
+      //    Release a slab.
+      // Parameters:
+      //    0) [in] slab: pointer to the slab.
+      //    1) [in] size: size of the slab, the same as allocated.
+      // Returned value:
+      //    None.
+
+   static void release(char* slab, int size);
+
+public:
+   static const int m_iHugePageSize;    // size of a huge page
+};
+
+// A limit on the payload memory of the buffers that share it, i.e., all sockets of a multiplexer.
+
+class CMemBudget
+{
+public:
+   CMemBudget(int64_t limit);
+
+public:
+
+      // Functionality:
+      //    Take memory from the budget, if there is enough left.
+      // Parameters:
+      //    0) [in] size: size of the memory.
+      // Returned value:
+      //    true if the memory is granted, otherwise false.
+
+   bool acquire(int64_t size);
+
+      // Functionality:
+      //    Take memory from the budget even if it is exceeded, for the minimum buffers a connection needs.
+      // Parameters:
+      //    0) [in] size: size of the memory.
+      // Returned value:
+      //    None.
+
+   void charge(int64_t size);
+
+      // Functionality:
+      //    Return memory to the budget.
+      // Parameters:
+      //    0) [in] size: size of the memory.
+      // Returned value:
+      //    None.
+
+   void release(int64_t size);
+
+      // Functionality:
+      //    Query the memory that can still be taken.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    Size of the memory left, 0 if the budget is exhausted.
+
+   int64_t getAvailable() const;
+
+private:
+   int64_t m_llLimit;                   // size of the budget
+   volatile int64_t m_llUsed;           // memory taken from the budget
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 
 // UDT Sequence Number 0 - (2^31 - 1)
@@ -94,6 +94,7 @@ CUDT::CUDT()
    m_pPeerAddr = NULL;
    m_pSNode = NULL;
    m_pRNode = NULL;
+   m_iAsyncCount = 0;
 
    // Initilize mutex and condition variables
    initSynch();
@@ -116,6 +117,19 @@ CUDT::CUDT()
    m_iRcvTimeOut = -1;
    m_bReuseAddr = true;
    m_llMaxBW = -1;
+   #ifdef LINUX
+      m_iRcvBatchSize = 16;
+      m_iSndBatchSize = 16;
+   #else
+      m_iRcvBatchSize = 1;
+      m_iSndBatchSize = 1;
+   #endif
+   m_bGSO = false;
+   m_bGRO = false;
+   m_iWorkers = 1;
+   m_iDiskBufSize = 0;
+   m_llMemBudget = 0;
+   m_iIdleTime = 10000;
 
    m_pCCFactory = new CCCFactory<CUDTCC>;
    m_pCC = NULL;
@@ -148,6 +162,7 @@ CUDT::CUDT(const CUDT& ancestor)
    m_pPeerAddr = NULL;
    m_pSNode = NULL;
    m_pRNode = NULL;
+   m_iAsyncCount = 0;
 
    // Initilize mutex and condition variables
    initSynch();
@@ -169,6 +184,14 @@ CUDT::CUDT(const CUDT& ancestor)
    m_iRcvTimeOut = ancestor.m_iRcvTimeOut;
    m_bReuseAddr = true;	// this must be true, because all accepted sockets shared the same port with the listener
    m_llMaxBW = ancestor.m_llMaxBW;
+   m_iRcvBatchSize = ancestor.m_iRcvBatchSize;
+   m_iSndBatchSize = ancestor.m_iSndBatchSize;
+   m_bGSO = ancestor.m_bGSO;
+   m_bGRO = ancestor.m_bGRO;
+   m_iWorkers = ancestor.m_iWorkers;
+   m_iDiskBufSize = ancestor.m_iDiskBufSize;
+   m_llMemBudget = ancestor.m_llMemBudget;
+   m_iIdleTime = ancestor.m_iIdleTime;
 
    m_pCCFactory = ancestor.m_pCCFactory->clone();
    m_pCC = NULL;
@@ -188,6 +211,12 @@ CUDT::CUDT(const CUDT& ancestor)
 
 CUDT::~CUDT()
 {
+   // fail the asynchronous operations left, the data lent to the sending buffer is returned when it is deleted below
+   for (deque<CAsyncOp*>::iterator i = m_qAsyncSend.begin(); i != m_qAsyncSend.end(); ++ i)
+      (*i)->m_pQueue->account(*i, (*i)->m_iLength - (*i)->m_iOffset, CUDTException::ECONNLOST);
+   for (deque<CAsyncOp*>::iterator i = m_qAsyncRecv.begin(); i != m_qAsyncRecv.end(); ++ i)
+      (*i)->m_pQueue->complete(*i, -CUDTException::ECONNLOST);
+
    // release mutex/condtion variables
    destroySynch();
 
@@ -345,6 +374,78 @@ void CUDT::setOpt(UDTOpt optName, const void* optval, int)
    case UDT_MAXBW:
       m_llMaxBW = *(int64_t*)optval;
       break;
+
+   case UDT_RCVBATCH:
+      if (m_bOpened)
+         throw CUDTException(5, 1, 0);
+
+      m_iRcvBatchSize = *(int*)optval;
+
+      if (m_iRcvBatchSize < 1)
+         m_iRcvBatchSize = 1;
+      else if (m_iRcvBatchSize > CChannel::m_iMaxBatchSize)
+         m_iRcvBatchSize = CChannel::m_iMaxBatchSize;
+
+      break;
+
+   case UDT_SNDBATCH:
+      if (m_bOpened)
+         throw CUDTException(5, 1, 0);
+
+      m_iSndBatchSize = *(int*)optval;
+
+      if (m_iSndBatchSize < 1)
+         m_iSndBatchSize = 1;
+      else if (m_iSndBatchSize > CChannel::m_iMaxBatchSize)
+         m_iSndBatchSize = CChannel::m_iMaxBatchSize;
+
+      break;
+
+   case UDT_GSO:
+      if (m_bOpened)
+         throw CUDTException(5, 1, 0);
+      m_bGSO = *(bool*)optval;
+      break;
+
+   case UDT_GRO:
+      if (m_bOpened)
+         throw CUDTException(5, 1, 0);
+      m_bGRO = *(bool*)optval;
+      break;
+
+   case UDT_WORKERS:
+      if (m_bOpened)
+         throw CUDTException(5, 1, 0);
+
+      m_iWorkers = *(int*)optval;
+
+      if (m_iWorkers < 1)
+         m_iWorkers = 1;
+      else if (m_iWorkers > 64)
+         m_iWorkers = 64;
+
+      break;
+
+   case UDT_DISKBUF:
+      m_iDiskBufSize = *(int*)optval;
+      if (m_iDiskBufSize < 0)
+         m_iDiskBufSize = 0;
+      break;
+
+   case UDT_MEMBUDGET:
+      if (m_bOpened)
+         throw CUDTException(5, 1, 0);
+
+      m_llMemBudget = *(int64_t*)optval;
+      if (m_llMemBudget < 0)
+         m_llMemBudget = 0;
+      break;
+
+   case UDT_IDLETIME:
+      m_iIdleTime = *(int*)optval;
+      if (m_iIdleTime < -1)
+         m_iIdleTime = -1;
+      break;
     
    default:
       throw CUDTException(5, 0, 0);
@@ -452,7 +553,7 @@ void CUDT::getOpt(UDTOpt optName, void* optval, int& optlen)
       {
          if (m_pRcvBuffer && (m_pRcvBuffer->getRcvDataSize() > 0))
             event |= UDT_EPOLL_IN;
-         if (m_pSndBuffer && (m_iSndBufSize > m_pSndBuffer->getCurrBufSize()))
+         if (m_pSndBuffer && (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) > m_pSndBuffer->getCurrBufSize()))
             event |= UDT_EPOLL_OUT;
       }
       *(int32_t*)optval = event;
@@ -476,6 +577,46 @@ void CUDT::getOpt(UDTOpt optName, void* optval, int& optlen)
       optlen = sizeof(int32_t);
       break;
 
+   case UDT_RCVBATCH:
+      *(int*)optval = m_iRcvBatchSize;
+      optlen = sizeof(int);
+      break;
+
+   case UDT_SNDBATCH:
+      *(int*)optval = m_iSndBatchSize;
+      optlen = sizeof(int);
+      break;
+
+   case UDT_GSO:
+      *(bool*)optval = m_bGSO;
+      optlen = sizeof(bool);
+      break;
+
+   case UDT_GRO:
+      *(bool*)optval = m_bGRO;
+      optlen = sizeof(bool);
+      break;
+
+   case UDT_WORKERS:
+      *(int*)optval = m_iWorkers;
+      optlen = sizeof(int);
+      break;
+
+   case UDT_DISKBUF:
+      *(int*)optval = m_iDiskBufSize;
+      optlen = sizeof(int);
+      break;
+
+   case UDT_MEMBUDGET:
+      *(int64_t*)optval = m_llMemBudget;
+      optlen = sizeof(int64_t);
+      break;
+
+   case UDT_IDLETIME:
+      *(int*)optval = m_iIdleTime;
+      optlen = sizeof(int);
+      break;
+
    default:
       throw CUDTException(5, 0, 0);
    }
@@ -507,13 +648,13 @@ void CUDT::open()
       m_pSNode = new CSNode;
    m_pSNode->m_pUDT = this;
    m_pSNode->m_llTimeStamp = 1;
-   m_pSNode->m_iHeapLoc = -1;
+   m_pSNode->m_iSlot = -1;
 
    if (NULL == m_pRNode)
       m_pRNode = new CRNode;
    m_pRNode->m_pUDT = this;
    m_pRNode->m_llTimeStamp = 1;
-   m_pRNode->m_pPrev = m_pRNode->m_pNext = NULL;
+   m_pRNode->m_iSlot = -1;
    m_pRNode->m_bOnList = false;
 
    m_iRTT = 10 * m_iSYNInterval;
@@ -542,6 +683,9 @@ void CUDT::open()
    m_ullTargetTime = 0;
    m_ullTimeDiff = 0;
 
+   m_llLastActivity = 0;
+   m_ullLastActiveTime = currtime;
+
    // Now UDT is opened.
    m_bOpened = true;
 }
@@ -757,7 +901,7 @@ POST_CONNECT:
    // Prepare all data structures
    try
    {
-      m_pSndBuffer = new CSndBuffer(32, m_iPayloadSize);
+      m_pSndBuffer = new CSndBuffer(32, m_iPayloadSize, m_pSndQueue->m_pBudget);
       m_pRcvBuffer = new CRcvBuffer(&(m_pRcvQueue->m_UnitQueue), m_iRcvBufSize);
       // after introducing lite ACK, the sndlosslist may not be cleared in time, so it requires twice space.
       m_pSndLossList = new CSndLossList(m_iFlowWindowSize * 2);
@@ -805,7 +949,7 @@ POST_CONNECT:
    s_UDTUnited.connect_complete(m_SocketID);
 
    // acknowledde any waiting epolls to write
-   s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, true);
+   s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_OUT, true);
 
    return 0;
 }
@@ -856,7 +1000,7 @@ void CUDT::connect(const sockaddr* peer, CHandShake* hs)
    // Prepare all structures
    try
    {
-      m_pSndBuffer = new CSndBuffer(32, m_iPayloadSize);
+      m_pSndBuffer = new CSndBuffer(32, m_iPayloadSize, m_pSndQueue->m_pBudget);
       m_pRcvBuffer = new CRcvBuffer(&(m_pRcvQueue->m_UnitQueue), m_iRcvBufSize);
       m_pSndLossList = new CSndLossList(m_iFlowWindowSize * 2);
       m_pRcvLossList = new CRcvLossList(m_iFlightFlagSize);
@@ -952,16 +1096,9 @@ void CUDT::close()
       m_pSndQueue->m_pSndUList->remove(this);
 
    // trigger any pending IO events.
-   s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_ERR, true);
+   s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_ERR, true);
    // then remove itself from all epoll monitoring
-   try
-   {
-      for (set<int>::iterator i = m_sPollID.begin(); i != m_sPollID.end(); ++ i)
-         s_UDTUnited.m_EPoll.remove_usock(*i, m_SocketID);
-   }
-   catch (...)
-   {
-   }
+   s_UDTUnited.m_EPoll.leave(-1, m_SocketID, m_PollSet);
 
    if (!m_bOpened)
       return;
@@ -1010,7 +1147,7 @@ void CUDT::close()
    m_bOpened = false;
 }
 
-int CUDT::send(const char* data, int len)
+int CUDT::send(const char* data, int len, UDTSENDCB callback, void* arg)
 {
    if (UDT_DGRAM == m_iSockType)
       throw CUDTException(5, 10, 0);
@@ -1034,7 +1171,7 @@ int CUDT::send(const char* data, int len)
       m_ullLastRspTime = currtime;
    }
 
-   if (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize())
+   if (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) <= m_pSndBuffer->getCurrBufSize())
    {
       if (!m_bSynSending)
          throw CUDTException(6, 1, 0);
@@ -1045,7 +1182,7 @@ int CUDT::send(const char* data, int len)
             pthread_mutex_lock(&m_SendBlockLock);
             if (m_iSndTimeOut < 0) 
             { 
-               while (!m_bBroken && m_bConnected && !m_bClosing && (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth)
+               while (!m_bBroken && m_bConnected && !m_bClosing && (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth)
                   pthread_cond_wait(&m_SendBlockCond, &m_SendBlockLock);
             }
             else
@@ -1056,21 +1193,21 @@ int CUDT::send(const char* data, int len)
                locktime.tv_sec = exptime / 1000000;
                locktime.tv_nsec = (exptime % 1000000) * 1000;
 
-               while (!m_bBroken && m_bConnected && !m_bClosing && (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth && (CTimer::getTime() < exptime))
+               while (!m_bBroken && m_bConnected && !m_bClosing && (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth && (CTimer::getTime() < exptime))
                   pthread_cond_timedwait(&m_SendBlockCond, &m_SendBlockLock, &locktime);
             }
             pthread_mutex_unlock(&m_SendBlockLock);
          #else
             if (m_iSndTimeOut < 0)
             {
-               while (!m_bBroken && m_bConnected && !m_bClosing && (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth)
+               while (!m_bBroken && m_bConnected && !m_bClosing && (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth)
                   WaitForSingleObject(m_SendBlockCond, INFINITE);
             }
             else 
             {
                uint64_t exptime = CTimer::getTime() + m_iSndTimeOut * 1000ULL;
 
-               while (!m_bBroken && m_bConnected && !m_bClosing && (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth && (CTimer::getTime() < exptime))
+               while (!m_bBroken && m_bConnected && !m_bClosing && (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth && (CTimer::getTime() < exptime))
                   WaitForSingleObject(m_SendBlockCond, DWORD((exptime - CTimer::getTime()) / 1000)); 
             }
          #endif
@@ -1088,7 +1225,7 @@ int CUDT::send(const char* data, int len)
       }
    }
 
-   if (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize())
+   if (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) <= m_pSndBuffer->getCurrBufSize())
    {
       if (m_iSndTimeOut >= 0)
          throw CUDTException(6, 3, 0); 
@@ -1096,7 +1233,7 @@ int CUDT::send(const char* data, int len)
       return 0;
    }
 
-   int size = (m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize;
+   int size = (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize;
    if (size > len)
       size = len;
 
@@ -1105,36 +1242,25 @@ int CUDT::send(const char* data, int len)
       m_llSndDurationCounter = CTimer::getTime();
 
    // insert the user buffer into the sening list
-   m_pSndBuffer->addBuffer(data, size);
+   if (NULL == callback)
+      m_pSndBuffer->addBuffer(data, size);
+   else
+      m_pSndBuffer->lendBuffer(data, size, -1, false, m_SocketID, callback, arg);
 
    // insert this socket to snd list if it is not on the list yet
    m_pSndQueue->m_pSndUList->update(this, false);
 
-   if (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize())
+   if (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) <= m_pSndBuffer->getCurrBufSize())
    {
       // write is not available any more
-      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, false);
+      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_OUT, false);
    }
 
    return size;
 }
 
-int CUDT::recv(char* data, int len)
+void CUDT::waitRecvData()
 {
-   if (UDT_DGRAM == m_iSockType)
-      throw CUDTException(5, 10, 0);
-
-   // throw an exception if not connected
-   if (!m_bConnected)
-      throw CUDTException(2, 2, 0);
-   else if ((m_bBroken || m_bClosing) && (0 == m_pRcvBuffer->getRcvDataSize()))
-      throw CUDTException(2, 1, 0);
-
-   if (len <= 0)
-      return 0;
-
-   CGuard recvguard(m_RecvLock);
-
    if (0 == m_pRcvBuffer->getRcvDataSize())
    {
       if (!m_bSynRecving)
@@ -1185,6 +1311,25 @@ int CUDT::recv(char* data, int len)
          #endif
       }
    }
+}
+
+int CUDT::recv(char* data, int len)
+{
+   if (UDT_DGRAM == m_iSockType)
+      throw CUDTException(5, 10, 0);
+
+   // throw an exception if not connected
+   if (!m_bConnected)
+      throw CUDTException(2, 2, 0);
+   else if ((m_bBroken || m_bClosing) && (0 == m_pRcvBuffer->getRcvDataSize()))
+      throw CUDTException(2, 1, 0);
+
+   if (len <= 0)
+      return 0;
+
+   CGuard recvguard(m_RecvLock);
+
+   waitRecvData();
 
    // throw an exception if not connected
    if (!m_bConnected)
@@ -1197,7 +1342,7 @@ int CUDT::recv(char* data, int len)
    if (m_pRcvBuffer->getRcvDataSize() <= 0)
    {
       // read is not available any more
-      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_IN, false);
+      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_IN, false);
    }
 
    if ((res <= 0) && (m_iRcvTimeOut >= 0))
@@ -1206,7 +1351,61 @@ int CUDT::recv(char* data, int len)
    return res;
 }
 
-int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
+int CUDT::recvbuf(iovec* vec, int num)
+{
+   if (UDT_DGRAM == m_iSockType)
+      throw CUDTException(5, 10, 0);
+
+   // throw an exception if not connected
+   if (!m_bConnected)
+      throw CUDTException(2, 2, 0);
+   else if ((m_bBroken || m_bClosing) && (0 == m_pRcvBuffer->getRcvDataSize()))
+      throw CUDTException(2, 1, 0);
+
+   if (num <= 0)
+      return 0;
+
+   CGuard recvguard(m_RecvLock);
+
+   waitRecvData();
+
+   // throw an exception if not connected
+   if (!m_bConnected)
+      throw CUDTException(2, 2, 0);
+   else if ((m_bBroken || m_bClosing) && (0 == m_pRcvBuffer->getRcvDataSize()))
+      throw CUDTException(2, 1, 0);
+
+   // the data stays in the receiver buffer until it is released
+   int res = m_pRcvBuffer->peekBuffer(vec, num);
+
+   if ((res <= 0) && (m_iRcvTimeOut >= 0))
+      throw CUDTException(6, 3, 0);
+
+   return res;
+}
+
+int CUDT::recvrelease(int len)
+{
+   if (UDT_DGRAM == m_iSockType)
+      throw CUDTException(5, 10, 0);
+
+   if (len <= 0)
+      return 0;
+
+   CGuard recvguard(m_RecvLock);
+
+   int res = m_pRcvBuffer->releaseBuffer(len);
+
+   if (m_pRcvBuffer->getRcvDataSize() <= 0)
+   {
+      // read is not available any more
+      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_IN, false);
+   }
+
+   return res;
+}
+
+int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder, UDTSENDCB callback, void* arg)
 {
    if (UDT_STREAM == m_iSockType)
       throw CUDTException(5, 9, 0);
@@ -1233,7 +1432,7 @@ int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
       m_ullLastRspTime = currtime;
    }
 
-   if ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len)
+   if ((m_pSndBuffer->getMaxBufSize(m_iSndBufSize) - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len)
    {
       if (!m_bSynSending)
          throw CUDTException(6, 1, 0);
@@ -1244,7 +1443,7 @@ int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
             pthread_mutex_lock(&m_SendBlockLock);
             if (m_iSndTimeOut < 0)
             {
-               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len))
+               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_pSndBuffer->getMaxBufSize(m_iSndBufSize) - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len))
                   pthread_cond_wait(&m_SendBlockCond, &m_SendBlockLock);
             }
             else
@@ -1255,21 +1454,21 @@ int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
                locktime.tv_sec = exptime / 1000000;
                locktime.tv_nsec = (exptime % 1000000) * 1000;
 
-               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len) && (CTimer::getTime() < exptime))
+               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_pSndBuffer->getMaxBufSize(m_iSndBufSize) - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len) && (CTimer::getTime() < exptime))
                   pthread_cond_timedwait(&m_SendBlockCond, &m_SendBlockLock, &locktime);
             }
             pthread_mutex_unlock(&m_SendBlockLock);
          #else
             if (m_iSndTimeOut < 0)
             {
-               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len))
+               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_pSndBuffer->getMaxBufSize(m_iSndBufSize) - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len))
                   WaitForSingleObject(m_SendBlockCond, INFINITE);
             }
             else
             {
                uint64_t exptime = CTimer::getTime() + m_iSndTimeOut * 1000ULL;
 
-               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len) && (CTimer::getTime() < exptime))
+               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_pSndBuffer->getMaxBufSize(m_iSndBufSize) - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len) && (CTimer::getTime() < exptime))
                   WaitForSingleObject(m_SendBlockCond, DWORD((exptime - CTimer::getTime()) / 1000));
             }
          #endif
@@ -1282,7 +1481,7 @@ int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
       }
    }
 
-   if ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len)
+   if ((m_pSndBuffer->getMaxBufSize(m_iSndBufSize) - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len)
    {
       if (m_iSndTimeOut >= 0)
          throw CUDTException(6, 3, 0);
@@ -1295,15 +1494,18 @@ int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
       m_llSndDurationCounter = CTimer::getTime();
 
    // insert the user buffer into the sening list
-   m_pSndBuffer->addBuffer(data, len, msttl, inorder);
+   if (NULL == callback)
+      m_pSndBuffer->addBuffer(data, len, msttl, inorder);
+   else
+      m_pSndBuffer->lendBuffer(data, len, msttl, inorder, m_SocketID, callback, arg);
 
    // insert this socket to the snd list if it is not on the list yet
    m_pSndQueue->m_pSndUList->update(this, false);
 
-   if (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize())
+   if (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) <= m_pSndBuffer->getCurrBufSize())
    {
       // write is not available any more
-      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, false);
+      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_OUT, false);
    }
 
    return len;   
@@ -1330,7 +1532,7 @@ int CUDT::recvmsg(char* data, int len)
       if (m_pRcvBuffer->getRcvMsgNum() <= 0)
       {
          // read is not available any more
-         s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_IN, false);
+         s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_IN, false);
       }
 
       if (0 == res)
@@ -1399,7 +1601,7 @@ int CUDT::recvmsg(char* data, int len)
    if (m_pRcvBuffer->getRcvMsgNum() <= 0)
    {
       // read is not available any more
-      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_IN, false);
+      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_IN, false);
    }
 
    if ((res <= 0) && (m_iRcvTimeOut >= 0))
@@ -1408,7 +1610,163 @@ int CUDT::recvmsg(char* data, int len)
    return res;
 }
 
-int64_t CUDT::sendfile(fstream& ifs, int64_t& offset, int64_t size, int block)
+void CUDT::postAsync(CAsyncOp* op)
+{
+   bool sending = (UDT_AIO_SEND == op->m_iType) || (UDT_AIO_SENDMSG == op->m_iType);
+   bool streaming = (UDT_AIO_SEND == op->m_iType) || (UDT_AIO_RECV == op->m_iType);
+
+   if (streaming && (UDT_DGRAM == m_iSockType))
+      throw CUDTException(5, 10, 0);
+   if (!streaming && (UDT_STREAM == m_iSockType))
+      throw CUDTException(5, 9, 0);
+
+   // throw an exception if not connected; data already received can still be read from a broken connection
+   if ((m_bBroken || m_bClosing) && (sending || ((UDT_STREAM == m_iSockType) ? (0 == m_pRcvBuffer->getRcvDataSize()) : (0 == m_pRcvBuffer->getRcvMsgNum()))))
+      throw CUDTException(2, 1, 0);
+   else if (!m_bConnected)
+      throw CUDTException(2, 2, 0);
+
+   if ((NULL == op->m_pcData) || (op->m_iLength <= 0))
+      throw CUDTException(5, 3, 0);
+
+   if ((UDT_AIO_SENDMSG == op->m_iType) && (op->m_iLength > m_iSndBufSize * m_iPayloadSize))
+      throw CUDTException(5, 12, 0);
+
+   CGuard::enterCS(m_AsyncLock);
+   if (sending)
+      m_qAsyncSend.push_back(op);
+   else
+      m_qAsyncRecv.push_back(op);
+   ++ m_iAsyncCount;
+   CGuard::leaveCS(m_AsyncLock);
+
+   // start it now; if the connection has been broken meanwhile, it fails here
+   processAsync();
+}
+
+void CUDT::processAsync()
+{
+   // most sockets have no asynchronous operation
+   if (0 == m_iAsyncCount)
+      return;
+
+   CGuard asyncguard(m_AsyncLock);
+
+   bool broken = m_bBroken || m_bClosing || !m_bConnected;
+
+   if (!m_qAsyncSend.empty())
+   {
+      if (broken)
+      {
+         // the data not lent to the sending buffer yet is dropped, the rest is returned by the buffer
+         while (!m_qAsyncSend.empty())
+         {
+            CAsyncOp* op = m_qAsyncSend.front();
+            m_qAsyncSend.pop_front();
+            op->m_pQueue->account(op, op->m_iLength - op->m_iOffset, CUDTException::ECONNLOST);
+         }
+      }
+      #ifndef WIN32
+      else if (0 == pthread_mutex_trylock(&m_SendLock))
+      #else
+      else if (WAIT_OBJECT_0 == WaitForSingleObject(m_SendLock, 0))
+      #endif
+      {
+         // a blocking "send" holds the lock while it waits, then the next ACK continues from here
+
+         if (m_pSndBuffer->getCurrBufSize() == 0)
+         {
+            // delay the EXP timer to avoid mis-fired timeout
+            uint64_t currtime;
+            CTimer::rdtsc(currtime);
+            m_ullLastRspTime = currtime;
+            m_llSndDurationCounter = CTimer::getTime();
+         }
+
+         while (!m_qAsyncSend.empty())
+         {
+            CAsyncOp* op = m_qAsyncSend.front();
+
+            int avail = (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize;
+            int size = op->m_iLength - op->m_iOffset;
+            if (UDT_AIO_SENDMSG == op->m_iType)
+            {
+               // a message is lent as a whole
+               if (size > avail)
+                  break;
+            }
+            else if (size > avail)
+               size = avail;
+            if (size <= 0)
+               break;
+
+            // once all of its data is lent, the operation may be completed by an ACK at any time
+            char* data = op->m_pcData + op->m_iOffset;
+            op->m_iOffset += size;
+            bool whole = (op->m_iOffset == op->m_iLength);
+            if (whole)
+               m_qAsyncSend.pop_front();
+
+            m_pSndBuffer->lendBuffer(data, size, op->m_iTTL, op->m_bInOrder, m_SocketID, CAsyncQueue::sendDone, op);
+
+            if (!whole)
+               break;
+         }
+
+         // insert this socket to snd list if it is not on the list yet
+         m_pSndQueue->m_pSndUList->update(this, false);
+
+         if (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) <= m_pSndBuffer->getCurrBufSize())
+         {
+            // write is not available any more
+            s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_OUT, false);
+         }
+
+         CGuard::leaveCS(m_SendLock);
+      }
+   }
+
+   #ifndef WIN32
+   if (!m_qAsyncRecv.empty() && (broken ? (0 == pthread_mutex_lock(&m_RecvLock)) : (0 == pthread_mutex_trylock(&m_RecvLock))))
+   #else
+   if (!m_qAsyncRecv.empty() && (WAIT_OBJECT_0 == WaitForSingleObject(m_RecvLock, broken ? INFINITE : 0)))
+   #endif
+   {
+      while (!m_qAsyncRecv.empty())
+      {
+         CAsyncOp* op = m_qAsyncRecv.front();
+
+         int res;
+         if (UDT_AIO_RECV == op->m_iType)
+            res = m_pRcvBuffer->readBuffer(op->m_pcData, op->m_iLength);
+         else
+            res = m_pRcvBuffer->readMsg(op->m_pcData, op->m_iLength);
+
+         if (res <= 0)
+         {
+            if (!broken)
+               break;
+            res = -CUDTException::ECONNLOST;
+         }
+
+         m_qAsyncRecv.pop_front();
+         op->m_pQueue->complete(op, res);
+      }
+
+      if (((UDT_STREAM == m_iSockType) && (m_pRcvBuffer->getRcvDataSize() <= 0)) ||
+         ((UDT_DGRAM == m_iSockType) && (m_pRcvBuffer->getRcvMsgNum() <= 0)))
+      {
+         // read is not available any more
+         s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_IN, false);
+      }
+
+      CGuard::leaveCS(m_RecvLock);
+   }
+
+   m_iAsyncCount = m_qAsyncSend.size() + m_qAsyncRecv.size();
+}
+
+int64_t CUDT::sendfile(CUDTSource& src, int64_t& offset, int64_t size, int block)
 {
    if (UDT_DGRAM == m_iSockType)
       throw CUDTException(5, 10, 0);
@@ -1434,34 +1792,21 @@ int64_t CUDT::sendfile(fstream& ifs, int64_t& offset, int64_t size, int block)
    int64_t tosend = size;
    int unitsize;
 
-   // positioning...
-   try
-   {
-      ifs.seekg((streamoff)offset);
-   }
-   catch (...)
-   {
-      throw CUDTException(4, 1);
-   }
+   // if the source has lent memory it still owns, the packets must be acknowledged before returning
+   bool borrowed = false;
 
    // sending block by block
    while (tosend > 0)
    {
-      if (ifs.fail())
-         throw CUDTException(4, 4);
-
-      if (ifs.eof())
-         break;
-
       unitsize = int((tosend >= block) ? block : tosend);
 
       #ifndef WIN32
          pthread_mutex_lock(&m_SendBlockLock);
-         while (!m_bBroken && m_bConnected && !m_bClosing && (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth)
+         while (!m_bBroken && m_bConnected && !m_bClosing && (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth)
             pthread_cond_wait(&m_SendBlockCond, &m_SendBlockLock);
          pthread_mutex_unlock(&m_SendBlockLock);
       #else
-         while (!m_bBroken && m_bConnected && !m_bClosing && (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth)
+         while (!m_bBroken && m_bConnected && !m_bClosing && (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth)
             WaitForSingleObject(m_SendBlockCond, INFINITE);
       #endif
 
@@ -1476,11 +1821,33 @@ int64_t CUDT::sendfile(fstream& ifs, int64_t& offset, int64_t size, int block)
          throw CUDTException(7);
       }
 
+      // do not grow the buffer beyond its limit or the memory budget
+      int room = (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize;
+      if (unitsize > room)
+         unitsize = room;
+
       // record total time used for sending
       if (0 == m_pSndBuffer->getCurrBufSize())
          m_llSndDurationCounter = CTimer::getTime();
 
-      int64_t sentsize = m_pSndBuffer->addBufferFromFile(ifs, unitsize);
+      // send the packets directly from the memory of the source if it can lend it, otherwise copy the data
+      UDTSENDCB release = NULL;
+      void* arg = NULL;
+      int64_t sentsize;
+      const char* data = src.lend(offset, unitsize, release, arg);
+      if (NULL != data)
+      {
+         m_pSndBuffer->lendBuffer(data, unitsize, -1, true, m_SocketID, release, arg);
+         if (NULL == release)
+            borrowed = true;
+         sentsize = unitsize;
+      }
+      else
+      {
+         sentsize = m_pSndBuffer->addBufferFromSource(src, offset, unitsize);
+         if (sentsize < 0)
+            throw CUDTException(4, 2);
+      }
 
       if (sentsize > 0)
       {
@@ -1490,18 +1857,38 @@ int64_t CUDT::sendfile(fstream& ifs, int64_t& offset, int64_t size, int block)
 
       // insert this socket to snd list if it is not on the list yet
       m_pSndQueue->m_pSndUList->update(this, false);
+
+      // end of the source
+      if (sentsize < unitsize)
+         break;
+   }
+
+   if (borrowed)
+   {
+      #ifndef WIN32
+         pthread_mutex_lock(&m_SendBlockLock);
+         while (!m_bBroken && m_bConnected && !m_bClosing && (m_pSndBuffer->getCurrBufSize() > 0))
+            pthread_cond_wait(&m_SendBlockCond, &m_SendBlockLock);
+         pthread_mutex_unlock(&m_SendBlockLock);
+      #else
+         while (!m_bBroken && m_bConnected && !m_bClosing && (m_pSndBuffer->getCurrBufSize() > 0))
+            WaitForSingleObject(m_SendBlockCond, INFINITE);
+      #endif
+
+      if (m_pSndBuffer->getCurrBufSize() > 0)
+         throw CUDTException(2, 1, 0);
    }
 
-   if (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize())
+   if (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) <= m_pSndBuffer->getCurrBufSize())
    {
       // write is not available any more
-      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, false);
+      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_OUT, false);
    }
 
    return size - tosend;
 }
 
-int64_t CUDT::recvfile(fstream& ofs, int64_t& offset, int64_t size, int block)
+int64_t CUDT::recvfile(CUDTSink& sink, int64_t& offset, int64_t size, int block)
 {
    if (UDT_DGRAM == m_iSockType)
       throw CUDTException(5, 10, 0);
@@ -1520,28 +1907,9 @@ int64_t CUDT::recvfile(fstream& ofs, int64_t& offset, int64_t size, int block)
    int unitsize = block;
    int recvsize;
 
-   // positioning...
-   try
-   {
-      ofs.seekp((streamoff)offset);
-   }
-   catch (...)
-   {
-      throw CUDTException(4, 3);
-   }
-
    // receiving... "recvfile" is always blocking
    while (torecv > 0)
    {
-      if (ofs.fail())
-      {
-         // send the sender a signal so it will not be blocked forever
-         int32_t err_code = CUDTException::EFILE;
-         sendCtrl(8, &err_code);
-
-         throw CUDTException(4, 4);
-      }
-
       #ifndef WIN32
          pthread_mutex_lock(&m_RecvDataLock);
          while (!m_bBroken && m_bConnected && !m_bClosing && (0 == m_pRcvBuffer->getRcvDataSize()))
@@ -1558,19 +1926,29 @@ int64_t CUDT::recvfile(fstream& ofs, int64_t& offset, int64_t size, int block)
          throw CUDTException(2, 1, 0);
 
       unitsize = int((torecv >= block) ? block : torecv);
-      recvsize = m_pRcvBuffer->readBufferToFile(ofs, unitsize);
+      recvsize = m_pRcvBuffer->readBufferToSink(sink, offset, unitsize);
 
-      if (recvsize > 0)
+      // all the data handed over to the sink must be stored before returning
+      if ((recvsize >= 0) && (torecv == recvsize) && (sink.flush() < 0))
+         recvsize = -1;
+
+      if (recvsize < 0)
       {
-         torecv -= recvsize;
-         offset += recvsize;
+         // send the sender a signal so it will not be blocked forever
+         int32_t err_code = CUDTException::EFILE;
+         sendCtrl(8, &err_code);
+
+         throw CUDTException(4, 4);
       }
+
+      torecv -= recvsize;
+      offset += recvsize;
    }
 
    if (m_pRcvBuffer->getRcvDataSize() <= 0)
    {
       // read is not available any more
-      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_IN, false);
+      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_IN, false);
    }
 
    return size - torecv;
@@ -1626,7 +2004,7 @@ void CUDT::sample(CPerfMon* perf, bool clear)
       if (WAIT_OBJECT_0 == WaitForSingleObject(m_ConnectionLock, 0))
    #endif
    {
-      perf->byteAvailSndBuf = (NULL == m_pSndBuffer) ? 0 : (m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iMSS;
+      perf->byteAvailSndBuf = (NULL == m_pSndBuffer) ? 0 : (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) - m_pSndBuffer->getCurrBufSize()) * m_iMSS;
       perf->byteAvailRcvBuf = (NULL == m_pRcvBuffer) ? 0 : m_pRcvBuffer->getAvailBufSize() * m_iMSS;
 
       #ifndef WIN32
@@ -1672,6 +2050,7 @@ void CUDT::initSynch()
       pthread_mutex_init(&m_RecvLock, NULL);
       pthread_mutex_init(&m_AckLock, NULL);
       pthread_mutex_init(&m_ConnectionLock, NULL);
+      pthread_mutex_init(&m_AsyncLock, NULL);
    #else
       m_SendBlockLock = CreateMutex(NULL, false, NULL);
       m_SendBlockCond = CreateEvent(NULL, false, false, NULL);
@@ -1681,6 +2060,7 @@ void CUDT::initSynch()
       m_RecvLock = CreateMutex(NULL, false, NULL);
       m_AckLock = CreateMutex(NULL, false, NULL);
       m_ConnectionLock = CreateMutex(NULL, false, NULL);
+      m_AsyncLock = CreateMutex(NULL, false, NULL);
    #endif
 }
 
@@ -1695,6 +2075,7 @@ void CUDT::destroySynch()
       pthread_mutex_destroy(&m_RecvLock);
       pthread_mutex_destroy(&m_AckLock);
       pthread_mutex_destroy(&m_ConnectionLock);
+      pthread_mutex_destroy(&m_AsyncLock);
    #else
       CloseHandle(m_SendBlockLock);
       CloseHandle(m_SendBlockCond);
@@ -1704,6 +2085,7 @@ void CUDT::destroySynch()
       CloseHandle(m_RecvLock);
       CloseHandle(m_AckLock);
       CloseHandle(m_ConnectionLock);
+      CloseHandle(m_AsyncLock);
    #endif
 }
 
@@ -1732,6 +2114,9 @@ void CUDT::releaseSynch()
       WaitForSingleObject(m_RecvLock, INFINITE);
       ReleaseMutex(m_RecvLock);
    #endif
+
+   // complete the asynchronous operations left, if the connection is broken
+   processAsync();
 }
 
 void CUDT::sendCtrl(int pkttype, void* lparam, void* rparam, int size)
@@ -1789,7 +2174,10 @@ void CUDT::sendCtrl(int pkttype, void* lparam, void* rparam, int size)
          #endif
 
          // acknowledge any waiting epolls to read
-         s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_IN, true);
+         s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_IN, true);
+
+         // and complete the asynchronous receive operations
+         processAsync();
       }
       else if (ack == m_iRcvLastAck)
       {
@@ -1809,6 +2197,10 @@ void CUDT::sendCtrl(int pkttype, void* lparam, void* rparam, int size)
          data[1] = m_iRTT;
          data[2] = m_iRTTVar;
          data[3] = m_pRcvBuffer->getAvailBufSize();
+         // with a memory budget, no more is advertised than the units the receiving queue can still give out
+         int avail = m_pRcvQueue->m_UnitQueue.getAvailUnits();
+         if ((avail >= 0) && (data[3] > avail))
+            data[3] = avail;
          // a minimum flow window of 2 is used, even if buffer is full, to break potential deadlock
          if (data[3] < 2)
             data[3] = 2;
@@ -1957,7 +2349,9 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
    m_iEXPCount = 1;
    uint64_t currtime;
    CTimer::rdtsc(currtime);
-   m_ullLastRspTime = currtime;
+   // the keep-alive packets of an idle receiver must not hold back the retransmission of unacknowledged data
+   if ((1 != ctrlpkt.getType()) || (CSeqNo::incseq(m_iSndCurrSeqNo) == m_iSndLastAck))
+      m_ullLastRspTime = currtime;
 
    switch (ctrlpkt.getType())
    {
@@ -2046,7 +2440,10 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
       #endif
 
       // acknowledde any waiting epolls to write
-      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, true);
+      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_OUT, true);
+
+      // lend more data of the asynchronous send operations
+      processAsync();
 
       // insert this socket to snd list if it is not on the list yet
       m_pSndQueue->m_pSndUList->update(this, false);
@@ -2221,6 +2618,9 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
       // Signal the sender and recver if they are waiting for data.
       releaseSynch();
 
+      // app can call any UDT API to learn the connection_broken error
+      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_IN | UDT_EPOLL_OUT | UDT_EPOLL_ERR, true);
+
       CTimer::triggerEvent();
 
       break;
@@ -2393,6 +2793,7 @@ int CUDT::processData(CUnit* unit)
    m_ullLastRspTime = currtime;
 
    m_pCC->onPktReceived(&packet);
+   CCUpdate();
    ++ m_iPktCount;
    // update time information
    m_pRcvTimeWindow->onPktArrival();
@@ -2522,7 +2923,7 @@ int CUDT::listen(sockaddr* addr, CPacket& packet)
          else
          {
             // a new connection has been created, enable epoll for write 
-            s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, true);
+            s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_OUT, true);
          }
       }
    }
@@ -2572,16 +2973,7 @@ void CUDT::checkTimers()
    //   m_ullNextNAKTime = currtime + m_ullNAKInt;
    //}
 
-   uint64_t next_exp_time;
-   if (m_pCC->m_bUserDefinedRTO)
-      next_exp_time = m_ullLastRspTime + m_pCC->m_iRTO * m_ullCPUFrequency;
-   else
-   {
-      uint64_t exp_int = (m_iEXPCount * (m_iRTT + 4 * m_iRTTVar) + m_iSYNInterval) * m_ullCPUFrequency;
-      if (exp_int < m_iEXPCount * m_ullMinExpInt)
-         exp_int = m_iEXPCount * m_ullMinExpInt;
-      next_exp_time = m_ullLastRspTime + exp_int;
-   }
+   uint64_t next_exp_time = getEXPTime();
 
    if (currtime > next_exp_time)
    {
@@ -2604,7 +2996,7 @@ void CUDT::checkTimers()
          releaseSynch();
 
          // app can call any UDT API to learn the connection_broken error
-         s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_IN | UDT_EPOLL_OUT | UDT_EPOLL_ERR, true);
+         s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_IN | UDT_EPOLL_OUT | UDT_EPOLL_ERR, true);
 
          CTimer::triggerEvent();
 
@@ -2639,13 +3031,93 @@ void CUDT::checkTimers()
       // Reset last response time since we just sent a heart-beat.
       m_ullLastRspTime = currtime;
    }
+
+   // the buffers of a connection that has not moved any data for a while are released, until data comes again
+   int64_t activity = m_llSentTotal + m_llRecvTotal;
+   if (activity != m_llLastActivity)
+   {
+      m_llLastActivity = activity;
+      m_ullLastActiveTime = currtime;
+   }
+   else if ((m_iIdleTime >= 0) && (currtime - m_ullLastActiveTime > m_iIdleTime * 1000ULL * m_ullCPUFrequency))
+      compactBuffers();
+}
+
+void CUDT::compactBuffers()
+{
+   // the receiving structures are updated by this worker only, and the application reads only the acknowledged
+   // data, so an empty receiving buffer is not in use
+   m_pRcvBuffer->compact();
+   m_pRcvLossList->compact();
+   m_pSndLossList->compact();
+   // the record of an ACK that is not acknowledged yet is still needed to process the ACK2 from the peer
+   if (m_iRcvLastAck == m_iRcvLastAckAck)
+      m_pACKWindow->compact();
+
+   // data is inserted into the sending buffer under the sending lock, skip it if a sending call is in progress
+   #ifndef WIN32
+      if (0 == pthread_mutex_trylock(&m_SendLock))
+      {
+         m_pSndBuffer->compact();
+         pthread_mutex_unlock(&m_SendLock);
+      }
+   #else
+      if (WAIT_OBJECT_0 == WaitForSingleObject(m_SendLock, 0))
+      {
+         m_pSndBuffer->compact();
+         ReleaseMutex(m_SendLock);
+      }
+   #endif
+}
+
+bool CUDT::isTimerDue(uint64_t currtime) const
+{
+   // a deadline has passed, or enough packets have arrived for an ACK
+   return (currtime >= m_pRNode->m_llTimeStamp) ||
+      ((m_pCC->m_iACKInterval > 0) && (m_pCC->m_iACKInterval <= m_iPktCount)) ||
+      (m_iSelfClockInterval * m_iLightACKCount <= m_iPktCount);
+}
+
+uint64_t CUDT::getNextTimerTime() const
+{
+   uint64_t currtime;
+   CTimer::rdtsc(currtime);
+
+   // the timers are checked at least once a second, so that a closed socket is removed from the queue soon
+   uint64_t nexttime = currtime + 1000000 * m_ullCPUFrequency;
+
+   // the timers fire when the current time is later than their deadlines
+   uint64_t exptime = getEXPTime() + 1;
+   if (exptime < nexttime)
+      nexttime = exptime;
+
+   // the ACK timer matters only if there is anything not acknowledged yet
+   int32_t ack = (0 == m_pRcvLossList->getLossLength()) ? CSeqNo::incseq(m_iRcvCurrSeqNo) : m_pRcvLossList->getFirstLostSeq();
+   if ((ack != m_iRcvLastAckAck) && (m_ullNextACKTime + 1 < nexttime))
+      nexttime = m_ullNextACKTime + 1;
+
+   // a timer that has not been processed is checked in the next round
+   if (nexttime <= currtime)
+      nexttime = currtime + 1;
+
+   return nexttime;
+}
+
+uint64_t CUDT::getEXPTime() const
+{
+   if (m_pCC->m_bUserDefinedRTO)
+      return m_ullLastRspTime + m_pCC->m_iRTO * m_ullCPUFrequency;
+
+   uint64_t exp_int = (m_iEXPCount * (m_iRTT + 4 * m_iRTTVar) + m_iSYNInterval) * m_ullCPUFrequency;
+   if (exp_int < m_iEXPCount * m_ullMinExpInt)
+      exp_int = m_iEXPCount * m_ullMinExpInt;
+
+   return m_ullLastRspTime + exp_int;
 }
 
 void CUDT::addEPoll(const int eid)
 {
-   CGuard::enterCS(s_UDTUnited.m_EPoll.m_EPollLock);
-   m_sPollID.insert(eid);
-   CGuard::leaveCS(s_UDTUnited.m_EPoll.m_EPollLock);
+   s_UDTUnited.m_EPoll.join(eid, m_PollSet);
 
    if (!m_bConnected || m_bBroken || m_bClosing)
       return;
@@ -2653,23 +3125,16 @@ void CUDT::addEPoll(const int eid)
    if (((UDT_STREAM == m_iSockType) && (m_pRcvBuffer->getRcvDataSize() > 0)) ||
       ((UDT_DGRAM == m_iSockType) && (m_pRcvBuffer->getRcvMsgNum() > 0)))
    {
-      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_IN, true);
+      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_IN, true);
    }
-   if (m_iSndBufSize > m_pSndBuffer->getCurrBufSize())
+   if (m_pSndBuffer->getMaxBufSize(m_iSndBufSize) > m_pSndBuffer->getCurrBufSize())
    {
-      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, true);
+      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_PollSet, UDT_EPOLL_OUT, true);
    }
 }
 
 void CUDT::removeEPoll(const int eid)
 {
-   // clear IO events notifications;
-   // since this happens after the epoll ID has been removed, they cannot be set again
-   set<int> remove;
-   remove.insert(eid);
-   s_UDTUnited.m_EPoll.update_events(m_SocketID, remove, UDT_EPOLL_IN | UDT_EPOLL_OUT, false);
-
-   CGuard::enterCS(s_UDTUnited.m_EPoll.m_EPollLock);
-   m_sPollID.erase(eid);
-   CGuard::leaveCS(s_UDTUnited.m_EPoll.m_EPollLock);
+   // IO events are no longer delivered to the epoll, and the socket is dropped from its ready list
+   s_UDTUnited.m_EPoll.leave(eid, m_SocketID, m_PollSet);
 }
@@ -42,6 +42,7 @@ written by
 #define __UDT_CORE_H__
 
 
+#include <deque>
 #include "udt.h"
 #include "common.h"
 #include "list.h"
@@ -53,6 +54,7 @@ written by
 #include "ccc.h"
 #include "cache.h"
 #include "queue.h"
+#include "aio.h"
 
 enum UDTSockType {UDT_STREAM = 1, UDT_DGRAM};
 
@@ -92,9 +94,16 @@ public: //API
    static int send(UDTSOCKET u, const char* buf, int len, int flags);
    static int recv(UDTSOCKET u, char* buf, int len, int flags);
    static int sendmsg(UDTSOCKET u, const char* buf, int len, int ttl = -1, bool inorder = false);
+   static int sendbuf(UDTSOCKET u, const char* buf, int len, UDTSENDCB callback, void* arg, int ttl = -1, bool inorder = false);
+   static int recvbuf(UDTSOCKET u, iovec* vec, int num);
+   static int recvrelease(UDTSOCKET u, int len);
    static int recvmsg(UDTSOCKET u, char* buf, int len);
    static int64_t sendfile(UDTSOCKET u, std::fstream& ifs, int64_t& offset, int64_t size, int block = 364000);
    static int64_t recvfile(UDTSOCKET u, std::fstream& ofs, int64_t& offset, int64_t size, int block = 7280000);
+   static int64_t sendfile(UDTSOCKET u, CUDTSource& src, int64_t& offset, int64_t size, int block = 364000);
+   static int64_t recvfile(UDTSOCKET u, CUDTSink& sink, int64_t& offset, int64_t size, int block = 7280000);
+   static int64_t sendfile2(UDTSOCKET u, const char* path, int64_t* offset, int64_t size, int block = 364000);
+   static int64_t recvfile2(UDTSOCKET u, const char* path, int64_t* offset, int64_t size, int block = 7280000);
    static int select(int nfds, ud_set* readfds, ud_set* writefds, ud_set* exceptfds, const timeval* timeout);
    static int selectEx(const std::vector<UDTSOCKET>& fds, std::vector<UDTSOCKET>* readfds, std::vector<UDTSOCKET>* writefds, std::vector<UDTSOCKET>* exceptfds, int64_t msTimeOut);
    static int epoll_create();
@@ -104,6 +113,12 @@ public: //API
    static int epoll_remove_ssock(const int eid, const SYSSOCKET s);
    static int epoll_wait(const int eid, std::set<UDTSOCKET>* readfds, std::set<UDTSOCKET>* writefds, int64_t msTimeOut, std::set<SYSSOCKET>* lrfds = NULL, std::set<SYSSOCKET>* wrfds = NULL);
    static int epoll_release(const int eid);
+   static int epoll_getfd(const int eid);
+   static int epoll_set_callback(const int eid, UDTEPOLLCB callback, void* arg);
+   static int aio_create(int depth);
+   static int aio_post(int qid, int type, UDTSOCKET u, char* buf, int len, void* arg, int ttl = -1, bool inorder = false);
+   static int aio_wait(int qid, CAIOResult* results, int num, int64_t msTimeOut);
+   static int aio_release(int qid);
    static CUDTException& getlasterror();
    static int perfmon(UDTSOCKET u, CPerfMon* perf, bool clear = true);
    static UDTSTATUS getsockstate(UDTSOCKET u);
@@ -172,10 +187,12 @@ private:
       // Parameters:
       //    0) [in] data: The address of the application data to be sent.
       //    1) [in] len: The size of the data block.
+      //    2) [in] callback: if not NULL, the data is sent without copying, and the callback is called when it is acknowledged.
+      //    3) [in] arg: user argument passed to the callback.
       // Returned value:
       //    Actual size of data sent.
 
-   int send(const char* data, int len);
+   int send(const char* data, int len, UDTSENDCB callback = NULL, void* arg = NULL);
 
       // Functionality:
       //    Request UDT to receive data to a memory block "data" with size of "len".
@@ -187,6 +204,25 @@ private:
 
    int recv(char* data, int len);
 
+      // Functionality:
+      //    Borrow the received data in place, the same data is returned until it is released.
+      // Parameters:
+      //    0) [out] vec: array of vectors pointing to the received data, in order.
+      //    1) [in] num: size of the array.
+      // Returned value:
+      //    Number of vectors filled.
+
+   int recvbuf(iovec* vec, int num);
+
+      // Functionality:
+      //    Release data borrowed by recvbuf, which can not be accessed any more.
+      // Parameters:
+      //    0) [in] len: size of data consumed, from the first vector returned by recvbuf.
+      // Returned value:
+      //    Actual size of data released.
+
+   int recvrelease(int len);
+
       // Functionality:
       //    send a message of a memory block "data" with size of "len".
       // Parameters:
@@ -194,10 +230,12 @@ private:
       //    1) [in] len: The desired size of data to be received.
       //    2) [in] ttl: the time-to-live of the message.
       //    3) [in] inorder: if the message should be delivered in order.
+      //    4) [in] callback: if not NULL, the data is sent without copying, and the callback is called when it is acknowledged.
+      //    5) [in] arg: user argument passed to the callback.
       // Returned value:
       //    Actual size of data sent.
 
-   int sendmsg(const char* data, int len, int ttl, bool inorder);
+   int sendmsg(const char* data, int len, int ttl, bool inorder, UDTSENDCB callback = NULL, void* arg = NULL);
 
       // Functionality:
       //    Receive a message to buffer "data".
@@ -210,28 +248,28 @@ private:
    int recvmsg(char* data, int len);
 
       // Functionality:
-      //    Request UDT to send out a file described as "fd", starting from "offset", with size of "size".
+      //    Request UDT to send out the data of a source, starting from "offset", with size of "size".
       // Parameters:
-      //    0) [in] ifs: The input file stream.
+      //    0) [in] src: The data source.
       //    1) [in, out] offset: From where to read and send data; output is the new offset when the call returns.
       //    2) [in] size: How many data to be sent.
-      //    3) [in] block: size of block per read from disk
+      //    3) [in] block: size of block per read from the source
       // Returned value:
       //    Actual size of data sent.
 
-   int64_t sendfile(std::fstream& ifs, int64_t& offset, int64_t size, int block = 366000);
+   int64_t sendfile(CUDTSource& src, int64_t& offset, int64_t size, int block = 366000);
 
       // Functionality:
-      //    Request UDT to receive data into a file described as "fd", starting from "offset", with expected size of "size".
+      //    Request UDT to receive data into a sink, starting from "offset", with expected size of "size".
       // Parameters:
-      //    0) [out] ofs: The output file stream.
+      //    0) [in] sink: The data sink.
       //    1) [in, out] offset: From where to write data; output is the new offset when the call returns.
       //    2) [in] size: How many data to be received.
-      //    3) [in] block: size of block per write to disk
+      //    3) [in] block: size of block per write to the sink
       // Returned value:
       //    Actual size of data received.
 
-   int64_t recvfile(std::fstream& ofs, int64_t& offset, int64_t size, int block = 7320000);
+   int64_t recvfile(CUDTSink& sink, int64_t& offset, int64_t size, int block = 7320000);
 
       // Functionality:
       //    Configure UDT options.
@@ -298,6 +336,14 @@ private: // Options
    int m_iRcvTimeOut;                           // receiving timeout in milliseconds
    bool m_bReuseAddr;				// reuse an exiting port or not, for UDP multiplexer
    int64_t m_llMaxBW;				// maximum data transfer rate (threshold)
+   int m_iRcvBatchSize;				// maximum number of UDP packets read per system call, for UDP multiplexer
+   int m_iSndBatchSize;				// maximum number of UDP packets sent per system call, for UDP multiplexer
+   bool m_bGSO;					// use UDP segmentation offload, for UDP multiplexer
+   bool m_bGRO;					// use UDP receive offload, for UDP multiplexer
+   int m_iWorkers;				// number of worker threads, for UDP multiplexer
+   int m_iDiskBufSize;				// size of data in flight to the disk by recvfile2, 0 means synchronous writes
+   int64_t m_llMemBudget;			// memory shared by the buffers of all sockets, for UDP multiplexer, 0 means unlimited
+   int m_iIdleTime;				// idle time in milliseconds before the buffers are released, -1 means never
 
 private: // congestion control
    CCCVirtualFactory* m_pCCFactory;             // Factory class to create a specific CC instance
@@ -383,6 +429,8 @@ private: // synchronization: mutexes and conditions
    void destroySynch();
    void releaseSynch();
 
+   void waitRecvData();
+
 private: // Generation and processing of packets
    void sendCtrl(int pkttype, void* lparam = NULL, void* rparam = NULL, int size = 0);
    void processCtrl(CPacket& ctrlpkt);
@@ -438,7 +486,14 @@ private: // Timers
 
    uint64_t m_ullTargetTime;			// scheduled time of next packet sending
 
+   int64_t m_llLastActivity;			// packets sent and received when the activity was last checked
+   uint64_t m_ullLastActiveTime;		// last time data was found sent or received
+
    void checkTimers();
+   bool isTimerDue(uint64_t currtime) const;
+   uint64_t getNextTimerTime() const;
+   uint64_t getEXPTime() const;
+   void compactBuffers();
 
 private: // for UDP multiplexer
    CSndQueue* m_pSndQueue;			// packet sending queue
@@ -449,9 +504,34 @@ private: // for UDP multiplexer
    CRNode* m_pRNode;                            // node information for UDT list used in rcv queue
 
 private: // for epoll
-   std::set<int> m_sPollID;                     // set of epoll ID to trigger
+   CEPollSet m_PollSet;                         // epolls to be notified of the IO events of this socket
    void addEPoll(const int eid);
    void removeEPoll(const int eid);
+
+private: // for asynchronous IO
+   std::deque<CAsyncOp*> m_qAsyncSend;          // send operations whose data has not been all lent to the sending buffer
+   std::deque<CAsyncOp*> m_qAsyncRecv;          // receive operations waiting for data
+   volatile int m_iAsyncCount;                  // number of operations in both queues, checked without locking
+   pthread_mutex_t m_AsyncLock;                 // protects the operation queues
+
+      // Functionality:
+      //    Queue an asynchronous operation on this socket, and start it at once.
+      // Parameters:
+      //    0) [in] op: the operation, owned by the socket from now on.
+      // Returned value:
+      //    None.
+
+   void postAsync(CAsyncOp* op);
+
+      // Functionality:
+      //    Continue the queued operations as far as the buffers allow; they fail if the connection is broken.
+      //    Called when the sending buffer is acknowledged or new data is acknowledged in the receiver buffer.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void processAsync();
 };
 
 
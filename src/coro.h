@@ -0,0 +1,666 @@
+/*****************************************************************************
+Copyright (c) 2001 - 2011, The Board of Trustees of the University of Illinois.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the
+  above copyright notice, this list of conditions
+  and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the University of Illinois
+  nor the names of its contributors may be used to
+  endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef __UDT_CORO_H__
+#define __UDT_CORO_H__
+
+
+#include "udt.h"
+#include "file.h"
+
+// The coroutine interface is header-only and needs a C++20 compiler; the library itself does not.
+#if defined(__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L)
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+
+namespace UDT
+{
+
+// Runs the coroutines resumed by a CReactor. post() is called from the UDT threads and must only queue the coroutine,
+// it must not resume it or call any UDT function before returning.
+class CExecutor
+{
+public:
+   virtual ~CExecutor() {}
+
+   virtual void post(std::coroutine_handle<> h) = 0;
+};
+
+// Executor resuming the coroutines in the threads that call run().
+class CQueueExecutor: public CExecutor
+{
+public:
+   CQueueExecutor(): m_bStopped(false) {}
+
+   virtual void post(std::coroutine_handle<> h)
+   {
+      std::lock_guard<std::mutex> lock(m_Lock);
+      m_qReady.push_back(h);
+      m_Cond.notify_one();
+   }
+
+      // Functionality:
+      //    Resume the queued coroutines until stop() is called.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void run()
+   {
+      std::unique_lock<std::mutex> lock(m_Lock);
+      for (;;)
+      {
+         while (m_qReady.empty() && !m_bStopped)
+            m_Cond.wait(lock);
+         if (m_qReady.empty())
+            return;
+
+         std::coroutine_handle<> h = m_qReady.front();
+         m_qReady.pop_front();
+
+         lock.unlock();
+         h.resume();
+         lock.lock();
+      }
+   }
+
+      // Functionality:
+      //    Make run() return once the coroutines already queued have been resumed.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void stop()
+   {
+      std::lock_guard<std::mutex> lock(m_Lock);
+      m_bStopped = true;
+      m_Cond.notify_all();
+   }
+
+private:
+   std::mutex m_Lock;
+   std::condition_variable m_Cond;
+   std::deque<std::coroutine_handle<> > m_qReady;
+   bool m_bStopped;
+};
+
+template <class T> class CTask;
+
+// State shared by the promises of all the tasks: the coroutine to resume when the task completes.
+class CTaskPromiseBase
+{
+public:
+   struct CFinal
+   {
+      bool await_ready() noexcept {return false;}
+
+      template <class P>
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+      {
+         CTaskPromiseBase& p = h.promise();
+
+         // a detached task has no one to return to, and frees itself
+         if (p.m_bDetached)
+         {
+            if (p.m_Exception)
+               std::terminate();
+            h.destroy();
+            return std::noop_coroutine();
+         }
+
+         return p.m_Continuation ? p.m_Continuation : std::noop_coroutine();
+      }
+
+      void await_resume() noexcept {}
+   };
+
+   std::suspend_always initial_suspend() noexcept {return std::suspend_always();}
+   CFinal final_suspend() noexcept {return CFinal();}
+   void unhandled_exception() {m_Exception = std::current_exception();}
+
+   std::coroutine_handle<> m_Continuation;   // coroutine awaiting the task
+   std::exception_ptr m_Exception;           // exception leaving the task
+   bool m_bDetached = false;                 // if the task has been started by CTask::detach()
+};
+
+template <class T>
+class CTaskPromise: public CTaskPromiseBase
+{
+public:
+   void return_value(T value) {m_Value = value;}
+
+   T m_Value = T();
+};
+
+template <>
+class CTaskPromise<void>: public CTaskPromiseBase
+{
+public:
+   void return_void() {}
+};
+
+// A coroutine returning T. It starts when it is awaited, and the awaiting coroutine resumes in the thread completing it.
+template <class T = void>
+class CTask
+{
+public:
+   struct promise_type: public CTaskPromise<T>
+   {
+      CTask get_return_object() {return CTask(std::coroutine_handle<promise_type>::from_promise(*this));}
+   };
+
+   CTask(CTask&& t) noexcept: m_Handle(t.m_Handle) {t.m_Handle = nullptr;}
+   ~CTask() {if (m_Handle) m_Handle.destroy();}
+
+   bool await_ready() const noexcept {return false;}
+
+   std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) noexcept
+   {
+      m_Handle.promise().m_Continuation = h;
+      return m_Handle;
+   }
+
+   T await_resume()
+   {
+      if (m_Handle.promise().m_Exception)
+         std::rethrow_exception(m_Handle.promise().m_Exception);
+      if constexpr (!std::is_void<T>::value)
+         return m_Handle.promise().m_Value;
+   }
+
+      // Functionality:
+      //    Start the task in the current thread without waiting for it; it frees itself when it completes.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void detach()
+   {
+      std::coroutine_handle<promise_type> h = m_Handle;
+      m_Handle = nullptr;
+      h.promise().m_bDetached = true;
+      h.resume();
+   }
+
+private:
+   explicit CTask(std::coroutine_handle<promise_type> h): m_Handle(h) {}
+   CTask(const CTask&);
+   CTask& operator=(const CTask&);
+
+   std::coroutine_handle<promise_type> m_Handle;
+};
+
+// Suspends the UDT socket operations of coroutines until the sockets are ready, and resumes them on an executor.
+// Each reactor owns an epoll whose events are delivered to it by UDT::epoll_set_callback, from the UDT threads
+// at the moment they happen: a coroutine is resumed once per readiness change and nothing is polled.
+// The sockets used with a reactor are made non-blocking; all UDT functions can still be called on them directly.
+class CReactor
+{
+public:
+   explicit CReactor(CExecutor& executor): m_Executor(executor)
+   {
+      m_iEPollID = UDT::epoll_create();
+      UDT::epoll_set_callback(m_iEPollID, onEvents, this);
+   }
+
+   ~CReactor()
+   {
+      // no callback is running after this, it is called under the lock of the epoll
+      UDT::epoll_set_callback(m_iEPollID, NULL, NULL);
+      UDT::epoll_release(m_iEPollID);
+   }
+
+   // Waits for a socket to be readable, to have a connection to accept, or to be broken.
+   struct CWait
+   {
+      CReactor* m_pReactor;
+      UDTSOCKET m_Socket;
+      bool m_bWrite;
+
+      bool await_ready() noexcept {return false;}
+      bool await_suspend(std::coroutine_handle<> h) {return m_pReactor->suspend(m_Socket, m_bWrite, h);}
+      void await_resume() noexcept {}
+   };
+
+      // Functionality:
+      //    Make a socket non-blocking and watch its events. The operations below do this on their first use.
+      // Parameters:
+      //    0) [in] u: the UDT socket.
+      // Returned value:
+      //    0 if success, otherwise UDT::ERROR.
+
+   int attach(UDTSOCKET u)
+   {
+      {
+         std::lock_guard<std::mutex> lock(m_Lock);
+         if (!m_mSocks.insert(std::make_pair(u, CWaiters())).second)
+            return 0;
+      }
+
+      bool block = false;
+      int events = UDT_EPOLL_IN | UDT_EPOLL_OUT | UDT_EPOLL_ET;
+      if ((UDT::ERROR == UDT::setsockopt(u, 0, UDT_SNDSYN, &block, sizeof(bool))) ||
+          (UDT::ERROR == UDT::setsockopt(u, 0, UDT_RCVSYN, &block, sizeof(bool))) ||
+          (UDT::ERROR == UDT::epoll_add_usock(m_iEPollID, u, &events)))
+      {
+         std::lock_guard<std::mutex> lock(m_Lock);
+         m_mSocks.erase(u);
+         return UDT::ERROR;
+      }
+
+      return 0;
+   }
+
+      // Functionality:
+      //    Close a socket; the coroutines waiting on it are resumed and their operations fail.
+      // Parameters:
+      //    0) [in] u: the UDT socket.
+      // Returned value:
+      //    0 if success, otherwise UDT::ERROR.
+
+   int close(UDTSOCKET u)
+   {
+      int r = UDT::close(u);
+
+      CWaiters w;
+      {
+         std::lock_guard<std::mutex> lock(m_Lock);
+         std::map<UDTSOCKET, CWaiters>::iterator i = m_mSocks.find(u);
+         if (i == m_mSocks.end())
+            return r;
+         w = i->second;
+         m_mSocks.erase(i);
+      }
+
+      if (w.m_Reader)
+         m_Executor.post(w.m_Reader);
+      if (w.m_Writer)
+         m_Executor.post(w.m_Writer);
+
+      return r;
+   }
+
+      // Functionality:
+      //    Start a coroutine on the executor; it frees itself when it completes.
+      // Parameters:
+      //    0) [in] task: the coroutine.
+      // Returned value:
+      //    None.
+
+   void spawn(CTask<void> task)
+   {
+      launch(&m_Executor, std::move(task)).detach();
+   }
+
+      // Functionality:
+      //    Awaitable that resumes when a socket can be read or accepted from, or is broken. It may resume spuriously.
+      // Parameters:
+      //    0) [in] u: the UDT socket.
+      // Returned value:
+      //    the awaitable.
+
+   CWait readable(UDTSOCKET u) {return CWait{this, u, false};}
+
+      // Functionality:
+      //    Awaitable that resumes when a socket can be written to, is connected, or is broken. It may resume spuriously.
+      // Parameters:
+      //    0) [in] u: the UDT socket.
+      // Returned value:
+      //    the awaitable.
+
+   CWait writable(UDTSOCKET u) {return CWait{this, u, true};}
+
+   // The operations below behave like the UDT functions of the same names on a blocking socket,
+   // returning UDT::ERROR with UDT::getlasterror() set in the thread resuming the caller.
+
+   CTask<int> connect(UDTSOCKET u, const struct sockaddr* name, int namelen)
+   {
+      if (UDT::ERROR == attach(u))
+         co_return UDT::ERROR;
+
+      if (UDT::ERROR == UDT::connect(u, name, namelen))
+         co_return UDT::ERROR;
+
+      for (;;)
+      {
+         UDTSTATUS s = UDT::getsockstate(u);
+         if (CONNECTED == s)
+            co_return 0;
+
+         // a connection that times out is reported as an error while the socket is still connecting
+         if ((CONNECTING != s) || failed(u))
+         {
+            UDT::getlasterror() = CUDTException(1, (CONNECTING == s) ? 1 : 0, 0);
+            co_return UDT::ERROR;
+         }
+
+         co_await writable(u);
+      }
+   }
+
+   CTask<UDTSOCKET> accept(UDTSOCKET u, struct sockaddr* addr, int* addrlen)
+   {
+      if (UDT::ERROR == attach(u))
+         co_return UDT::INVALID_SOCK;
+
+      for (;;)
+      {
+         UDTSOCKET s = UDT::accept(u, addr, addrlen);
+         if (UDT::INVALID_SOCK != s)
+         {
+            attach(s);
+            co_return s;
+         }
+         if (CUDTException::EASYNCRCV != UDT::getlasterror_code())
+            co_return UDT::INVALID_SOCK;
+
+         co_await readable(u);
+      }
+   }
+
+   CTask<int> send(UDTSOCKET u, const char* buf, int len)
+   {
+      if (UDT::ERROR == attach(u))
+         co_return UDT::ERROR;
+
+      for (;;)
+      {
+         int r = UDT::send(u, buf, len, 0);
+         if ((UDT::ERROR != r) || (CUDTException::EASYNCSND != UDT::getlasterror_code()))
+            co_return r;
+
+         co_await writable(u);
+      }
+   }
+
+   CTask<int> recv(UDTSOCKET u, char* buf, int len)
+   {
+      if (UDT::ERROR == attach(u))
+         co_return UDT::ERROR;
+
+      for (;;)
+      {
+         int r = UDT::recv(u, buf, len, 0);
+         if ((UDT::ERROR != r) || (CUDTException::EASYNCRCV != UDT::getlasterror_code()))
+            co_return r;
+
+         co_await readable(u);
+      }
+   }
+
+   // Unlike UDT::sendfile(), which blocks, the data is queued with non-blocking sends. Memory lent by the source with a
+   // release function is sent in place by sendbuf(); memory the source keeps is copied by send(), as there is no event
+   // telling when it has been acknowledged; otherwise the data is read into a buffer. The bytes sent are returned if
+   // the source ends before "size".
+
+   CTask<int64_t> sendfile(UDTSOCKET u, CUDTSource& src, int64_t& offset, int64_t size, int block = 364000)
+   {
+      if (UDT::ERROR == attach(u))
+         co_return UDT::ERROR;
+
+      std::vector<char> buf;
+      int64_t sent = 0;
+      bool end = false;
+
+      while (!end && (sent < size))
+      {
+         int unitsize = int((size - sent >= block) ? block : size - sent);
+
+         UDTSENDCB release = NULL;
+         void* arg = NULL;
+         const char* data = src.lend(offset, unitsize, release, arg);
+         CLent* lent = NULL;
+         if (NULL != release)
+            lent = new CLent(data, unitsize, release, arg);
+         else if (NULL == data)
+         {
+            buf.resize(block);
+
+            iovec vec;
+            vec.iov_base = &buf[0];
+            vec.iov_len = unitsize;
+            int r = src.read(&vec, 1, offset);
+            if (r < 0)
+            {
+               UDT::getlasterror() = CUDTException(4, 2, 0);
+               co_return UDT::ERROR;
+            }
+
+            // end of the source
+            end = (r < unitsize);
+            unitsize = r;
+            data = &buf[0];
+         }
+
+         for (int pos = 0; pos < unitsize; )
+         {
+            int r;
+            if (NULL != lent)
+            {
+               // the source gets its memory back when the last piece queued is released
+               ++ lent->m_iRefs;
+               r = UDT::sendbuf(u, data + pos, unitsize - pos, releasePiece, lent);
+               if (r <= 0)
+                  -- lent->m_iRefs;
+            }
+            else
+               r = UDT::send(u, data + pos, unitsize - pos, 0);
+
+            if (r > 0)
+            {
+               pos += r;
+               sent += r;
+               offset += r;
+               continue;
+            }
+
+            if (CUDTException::EASYNCSND != UDT::getlasterror_code())
+            {
+               // the rest of the memory is not sent
+               if (NULL != lent)
+               {
+                  lent->m_bAcked = false;
+                  unref(u, lent);
+               }
+               co_return UDT::ERROR;
+            }
+
+            co_await writable(u);
+         }
+
+         if (NULL != lent)
+            unref(u, lent);
+      }
+
+      co_return sent;
+   }
+
+   CTask<int64_t> sendfile(UDTSOCKET u, std::fstream& ifs, int64_t& offset, int64_t size, int block = 364000)
+   {
+      CStreamSource src(ifs);
+      co_return co_await sendfile(u, src, offset, size, block);
+   }
+
+private:
+   struct CWaiters
+   {
+      std::coroutine_handle<> m_Reader;      // coroutine waiting to read or accept
+      std::coroutine_handle<> m_Writer;      // coroutine waiting to write or connect
+      bool m_bReadable = false;              // if the socket has become readable since the reader last waited
+      bool m_bWritable = false;
+      bool m_bError = false;                 // if an error has been reported on the socket
+   };
+
+   // Moves the coroutine awaiting it to the executor.
+   struct CPost
+   {
+      CExecutor* m_pExecutor;
+
+      bool await_ready() noexcept {return false;}
+      void await_suspend(std::coroutine_handle<> h) {m_pExecutor->post(h);}
+      void await_resume() noexcept {}
+   };
+
+   // Memory lent by a source to sendfile(), queued with sendbuf() in as many pieces as the send buffer takes.
+   struct CLent
+   {
+      CLent(const char* data, int len, UDTSENDCB release, void* arg):
+         m_pcData(data), m_iLength(len), m_pRelease(release), m_pArg(arg), m_iRefs(1), m_bAcked(true) {}
+
+      const char* m_pcData;
+      int m_iLength;
+      UDTSENDCB m_pRelease;                  // release function of the source
+      void* m_pArg;
+      std::atomic<int> m_iRefs;              // pieces queued, plus one while sendfile() is queueing them
+      std::atomic<bool> m_bAcked;            // if all the pieces have been acknowledged
+   };
+
+   static void releasePiece(UDTSOCKET u, const char*, int, bool acked, void* arg)
+   {
+      CLent* lent = (CLent*)arg;
+      if (!acked)
+         lent->m_bAcked = false;
+      unref(u, lent);
+   }
+
+   static void unref(UDTSOCKET u, CLent* lent)
+   {
+      if (1 != lent->m_iRefs.fetch_sub(1))
+         return;
+
+      lent->m_pRelease(u, lent->m_pcData, lent->m_iLength, lent->m_bAcked, lent->m_pArg);
+      delete lent;
+   }
+
+   static CTask<void> launch(CExecutor* executor, CTask<void> task)
+   {
+      co_await CPost{executor};
+      co_await task;
+   }
+
+   bool suspend(UDTSOCKET u, bool write, std::coroutine_handle<> h)
+   {
+      if (UDT::ERROR == attach(u))
+         return false;
+
+      std::lock_guard<std::mutex> lock(m_Lock);
+
+      // the socket has been closed by close()
+      std::map<UDTSOCKET, CWaiters>::iterator i = m_mSocks.find(u);
+      if (i == m_mSocks.end())
+         return false;
+
+      // an event since the operation last failed: retry it at once
+      bool& ready = write ? i->second.m_bWritable : i->second.m_bReadable;
+      if (ready)
+      {
+         ready = false;
+         return false;
+      }
+
+      (write ? i->second.m_Writer : i->second.m_Reader) = h;
+      return true;
+   }
+
+   bool failed(UDTSOCKET u)
+   {
+      std::lock_guard<std::mutex> lock(m_Lock);
+      std::map<UDTSOCKET, CWaiters>::iterator i = m_mSocks.find(u);
+      return (i == m_mSocks.end()) || i->second.m_bError;
+   }
+
+   static void onEvents(int, UDTSOCKET u, int events, void* arg)
+   {
+      CReactor* self = (CReactor*)arg;
+      std::coroutine_handle<> reader;
+      std::coroutine_handle<> writer;
+
+      {
+         std::lock_guard<std::mutex> lock(self->m_Lock);
+
+         std::map<UDTSOCKET, CWaiters>::iterator i = self->m_mSocks.find(u);
+         if (i == self->m_mSocks.end())
+            return;
+
+         if (events & UDT_EPOLL_ERR)
+            i->second.m_bError = true;
+
+         if (events & (UDT_EPOLL_IN | UDT_EPOLL_ERR))
+         {
+            std::swap(reader, i->second.m_Reader);
+            i->second.m_bReadable = !reader;
+         }
+         if (events & (UDT_EPOLL_OUT | UDT_EPOLL_ERR))
+         {
+            std::swap(writer, i->second.m_Writer);
+            i->second.m_bWritable = !writer;
+         }
+      }
+
+      if (reader)
+         self->m_Executor.post(reader);
+      if (writer)
+         self->m_Executor.post(writer);
+   }
+
+private:
+   CExecutor& m_Executor;
+   int m_iEPollID;                           // epoll delivering the events of the sockets to onEvents()
+
+   std::map<UDTSOCKET, CWaiters> m_mSocks;   // sockets attached, with the coroutines waiting on them
+   std::mutex m_Lock;                        // protects m_mSocks
+
+private:
+   CReactor(const CReactor&);
+   CReactor& operator=(const CReactor&);
+};
+
+}  // namespace UDT
+
+#endif
+
+#endif
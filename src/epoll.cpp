@@ -40,6 +40,7 @@ written by
 
 #ifdef LINUX
    #include <sys/epoll.h>
+   #include <sys/eventfd.h>
    #include <unistd.h>
 #endif
 #include <algorithm>
@@ -52,6 +53,34 @@ written by
 #include "udt.h"
 
 using namespace std;
+namespace
+{
+
+// Events of a socket that can be reported: errors are reported to any watcher, in both the read and the write sets.
+int ready_events(const CEPollItem& item)
+{
+   int watch = item.m_iWatch & (UDT_EPOLL_IN | UDT_EPOLL_OUT | UDT_EPOLL_ERR);
+   if (0 != watch)
+      watch |= UDT_EPOLL_ERR;
+   return item.m_iState & watch;
+}
+
+}  // namespace
+
+CEPollSet::CEPollSet():
+m_vPolls(),
+m_iSize(0)
+{
+   CGuard::createMutex(m_Lock);
+}
+
+CEPollSet::~CEPollSet()
+{
+   for (vector<CEPollDesc*>::iterator i = m_vPolls.begin(); i != m_vPolls.end(); ++ i)
+      CEPoll::unref(*i);
+
+   CGuard::releaseMutex(m_Lock);
+}
 
 CEPoll::CEPoll():
 m_iIDSeed(0)
@@ -61,6 +90,19 @@ m_iIDSeed(0)
 
 CEPoll::~CEPoll()
 {
+   for (map<int, CEPollDesc*>::iterator i = m_mPolls.begin(); i != m_mPolls.end(); ++ i)
+   {
+      #ifdef LINUX
+      ::close(i->second->m_iLocalID);
+      if (i->second->m_iEventFD >= 0)
+         ::close(i->second->m_iEventFD);
+      #endif
+
+      CGuard::enterCS(i->second->m_Lock);
+      i->second->m_bReleased = true;
+      unlock(i->second);
+   }
+
    CGuard::releaseMutex(m_EPollLock);
 }
 
@@ -83,37 +125,52 @@ int CEPoll::create()
    if (++ m_iIDSeed >= 0x7FFFFFFF)
       m_iIDSeed = 0;
 
-   CEPollDesc desc;
-   desc.m_iID = m_iIDSeed;
-   desc.m_iLocalID = localid;
-   m_mPolls[desc.m_iID] = desc;
-
-   return desc.m_iID;
+   CEPollDesc* desc = new CEPollDesc;
+   desc->m_iID = m_iIDSeed;
+   desc->m_pReadyHead = desc->m_pReadyTail = NULL;
+   desc->m_iLocalID = localid;
+   desc->m_iEventFD = -1;
+   desc->m_pCallback = NULL;
+   desc->m_pCallbackArg = NULL;
+   desc->m_iRefCount = 1;
+   desc->m_bReleased = false;
+   CGuard::createMutex(desc->m_Lock);
+   CGuard::createCond(desc->m_Cond);
+   m_mPolls[desc->m_iID] = desc;
+
+   return desc->m_iID;
 }
 
 int CEPoll::add_usock(const int eid, const UDTSOCKET& u, const int* events)
 {
-   CGuard pg(m_EPollLock);
+   CEPollDesc* d = acquire(eid);
 
-   map<int, CEPollDesc>::iterator p = m_mPolls.find(eid);
-   if (p == m_mPolls.end())
-      throw CUDTException(5, 13);
+   map<UDTSOCKET, CEPollItem>::iterator i = d->m_mSocks.find(u);
+   if (i == d->m_mSocks.end())
+   {
+      CEPollItem item;
+      item.m_Socket = u;
+      item.m_iState = 0;
+      item.m_bReady = false;
+      item.m_pPrev = item.m_pNext = NULL;
+      i = d->m_mSocks.insert(make_pair(u, item)).first;
+   }
 
-   if (!events || (*events & UDT_EPOLL_IN))
-      p->second.m_sUDTSocksIn.insert(u);
-   if (!events || (*events & UDT_EPOLL_OUT))
-      p->second.m_sUDTSocksOut.insert(u);
+   // adding a socket again replaces the events watched, and re-arms an edge-triggered or one-shot socket
+   i->second.m_iWatch = (NULL == events) ? (UDT_EPOLL_IN | UDT_EPOLL_OUT) : *events;
+   if (0 == ready_events(i->second))
+      clearReady(d, &i->second);
+   else
+      notify(d, &i->second);
+
+   unlock(d);
 
    return 0;
 }
 
 int CEPoll::add_ssock(const int eid, const SYSSOCKET& s, const int* events)
 {
-   CGuard pg(m_EPollLock);
-
-   map<int, CEPollDesc>::iterator p = m_mPolls.find(eid);
-   if (p == m_mPolls.end())
-      throw CUDTException(5, 13);
+   CEPollDesc* d = acquire(eid);
 
 #ifdef LINUX
    epoll_event ev;
@@ -133,45 +190,53 @@ int CEPoll::add_ssock(const int eid, const SYSSOCKET& s, const int* events)
    }
 
    ev.data.fd = s;
-   if (::epoll_ctl(p->second.m_iLocalID, EPOLL_CTL_ADD, s, &ev) < 0)
+   if (::epoll_ctl(d->m_iLocalID, EPOLL_CTL_ADD, s, &ev) < 0)
+   {
+      unlock(d);
       throw CUDTException();
+   }
 #endif
 
-   p->second.m_sLocals.insert(s);
+   d->m_sLocals.insert(s);
+
+   unlock(d);
 
    return 0;
 }
 
 int CEPoll::remove_usock(const int eid, const UDTSOCKET& u)
 {
-   CGuard pg(m_EPollLock);
+   CEPollDesc* d = acquire(eid);
 
-   map<int, CEPollDesc>::iterator p = m_mPolls.find(eid);
-   if (p == m_mPolls.end())
-      throw CUDTException(5, 13);
+   map<UDTSOCKET, CEPollItem>::iterator i = d->m_mSocks.find(u);
+   if (i != d->m_mSocks.end())
+   {
+      clearReady(d, &i->second);
+      d->m_mSocks.erase(i);
+      wakeup(d);
+   }
 
-   p->second.m_sUDTSocksIn.erase(u);
-   p->second.m_sUDTSocksOut.erase(u);
-   p->second.m_sUDTSocksEx.erase(u);
+   unlock(d);
 
    return 0;
 }
 
 int CEPoll::remove_ssock(const int eid, const SYSSOCKET& s)
 {
-   CGuard pg(m_EPollLock);
-
-   map<int, CEPollDesc>::iterator p = m_mPolls.find(eid);
-   if (p == m_mPolls.end())
-      throw CUDTException(5, 13);
+   CEPollDesc* d = acquire(eid);
 
 #ifdef LINUX
    epoll_event ev;  // ev is ignored, for compatibility with old Linux kernel only.
-   if (::epoll_ctl(p->second.m_iLocalID, EPOLL_CTL_DEL, s, &ev) < 0)
+   if (::epoll_ctl(d->m_iLocalID, EPOLL_CTL_DEL, s, &ev) < 0)
+   {
+      unlock(d);
       throw CUDTException();
+   }
 #endif
 
-   p->second.m_sLocals.erase(s);
+   d->m_sLocals.erase(s);
+
+   unlock(d);
 
    return 0;
 }
@@ -179,7 +244,7 @@ int CEPoll::remove_ssock(const int eid, const SYSSOCKET& s)
 int CEPoll::wait(const int eid, set<UDTSOCKET>* readfds, set<UDTSOCKET>* writefds, int64_t msTimeOut, set<SYSSOCKET>* lrfds, set<SYSSOCKET>* lwfds)
 {
    // if all fields is NULL and waiting time is infinite, then this would be a deadlock
-   if (!readfds && !writefds && !lrfds && lwfds && (msTimeOut < 0))
+   if (!readfds && !writefds && !lrfds && !lwfds && (msTimeOut < 0))
       throw CUDTException(5, 3, 0);
 
    // Clear these sets in case the app forget to do it.
@@ -190,52 +255,69 @@ int CEPoll::wait(const int eid, set<UDTSOCKET>* readfds, set<UDTSOCKET>* writefd
 
    int total = 0;
 
-   int64_t entertime = CTimer::getTime();
+   CEPollDesc* d = acquire(eid);
+
+   uint64_t entertime = CTimer::getTime();
    while (true)
    {
-      CGuard::enterCS(m_EPollLock);
-
-      map<int, CEPollDesc>::iterator p = m_mPolls.find(eid);
-      if (p == m_mPolls.end())
+      if (d->m_bReleased)
       {
-         CGuard::leaveCS(m_EPollLock);
+         unlock(d);
          throw CUDTException(5, 13);
       }
 
-      if (p->second.m_sUDTSocksIn.empty() && p->second.m_sUDTSocksOut.empty() && p->second.m_sLocals.empty() && (msTimeOut < 0))
+      if (d->m_mSocks.empty() && d->m_sLocals.empty() && (msTimeOut < 0))
       {
          // no socket is being monitored, this may be a deadlock
-         CGuard::leaveCS(m_EPollLock);
+         unlock(d);
          throw CUDTException(5, 3);
       }
 
-      // Sockets with exceptions are returned to both read and write sets.
-      if ((NULL != readfds) && (!p->second.m_sUDTReads.empty() || !p->second.m_sUDTExcepts.empty()))
+      // only the sockets on the ready list are visited, not all those being watched
+      CEPollItem* item = d->m_pReadyHead;
+      while (NULL != item)
       {
-         *readfds = p->second.m_sUDTReads;
-         for (set<UDTSOCKET>::const_iterator i = p->second.m_sUDTExcepts.begin(); i != p->second.m_sUDTExcepts.end(); ++ i)
-            readfds->insert(*i);
-         total += p->second.m_sUDTReads.size() + p->second.m_sUDTExcepts.size();
-      }
-      if ((NULL != writefds) && (!p->second.m_sUDTWrites.empty() || !p->second.m_sUDTExcepts.empty()))
-      {
-         *writefds = p->second.m_sUDTWrites;
-         for (set<UDTSOCKET>::const_iterator i = p->second.m_sUDTExcepts.begin(); i != p->second.m_sUDTExcepts.end(); ++ i)
-            writefds->insert(*i);
-         total += p->second.m_sUDTWrites.size() + p->second.m_sUDTExcepts.size();
+         CEPollItem* next = item->m_pNext;
+
+         int events = ready_events(*item);
+         bool reported = false;
+
+         // Sockets with exceptions are returned to both read and write sets.
+         if ((NULL != readfds) && (events & (UDT_EPOLL_IN | UDT_EPOLL_ERR)))
+         {
+            readfds->insert(item->m_Socket);
+            ++ total;
+            reported = true;
+         }
+         if ((NULL != writefds) && (events & (UDT_EPOLL_OUT | UDT_EPOLL_ERR)))
+         {
+            writefds->insert(item->m_Socket);
+            ++ total;
+            reported = true;
+         }
+
+         if (reported && (item->m_iWatch & UDT_EPOLL_ONESHOT))
+            item->m_iWatch &= UDT_EPOLL_ONESHOT | UDT_EPOLL_ET;
+
+         // a level-triggered socket stays on the list while its events hold,
+         // an edge-triggered one is only reported again when new events arrive
+         if ((0 == events) || (reported && ((item->m_iWatch & UDT_EPOLL_ET) || (0 == ready_events(*item)))))
+            clearReady(d, item);
+
+         item = next;
       }
 
-      if (lrfds || lwfds)
+      if ((lrfds || lwfds) && !d->m_sLocals.empty())
       {
          #ifdef LINUX
-         const int max_events = p->second.m_sLocals.size();
+         const int max_events = d->m_sLocals.size();
          epoll_event ev[max_events];
-         int nfds = ::epoll_wait(p->second.m_iLocalID, ev, max_events, 0);
+         int nfds = ::epoll_wait(d->m_iLocalID, ev, max_events, 0);
 
          for (int i = 0; i < nfds; ++ i)
          {
             if ((NULL != lrfds) && (ev[i].events & EPOLLIN))
-           {
+            {
                lrfds->insert(ev[i].data.fd);
                ++ total;
             }
@@ -256,7 +338,7 @@ int CEPoll::wait(const int eid, set<UDTSOCKET>* readfds, set<UDTSOCKET>* writefd
          FD_ZERO(&readfds);
          FD_ZERO(&writefds);
 
-         for (set<SYSSOCKET>::const_iterator i = p->second.m_sLocals.begin(); i != p->second.m_sLocals.end(); ++ i)
+         for (set<SYSSOCKET>::const_iterator i = d->m_sLocals.begin(); i != d->m_sLocals.end(); ++ i)
          {
             if (lrfds)
                FD_SET(*i, &readfds);
@@ -269,7 +351,7 @@ int CEPoll::wait(const int eid, set<UDTSOCKET>* readfds, set<UDTSOCKET>* writefd
          tv.tv_usec = 0;
          if (::select(0, &readfds, &writefds, NULL, &tv) > 0)
          {
-            for (set<SYSSOCKET>::const_iterator i = p->second.m_sLocals.begin(); i != p->second.m_sLocals.end(); ++ i)
+            for (set<SYSSOCKET>::const_iterator i = d->m_sLocals.begin(); i != d->m_sLocals.end(); ++ i)
             {
                if (lrfds && FD_ISSET(*i, &readfds))
                {
@@ -286,82 +368,359 @@ int CEPoll::wait(const int eid, set<UDTSOCKET>* readfds, set<UDTSOCKET>* writefd
          #endif
       }
 
-      CGuard::leaveCS(m_EPollLock);
-
       if (total > 0)
-         return total;
+         break;
 
-      if ((msTimeOut >= 0) && (int64_t(CTimer::getTime() - entertime) >= msTimeOut * 1000LL))
-         throw CUDTException(6, 3, 0);
+      // UDT sockets wake up this epoll only; system sockets have no notification and are polled every 10ms
+      int64_t interval = -1;
+      if (msTimeOut >= 0)
+      {
+         int64_t elapsed = CTimer::getTime() - entertime;
+         if (elapsed >= msTimeOut * 1000LL)
+         {
+            unlock(d);
+            throw CUDTException(6, 3, 0);
+         }
+         interval = msTimeOut * 1000LL - elapsed;
+      }
+      if (!d->m_sLocals.empty() && ((interval < 0) || (interval > 10000)))
+         interval = 10000;
 
-      CTimer::waitForEvent();
+      #ifndef WIN32
+         if (interval < 0)
+            pthread_cond_wait(&d->m_Cond, &d->m_Lock);
+         else
+         {
+            timeval now;
+            timespec timeout;
+            gettimeofday(&now, 0);
+            uint64_t expire = now.tv_sec * 1000000ULL + now.tv_usec + interval;
+            timeout.tv_sec = expire / 1000000;
+            timeout.tv_nsec = (expire % 1000000) * 1000;
+
+            pthread_cond_timedwait(&d->m_Cond, &d->m_Lock, &timeout);
+         }
+      #else
+         CGuard::leaveCS(d->m_Lock);
+         WaitForSingleObject(d->m_Cond, (interval < 0) ? INFINITE : DWORD((interval + 999) / 1000));
+         CGuard::enterCS(d->m_Lock);
+      #endif
    }
 
-   return 0;
+   unlock(d);
+
+   return total;
 }
 
 int CEPoll::release(const int eid)
 {
-   CGuard pg(m_EPollLock);
+   CEPollDesc* d;
 
-   map<int, CEPollDesc>::iterator i = m_mPolls.find(eid);
-   if (i == m_mPolls.end())
-      throw CUDTException(5, 13);
+   {
+      CGuard pg(m_EPollLock);
+
+      map<int, CEPollDesc*>::iterator i = m_mPolls.find(eid);
+      if (i == m_mPolls.end())
+         throw CUDTException(5, 13);
+
+      d = i->second;
+      m_mPolls.erase(i);
+   }
+
+   // the sockets drop their references on their next update, and the waiting calls return with an error
+   CGuard::enterCS(d->m_Lock);
+   d->m_bReleased = true;
+   d->m_mSocks.clear();
+   d->m_pCallback = NULL;
+   d->m_pReadyHead = d->m_pReadyTail = NULL;
 
    #ifdef LINUX
-   // release local/system epoll descriptor
-   ::close(i->second.m_iLocalID);
+   // release local/system epoll descriptor, and the event descriptor
+   ::close(d->m_iLocalID);
+   if (d->m_iEventFD >= 0)
+      ::close(d->m_iEventFD);
+   d->m_iEventFD = -1;
    #endif
 
-   m_mPolls.erase(i);
+   wakeup(d);
+   unlock(d);
 
    return 0;
 }
 
-namespace
+int CEPoll::getfd(const int eid)
 {
+   #ifdef LINUX
+   CEPollDesc* d = acquire(eid);
 
-void update_epoll_sets(const UDTSOCKET& uid, const set<UDTSOCKET>& watch, set<UDTSOCKET>& result, bool enable)
-{
-   if (enable && (watch.find(uid) != watch.end()))
+   // the descriptor is created on first use, so that the other epolls make no system call when sockets become ready
+   if (d->m_iEventFD < 0)
    {
-      result.insert(uid);
+      d->m_iEventFD = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (d->m_iEventFD < 0)
+      {
+         int err = errno;
+         unlock(d);
+         throw CUDTException(-1, 0, err);
+      }
+
+      uint64_t one = 1;
+      if (NULL != d->m_pReadyHead)
+         ::write(d->m_iEventFD, &one, sizeof(uint64_t));
    }
-   else if (!enable)
+
+   int fd = d->m_iEventFD;
+   unlock(d);
+
+   return fd;
+   #else
+   throw CUDTException(5, 0, 0);
+   #endif
+}
+
+int CEPoll::set_callback(const int eid, UDTEPOLLCB callback, void* arg)
+{
+   CEPollDesc* d = acquire(eid);
+
+   d->m_pCallback = callback;
+   d->m_pCallbackArg = arg;
+
+   // the sockets already queued are delivered now, they would not be signaled again
+   if (NULL != callback)
    {
-      result.erase(uid);
+      while (NULL != d->m_pReadyHead)
+      {
+         CEPollItem* item = d->m_pReadyHead;
+         clearReady(d, item);
+         if (0 != ready_events(*item))
+            notify(d, item);
+      }
    }
-}
 
-}  // namespace
+   unlock(d);
+
+   return 0;
+}
 
-int CEPoll::update_events(const UDTSOCKET& uid, std::set<int>& eids, int events, bool enable)
+int CEPoll::update_events(const UDTSOCKET& uid, CEPollSet& polls, int events, bool enable)
 {
-   CGuard pg(m_EPollLock);
+   // most sockets are not watched by any epoll
+   if (polls.empty())
+      return 0;
 
-   map<int, CEPollDesc>::iterator p;
+   vector<CEPollDesc*> lost;
 
-   vector<int> lost;
-   for (set<int>::iterator i = eids.begin(); i != eids.end(); ++ i)
+   CGuard sg(polls.m_Lock);
+
+   for (vector<CEPollDesc*>::iterator i = polls.m_vPolls.begin(); i != polls.m_vPolls.end(); ++ i)
    {
-      p = m_mPolls.find(*i);
-      if (p == m_mPolls.end())
+      CEPollDesc* d = *i;
+
+      CGuard::enterCS(d->m_Lock);
+
+      if (d->m_bReleased)
       {
-         lost.push_back(*i);
+         CGuard::leaveCS(d->m_Lock);
+         lost.push_back(d);
+         continue;
       }
-      else
+
+      map<UDTSOCKET, CEPollItem>::iterator p = d->m_mSocks.find(uid);
+      if (p != d->m_mSocks.end())
       {
-         if ((events & UDT_EPOLL_IN) != 0)
-            update_epoll_sets(uid, p->second.m_sUDTSocksIn, p->second.m_sUDTReads, enable);
-         if ((events & UDT_EPOLL_OUT) != 0)
-            update_epoll_sets(uid, p->second.m_sUDTSocksOut, p->second.m_sUDTWrites, enable);
-         if ((events & UDT_EPOLL_ERR) != 0)
-            update_epoll_sets(uid, p->second.m_sUDTSocksEx, p->second.m_sUDTExcepts, enable);
+         CEPollItem* item = &p->second;
+
+         int before = ready_events(*item);
+
+         if (enable)
+            item->m_iState |= events;
+         else
+            item->m_iState &= ~events;
+
+         int ready = ready_events(*item);
+         if (0 == ready)
+            clearReady(d, item);
+         else if (enable && (ready & events) && ((ready & ~before) || (item->m_iWatch & UDT_EPOLL_ET)))
+         {
+            // an edge-triggered socket is queued again on every new event, even if it has not been reported
+            notify(d, item);
+         }
       }
+
+      CGuard::leaveCS(d->m_Lock);
    }
 
-   for (vector<int>::iterator i = lost.begin(); i != lost.end(); ++ i)
-      eids.erase(*i);
+   for (vector<CEPollDesc*>::iterator i = lost.begin(); i != lost.end(); ++ i)
+   {
+      polls.m_vPolls.erase(find(polls.m_vPolls.begin(), polls.m_vPolls.end(), *i));
+      unref(*i);
+   }
+   polls.m_iSize = polls.m_vPolls.size();
 
    return 0;
 }
+
+void CEPoll::join(const int eid, CEPollSet& polls)
+{
+   CEPollDesc* d = acquire(eid);
+   CGuard::leaveCS(d->m_Lock);
+
+   CGuard sg(polls.m_Lock);
+
+   if (find(polls.m_vPolls.begin(), polls.m_vPolls.end(), d) == polls.m_vPolls.end())
+   {
+      // the reference is handed over to the socket
+      polls.m_vPolls.push_back(d);
+      polls.m_iSize = polls.m_vPolls.size();
+   }
+   else
+      unref(d);
+}
+
+void CEPoll::leave(const int eid, const UDTSOCKET& uid, CEPollSet& polls)
+{
+   vector<CEPollDesc*> removed;
+
+   {
+      CGuard sg(polls.m_Lock);
+
+      for (vector<CEPollDesc*>::iterator i = polls.m_vPolls.begin(); i != polls.m_vPolls.end();)
+      {
+         if ((eid < 0) || ((*i)->m_iID == eid))
+         {
+            removed.push_back(*i);
+            i = polls.m_vPolls.erase(i);
+         }
+         else
+            ++ i;
+      }
+      polls.m_iSize = polls.m_vPolls.size();
+   }
+
+   for (vector<CEPollDesc*>::iterator i = removed.begin(); i != removed.end(); ++ i)
+   {
+      CGuard::enterCS((*i)->m_Lock);
+      map<UDTSOCKET, CEPollItem>::iterator p = (*i)->m_mSocks.find(uid);
+      if (p != (*i)->m_mSocks.end())
+      {
+         clearReady(*i, &p->second);
+         (*i)->m_mSocks.erase(p);
+         wakeup(*i);
+      }
+      unlock(*i);
+   }
+}
+
+CEPollDesc* CEPoll::acquire(const int eid)
+{
+   CGuard pg(m_EPollLock);
+
+   map<int, CEPollDesc*>::iterator p = m_mPolls.find(eid);
+   if (p == m_mPolls.end())
+      throw CUDTException(5, 13);
+
+   // the epoll is returned locked, so that the reference and the lock are taken together
+   CGuard::enterCS(p->second->m_Lock);
+   ++ p->second->m_iRefCount;
+
+   return p->second;
+}
+
+void CEPoll::unlock(CEPollDesc* d)
+{
+   bool last = (0 == -- d->m_iRefCount);
+   CGuard::leaveCS(d->m_Lock);
+
+   if (last)
+      destroy(d);
+}
+
+void CEPoll::unref(CEPollDesc* d)
+{
+   CGuard::enterCS(d->m_Lock);
+   unlock(d);
+}
+
+void CEPoll::destroy(CEPollDesc* d)
+{
+   CGuard::releaseCond(d->m_Cond);
+   CGuard::releaseMutex(d->m_Lock);
+   delete d;
+}
+
+void CEPoll::setReady(CEPollDesc* d, CEPollItem* item)
+{
+   if (item->m_bReady)
+      return;
+
+   item->m_bReady = true;
+   item->m_pNext = NULL;
+   item->m_pPrev = d->m_pReadyTail;
+   if (NULL == d->m_pReadyTail)
+   {
+      d->m_pReadyHead = item;
+
+      #ifdef LINUX
+      // the event descriptor becomes readable with the first ready socket
+      uint64_t one = 1;
+      if (d->m_iEventFD >= 0)
+         ::write(d->m_iEventFD, &one, sizeof(uint64_t));
+      #endif
+   }
+   else
+      d->m_pReadyTail->m_pNext = item;
+   d->m_pReadyTail = item;
+}
+
+void CEPoll::clearReady(CEPollDesc* d, CEPollItem* item)
+{
+   if (!item->m_bReady)
+      return;
+
+   if (NULL == item->m_pPrev)
+      d->m_pReadyHead = item->m_pNext;
+   else
+      item->m_pPrev->m_pNext = item->m_pNext;
+   if (NULL == item->m_pNext)
+      d->m_pReadyTail = item->m_pPrev;
+   else
+      item->m_pNext->m_pPrev = item->m_pPrev;
+
+   item->m_bReady = false;
+   item->m_pPrev = item->m_pNext = NULL;
+
+   #ifdef LINUX
+   // and is cleared when no socket is ready any more
+   uint64_t count;
+   if ((NULL == d->m_pReadyHead) && (d->m_iEventFD >= 0))
+      ::read(d->m_iEventFD, &count, sizeof(uint64_t));
+   #endif
+}
+
+void CEPoll::wakeup(CEPollDesc* d)
+{
+   #ifndef WIN32
+      pthread_cond_broadcast(&d->m_Cond);
+   #else
+      SetEvent(d->m_Cond);
+   #endif
+}
+
+void CEPoll::notify(CEPollDesc* d, CEPollItem* item)
+{
+   if (NULL == d->m_pCallback)
+   {
+      setReady(d, item);
+
+      // wake up the callers waiting on this epoll only
+      wakeup(d);
+      return;
+   }
+
+   // the callback takes the place of wait(): the socket is reported now, and a one-shot socket is disabled
+   int events = ready_events(*item);
+   if (item->m_iWatch & UDT_EPOLL_ONESHOT)
+      item->m_iWatch &= UDT_EPOLL_ONESHOT | UDT_EPOLL_ET;
+
+   d->m_pCallback(d->m_iID, item->m_Socket, events, d->m_pCallbackArg);
+}
@@ -44,28 +44,77 @@ written by
 
 #include <map>
 #include <set>
+#include <vector>
 #include "udt.h"
 
 
+struct CEPollDesc;
+
+struct CEPollItem
+{
+   UDTSOCKET m_Socket;                       // UDT socket ID
+   int m_iWatch;                             // events watched, with the UDT_EPOLL_ET and UDT_EPOLL_ONESHOT flags
+   int m_iState;                             // events currently signaled on the socket
+
+   bool m_bReady;                            // if the item is on the ready list
+   CEPollItem* m_pPrev;                      // previous item on the ready list
+   CEPollItem* m_pNext;                      // next item on the ready list
+};
+
 struct CEPollDesc
 {
    int m_iID;                                // epoll ID
-   std::set<UDTSOCKET> m_sUDTSocksOut;       // set of UDT sockets waiting for write events
-   std::set<UDTSOCKET> m_sUDTSocksIn;        // set of UDT sockets waiting for read events
-   std::set<UDTSOCKET> m_sUDTSocksEx;        // set of UDT sockets waiting for exceptions
+   std::map<UDTSOCKET, CEPollItem> m_mSocks; // UDT sockets watched, with their events
+
+   CEPollItem* m_pReadyHead;                 // UDT sockets with events to be reported, in the order they became ready
+   CEPollItem* m_pReadyTail;
 
    int m_iLocalID;                           // local system epoll ID
+   int m_iEventFD;                           // eventfd readable while any UDT socket is ready, -1 if not supported
    std::set<SYSSOCKET> m_sLocals;            // set of local (non-UDT) descriptors
 
-   std::set<UDTSOCKET> m_sUDTWrites;         // UDT sockets ready for write
-   std::set<UDTSOCKET> m_sUDTReads;          // UDT sockets ready for read
-   std::set<UDTSOCKET> m_sUDTExcepts;        // UDT sockets with exceptions (connection broken, etc.)
+   UDTEPOLLCB m_pCallback;                   // if not NULL, receives the events of the UDT sockets instead of the ready list
+   void* m_pCallbackArg;
+
+   int m_iRefCount;                          // references from the epoll table, the sockets and the waiting calls
+   bool m_bReleased;                         // if the epoll has been released by the application
+
+   pthread_mutex_t m_Lock;                   // protects this epoll, and the reference count
+   pthread_cond_t m_Cond;                    // signaled when a socket becomes ready or the epoll is released
+};
+
+class CEPollSet
+{
+friend class CEPoll;
+
+public:
+   CEPollSet();
+   ~CEPollSet();
+
+      // Functionality:
+      //    Check, without locking, if the socket has been added to any epoll.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    true if there is no epoll to be updated, otherwise false.
+
+   bool empty() const {return 0 == m_iSize;}
+
+private:
+   std::vector<CEPollDesc*> m_vPolls;        // epolls the socket has been added to, each holding a reference
+   volatile int m_iSize;                     // number of epolls in m_vPolls
+   pthread_mutex_t m_Lock;                   // protects m_vPolls
+
+private:
+   CEPollSet(const CEPollSet&);
+   CEPollSet& operator=(const CEPollSet&);
 };
 
 class CEPoll
 {
 friend class CUDT;
 friend class CRendezvousQueue;
+friend class CEPollSet;
 
 public:
    CEPoll();
@@ -83,11 +132,11 @@ public: // for CUDTUnited API
    int create();
 
       // Functionality:
-      //    add a UDT socket to an EPoll.
+      //    add a UDT socket to an EPoll, or change the events watched if it has been added.
       // Parameters:
       //    0) [in] eid: EPoll ID.
       //    1) [in] u: UDT Socket ID.
-      //    2) [in] events: events to watch.
+      //    2) [in] events: events to watch, with UDT_EPOLL_ET or UDT_EPOLL_ONESHOT.
       // Returned value:
       //    0 if success, otherwise an error number.
 
@@ -147,26 +196,79 @@ public: // for CUDTUnited API
 
    int release(const int eid);
 
+      // Functionality:
+      //    get a system descriptor (eventfd) that is readable while any UDT socket in the EPoll is ready,
+      //    so that the EPoll can be watched by another event loop. Linux only.
+      // Parameters:
+      //    0) [in] eid: EPoll ID.
+      // Returned value:
+      //    the descriptor, owned by the EPoll.
+
+   int getfd(const int eid);
+
+      // Functionality:
+      //    deliver the events of the UDT sockets to a callback as soon as they happen, instead of queuing them for wait().
+      // Parameters:
+      //    0) [in] eid: EPoll ID.
+      //    1) [in] callback: function called with the socket and its events, NULL to go back to wait().
+      //    2) [in] arg: argument passed to the callback.
+      // Returned value:
+      //    0 if success, otherwise an error number.
+
+   int set_callback(const int eid, UDTEPOLLCB callback, void* arg);
+
 public: // for CUDT to acknowledge IO status
 
       // Functionality:
       //    Update events available for a UDT socket.
       // Parameters:
       //    0) [in] uid: UDT socket ID.
-      //    1) [in] eids: EPoll IDs to be set
-      //    1) [in] events: Combination of events to update
-      //    1) [in] enable: true -> enable, otherwise disable
+      //    1) [in] polls: EPolls to be updated, those that have been released are dropped
+      //    2) [in] events: Combination of events to update
+      //    3) [in] enable: true -> enable, otherwise disable
       // Returned value:
       //    0 if success, otherwise an error number
 
-   int update_events(const UDTSOCKET& uid, std::set<int>& eids, int events, bool enable);
+   int update_events(const UDTSOCKET& uid, CEPollSet& polls, int events, bool enable);
+
+      // Functionality:
+      //    Record that a UDT socket has been added to an EPoll, so that its events are delivered there.
+      // Parameters:
+      //    0) [in] eid: EPoll ID.
+      //    1) [in] polls: EPolls of the socket.
+      // Returned value:
+      //    None.
+
+   void join(const int eid, CEPollSet& polls);
+
+      // Functionality:
+      //    Record that a UDT socket has been removed from an EPoll, or from all of them.
+      // Parameters:
+      //    0) [in] eid: EPoll ID, or -1 for all.
+      //    1) [in] uid: UDT socket ID, to be removed from the EPolls as well.
+      //    2) [in] polls: EPolls of the socket.
+      // Returned value:
+      //    None.
+
+   void leave(const int eid, const UDTSOCKET& uid, CEPollSet& polls);
+
+private:
+   CEPollDesc* acquire(const int eid);
+   static void unlock(CEPollDesc* d);
+   static void unref(CEPollDesc* d);
+   static void destroy(CEPollDesc* d);
+
+   static void setReady(CEPollDesc* d, CEPollItem* item);
+   static void clearReady(CEPollDesc* d, CEPollItem* item);
+   static void wakeup(CEPollDesc* d);
+   static void notify(CEPollDesc* d, CEPollItem* item);
 
 private:
    int m_iIDSeed;                            // seed to generate a new ID
    pthread_mutex_t m_SeedLock;
 
-   std::map<int, CEPollDesc> m_mPolls;       // all epolls
-   pthread_mutex_t m_EPollLock;
+   std::map<int, CEPollDesc*> m_mPolls;      // all epolls
+   pthread_mutex_t m_EPollLock;              // protects m_mPolls only, each epoll has its own lock
 };
 
 
@@ -0,0 +1,529 @@
+/*****************************************************************************
+Copyright (c) 2001 - 2011, The Board of Trustees of the University of Illinois.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the
+  above copyright notice, this list of conditions
+  and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the University of Illinois
+  nor the names of its contributors may be used to
+  endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef WIN32
+   #include <unistd.h>
+   #include <fcntl.h>
+   #include <sys/mman.h>
+   #include <sys/stat.h>
+   #include <sys/uio.h>
+   #include <cerrno>
+   #include <cstdlib>
+#endif
+#include <cstring>
+#include "common.h"
+#include "file.h"
+
+using namespace std;
+
+CMemSource::CMemSource(const char* data, int64_t size):
+m_pcData(data),
+m_llSize(size)
+{
+}
+
+int CMemSource::read(const iovec* vec, int num, int64_t offset)
+{
+   int total = 0;
+   for (int i = 0; (i < num) && (offset < m_llSize); ++ i)
+   {
+      int size = (int)vec[i].iov_len;
+      if (size > m_llSize - offset)
+         size = int(m_llSize - offset);
+
+      memcpy(vec[i].iov_base, m_pcData + offset, size);
+      offset += size;
+      total += size;
+   }
+
+   return total;
+}
+
+const char* CMemSource::lend(int64_t offset, int len, UDTSENDCB& release, void*& arg)
+{
+   if ((offset < 0) || (offset + len > m_llSize))
+      return NULL;
+
+   // the memory belongs to the application, nothing to be released
+   release = NULL;
+   arg = NULL;
+   return m_pcData + offset;
+}
+
+CMemSink::CMemSink(char* data, int64_t size):
+m_pcData(data),
+m_llSize(size)
+{
+}
+
+int CMemSink::write(const iovec* vec, int num, int64_t offset)
+{
+   int total = 0;
+   for (int i = 0; i < num; ++ i)
+   {
+      if ((offset < 0) || (offset + (int64_t)vec[i].iov_len > m_llSize))
+         return -1;
+
+      memcpy(m_pcData + offset, vec[i].iov_base, vec[i].iov_len);
+      offset += vec[i].iov_len;
+      total += vec[i].iov_len;
+   }
+
+   return total;
+}
+
+CStreamSource::CStreamSource(fstream& ifs):
+m_IFS(ifs)
+{
+}
+
+int CStreamSource::read(const iovec* vec, int num, int64_t offset)
+{
+   if (m_IFS.bad() || m_IFS.fail())
+      return m_IFS.eof() ? 0 : -1;
+
+   try
+   {
+      m_IFS.seekg((streamoff)offset);
+   }
+   catch (...)
+   {
+      return -1;
+   }
+
+   int total = 0;
+   for (int i = 0; i < num; ++ i)
+   {
+      m_IFS.read((char*)vec[i].iov_base, vec[i].iov_len);
+      total += (int)m_IFS.gcount();
+      if (m_IFS.gcount() < (streamsize)vec[i].iov_len)
+         break;
+   }
+
+   if (m_IFS.bad() || (m_IFS.fail() && !m_IFS.eof()))
+      return -1;
+
+   return total;
+}
+
+CStreamSink::CStreamSink(fstream& ofs):
+m_OFS(ofs)
+{
+}
+
+int CStreamSink::write(const iovec* vec, int num, int64_t offset)
+{
+   try
+   {
+      m_OFS.seekp((streamoff)offset);
+   }
+   catch (...)
+   {
+      return -1;
+   }
+
+   int total = 0;
+   for (int i = 0; i < num; ++ i)
+   {
+      m_OFS.write((char*)vec[i].iov_base, vec[i].iov_len);
+      if (m_OFS.fail())
+         return -1;
+      total += vec[i].iov_len;
+   }
+
+   return total;
+}
+
+#ifndef WIN32
+CFileSource::CFileSource(int fd, bool map):
+m_iFD(fd),
+m_bMap(map)
+{
+}
+
+int CFileSource::read(const iovec* vec, int num, int64_t offset)
+{
+   int total = 0;
+
+   #ifdef LINUX
+      int res;
+      while (((res = ::preadv(m_iFD, vec, num, offset)) < 0) && (EINTR == errno)) {}
+      total = res;
+   #else
+      for (int i = 0; i < num; ++ i)
+      {
+         int res = ::pread(m_iFD, vec[i].iov_base, vec[i].iov_len, offset + total);
+         if (res < 0)
+         {
+            if (EINTR == errno)
+            {
+               -- i;
+               continue;
+            }
+            return (0 == total) ? -1 : total;
+         }
+         total += res;
+         if (res < (int)vec[i].iov_len)
+            break;
+      }
+   #endif
+
+   return total;
+}
+
+// a block of file mapped by CFileSource, released when all its packets are acknowledged
+struct CFileBlock
+{
+   void* m_pBase;                       // start of the mapping, aligned to the page size
+   size_t m_iLength;                    // size of the mapping
+};
+
+static void unmapFileBlock(UDTSOCKET, const char*, int, bool, void* arg)
+{
+   CFileBlock* fb = (CFileBlock*)arg;
+   ::munmap(fb->m_pBase, fb->m_iLength);
+   delete fb;
+}
+
+const char* CFileSource::lend(int64_t offset, int len, UDTSENDCB& release, void*& arg)
+{
+   if (!m_bMap)
+      return NULL;
+
+   // the tail of the file is read, accessing a mapping beyond the end of file is fatal
+   struct stat st;
+   if ((0 != ::fstat(m_iFD, &st)) || (offset < 0) || (offset + len > st.st_size))
+      return NULL;
+
+   // the mapping must start at a page boundary
+   static const int64_t pagesize = ::sysconf(_SC_PAGESIZE);
+   int64_t base = offset - offset % pagesize;
+
+   CFileBlock* fb = new CFileBlock;
+   fb->m_iLength = size_t(offset - base) + len;
+   fb->m_pBase = ::mmap(NULL, fb->m_iLength, PROT_READ, MAP_SHARED, m_iFD, base);
+   if (MAP_FAILED == fb->m_pBase)
+   {
+      delete fb;
+      return NULL;
+   }
+   ::madvise(fb->m_pBase, fb->m_iLength, MADV_WILLNEED);
+
+   release = unmapFileBlock;
+   arg = fb;
+   return (char*)fb->m_pBase + (offset - base);
+}
+
+CFileSink::CFileSink(int fd):
+m_iFD(fd)
+{
+}
+
+int CFileSink::write(const iovec* vec, int num, int64_t offset)
+{
+   int total = 0;
+
+   #ifdef LINUX
+      int res;
+      while (((res = ::pwritev(m_iFD, vec, num, offset)) < 0) && (EINTR == errno)) {}
+      total = res;
+   #else
+      for (int i = 0; i < num; ++ i)
+      {
+         int res = ::pwrite(m_iFD, vec[i].iov_base, vec[i].iov_len, offset + total);
+         if (res < 0)
+         {
+            if (EINTR == errno)
+            {
+               -- i;
+               continue;
+            }
+            return (0 == total) ? -1 : total;
+         }
+         total += res;
+         if (res < (int)vec[i].iov_len)
+            break;
+      }
+   #endif
+
+   return total;
+}
+
+const int CFileWriter::m_iAlignment = 4096;
+
+CFileWriter::CFileWriter(int fd, int size):
+m_iFD(fd),
+m_llOffset(0),
+m_pBuffer(NULL),
+m_iBufNum(4),
+m_iBufSize(),
+m_iFillPos(0),
+m_iWritePos(0),
+m_iPending(0),
+m_bClosing(false),
+m_bError(false),
+m_bDirect(false),
+m_WorkerThread(),
+m_Lock(),
+m_Cond()
+{
+   // split the in-flight data into a few buffers, so that the application can fill one while the others are written
+   m_iBufSize = size / m_iBufNum;
+   m_iBufSize -= m_iBufSize % m_iAlignment;
+   if (m_iBufSize < m_iAlignment)
+      m_iBufSize = m_iAlignment;
+
+   #ifdef LINUX
+      m_bDirect = (0 != (::fcntl(m_iFD, F_GETFL) & O_DIRECT));
+   #endif
+
+   m_pBuffer = new Buffer[m_iBufNum];
+   for (int i = 0; i < m_iBufNum; ++ i)
+   {
+      void* p = NULL;
+      if (0 != ::posix_memalign(&p, m_iAlignment, m_iBufSize))
+      {
+         for (int j = 0; j < i; ++ j)
+            ::free(m_pBuffer[j].m_pcData);
+         delete [] m_pBuffer;
+         throw CUDTException(3, 2, 0);
+      }
+      m_pBuffer[i].m_pcData = (char*)p;
+      m_pBuffer[i].m_iLength = 0;
+      m_pBuffer[i].m_llOffset = 0;
+   }
+
+   pthread_mutex_init(&m_Lock, NULL);
+   pthread_cond_init(&m_Cond, NULL);
+
+   if (0 != pthread_create(&m_WorkerThread, NULL, CFileWriter::worker, this))
+   {
+      pthread_mutex_destroy(&m_Lock);
+      pthread_cond_destroy(&m_Cond);
+      for (int i = 0; i < m_iBufNum; ++ i)
+         ::free(m_pBuffer[i].m_pcData);
+      delete [] m_pBuffer;
+      throw CUDTException(3, 1);
+   }
+}
+
+CFileWriter::~CFileWriter()
+{
+   // the submitted buffers are still written, data not submitted by flush() is discarded
+   pthread_mutex_lock(&m_Lock);
+   m_bClosing = true;
+   pthread_cond_broadcast(&m_Cond);
+   pthread_mutex_unlock(&m_Lock);
+
+   pthread_join(m_WorkerThread, NULL);
+
+   pthread_mutex_destroy(&m_Lock);
+   pthread_cond_destroy(&m_Cond);
+
+   for (int i = 0; i < m_iBufNum; ++ i)
+      ::free(m_pBuffer[i].m_pcData);
+   delete [] m_pBuffer;
+}
+
+int CFileWriter::write(const iovec* vec, int num, int64_t offset)
+{
+   if (m_bError)
+      return -1;
+
+   // each buffer holds contiguous data of the file
+   Buffer* b = m_pBuffer + m_iFillPos;
+   if ((b->m_iLength > 0) && (offset != m_llOffset))
+   {
+      submit();
+      b = m_pBuffer + m_iFillPos;
+   }
+   if (0 == b->m_iLength)
+      b->m_llOffset = m_llOffset = offset;
+
+   int total = 0;
+   for (int i = 0; i < num; ++ i)
+   {
+      const char* data = (const char*)vec[i].iov_base;
+      int len = (int)vec[i].iov_len;
+
+      while (len > 0)
+      {
+         int size = m_iBufSize - b->m_iLength;
+         if (size > len)
+            size = len;
+
+         memcpy(b->m_pcData + b->m_iLength, data, size);
+         b->m_iLength += size;
+         m_llOffset += size;
+         data += size;
+         len -= size;
+         total += size;
+
+         if (b->m_iLength == m_iBufSize)
+         {
+            submit();
+            b = m_pBuffer + m_iFillPos;
+         }
+      }
+   }
+
+   return m_bError ? -1 : total;
+}
+
+int CFileWriter::flush()
+{
+   if (m_pBuffer[m_iFillPos].m_iLength > 0)
+      submit();
+
+   pthread_mutex_lock(&m_Lock);
+   while (m_iPending > 0)
+      pthread_cond_wait(&m_Cond, &m_Lock);
+   pthread_mutex_unlock(&m_Lock);
+
+   return m_bError ? -1 : 0;
+}
+
+void CFileWriter::submit()
+{
+   pthread_mutex_lock(&m_Lock);
+
+   ++ m_iPending;
+   pthread_cond_broadcast(&m_Cond);
+
+   // wait for the next buffer to be written out, if all of them are in flight
+   m_iFillPos = (m_iFillPos + 1) % m_iBufNum;
+   while (m_iPending == m_iBufNum)
+      pthread_cond_wait(&m_Cond, &m_Lock);
+
+   pthread_mutex_unlock(&m_Lock);
+
+   m_pBuffer[m_iFillPos].m_iLength = 0;
+   m_pBuffer[m_iFillPos].m_llOffset = m_llOffset;
+}
+
+void* CFileWriter::worker(void* param)
+{
+   CFileWriter* self = (CFileWriter*)param;
+
+   pthread_mutex_lock(&self->m_Lock);
+
+   while (true)
+   {
+      while ((0 == self->m_iPending) && !self->m_bClosing)
+         pthread_cond_wait(&self->m_Cond, &self->m_Lock);
+
+      if (0 == self->m_iPending)
+         break;
+
+      Buffer* b = self->m_pBuffer + self->m_iWritePos;
+      pthread_mutex_unlock(&self->m_Lock);
+
+      // once a write fails, the remaining buffers are dropped
+      bool error = self->m_bError || (self->writeBuffer(b->m_pcData, b->m_iLength, b->m_llOffset) < 0);
+
+      pthread_mutex_lock(&self->m_Lock);
+      if (error)
+         self->m_bError = true;
+      self->m_iWritePos = (self->m_iWritePos + 1) % self->m_iBufNum;
+      -- self->m_iPending;
+      pthread_cond_broadcast(&self->m_Cond);
+   }
+
+   pthread_mutex_unlock(&self->m_Lock);
+
+   return NULL;
+}
+
+int CFileWriter::writeBuffer(const char* data, int len, int64_t offset)
+{
+   #ifdef LINUX
+      if (m_bDirect)
+      {
+         // direct I/O requires aligned offset and size: the aligned part is written directly,
+         // only the unaligned rest (usually the tail of the file) goes through the page cache
+         int aligned = (0 == offset % m_iAlignment) ? len - len % m_iAlignment : 0;
+         if (aligned > 0)
+         {
+            if (writeData(data, aligned, offset) < 0)
+            {
+               if (EINVAL != errno)
+                  return -1;
+
+               // the file system does not support direct I/O
+               m_bDirect = false;
+               ::fcntl(m_iFD, F_SETFL, ::fcntl(m_iFD, F_GETFL) & ~O_DIRECT);
+               return writeData(data, len, offset);
+            }
+
+            data += aligned;
+            len -= aligned;
+            offset += aligned;
+         }
+
+         if (0 == len)
+            return 0;
+
+         // switch off O_DIRECT for this write only, the following buffers are written directly again
+         int flags = ::fcntl(m_iFD, F_GETFL);
+         ::fcntl(m_iFD, F_SETFL, flags & ~O_DIRECT);
+         int res = writeData(data, len, offset);
+         ::fcntl(m_iFD, F_SETFL, flags);
+         return res;
+      }
+   #endif
+
+   return writeData(data, len, offset);
+}
+
+int CFileWriter::writeData(const char* data, int len, int64_t offset)
+{
+   while (len > 0)
+   {
+      int res = ::pwrite(m_iFD, data, len, offset);
+      if (res < 0)
+      {
+         if (EINTR == errno)
+            continue;
+         return -1;
+      }
+
+      data += res;
+      len -= res;
+      offset += res;
+   }
+
+   return 0;
+}
+#endif
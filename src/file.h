@@ -0,0 +1,142 @@
+/*****************************************************************************
+Copyright (c) 2001 - 2011, The Board of Trustees of the University of Illinois.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the
+  above copyright notice, this list of conditions
+  and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the University of Illinois
+  nor the names of its contributors may be used to
+  endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef __UDT_FILE_H__
+#define __UDT_FILE_H__
+
+
+#ifndef WIN32
+   #include <pthread.h>
+#endif
+#include <fstream>
+#include "udt.h"
+
+
+// Source of data in a C++ file stream, for the fstream version of sendfile().
+class UDT_API CStreamSource: public CUDTSource
+{
+public:
+   CStreamSource(std::fstream& ifs);
+
+   virtual int read(const iovec* vec, int num, int64_t offset);
+
+private:
+   std::fstream& m_IFS;
+};
+
+// Sink of data in a C++ file stream, for the fstream version of recvfile().
+class UDT_API CStreamSink: public CUDTSink
+{
+public:
+   CStreamSink(std::fstream& ofs);
+
+   virtual int write(const iovec* vec, int num, int64_t offset);
+
+private:
+   std::fstream& m_OFS;
+};
+
+#ifndef WIN32
+// Sink of data in a file, written asynchronously by a separate thread out of aligned buffers.
+class CFileWriter: public CUDTSink
+{
+public:
+   CFileWriter(int fd, int size);
+   virtual ~CFileWriter();
+
+      // Functionality:
+      //    Copy data into the write buffers, to be written to the file by the writer thread.
+      //    Block if all the buffers are being written.
+      // Parameters:
+      //    0) [in] vec: the buffers to be written, in order.
+      //    1) [in] num: number of buffers.
+      //    2) [in] offset: position of the data in the file.
+      // Returned value:
+      //    size of data accepted, or -1 if an earlier write has failed.
+
+   virtual int write(const iovec* vec, int num, int64_t offset);
+
+      // Functionality:
+      //    Write out all the buffered data and wait until all writes are completed.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    0 on success, -1 if any write has failed.
+
+   virtual int flush();
+
+public:
+   static const int m_iAlignment;       // alignment of buffer address, file offset and size required by direct I/O
+
+private:
+   static void* worker(void* param);
+
+   void submit();
+   int writeBuffer(const char* data, int len, int64_t offset);
+   int writeData(const char* data, int len, int64_t offset);
+
+private:
+   int m_iFD;                           // file descriptor
+   int64_t m_llOffset;                  // file offset of the end of the buffer being filled
+
+   struct Buffer
+   {
+      char* m_pcData;                   // aligned data buffer
+      int m_iLength;                    // size of the data in the buffer
+      int64_t m_llOffset;               // file offset of the data
+   } *m_pBuffer;                        // write buffers, used in a ring
+
+   int m_iBufNum;                       // number of write buffers
+   int m_iBufSize;                      // size of each write buffer
+   int m_iFillPos;                      // the buffer being filled by the application
+   int m_iWritePos;                     // the next buffer to be written by the writer thread
+   int m_iPending;                      // number of buffers submitted but not written yet
+
+   volatile bool m_bClosing;            // closing the writer thread
+   volatile bool m_bError;              // a write has failed
+   bool m_bDirect;                      // the file is written with direct I/O, used by the writer thread only
+
+   pthread_t m_WorkerThread;
+   pthread_mutex_t m_Lock;
+   pthread_cond_t m_Cond;               // signalled when a buffer is submitted or written
+
+private:
+   CFileWriter(const CFileWriter&);
+   CFileWriter& operator=(const CFileWriter&);
+};
+#endif
+
+
+#endif
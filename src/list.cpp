@@ -38,332 +38,317 @@ written by
    Yunhong Gu, last updated 01/22/2011
 *****************************************************************************/
 
+#ifdef WIN32
+   #include <intrin.h>
+#endif
+
 #include "list.h"
 
-CSndLossList::CSndLossList(int size):
-m_piData1(NULL),
-m_piData2(NULL),
-m_piNext(NULL),
-m_iHead(-1),
-m_iLength(0),
-m_iSize(size),
-m_iLastInsertPos(-1),
-m_ListLock()
+CBitmap::CBitmap(int size):
+m_pllWords(NULL),
+m_iLevels(0),
+m_iSize(size)
 {
-   m_piData1 = new int32_t [m_iSize];
-   m_piData2 = new int32_t [m_iSize];
-   m_piNext = new int [m_iSize];
-
-   // -1 means there is no data in the node
-   for (int i = 0; i < size; ++ i)
+   // each level has a bit for every word of the level below
+   int bits = size;
+   do
    {
-      m_piData1[i] = -1;
-      m_piData2[i] = -1;
-   }
-
-   // sender list needs mutex protection
-   #ifndef WIN32
-      pthread_mutex_init(&m_ListLock, 0);
-   #else
-      m_ListLock = CreateMutex(NULL, false, NULL);
-   #endif
+      int words = (bits + 63) >> 6;
+      m_iWords[m_iLevels] = words;
+      m_pllBits[m_iLevels] = NULL;
+      ++ m_iLevels;
+      bits = words;
+   } while ((bits > 1) && (m_iLevels < m_iMaxLevels));
 }
 
-CSndLossList::~CSndLossList()
+CBitmap::~CBitmap()
 {
-   delete [] m_piData1;
-   delete [] m_piData2;
-   delete [] m_piNext;
-
-   #ifndef WIN32
-      pthread_mutex_destroy(&m_ListLock);
-   #else
-      CloseHandle(m_ListLock);
-   #endif
+   delete [] m_pllWords;
 }
 
-int CSndLossList::insert(int32_t seqno1, int32_t seqno2)
+int CBitmap::set(int from, int to)
 {
-   CGuard listguard(m_ListLock);
+   if (to < from)
+      return set(from, m_iSize - 1) + set(0, to);
 
-   if (0 == m_iLength)
-   {
-      // insert data into an empty list
+   if (NULL == m_pllWords)
+      allocate();
 
-      m_iHead = 0;
-      m_piData1[m_iHead] = seqno1;
-      if (seqno2 != seqno1)
-         m_piData2[m_iHead] = seqno2;
+   int count = 0;
+
+   for (int w = from >> 6; w <= (to >> 6); ++ w)
+   {
+      uint64_t mask = ~uint64_t(0);
+      if (w == (from >> 6))
+         mask &= ~uint64_t(0) << (from & 63);
+      if (w == (to >> 6))
+         mask &= ~uint64_t(0) >> (63 - (to & 63));
+
+      uint64_t old = m_pllBits[0][w];
+      m_pllBits[0][w] = old | mask;
+      count += countBits(mask & ~old);
+
+      if (0 == old)
+         mark(w);
+   }
 
-      m_piNext[m_iHead] = -1;
-      m_iLastInsertPos = m_iHead;
+   return count;
+}
 
-      m_iLength += CSeqNo::seqlen(seqno1, seqno2);
+int CBitmap::clear(int from, int to)
+{
+   if (to < from)
+      return clear(from, m_iSize - 1) + clear(0, to);
 
-      return m_iLength;
-   }
+   if (NULL == m_pllWords)
+      return 0;
 
-   // otherwise find the position where the data can be inserted
-   int origlen = m_iLength;
-   int offset = CSeqNo::seqoff(m_piData1[m_iHead], seqno1);
-   int loc = (m_iHead + offset + m_iSize) % m_iSize;
+   int count = 0;
 
-   if (offset < 0)
+   // jump over the empty words through the upper levels
+   for (int pos = find(from); (pos >= 0) && (pos <= to); pos = find(pos))
    {
-      // Insert data prior to the head pointer
+      int w = pos >> 6;
+      uint64_t mask = ~uint64_t(0) << (pos & 63);
+      if (w == (to >> 6))
+         mask &= ~uint64_t(0) >> (63 - (to & 63));
 
-      m_piData1[loc] = seqno1;
-      if (seqno2 != seqno1)
-         m_piData2[loc] = seqno2;
+      count += countBits(m_pllBits[0][w] & mask);
+      m_pllBits[0][w] &= ~mask;
 
-      // new node becomes head
-      m_piNext[loc] = m_iHead;
-      m_iHead = loc;
-      m_iLastInsertPos = loc;
+      if (0 == m_pllBits[0][w])
+         unmark(w);
 
-      m_iLength += CSeqNo::seqlen(seqno1, seqno2);
+      pos = (w + 1) << 6;
+      if (pos >= m_iSize)
+         break;
    }
-   else if (offset > 0)
+
+   return count;
+}
+
+bool CBitmap::test(int pos) const
+{
+   return (NULL != m_pllWords) && (0 != (m_pllBits[0][pos >> 6] & (uint64_t(1) << (pos & 63))));
+}
+
+int CBitmap::find(int from) const
+{
+   if ((from >= m_iSize) || (NULL == m_pllWords))
+      return -1;
+
+   // go up until a level has a bit set after the position, then follow the lowest bits down
+   int level = 0;
+   int pos = from;
+   for (;;)
    {
-      if (seqno1 == m_piData1[loc])
-      {
-         m_iLastInsertPos = loc;
-
-         // first seqno is equivlent, compare the second
-         if (-1 == m_piData2[loc])
-         {
-            if (seqno2 != seqno1)
-            {
-               m_iLength += CSeqNo::seqlen(seqno1, seqno2) - 1;
-               m_piData2[loc] = seqno2;
-            }
-         }
-         else if (CSeqNo::seqcmp(seqno2, m_piData2[loc]) > 0)
-         {
-            // new seq pair is longer than old pair, e.g., insert [3, 7] to [3, 5], becomes [3, 7]
-            m_iLength += CSeqNo::seqlen(m_piData2[loc], seqno2) - 1;
-            m_piData2[loc] = seqno2;
-         }
-         else
-            // Do nothing if it is already there
-            return 0;
-      }
-      else
+      int w = pos >> 6;
+      if (w >= m_iWords[level])
+         return -1;
+
+      uint64_t bits = m_pllBits[level][w] & (~uint64_t(0) << (pos & 63));
+      if (0 != bits)
       {
-         // searching the prior node
-         int i;
-         if ((-1 != m_iLastInsertPos) && (CSeqNo::seqcmp(m_piData1[m_iLastInsertPos], seqno1) < 0))
-            i = m_iLastInsertPos;
-         else
-            i = m_iHead;
-
-         while ((-1 != m_piNext[i]) && (CSeqNo::seqcmp(m_piData1[m_piNext[i]], seqno1) < 0))
-            i = m_piNext[i];
-
-         if ((-1 == m_piData2[i]) || (CSeqNo::seqcmp(m_piData2[i], seqno1) < 0))
-         {
-            m_iLastInsertPos = loc;
-
-            // no overlap, create new node
-            m_piData1[loc] = seqno1;
-            if (seqno2 != seqno1)
-               m_piData2[loc] = seqno2;
-
-            m_piNext[loc] = m_piNext[i];
-            m_piNext[i] = loc;
-
-            m_iLength += CSeqNo::seqlen(seqno1, seqno2);
-         }
-         else
-         {
-            m_iLastInsertPos = i;
-
-            // overlap, coalesce with prior node, insert(3, 7) to [2, 5], ... becomes [2, 7]
-            if (CSeqNo::seqcmp(m_piData2[i], seqno2) < 0)
-            {
-               m_iLength += CSeqNo::seqlen(m_piData2[i], seqno2) - 1;
-               m_piData2[i] = seqno2;
-
-               loc = i;
-            }
-            else
-               return 0;
-         }
+         pos = (w << 6) + lowestBit(bits);
+         break;
       }
+
+      if (level == m_iLevels - 1)
+         return -1;
+
+      pos = w + 1;
+      ++ level;
    }
-   else
-   {
-      m_iLastInsertPos = m_iHead;
 
-      // insert to head node
-      if (seqno2 != seqno1)
-      {
-         if (-1 == m_piData2[loc])
-         {
-            m_iLength += CSeqNo::seqlen(seqno1, seqno2) - 1;
-            m_piData2[loc] = seqno2;
-         }
-         else if (CSeqNo::seqcmp(seqno2, m_piData2[loc]) > 0)
-         {
-            m_iLength += CSeqNo::seqlen(m_piData2[loc], seqno2) - 1;
-            m_piData2[loc] = seqno2;
-         }
-         else 
-            return 0;
-      }
-      else
-         return 0;
+   while (level > 0)
+   {
+      -- level;
+      pos = (pos << 6) + lowestBit(m_pllBits[level][pos]);
    }
 
-   // coalesce with next node. E.g., [3, 7], ..., [6, 9] becomes [3, 9] 
-   while ((-1 != m_piNext[loc]) && (-1 != m_piData2[loc]))
+   return pos;
+}
+
+int CBitmap::findZero(int from) const
+{
+   if (NULL == m_pllWords)
+      return (from < m_iSize) ? from : -1;
+
+   // runs of set bits are short compared with the bitmap, only the bits themselves are scanned
+   for (int w = from >> 6; w < m_iWords[0]; ++ w)
    {
-      int i = m_piNext[loc];
+      uint64_t bits = ~m_pllBits[0][w];
+      if (w == (from >> 6))
+         bits &= ~uint64_t(0) << (from & 63);
 
-      if (CSeqNo::seqcmp(m_piData1[i], CSeqNo::incseq(m_piData2[loc])) <= 0)
+      if (0 != bits)
       {
-         // coalesce if there is overlap
-         if (-1 != m_piData2[i])
-         {
-            if (CSeqNo::seqcmp(m_piData2[i], m_piData2[loc]) > 0)
-            {
-               if (CSeqNo::seqcmp(m_piData2[loc], m_piData1[i]) >= 0)
-                  m_iLength -= CSeqNo::seqlen(m_piData1[i], m_piData2[loc]);
-
-               m_piData2[loc] = m_piData2[i];
-            }
-            else
-               m_iLength -= CSeqNo::seqlen(m_piData1[i], m_piData2[i]);
-         }
-         else
-         {
-            if (m_piData1[i] == CSeqNo::incseq(m_piData2[loc]))
-               m_piData2[loc] = m_piData1[i];
-            else
-               m_iLength --;
-         }
-
-         m_piData1[i] = -1;
-         m_piData2[i] = -1;
-         m_piNext[loc] = m_piNext[i];
+         int pos = (w << 6) + lowestBit(bits);
+         return (pos < m_iSize) ? pos : -1;
       }
-      else
-         break;
    }
 
-   return m_iLength - origlen;
+   return -1;
 }
 
-void CSndLossList::remove(int32_t seqno)
+bool CBitmap::release()
 {
-   CGuard listguard(m_ListLock);
+   // the top level is a single word, it is 0 only if no bit is set
+   if ((NULL == m_pllWords) || (0 != m_pllBits[m_iLevels - 1][0]))
+      return false;
 
-   if (0 == m_iLength)
-      return;
+   delete [] m_pllWords;
+   m_pllWords = NULL;
+   for (int i = 0; i < m_iLevels; ++ i)
+      m_pllBits[i] = NULL;
 
-   // Remove all from the head pointer to a node with a larger seq. no. or the list is empty
-   int offset = CSeqNo::seqoff(m_piData1[m_iHead], seqno);
-   int loc = (m_iHead + offset + m_iSize) % m_iSize;
+   return true;
+}
 
-   if (0 == offset)
-   {
-      // It is the head. Remove the head and point to the next node
-      loc = (loc + 1) % m_iSize;
+int CBitmap::lowestBit(uint64_t x)
+{
+   #ifndef WIN32
+      return __builtin_ctzll(x);
+   #else
+      unsigned long i;
+      if (_BitScanForward(&i, (unsigned long)x))
+         return (int)i;
+      _BitScanForward(&i, (unsigned long)(x >> 32));
+      return (int)i + 32;
+   #endif
+}
 
-      if (-1 == m_piData2[m_iHead])
-         loc = m_piNext[m_iHead];
-      else
-      {
-         m_piData1[loc] = CSeqNo::incseq(seqno);
-         if (CSeqNo::seqcmp(m_piData2[m_iHead], CSeqNo::incseq(seqno)) > 0)
-            m_piData2[loc] = m_piData2[m_iHead];
+int CBitmap::countBits(uint64_t x)
+{
+   #ifndef WIN32
+      return __builtin_popcountll(x);
+   #else
+      x = x - ((x >> 1) & 0x5555555555555555ULL);
+      x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+      x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+      return (int)((x * 0x0101010101010101ULL) >> 56);
+   #endif
+}
 
-         m_piData2[m_iHead] = -1;
+void CBitmap::allocate()
+{
+   int total = 0;
+   for (int i = 0; i < m_iLevels; ++ i)
+      total += m_iWords[i];
 
-         m_piNext[loc] = m_piNext[m_iHead];
-      }
+   m_pllWords = new uint64_t [total];
+   for (int i = 0; i < total; ++ i)
+      m_pllWords[i] = 0;
 
-      m_piData1[m_iHead] = -1;
+   uint64_t* p = m_pllWords;
+   for (int i = 0; i < m_iLevels; ++ i)
+   {
+      m_pllBits[i] = p;
+      p += m_iWords[i];
+   }
+}
 
-      if (m_iLastInsertPos == m_iHead)
-         m_iLastInsertPos = -1;
+void CBitmap::mark(int word)
+{
+   for (int level = 1; level < m_iLevels; ++ level)
+   {
+      uint64_t old = m_pllBits[level][word >> 6];
+      m_pllBits[level][word >> 6] = old | (uint64_t(1) << (word & 63));
 
-      m_iHead = loc;
+      // the upper levels are already marked
+      if (0 != old)
+         break;
 
-      m_iLength --;
+      word >>= 6;
    }
-   else if (offset > 0)
+}
+
+void CBitmap::unmark(int word)
+{
+   for (int level = 1; level < m_iLevels; ++ level)
    {
-      int h = m_iHead;
+      m_pllBits[level][word >> 6] &= ~(uint64_t(1) << (word & 63));
 
-      if (seqno == m_piData1[loc])
-      {
-         // target node is not empty, remove part/all of the seqno in the node.
-         int temp = loc;
-         loc = (loc + 1) % m_iSize;
-
-         if (-1 == m_piData2[temp])
-            m_iHead = m_piNext[temp];
-         else
-         {
-            // remove part, e.g., [3, 7] becomes [], [4, 7] after remove(3)
-            m_piData1[loc] = CSeqNo::incseq(seqno);
-            if (CSeqNo::seqcmp(m_piData2[temp], m_piData1[loc]) > 0)
-               m_piData2[loc] = m_piData2[temp];
-            m_iHead = loc;
-            m_piNext[loc] = m_piNext[temp];
-            m_piNext[temp] = loc;
-            m_piData2[temp] = -1;
-         }
-      }
-      else
-      {
-         // target node is empty, check prior node
-         int i = m_iHead;
-         while ((-1 != m_piNext[i]) && (CSeqNo::seqcmp(m_piData1[m_piNext[i]], seqno) < 0))
-            i = m_piNext[i];
-
-         loc = (loc + 1) % m_iSize;
-
-         if (-1 == m_piData2[i])
-            m_iHead = m_piNext[i];
-         else if (CSeqNo::seqcmp(m_piData2[i], seqno) > 0)
-         {
-            // remove part/all seqno in the prior node
-            m_piData1[loc] = CSeqNo::incseq(seqno);
-            if (CSeqNo::seqcmp(m_piData2[i], m_piData1[loc]) > 0)
-               m_piData2[loc] = m_piData2[i];
-
-            m_piData2[i] = seqno;
-
-            m_piNext[loc] = m_piNext[i];
-            m_piNext[i] = loc;
-
-            m_iHead = loc;
-         }
-         else
-            m_iHead = m_piNext[i];
-      }
+      // the upper levels still have other words below them
+      if (0 != m_pllBits[level][word >> 6])
+         break;
 
-      // Remove all nodes prior to the new head
-      while (h != m_iHead)
-      {
-         if (m_piData2[h] != -1)
-         {
-            m_iLength -= CSeqNo::seqlen(m_piData1[h], m_piData2[h]);
-            m_piData2[h] = -1;
-         }
-         else
-            m_iLength --;
+      word >>= 6;
+   }
+}
 
-         m_piData1[h] = -1;
+////////////////////////////////////////////////////////////////////////////////
 
-         if (m_iLastInsertPos == h)
-            m_iLastInsertPos = -1;
+// the bitmap size is a power of 2, so that the position of a sequence number does not jump when the number wraps
+static int lossListSize(int size)
+{
+   int s = 64;
+   while (s < size)
+      s <<= 1;
+   return s;
+}
 
-         h = m_piNext[h];
-      }
-   }
+CSndLossList::CSndLossList(int size):
+m_iSize(lossListSize(size)),
+m_Bitmap(m_iSize),
+m_iLowSeq(0),
+m_iLength(0),
+m_ListLock()
+{
+   // sender list needs mutex protection
+   #ifndef WIN32
+      pthread_mutex_init(&m_ListLock, 0);
+   #else
+      m_ListLock = CreateMutex(NULL, false, NULL);
+   #endif
+}
+
+CSndLossList::~CSndLossList()
+{
+   #ifndef WIN32
+      pthread_mutex_destroy(&m_ListLock);
+   #else
+      CloseHandle(m_ListLock);
+   #endif
+}
+
+int CSndLossList::insert(int32_t seqno1, int32_t seqno2)
+{
+   CGuard listguard(m_ListLock);
+
+   if (CSeqNo::seqcmp(seqno1, seqno2) > 0)
+      return 0;
+
+   if ((0 == m_iLength) || (CSeqNo::seqcmp(seqno1, m_iLowSeq) < 0))
+      m_iLowSeq = seqno1;
+
+   int len = CSeqNo::seqlen(seqno1, seqno2);
+   if (len > m_iSize)
+      len = m_iSize;
+
+   int pos = seqno1 & (m_iSize - 1);
+   int num = m_Bitmap.set(pos, (pos + len - 1) & (m_iSize - 1));
+   m_iLength += num;
+
+   return num;
+}
+
+void CSndLossList::remove(int32_t seqno)
+{
+   CGuard listguard(m_ListLock);
+
+   if (0 == m_iLength)
+      return;
+
+   int len = CSeqNo::seqlen(m_iLowSeq, seqno);
+   if (CSeqNo::seqcmp(seqno, m_iLowSeq) < 0)
+      return;
+   if (len > m_iSize)
+      len = m_iSize;
+
+   int pos = m_iLowSeq & (m_iSize - 1);
+   m_iLength -= m_Bitmap.clear(pos, (pos + len - 1) & (m_iSize - 1));
+   m_iLowSeq = CSeqNo::incseq(seqno);
 }
 
 int CSndLossList::getLossLength()
@@ -383,71 +368,40 @@ int32_t CSndLossList::getLostSeq()
    if (0 == m_iLength)
      return -1;
 
-   if (m_iLastInsertPos == m_iHead)
-      m_iLastInsertPos = -1;
-
-   // return the first loss seq. no.
-   int32_t seqno = m_piData1[m_iHead];
+   // the first bit from the lowest possible sequence number, wrapping around the end of the bitmap
+   int low = m_iLowSeq & (m_iSize - 1);
+   int pos = m_Bitmap.find(low);
+   if (pos < 0)
+      pos = m_Bitmap.find(0);
 
-   // head moves to the next node
-   if (-1 == m_piData2[m_iHead])
-   {
-      //[3, -1] becomes [], and head moves to next node in the list
-      m_piData1[m_iHead] = -1;
-      m_iHead = m_piNext[m_iHead];
-   }
-   else
-   {
-      // shift to next node, e.g., [3, 7] becomes [], [4, 7]
-      int loc = (m_iHead + 1) % m_iSize;
-
-      m_piData1[loc] = CSeqNo::incseq(seqno);
-      if (CSeqNo::seqcmp(m_piData2[m_iHead], m_piData1[loc]) > 0)
-         m_piData2[loc] = m_piData2[m_iHead];
+   m_Bitmap.clear(pos, pos);
+   -- m_iLength;
 
-      m_piData1[m_iHead] = -1;
-      m_piData2[m_iHead] = -1;
+   int32_t seqno = CSeqNo::incseq(m_iLowSeq, (pos - low) & (m_iSize - 1));
+   m_iLowSeq = CSeqNo::incseq(seqno);
 
-      m_piNext[loc] = m_piNext[m_iHead];
-      m_iHead = loc;
-   }
+   return seqno;
+}
 
-   m_iLength --;
+bool CSndLossList::compact()
+{
+   CGuard listguard(m_ListLock);
 
-   return seqno;
+   return m_Bitmap.release();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 CRcvLossList::CRcvLossList(int size):
-m_piData1(NULL),
-m_piData2(NULL),
-m_piNext(NULL),
-m_piPrior(NULL),
-m_iHead(-1),
-m_iTail(-1),
-m_iLength(0),
-m_iSize(size)
+m_iSize(lossListSize(size)),
+m_Bitmap(m_iSize),
+m_iFirstSeq(-1),
+m_iLength(0)
 {
-   m_piData1 = new int32_t [m_iSize];
-   m_piData2 = new int32_t [m_iSize];
-   m_piNext = new int [m_iSize];
-   m_piPrior = new int [m_iSize];
-
-   // -1 means there is no data in the node
-   for (int i = 0; i < size; ++ i)
-   {
-      m_piData1[i] = -1;
-      m_piData2[i] = -1;
-   }
 }
 
 CRcvLossList::~CRcvLossList()
 {
-   delete [] m_piData1;
-   delete [] m_piData2;
-   delete [] m_piNext;
-   delete [] m_piPrior;
 }
 
 void CRcvLossList::insert(int32_t seqno1, int32_t seqno2)
@@ -456,194 +410,59 @@ void CRcvLossList::insert(int32_t seqno1, int32_t seqno2)
    // guaranteed by the UDT receiver
 
    if (0 == m_iLength)
-   {
-      // insert data into an empty list
-      m_iHead = 0;
-      m_iTail = 0;
-      m_piData1[m_iHead] = seqno1;
-      if (seqno2 != seqno1)
-         m_piData2[m_iHead] = seqno2;
-
-      m_piNext[m_iHead] = -1;
-      m_piPrior[m_iHead] = -1;
-      m_iLength += CSeqNo::seqlen(seqno1, seqno2);
-
+      m_iFirstSeq = seqno1;
+   else if (CSeqNo::seqoff(m_iFirstSeq, seqno2) >= m_iSize)
       return;
-   }
-
-   // otherwise searching for the position where the node should be
-   int offset = CSeqNo::seqoff(m_piData1[m_iHead], seqno1);
-   int loc = (m_iHead + offset) % m_iSize;
-
-   if ((-1 != m_piData2[m_iTail]) && (CSeqNo::incseq(m_piData2[m_iTail]) == seqno1))
-   {
-      // coalesce with prior node, e.g., [2, 5], [6, 7] becomes [2, 7]
-      loc = m_iTail;
-      m_piData2[loc] = seqno2;
-   }
-   else
-   {
-      // create new node
-      m_piData1[loc] = seqno1;
-
-      if (seqno2 != seqno1)
-         m_piData2[loc] = seqno2;
 
-      m_piNext[m_iTail] = loc;
-      m_piPrior[loc] = m_iTail;
-      m_piNext[loc] = -1;
-      m_iTail = loc;
-   }
-
-   m_iLength += CSeqNo::seqlen(seqno1, seqno2);
+   int pos = seqno1 & (m_iSize - 1);
+   m_iLength += m_Bitmap.set(pos, (pos + CSeqNo::seqlen(seqno1, seqno2) - 1) & (m_iSize - 1));
 }
 
 bool CRcvLossList::remove(int32_t seqno)
 {
    if (0 == m_iLength)
-      return false; 
-
-   // locate the position of "seqno" in the list
-   int offset = CSeqNo::seqoff(m_piData1[m_iHead], seqno);
-   if (offset < 0)
       return false;
 
-   int loc = (m_iHead + offset) % m_iSize;
-
-   if (seqno == m_piData1[loc])
-   {
-      // This is a seq. no. that starts the loss sequence
-
-      if (-1 == m_piData2[loc])
-      {
-         // there is only 1 loss in the sequence, delete it from the node
-         if (m_iHead == loc)
-         {
-            m_iHead = m_piNext[m_iHead];
-            if (-1 != m_iHead)
-               m_piPrior[m_iHead] = -1;
-         }
-         else
-         {
-            m_piNext[m_piPrior[loc]] = m_piNext[loc];
-            if (-1 != m_piNext[loc])
-               m_piPrior[m_piNext[loc]] = m_piPrior[loc];
-            else
-               m_iTail = m_piPrior[loc];
-         }
-
-         m_piData1[loc] = -1;
-      }
-      else
-      {
-         // there are more than 1 loss in the sequence
-         // move the node to the next and update the starter as the next loss inSeqNo(seqno)
-
-         // find next node
-         int i = (loc + 1) % m_iSize;
-
-         // remove the "seqno" and change the starter as next seq. no.
-         m_piData1[i] = CSeqNo::incseq(m_piData1[loc]);
-
-         // process the sequence end
-         if (CSeqNo::seqcmp(m_piData2[loc], CSeqNo::incseq(m_piData1[loc])) > 0)
-            m_piData2[i] = m_piData2[loc];
-
-         // remove the current node
-         m_piData1[loc] = -1;
-         m_piData2[loc] = -1;
- 
-         // update list pointer
-         m_piNext[i] = m_piNext[loc];
-         m_piPrior[i] = m_piPrior[loc];
-
-         if (m_iHead == loc)
-            m_iHead = i;
-         else
-            m_piNext[m_piPrior[i]] = i;
-
-         if (m_iTail == loc)
-            m_iTail = i;
-         else
-            m_piPrior[m_piNext[i]] = i;
-      }
-
-      m_iLength --;
-
-      return true;
-   }
-
-   // There is no loss sequence in the current position
-   // the "seqno" may be contained in a previous node
-
-   // searching previous node
-   int i = (loc - 1 + m_iSize) % m_iSize;
-   while (-1 == m_piData1[i])
-      i = (i - 1 + m_iSize) % m_iSize;
-
-   // not contained in this node, return
-   if ((-1 == m_piData2[i]) || (CSeqNo::seqcmp(seqno, m_piData2[i]) > 0))
-       return false;
+   int dist = CSeqNo::seqoff(m_iFirstSeq, seqno);
+   if ((dist < 0) || (dist >= m_iSize))
+      return false;
 
-   if (seqno == m_piData2[i])
-   {
-      // it is the sequence end
+   int pos = seqno & (m_iSize - 1);
+   if (!m_Bitmap.test(pos))
+      return false;
 
-      if (seqno == CSeqNo::incseq(m_piData1[i]))
-         m_piData2[i] = -1;
-      else
-         m_piData2[i] = CSeqNo::decseq(seqno);
-   }
-   else
-   {
-      // split the sequence
-
-      // construct the second sequence from CSeqNo::incseq(seqno) to the original sequence end
-      // located at "loc + 1"
-      loc = (loc + 1) % m_iSize;
-
-      m_piData1[loc] = CSeqNo::incseq(seqno);
-      if (CSeqNo::seqcmp(m_piData2[i], m_piData1[loc]) > 0)      
-         m_piData2[loc] = m_piData2[i];
-
-      // the first (original) sequence is between the original sequence start to CSeqNo::decseq(seqno)
-      if (seqno == CSeqNo::incseq(m_piData1[i]))
-         m_piData2[i] = -1;
-      else
-         m_piData2[i] = CSeqNo::decseq(seqno);
-
-      // update the list pointer
-      m_piNext[loc] = m_piNext[i];
-      m_piNext[i] = loc;
-      m_piPrior[loc] = i;
-
-      if (m_iTail == i)
-         m_iTail = loc;
-      else
-         m_piPrior[m_piNext[loc]] = loc;
-   }
+   m_Bitmap.clear(pos, pos);
+   -- m_iLength;
 
-   m_iLength --;
+   // a retransmission usually fills the first hole, move to the next one
+   if ((0 == dist) && (m_iLength > 0))
+      m_iFirstSeq = CSeqNo::incseq(m_iFirstSeq, findLoss(1));
 
    return true;
 }
 
 bool CRcvLossList::remove(int32_t seqno1, int32_t seqno2)
 {
-   if (seqno1 <= seqno2)
-   {
-      for (int32_t i = seqno1; i <= seqno2; ++ i)
-         remove(i);
-   }
-   else
-   {
-      for (int32_t j = seqno1; j < CSeqNo::m_iMaxSeqNo; ++ j)
-         remove(j);
-      for (int32_t k = 0; k <= seqno2; ++ k)
-         remove(k);
-   }
+   if (0 == m_iLength)
+      return false;
 
-   return true;
+   int dist1 = CSeqNo::seqoff(m_iFirstSeq, seqno1);
+   int dist2 = CSeqNo::seqoff(m_iFirstSeq, seqno2);
+   if ((dist2 < 0) || (dist1 >= m_iSize))
+      return false;
+   if (dist1 < 0)
+      dist1 = 0;
+   if (dist2 >= m_iSize)
+      dist2 = m_iSize - 1;
+
+   int pos = m_iFirstSeq & (m_iSize - 1);
+   int num = m_Bitmap.clear((pos + dist1) & (m_iSize - 1), (pos + dist2) & (m_iSize - 1));
+   m_iLength -= num;
+
+   if ((0 == dist1) && (m_iLength > 0))
+      m_iFirstSeq = CSeqNo::incseq(m_iFirstSeq, findLoss(dist2 + 1));
+
+   return num > 0;
 }
 
 bool CRcvLossList::find(int32_t seqno1, int32_t seqno2) const
@@ -651,19 +470,13 @@ bool CRcvLossList::find(int32_t seqno1, int32_t seqno2) const
    if (0 == m_iLength)
       return false;
 
-   int p = m_iHead;
-
-   while (-1 != p)
-   {
-      if ((CSeqNo::seqcmp(m_piData1[p], seqno1) == 0) ||
-          ((CSeqNo::seqcmp(m_piData1[p], seqno1) > 0) && (CSeqNo::seqcmp(m_piData1[p], seqno2) <= 0)) ||
-          ((CSeqNo::seqcmp(m_piData1[p], seqno1) < 0) && (m_piData2[p] != -1) && CSeqNo::seqcmp(m_piData2[p], seqno1) >= 0))
-          return true;
-
-      p = m_piNext[p];
-   }
+   int dist1 = CSeqNo::seqoff(m_iFirstSeq, seqno1);
+   int dist2 = CSeqNo::seqoff(m_iFirstSeq, seqno2);
+   if (dist2 < 0)
+      return false;
 
-   return false;
+   int dist = findLoss((dist1 < 0) ? 0 : dist1);
+   return (dist >= 0) && (dist <= dist2);
 }
 
 int CRcvLossList::getLossLength() const
@@ -676,28 +489,74 @@ int CRcvLossList::getFirstLostSeq() const
    if (0 == m_iLength)
       return -1;
 
-   return m_piData1[m_iHead];
+   return m_iFirstSeq;
 }
 
 void CRcvLossList::getLossArray(int32_t* array, int& len, int limit)
 {
    len = 0;
 
-   int i = m_iHead;
+   if (0 == m_iLength)
+      return;
 
-   while ((len < limit - 1) && (-1 != i))
+   // each run of lost packets is a range in the report
+   int dist = 0;
+   while ((len < limit - 1) && (dist < m_iSize) && ((dist = findLoss(dist)) >= 0))
    {
-      array[len] = m_piData1[i];
-      if (-1 != m_piData2[i])
+      int end = findEnd(dist);
+
+      array[len] = CSeqNo::incseq(m_iFirstSeq, dist);
+      if (end - dist > 1)
       {
          // there are more than 1 loss in the sequence
          array[len] |= 0x80000000;
          ++ len;
-         array[len] = m_piData2[i];
+         array[len] = CSeqNo::incseq(m_iFirstSeq, end - 1);
       }
 
       ++ len;
 
-      i = m_piNext[i];
+      dist = end;
    }
 }
+
+bool CRcvLossList::compact()
+{
+   return m_Bitmap.release();
+}
+
+int CRcvLossList::findLoss(int dist) const
+{
+   // the first lost packet at or after the distance, searching to the end of the bitmap and then from its start
+   int first = m_iFirstSeq & (m_iSize - 1);
+   int pos = (first + dist) & (m_iSize - 1);
+
+   int found = m_Bitmap.find(pos);
+   if ((pos >= first) && (found >= 0))
+      return found - first;
+
+   if (pos >= first)
+      found = m_Bitmap.find(0);
+   if ((found < 0) || (found >= first))
+      return -1;
+
+   return found + m_iSize - first;
+}
+
+int CRcvLossList::findEnd(int dist) const
+{
+   // the first received packet after the lost one at the distance, or the window size if there is none
+   int first = m_iFirstSeq & (m_iSize - 1);
+   int pos = (first + dist) & (m_iSize - 1);
+
+   int found = m_Bitmap.findZero(pos);
+   if ((pos >= first) && (found >= 0))
+      return found - first;
+
+   if (pos >= first)
+      found = m_Bitmap.findZero(0);
+   if ((found < 0) || (found >= first))
+      return m_iSize;
+
+   return found + m_iSize - first;
+}
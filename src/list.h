@@ -46,6 +46,108 @@ written by
 #include "common.h"
 
 
+class CBitmap
+{
+public:
+   CBitmap(int size);
+   ~CBitmap();
+
+      // Functionality:
+      //    Set all the bits in a range, which wraps around the end of the bitmap if "to" is smaller than "from".
+      // Parameters:
+      //    0) [in] from: the first bit.
+      //    1) [in] to: the last bit.
+      // Returned value:
+      //    number of bits that were not set previously.
+
+   int set(int from, int to);
+
+      // Functionality:
+      //    Clear all the bits in a range, which wraps around like set(); only the words with bits set are visited.
+      // Parameters:
+      //    0) [in] from: the first bit.
+      //    1) [in] to: the last bit.
+      // Returned value:
+      //    number of bits that were set previously.
+
+   int clear(int from, int to);
+
+      // Functionality:
+      //    Check if a bit is set.
+      // Parameters:
+      //    0) [in] pos: the bit.
+      // Returned value:
+      //    true if the bit is set, otherwise false.
+
+   bool test(int pos) const;
+
+      // Functionality:
+      //    Find the first bit set at or after a position.
+      // Parameters:
+      //    0) [in] from: the position to start searching.
+      // Returned value:
+      //    the bit found, or -1 if no bit is set from the position.
+
+   int find(int from) const;
+
+      // Functionality:
+      //    Find the first bit not set at or after a position.
+      // Parameters:
+      //    0) [in] from: the position to start searching.
+      // Returned value:
+      //    the bit found, or -1 if all the bits are set from the position.
+
+   int findZero(int from) const;
+
+      // Functionality:
+      //    Free the words if no bit is set; they are allocated again when a bit is set.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    true if the words are freed, otherwise false.
+
+   bool release();
+
+      // Functionality:
+      //    Find the lowest bit set in a word.
+      // Parameters:
+      //    0) [in] x: the word, not 0.
+      // Returned value:
+      //    index of the bit.
+
+   static int lowestBit(uint64_t x);
+
+      // Functionality:
+      //    Count the bits set in a word.
+      // Parameters:
+      //    0) [in] x: the word.
+      // Returned value:
+      //    number of bits set.
+
+   static int countBits(uint64_t x);
+
+private:
+   void allocate();
+   void mark(int word);
+   void unmark(int word);
+
+private:
+   // level 0 holds the bits, a bit of each higher level is set when the word below it is not 0, up to a single word
+   static const int m_iMaxLevels = 6;
+
+   uint64_t* m_pllWords;                // words of all levels, NULL until a bit is set
+   uint64_t* m_pllBits[m_iMaxLevels];   // words of each level
+   int m_iWords[m_iMaxLevels];          // number of words of each level
+   int m_iLevels;                       // number of levels
+   int m_iSize;                         // number of bits
+
+private:
+   CBitmap(const CBitmap&);
+   CBitmap& operator=(const CBitmap&);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
 class CSndLossList
 {
 public:
@@ -89,15 +191,22 @@ public:
 
    int32_t getLostSeq();
 
+      // Functionality:
+      //    Release the memory of an empty list, it is allocated again by the next insertion.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    true if the memory is released, otherwise false.
+
+   bool compact();
+
 private:
-   int32_t* m_piData1;                  // sequence number starts
-   int32_t* m_piData2;                  // seqnence number ends
-   int* m_piNext;                       // next node in the list
+   // a lost sequence number is a bit of the bitmap, located by the number modulo the size
+   int m_iSize;                         // size of the bitmap, a power of 2 not smaller than the span of the list
+   CBitmap m_Bitmap;                    // lost packets
 
-   int m_iHead;                         // first node
+   int32_t m_iLowSeq;                   // no sequence number in the list is smaller than this one
    int m_iLength;                       // loss length
-   int m_iSize;                         // size of the static array
-   int m_iLastInsertPos;                // position of last insert node
 
    pthread_mutex_t m_ListLock;          // used to synchronize list operation
 
@@ -182,16 +291,27 @@ public:
 
    void getLossArray(int32_t* array, int& len, int limit);
 
+      // Functionality:
+      //    Release the memory of an empty list, it is allocated again by the next insertion.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    true if the memory is released, otherwise false.
+
+   bool compact();
+
+private:
+   int findLoss(int dist) const;
+   int findEnd(int dist) const;
+
 private:
-   int32_t* m_piData1;                  // sequence number starts
-   int32_t* m_piData2;                  // sequence number ends
-   int* m_piNext;                       // next node in the list
-   int* m_piPrior;                      // prior node in the list;
+   // a lost sequence number is a bit of the bitmap, located by the number modulo the size; the lost packets are
+   // found by their distance from the first one
+   int m_iSize;                         // size of the bitmap, a power of 2 not smaller than the receiver window
+   CBitmap m_Bitmap;                    // lost packets
 
-   int m_iHead;                         // first node in the list
-   int m_iTail;                         // last node in the list;
+   int32_t m_iFirstSeq;                 // the first (smallest) lost sequence number
    int m_iLength;                       // loss length
-   int m_iSize;                         // size of the static array
 
 private:
    CRcvLossList(const CRcvLossList&);
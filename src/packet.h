@@ -44,14 +44,6 @@ written by
 
 #include "udt.h"
 
-#ifdef WIN32
-   struct iovec
-   {
-      int iov_len;
-      char* iov_base;
-   };
-#endif
-
 class CChannel;
 
 class CPacket
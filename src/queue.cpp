@@ -46,6 +46,7 @@ written by
    #endif
 #endif
 #include <cstring>
+#include <algorithm>
 
 #include "common.h"
 #include "core.h"
@@ -55,12 +56,16 @@ using namespace std;
 
 CUnitQueue::CUnitQueue():
 m_pQEntry(NULL),
-m_pCurrQueue(NULL),
 m_pLastQueue(NULL),
+m_pFreeUnit(NULL),
+m_pReleased(NULL),
 m_iSize(0),
 m_iCount(0),
+m_iInitSize(0),
+m_ullShrinkTime(0),
 m_iMSS(),
-m_iIPversion()
+m_iIPversion(),
+m_pBudget(NULL)
 {
 }
 
@@ -71,7 +76,9 @@ CUnitQueue::~CUnitQueue()
    while (p != NULL)
    {
       delete [] p->m_pUnit;
-      delete [] p->m_pBuffer;
+      CPktAllocator::release(p->m_pBuffer, p->m_iSize * m_iMSS);
+      if (NULL != m_pBudget)
+         m_pBudget->release(p->m_iSize * m_iMSS);
 
       CQEntry* q = p;
       if (p == m_pLastQueue)
@@ -82,7 +89,7 @@ CUnitQueue::~CUnitQueue()
    }
 }
 
-int CUnitQueue::init(int size, int mss, int version)
+int CUnitQueue::init(int size, int mss, int version, CMemBudget* budget)
 {
    CQEntry* tempq = NULL;
    CUnit* tempu = NULL;
@@ -92,13 +99,13 @@ int CUnitQueue::init(int size, int mss, int version)
    {
       tempq = new CQEntry;
       tempu = new CUnit [size];
-      tempb = new char [size * mss];
+      tempb = CPktAllocator::allocate(size * mss);
    }
    catch (...)
    {
       delete tempq;
       delete [] tempu;
-      delete [] tempb;
+      CPktAllocator::release(tempb, size * mss);
 
       return -1;
    }
@@ -107,44 +114,32 @@ int CUnitQueue::init(int size, int mss, int version)
    {
       tempu[i].m_iFlag = 0;
       tempu[i].m_Packet.m_pcData = tempb + i * mss;
+      tempu[i].m_pNextFree = (i + 1 < size) ? tempu + i + 1 : NULL;
    }
    tempq->m_pUnit = tempu;
    tempq->m_pBuffer = tempb;
    tempq->m_iSize = size;
 
-   m_pQEntry = m_pCurrQueue = m_pLastQueue = tempq;
+   m_pQEntry = m_pLastQueue = tempq;
    m_pQEntry->m_pNext = m_pQEntry;
 
-   m_pAvailUnit = m_pCurrQueue->m_pUnit;
+   m_pFreeUnit = tempu;
 
    m_iSize = size;
+   m_iInitSize = size;
    m_iMSS = mss;
    m_iIPversion = version;
 
+   // the first block is always kept, even beyond the budget
+   m_pBudget = budget;
+   if (NULL != m_pBudget)
+      m_pBudget->charge(size * mss);
+
    return 0;
 }
 
 int CUnitQueue::increase()
 {
-   // adjust/correct m_iCount
-   int real_count = 0;
-   CQEntry* p = m_pQEntry;
-   while (p != NULL)
-   {
-      CUnit* u = p->m_pUnit;
-      for (CUnit* end = u + p->m_iSize; u != end; ++ u)
-         if (u->m_iFlag != 0)
-            ++ real_count;
-
-      if (p == m_pLastQueue)
-         p = NULL;
-      else
-         p = p->m_pNext;
-   }
-   m_iCount = real_count;
-   if (double(m_iCount) / m_iSize < 0.9)
-      return -1;
-
    CQEntry* tempq = NULL;
    CUnit* tempu = NULL;
    char* tempb = NULL;
@@ -152,26 +147,35 @@ int CUnitQueue::increase()
    // all queues have the same size
    int size = m_pQEntry->m_iSize;
 
+   if ((NULL != m_pBudget) && !m_pBudget->acquire(size * m_iMSS))
+      return -1;
+
    try
    {
       tempq = new CQEntry;
       tempu = new CUnit [size];
-      tempb = new char [size * m_iMSS];
+      tempb = CPktAllocator::allocate(size * m_iMSS);
    }
    catch (...)
    {
       delete tempq;
       delete [] tempu;
-      delete [] tempb;
+      CPktAllocator::release(tempb, size * m_iMSS);
+      if (NULL != m_pBudget)
+         m_pBudget->release(size * m_iMSS);
 
       return -1;
    }
 
+   // the new units are put at the head of the free list
    for (int i = 0; i < size; ++ i)
    {
       tempu[i].m_iFlag = 0;
       tempu[i].m_Packet.m_pcData = tempb + i * m_iMSS;
+      tempu[i].m_pNextFree = (i + 1 < size) ? tempu + i + 1 : m_pFreeUnit;
    }
+   m_pFreeUnit = tempu;
+
    tempq->m_pUnit = tempu;
    tempq->m_pBuffer = tempb;
    tempq->m_iSize = size;
@@ -187,52 +191,472 @@ int CUnitQueue::increase()
 
 int CUnitQueue::shrink()
 {
-   // currently queue cannot be shrunk.
+   if (m_iSize == m_iInitSize)
+      return 0;
+
+   uint64_t currtime = CTimer::getTime();
+   if (currtime - m_ullShrinkTime < 1000000)
+      return 0;
+   m_ullShrinkTime = currtime;
+
+   collectFreeUnits();
+
+   // shrink only if less than a quarter of the units are in use
+   if (m_iCount * 4 >= m_iSize)
+      return 0;
+
+   // the blocks added by increase(), ordered by address, so that the block of a unit is found by a binary search
+   vector<pair<CUnit*, CQEntry*> > block;
+   for (CQEntry* p = m_pQEntry->m_pNext; p != m_pQEntry; p = p->m_pNext)
+      block.push_back(make_pair(p->m_pUnit, p));
+   sort(block.begin(), block.end());
+
+   // a block can be released when all of its units are on the free list
+   vector<int> free(block.size(), 0);
+   for (CUnit* u = m_pFreeUnit; NULL != u; u = u->m_pNextFree)
+   {
+      int b = findBlock(block, u);
+      if (b >= 0)
+         ++ free[b];
+   }
+
+   // keep at least half of the units free after shrinking
+   vector<bool> release(block.size(), false);
+   int size = m_iSize;
+   int released = 0;
+   for (unsigned int b = 0; (b < block.size()) && (m_iCount * 4 < size); ++ b)
+   {
+      CQEntry* p = block[b].second;
+      if ((free[b] < p->m_iSize) || (m_iCount * 2 > size - p->m_iSize))
+         continue;
+
+      release[b] = true;
+      size -= p->m_iSize;
+      ++ released;
+   }
+
+   if (0 == released)
+      return 0;
+
+   CUnit** q = &m_pFreeUnit;
+   while (NULL != *q)
+   {
+      int b = findBlock(block, *q);
+      if ((b >= 0) && release[b])
+         *q = (*q)->m_pNextFree;
+      else
+         q = &((*q)->m_pNextFree);
+   }
+
+   CQEntry* prev = m_pQEntry;
+   for (CQEntry* p = m_pQEntry->m_pNext; p != m_pQEntry; p = prev->m_pNext)
+   {
+      int b = findBlock(block, p->m_pUnit);
+      if (!release[b])
+      {
+         prev = p;
+         continue;
+      }
+
+      prev->m_pNext = p->m_pNext;
+      if (p == m_pLastQueue)
+         m_pLastQueue = prev;
+
+      m_iSize -= p->m_iSize;
+
+      delete [] p->m_pUnit;
+      CPktAllocator::release(p->m_pBuffer, p->m_iSize * m_iMSS);
+      if (NULL != m_pBudget)
+         m_pBudget->release(p->m_iSize * m_iMSS);
+      delete p;
+   }
+
+   return released;
+}
+
+int CUnitQueue::findBlock(const vector<pair<CUnit*, CQEntry*> >& block, const CUnit* unit)
+{
+   int l = 0, h = block.size() - 1;
+   while (l <= h)
+   {
+      int m = (l + h) >> 1;
+      if (unit < block[m].first)
+         h = m - 1;
+      else if (unit >= block[m].first + block[m].second->m_iSize)
+         l = m + 1;
+      else
+         return m;
+   }
+
    return -1;
 }
 
-CUnit* CUnitQueue::getNextAvailUnit()
+int CUnitQueue::getNextAvailUnits(CUnit** units, int num)
+{
+   if (NULL == m_pFreeUnit)
+      collectFreeUnits();
+
+   // keep 10% of the units free for the out-of-order packets of all sockets
+   if ((m_iCount + num) * 10 > m_iSize * 9)
+   {
+      collectFreeUnits();
+      if ((m_iCount + num) * 10 > m_iSize * 9)
+         increase();
+   }
+
+   int n = 0;
+   while ((n < num) && (NULL != m_pFreeUnit))
+   {
+      CUnit* unit = m_pFreeUnit;
+      m_pFreeUnit = unit->m_pNextFree;
+
+      unit->m_iFlag = 4;
+      units[n ++] = unit;
+   }
+
+   m_iCount += n;
+
+   return n;
+}
+
+int CUnitQueue::getAvailUnits() const
 {
-   if (m_iCount * 10 > m_iSize * 9)
-      increase();
+   if (NULL == m_pBudget)
+      return -1;
+
+   int64_t avail = m_iSize - m_iCount + m_pBudget->getAvailable() / m_iMSS;
+   return (avail < 0x7FFFFFFF) ? int(avail) : 0x7FFFFFFF;
+}
+
+void CUnitQueue::returnUnits(CUnit** units, int num)
+{
+   // the units taken by the buffers are occupied now, and may even have been released already
+   for (int i = 0; i < num; ++ i)
+   {
+      if (4 != units[i]->m_iFlag)
+         continue;
+
+      units[i]->m_iFlag = 0;
+      units[i]->m_pNextFree = m_pFreeUnit;
+      m_pFreeUnit = units[i];
+      -- m_iCount;
+   }
+}
+
+void CUnitQueue::makeUnitFree(CUnit* unit)
+{
+   unit->m_iFlag = 0;
+
+   // lock-free push, only the receiving worker takes the units off this stack, and it takes all of them at once
+   #ifndef WIN32
+      CUnit* top;
+      do
+      {
+         top = m_pReleased;
+         unit->m_pNextFree = top;
+      } while (!__sync_bool_compare_and_swap(&m_pReleased, top, unit));
+   #else
+      CUnit* top;
+      do
+      {
+         top = m_pReleased;
+         unit->m_pNextFree = top;
+      } while (InterlockedCompareExchangePointer((PVOID volatile*)&m_pReleased, unit, top) != top);
+   #endif
+}
+
+void CUnitQueue::collectFreeUnits()
+{
+   if (NULL == m_pReleased)
+      return;
+
+   #ifndef WIN32
+      CUnit* p = __sync_lock_test_and_set(&m_pReleased, (CUnit*)NULL);
+   #else
+      CUnit* p = (CUnit*)InterlockedExchangePointer((PVOID volatile*)&m_pReleased, NULL);
+   #endif
+
+   while (NULL != p)
+   {
+      CUnit* next = p->m_pNextFree;
+      p->m_pNextFree = m_pFreeUnit;
+      m_pFreeUnit = p;
+      -- m_iCount;
+      p = next;
+   }
+}
+
+CTimerWheel::CTimerWheel():
+m_llResolution(1),
+m_llCurrTick(0),
+m_iCount(0)
+{
+   memset(m_pSlot, 0, sizeof(m_pSlot));
+   memset(m_pBitmap, 0, sizeof(m_pBitmap));
+}
+
+void CTimerWheel::init(uint64_t time, uint64_t resolution)
+{
+   m_llResolution = (resolution > 0) ? resolution : 1;
+   m_llCurrTick = time / m_llResolution;
+}
+
+void CTimerWheel::insert(CWheelNode* n)
+{
+   place(n);
+   ++ m_iCount;
+}
+
+void CTimerWheel::remove(CWheelNode* n)
+{
+   unlink(n);
+   -- m_iCount;
+}
+
+CWheelNode* CTimerWheel::due(uint64_t time)
+{
+   uint64_t tick = time / m_llResolution;
+
+   // most of the time, the current slot still has nodes to be processed
+   CWheelNode* h = m_pSlot[0][m_llCurrTick & (m_iSlots - 1)];
+   if ((NULL != h) && (m_llCurrTick <= tick))
+   {
+      CWheelNode* n = h;
+      do
+      {
+         if (n->m_llTimeStamp <= time)
+            return n;
+         n = n->m_pNext;
+      } while (n != h);
+
+      // all the nodes of the current slot are later in the current tick
+      return NULL;
+   }
+
+   // move forward until the first slot at the lowest level that is not empty, or the current time
+   while (m_iCount > 0)
+   {
+      int level;
+      uint64_t t = nextEvent(level);
+      if (t > tick)
+         break;
+
+      if (t > m_llCurrTick)
+         moveTo(t);
+
+      if (0 != level)
+         continue;
+
+      // the nodes of this slot are due in the current tick, but they are not ordered within the tick
+      h = m_pSlot[0][t & (m_iSlots - 1)];
+      CWheelNode* n = h;
+      do
+      {
+         if (n->m_llTimeStamp <= time)
+            return n;
+         n = n->m_pNext;
+      } while (n != h);
 
-   if (m_iCount >= m_iSize)
       return NULL;
+   }
 
-   CQEntry* entrance = m_pCurrQueue;
+   if (tick > m_llCurrTick)
+      moveTo(tick);
 
-   do
+   return NULL;
+}
+
+uint64_t CTimerWheel::next() const
+{
+   if (0 == m_iCount)
+      return 0;
+
+   CWheelNode* h = m_pSlot[0][m_llCurrTick & (m_iSlots - 1)];
+   if (NULL == h)
    {
-      for (CUnit* sentinel = m_pCurrQueue->m_pUnit + m_pCurrQueue->m_iSize - 1; m_pAvailUnit != sentinel; ++ m_pAvailUnit)
-         if (m_pAvailUnit->m_iFlag == 0)
-            return m_pAvailUnit;
+      int level;
+      uint64_t t = nextEvent(level);
+
+      // the nodes of a coarser slot will be moved down at the start of the slot
+      if (0 != level)
+         return t * m_llResolution;
 
-      if (m_pCurrQueue->m_pUnit->m_iFlag == 0)
+      h = m_pSlot[0][t & (m_iSlots - 1)];
+   }
+
+   uint64_t ts = h->m_llTimeStamp;
+   for (CWheelNode* n = h->m_pNext; n != h; n = n->m_pNext)
+   {
+      if (n->m_llTimeStamp < ts)
+         ts = n->m_llTimeStamp;
+   }
+
+   return ts;
+}
+
+uint64_t CTimerWheel::nextEvent(int& level) const
+{
+   // the lowest level holds the nodes of the next m_iSlots ticks, including the current one;
+   // a coarser level holds the nodes to be moved down when the wheel enters their slots, the current slot
+   // of a coarser level has been moved down already and can only hold the nodes of the next round
+   uint64_t t = 0;
+   level = -1;
+
+   for (int l = m_iLevels - 1; l >= 0; -- l)
+   {
+      int shift = l * m_iSlotBits;
+      int idx = int((m_llCurrTick >> shift) & (m_iSlots - 1));
+
+      uint64_t e;
+      if (0 == l)
       {
-         m_pAvailUnit = m_pCurrQueue->m_pUnit;
-         return m_pAvailUnit;
+         int d = findSlot(0, idx);
+         if (d < 0)
+            continue;
+         e = m_llCurrTick + d;
       }
+      else
+      {
+         int d = findSlot(l, (idx + 1) & (m_iSlots - 1));
+         if (d < 0)
+            continue;
+         e = ((m_llCurrTick >> shift) + d + 1) << shift;
+      }
+
+      // a coarser level goes first when both are at the same time
+      if ((-1 == level) || (e < t))
+      {
+         t = e;
+         level = l;
+      }
+   }
 
-      m_pCurrQueue = m_pCurrQueue->m_pNext;
-      m_pAvailUnit = m_pCurrQueue->m_pUnit;
-   } while (m_pCurrQueue != entrance);
+   return t;
+}
 
-   increase();
+int CTimerWheel::findSlot(int level, int from) const
+{
+   // distance from "from" to the next non-empty slot, going round the level
+   const uint64_t* bitmap = m_pBitmap[level];
+   const int words = m_iSlots / 64;
 
-   return NULL;
+   int w = from >> 6;
+   uint64_t bits = bitmap[w] & (~uint64_t(0) << (from & 63));
+   for (int i = 0; i <= words; ++ i)
+   {
+      if (0 != bits)
+      {
+         int slot = (w << 6) + CBitmap::lowestBit(bits);
+         return (slot - from + m_iSlots) & (m_iSlots - 1);
+      }
+
+      w = (w + 1) % words;
+      bits = bitmap[w];
+      if (i == words - 1)
+         bits &= ~(~uint64_t(0) << (from & 63));
+   }
+
+   return -1;
+}
+
+void CTimerWheel::place(CWheelNode* n)
+{
+   uint64_t tick = n->m_llTimeStamp / m_llResolution;
+   if (tick < m_llCurrTick)
+      tick = m_llCurrTick;
+
+   // the level is chosen by the distance, a node beyond the range is moved down as far as possible and placed again
+   uint64_t delta = tick - m_llCurrTick;
+   int level = 0;
+   while ((level < m_iLevels - 1) && (delta >= (uint64_t(1) << ((level + 1) * m_iSlotBits))))
+      ++ level;
+   if (delta >= (uint64_t(1) << (m_iLevels * m_iSlotBits)))
+      tick = m_llCurrTick + (uint64_t(1) << (m_iLevels * m_iSlotBits)) - 1;
+
+   int slot = int((tick >> (level * m_iSlotBits)) & (m_iSlots - 1));
+
+   CWheelNode*& h = m_pSlot[level][slot];
+   if (NULL == h)
+   {
+      n->m_pPrev = n->m_pNext = n;
+      h = n;
+      m_pBitmap[level][slot >> 6] |= uint64_t(1) << (slot & 63);
+   }
+   else
+   {
+      // append to the tail
+      n->m_pNext = h;
+      n->m_pPrev = h->m_pPrev;
+      h->m_pPrev->m_pNext = n;
+      h->m_pPrev = n;
+   }
+
+   n->m_iSlot = level * m_iSlots + slot;
 }
 
+void CTimerWheel::unlink(CWheelNode* n)
+{
+   int level = n->m_iSlot / m_iSlots;
+   int slot = n->m_iSlot % m_iSlots;
+
+   CWheelNode*& h = m_pSlot[level][slot];
+   if (n->m_pNext == n)
+   {
+      h = NULL;
+      m_pBitmap[level][slot >> 6] &= ~(uint64_t(1) << (slot & 63));
+   }
+   else
+   {
+      n->m_pPrev->m_pNext = n->m_pNext;
+      n->m_pNext->m_pPrev = n->m_pPrev;
+      if (h == n)
+         h = n->m_pNext;
+   }
+
+   n->m_iSlot = -1;
+}
+
+void CTimerWheel::moveTo(uint64_t tick)
+{
+   uint64_t last = m_llCurrTick;
+   m_llCurrTick = tick;
+
+   // the slots entered at the coarser levels are moved down, from the top
+   for (int l = m_iLevels - 1; l > 0; -- l)
+   {
+      int shift = l * m_iSlotBits;
+      if ((tick >> shift) == (last >> shift))
+         continue;
+
+      int slot = int((tick >> shift) & (m_iSlots - 1));
+      CWheelNode* h = m_pSlot[l][slot];
+      if (NULL == h)
+         continue;
+
+      m_pSlot[l][slot] = NULL;
+      m_pBitmap[l][slot >> 6] &= ~(uint64_t(1) << (slot & 63));
+
+      CWheelNode* n = h;
+      do
+      {
+         CWheelNode* next = n->m_pNext;
+         place(n);
+         n = next;
+      } while (n != h);
+   }
+}
 
 CSndUList::CSndUList():
-m_pHeap(NULL),
-m_iArrayLength(4096),
-m_iLastEntry(-1),
+m_Wheel(),
+m_llWakeTime(0),
 m_ListLock(),
 m_pWindowLock(NULL),
 m_pWindowCond(NULL),
 m_pTimer(NULL)
 {
-   m_pHeap = new CSNode*[m_iArrayLength];
+   uint64_t currtime;
+   CTimer::rdtsc(currtime);
+   m_Wheel.init(currtime, CTimer::getCPUFrequency());
 
    #ifndef WIN32
       pthread_mutex_init(&m_ListLock, NULL);
@@ -243,8 +667,6 @@ m_pTimer(NULL)
 
 CSndUList::~CSndUList()
 {
-   delete [] m_pHeap;
-
    #ifndef WIN32
       pthread_mutex_destroy(&m_ListLock);
    #else
@@ -256,26 +678,6 @@ void CSndUList::insert(int64_t ts, const CUDT* u)
 {
    CGuard listguard(m_ListLock);
 
-   // increase the heap array size if necessary
-   if (m_iLastEntry == m_iArrayLength - 1)
-   {
-      CSNode** temp = NULL;
-
-      try
-      {
-         temp = new CSNode*[m_iArrayLength * 2];
-      }
-      catch(...)
-      {
-         return;
-      }
-
-      memcpy(temp, m_pHeap, sizeof(CSNode*) * m_iArrayLength);
-      m_iArrayLength *= 2;
-      delete [] m_pHeap;
-      m_pHeap = temp;
-   }
-
    insert_(ts, u);
 }
 
@@ -285,18 +687,11 @@ void CSndUList::update(const CUDT* u, bool reschedule)
 
    CSNode* n = u->m_pSNode;
 
-   if (n->m_iHeapLoc >= 0)
+   if (n->m_iSlot >= 0)
    {
       if (!reschedule)
          return;
 
-      if (n->m_iHeapLoc == 0)
-      {
-         n->m_llTimeStamp = 1;
-         m_pTimer->interrupt();
-         return;
-      }
-
       remove_(u);
    }
 
@@ -307,16 +702,20 @@ int CSndUList::pop(sockaddr*& addr, CPacket& pkt)
 {
    CGuard listguard(m_ListLock);
 
-   if (-1 == m_iLastEntry)
+   // the worker is awake, it will read the next processing time again before it sleeps
+   m_llWakeTime = 0;
+
+   if (0 == m_Wheel.size())
       return -1;
 
    // no pop until the next schedulled time
    uint64_t ts;
    CTimer::rdtsc(ts);
-   if (ts < m_pHeap[0]->m_llTimeStamp)
+   CSNode* n = static_cast<CSNode*>(m_Wheel.due(ts));
+   if (NULL == n)
       return -1;
 
-   CUDT* u = m_pHeap[0]->m_pUDT;
+   CUDT* u = n->m_pUDT;
    remove_(u);
 
    if (!u->m_bConnected || u->m_bBroken)
@@ -335,6 +734,45 @@ int CSndUList::pop(sockaddr*& addr, CPacket& pkt)
    return 1;
 }
 
+int CSndUList::pop(sockaddr** addr, CPacket** pkt, int num)
+{
+   CGuard listguard(m_ListLock);
+
+   // the worker is awake, it will read the next processing time again before it sleeps
+   m_llWakeTime = 0;
+
+   int n = 0;
+
+   while ((n < num) && (m_Wheel.size() > 0))
+   {
+      // stop when no socket is due
+      uint64_t ts;
+      CTimer::rdtsc(ts);
+      CSNode* node = static_cast<CSNode*>(m_Wheel.due(ts));
+      if (NULL == node)
+         break;
+
+      CUDT* u = node->m_pUDT;
+      remove_(u);
+
+      if (!u->m_bConnected || u->m_bBroken)
+         continue;
+
+      // pack a packet from the socket
+      if (u->packData(*pkt[n], ts) <= 0)
+         continue;
+
+      addr[n] = u->m_pPeerAddr;
+      ++ n;
+
+      // insert a new entry, ts is the next processing time
+      if (ts > 0)
+         insert_(ts, u);
+   }
+
+   return n;
+}
+
 void CSndUList::remove(const CUDT* u)
 {
    CGuard listguard(m_ListLock);
@@ -346,10 +784,9 @@ uint64_t CSndUList::getNextProcTime()
 {
    CGuard listguard(m_ListLock);
 
-   if (-1 == m_iLastEntry)
-      return 0;
+   m_llWakeTime = m_Wheel.next();
 
-   return m_pHeap[0]->m_llTimeStamp;
+   return m_llWakeTime;
 }
 
 void CSndUList::insert_(int64_t ts, const CUDT* u)
@@ -357,38 +794,21 @@ void CSndUList::insert_(int64_t ts, const CUDT* u)
    CSNode* n = u->m_pSNode;
 
    // do not insert repeated node
-   if (n->m_iHeapLoc >= 0)
+   if (n->m_iSlot >= 0)
       return;
 
-   m_iLastEntry ++;
-   m_pHeap[m_iLastEntry] = n;
    n->m_llTimeStamp = ts;
+   m_Wheel.insert(n);
 
-   int q = m_iLastEntry;
-   int p = q;
-   while (p != 0)
+   // an event earlier than the one the sending worker is sleeping for, wake it up once
+   if ((0 != m_llWakeTime) && ((uint64_t)ts < m_llWakeTime))
    {
-      p = (q - 1) >> 1;
-      if (m_pHeap[p]->m_llTimeStamp > m_pHeap[q]->m_llTimeStamp)
-      {
-         CSNode* t = m_pHeap[p];
-         m_pHeap[p] = m_pHeap[q];
-         m_pHeap[q] = t;
-         t->m_iHeapLoc = q;
-         q = p;
-      }
-      else
-         break;
-   }
-
-   n->m_iHeapLoc = q;
-
-   // an earlier event has been inserted, wake up sending worker
-   if (n->m_iHeapLoc == 0)
+      m_llWakeTime = 0;
       m_pTimer->interrupt();
+   }
 
-   // first entry, activate the sending queue
-   if (0 == m_iLastEntry)
+   // first entry, activate the sending queue, which waits for the window condition rather than the timer
+   if (1 == m_Wheel.size())
    {
       #ifndef WIN32
          pthread_mutex_lock(m_pWindowLock);
@@ -404,41 +824,17 @@ void CSndUList::remove_(const CUDT* u)
 {
    CSNode* n = u->m_pSNode;
 
-   if (n->m_iHeapLoc >= 0)
+   if (n->m_iSlot >= 0)
    {
-      // remove the node from heap
-      m_pHeap[n->m_iHeapLoc] = m_pHeap[m_iLastEntry];
-      m_iLastEntry --;
-      m_pHeap[n->m_iHeapLoc]->m_iHeapLoc = n->m_iHeapLoc;
-
-      int q = n->m_iHeapLoc;
-      int p = q * 2 + 1;
-      while (p <= m_iLastEntry)
-      {
-         if ((p + 1 <= m_iLastEntry) && (m_pHeap[p]->m_llTimeStamp > m_pHeap[p + 1]->m_llTimeStamp))
-            p ++;
+      m_Wheel.remove(n);
 
-         if (m_pHeap[q]->m_llTimeStamp > m_pHeap[p]->m_llTimeStamp)
-         {
-            CSNode* t = m_pHeap[p];
-            m_pHeap[p] = m_pHeap[q];
-            m_pHeap[p]->m_iHeapLoc = p;
-            m_pHeap[q] = t;
-            m_pHeap[q]->m_iHeapLoc = q;
-
-            q = p;
-            p = q * 2 + 1;
-         }
-         else
-            break;
+      // the only event has been deleted, wake up the sleeping worker immediately
+      if ((0 == m_Wheel.size()) && (0 != m_llWakeTime))
+      {
+         m_llWakeTime = 0;
+         m_pTimer->interrupt();
       }
-
-      n->m_iHeapLoc = -1;
    }
-
-   // the only event has been deleted, wake up immediately
-   if (0 == m_iLastEntry)
-      m_pTimer->interrupt();
 }
 
 //
@@ -447,6 +843,8 @@ m_WorkerThread(),
 m_pSndUList(NULL),
 m_pChannel(NULL),
 m_pTimer(NULL),
+m_iBatchSize(1),
+m_pBudget(NULL),
 m_WindowLock(),
 m_WindowCond(),
 m_bClosing(false),
@@ -487,10 +885,18 @@ CSndQueue::~CSndQueue()
    delete m_pSndUList;
 }
 
-void CSndQueue::init(CChannel* c, CTimer* t)
+void CSndQueue::init(CChannel* c, CTimer* t, int batch, CMemBudget* budget)
 {
    m_pChannel = c;
    m_pTimer = t;
+   m_pBudget = budget;
+
+   m_iBatchSize = batch;
+   if (m_iBatchSize < 1)
+      m_iBatchSize = 1;
+   else if (m_iBatchSize > CChannel::m_iMaxBatchSize)
+      m_iBatchSize = CChannel::m_iMaxBatchSize;
+
    m_pSndUList = new CSndUList;
    m_pSndUList->m_pWindowLock = &m_WindowLock;
    m_pSndUList->m_pWindowCond = &m_WindowCond;
@@ -518,6 +924,13 @@ void CSndQueue::init(CChannel* c, CTimer* t)
 {
    CSndQueue* self = (CSndQueue*)param;
 
+   int batch = self->m_iBatchSize;
+   sockaddr** addrs = new sockaddr*[batch];
+   CPacket* pkts = new CPacket[batch];
+   CPacket** packets = new CPacket*[batch];
+   for (int i = 0; i < batch; ++ i)
+      packets[i] = pkts + i;
+
    while (!self->m_bClosing)
    {
       uint64_t ts = self->m_pSndUList->getNextProcTime();
@@ -530,20 +943,30 @@ void CSndQueue::init(CChannel* c, CTimer* t)
          if (currtime < ts)
             self->m_pTimer->sleepto(ts);
 
-         // it is time to send the next pkt
-         sockaddr* addr;
-         CPacket pkt;
-         if (self->m_pSndUList->pop(addr, pkt) < 0)
+         // it is time to send the next pkt, and all others that are also due now
+         if (1 == batch)
+         {
+            sockaddr* addr;
+            CPacket pkt;
+            if (self->m_pSndUList->pop(addr, pkt) < 0)
+               continue;
+
+            self->m_pChannel->sendto(addr, pkt);
             continue;
+         }
 
-         self->m_pChannel->sendto(addr, pkt);
+         int n = self->m_pSndUList->pop(addrs, packets, batch);
+         if (1 == n)
+            self->m_pChannel->sendto(addrs[0], *packets[0]);
+         else if (n > 1)
+            self->m_pChannel->sendto(addrs, packets, n);
       }
       else
       {
          // wait here if there is no sockets with data to be sent
          #ifndef WIN32
             pthread_mutex_lock(&self->m_WindowLock);
-            if (!self->m_bClosing && (self->m_pSndUList->m_iLastEntry < 0))
+            if (!self->m_bClosing && (0 == self->m_pSndUList->m_Wheel.size()))
                pthread_cond_wait(&self->m_WindowCond, &self->m_WindowLock);
             pthread_mutex_unlock(&self->m_WindowLock);
          #else
@@ -552,6 +975,10 @@ void CSndQueue::init(CChannel* c, CTimer* t)
       }
    }
 
+   delete [] addrs;
+   delete [] pkts;
+   delete [] packets;
+
    #ifndef WIN32
       return NULL;
    #else
@@ -570,9 +997,13 @@ int CSndQueue::sendto(const sockaddr* addr, CPacket& packet)
 
 //
 CRcvUList::CRcvUList():
-m_pUList(NULL),
-m_pLast(NULL)
+m_Wheel()
 {
+   uint64_t currtime;
+   CTimer::rdtsc(currtime);
+
+   // timer deadlines are at least a few milliseconds apart, one slot per millisecond is fine enough
+   m_Wheel.init(currtime, 1000 * CTimer::getCPUFrequency());
 }
 
 CRcvUList::~CRcvUList()
@@ -582,128 +1013,89 @@ CRcvUList::~CRcvUList()
 void CRcvUList::insert(const CUDT* u)
 {
    CRNode* n = u->m_pRNode;
-   CTimer::rdtsc(n->m_llTimeStamp);
-
-   if (NULL == m_pUList)
-   {
-      // empty list, insert as the single node
-      n->m_pPrev = n->m_pNext = NULL;
-      m_pLast = m_pUList = n;
-
-      return;
-   }
-
-   // always insert at the end for RcvUList
-   n->m_pPrev = m_pLast;
-   n->m_pNext = NULL;
-   m_pLast->m_pNext = n;
-   m_pLast = n;
+   n->m_llTimeStamp = u->getNextTimerTime();
+   m_Wheel.insert(n);
 }
 
 void CRcvUList::remove(const CUDT* u)
 {
    CRNode* n = u->m_pRNode;
 
-   if (!n->m_bOnList)
-      return;
-
-   if (NULL == n->m_pPrev)
-   {
-      // n is the first node
-      m_pUList = n->m_pNext;
-      if (NULL == m_pUList)
-         m_pLast = NULL;
-      else
-         m_pUList->m_pPrev = NULL;
-   }
-   else
-   {
-      n->m_pPrev->m_pNext = n->m_pNext;
-      if (NULL == n->m_pNext)
-      {
-         // n is the last node
-         m_pLast = n->m_pPrev;
-      }
-      else
-         n->m_pNext->m_pPrev = n->m_pPrev;
-   }
-
-   n->m_pNext = n->m_pPrev = NULL;
+   if (n->m_iSlot >= 0)
+      m_Wheel.remove(n);
 }
 
 void CRcvUList::update(const CUDT* u)
 {
    CRNode* n = u->m_pRNode;
 
-   if (!n->m_bOnList)
+   if (!n->m_bOnList || (n->m_iSlot < 0))
       return;
 
-   CTimer::rdtsc(n->m_llTimeStamp);
-
-   // if n is the last node, do not need to change
-   if (NULL == n->m_pNext)
+   uint64_t ts = u->getNextTimerTime();
+   if (ts == n->m_llTimeStamp)
       return;
 
-   if (NULL == n->m_pPrev)
-   {
-      m_pUList = n->m_pNext;
-      m_pUList->m_pPrev = NULL;
-   }
-   else
-   {
-      n->m_pPrev->m_pNext = n->m_pNext;
-      n->m_pNext->m_pPrev = n->m_pPrev;
-   }
+   m_Wheel.remove(n);
+   n->m_llTimeStamp = ts;
+   m_Wheel.insert(n);
+}
+
+CUDT* CRcvUList::due(uint64_t currtime)
+{
+   CRNode* n = static_cast<CRNode*>(m_Wheel.due(currtime));
+   if (NULL == n)
+      return NULL;
 
-   n->m_pPrev = m_pLast;
-   n->m_pNext = NULL;
-   m_pLast->m_pNext = n;
-   m_pLast = n;
+   return n->m_pUDT;
+}
+
+uint64_t CRcvUList::getNextTime() const
+{
+   return m_Wheel.next();
 }
 
 //
 CHash::CHash():
 m_pBucket(NULL),
-m_iHashSize(0)
+m_iSize(0),
+m_iCount(0),
+m_iUsed(0)
 {
 }
 
 CHash::~CHash()
 {
-   for (int i = 0; i < m_iHashSize; ++ i)
-   {
-      CBucket* b = m_pBucket[i];
-      while (NULL != b)
-      {
-         CBucket* n = b->m_pNext;
-         delete b;
-         b = n;
-      }
-   }
-
    delete [] m_pBucket;
 }
 
 void CHash::init(int size)
 {
-   m_pBucket = new CBucket* [size];
+   int n = 16;
+   while (n < size)
+      n <<= 1;
 
-   for (int i = 0; i < size; ++ i)
-      m_pBucket[i] = NULL;
-
-   m_iHashSize = size;
+   m_pBucket = new CBucket[n];
+   for (int i = 0; i < n; ++ i)
+   {
+      m_pBucket[i].m_iID = 0;
+      m_pBucket[i].m_pUDT = NULL;
+   }
+   m_iSize = n;
 }
 
-CUDT* CHash::lookup(int32_t id)
+CUDT* CHash::lookup(int32_t id) const
 {
-   // simple hash function (% hash table size); suitable for socket descriptors
-   CBucket* b = m_pBucket[id % m_iHashSize];
+   int mask = m_iSize - 1;
 
-   while (NULL != b)
+   for (int i = hash(id, m_iSize), n = 0; n < m_iSize; i = (i + 1) & mask, ++ n)
    {
-      if (id == b->m_iID)
-         return b->m_pUDT;
-      b = b->m_pNext;
+      // an empty bucket ends the probe sequence
+      if (0 == m_pBucket[i].m_iID)
+         return NULL;
+
+      if (id == m_pBucket[i].m_iID)
+         return m_pBucket[i].m_pUDT;
    }
 
    return NULL;
@@ -711,38 +1103,90 @@ CUDT* CHash::lookup(int32_t id)
 
 void CHash::insert(int32_t id, CUDT* u)
 {
-   CBucket* b = m_pBucket[id % m_iHashSize];
+   // keep at least half of the buckets empty, the table is rebuilt in a larger size or in the same size
+   // if most of the used buckets are removed entries
+   if ((m_iUsed + 1) * 2 > m_iSize)
+   {
+      int size = m_iSize;
+      while ((m_iCount + 1) * 4 > size)
+         size <<= 1;
+      resize(size);
+   }
+
+   int mask = m_iSize - 1;
+   int i = hash(id, m_iSize);
+   while (m_pBucket[i].m_iID > 0)
+      i = (i + 1) & mask;
 
-   CBucket* n = new CBucket;
-   n->m_iID = id;
-   n->m_pUDT = u;
-   n->m_pNext = b;
+   if (0 == m_pBucket[i].m_iID)
+      ++ m_iUsed;
+   ++ m_iCount;
 
-   m_pBucket[id % m_iHashSize] = n;
+   m_pBucket[i].m_iID = id;
+   m_pBucket[i].m_pUDT = u;
 }
 
 void CHash::remove(int32_t id)
 {
-   CBucket* b = m_pBucket[id % m_iHashSize];
-   CBucket* p = NULL;
+   int mask = m_iSize - 1;
 
-   while (NULL != b)
+   for (int i = hash(id, m_iSize), n = 0; (n < m_iSize) && (0 != m_pBucket[i].m_iID); i = (i + 1) & mask, ++ n)
    {
-      if (id == b->m_iID)
-      {
-         if (NULL == p)
-            m_pBucket[id % m_iHashSize] = b->m_pNext;
-         else
-            p->m_pNext = b->m_pNext;
+      if (id != m_pBucket[i].m_iID)
+         continue;
 
-         delete b;
+      m_pBucket[i].m_iID = -1;
+      -- m_iCount;
 
-         return;
+      // a removed entry followed by an empty bucket is not in the probe sequence of any entry, it can be emptied
+      while ((-1 == m_pBucket[i].m_iID) && (0 == m_pBucket[(i + 1) & mask].m_iID))
+      {
+         m_pBucket[i].m_iID = 0;
+         -- m_iUsed;
+         i = (i - 1) & mask;
       }
 
-      p = b;
-      b = b->m_pNext;
+      break;
+   }
+}
+
+int CHash::hash(int32_t id, int size)
+{
+   // mix the bits, so that neighbouring IDs do not form long runs of used buckets with other IDs
+   uint32_t h = id;
+   h ^= h >> 16;
+   h *= 0x45d9f3b;
+   h ^= h >> 16;
+
+   return h & (size - 1);
+}
+
+void CHash::resize(int size)
+{
+   CBucket* b = new CBucket[size];
+   for (int i = 0; i < size; ++ i)
+   {
+      b[i].m_iID = 0;
+      b[i].m_pUDT = NULL;
    }
+
+   int mask = size - 1;
+   for (int i = 0; i < m_iSize; ++ i)
+   {
+      if (m_pBucket[i].m_iID <= 0)
+         continue;
+
+      int j = hash(m_pBucket[i].m_iID, size);
+      while (0 != b[j].m_iID)
+         j = (j + 1) & mask;
+
+      b[j] = m_pBucket[i];
+   }
+
+   delete [] m_pBucket;
+   m_pBucket = b;
+   m_iSize = size;
+   m_iUsed = m_iCount;
 }
 
 
@@ -812,6 +1256,12 @@ void CRendezvousQueue::remove(const UDTSOCKET& id)
    }
 }
 
+bool CRendezvousQueue::empty()
+{
+   CGuard vg(m_RIDVectorLock);
+   return m_lRendezvousID.empty();
+}
+
 CUDT* CRendezvousQueue::retrieve(const sockaddr* addr, UDTSOCKET& id)
 {
    CGuard vg(m_RIDVectorLock);
@@ -845,7 +1295,7 @@ void CRendezvousQueue::updateConnStatus()
          {
             // connection timer expired, acknowledge app via epoll
             i->m_pUDT->m_bConnecting = false;
-            CUDT::s_UDTUnited.m_EPoll.update_events(i->m_iID, i->m_pUDT->m_sPollID, UDT_EPOLL_ERR, true);
+            CUDT::s_UDTUnited.m_EPoll.update_events(i->m_iID, i->m_pUDT->m_PollSet, UDT_EPOLL_ERR, true);
             continue;
          }
 
@@ -872,7 +1322,9 @@ m_pRcvUList(NULL),
 m_pHash(NULL),
 m_pChannel(NULL),
 m_pTimer(NULL),
+m_pReactor(NULL),
 m_iPayloadSize(),
+m_iBatchSize(1),
 m_bClosing(false),
 m_ExitCond(),
 m_LSLock(),
@@ -882,7 +1334,8 @@ m_vNewEntry(),
 m_IDLock(),
 m_mBuffer(),
 m_PassLock(),
-m_PassCond()
+m_PassCond(),
+m_vShard()
 {
    #ifndef WIN32
       pthread_mutex_init(&m_PassLock, NULL);
@@ -900,19 +1353,14 @@ m_PassCond()
 
 CRcvQueue::~CRcvQueue()
 {
-   m_bClosing = true;
+   stop();
 
    #ifndef WIN32
-      if (0 != m_WorkerThread)
-         pthread_join(m_WorkerThread, NULL);
       pthread_mutex_destroy(&m_PassLock);
       pthread_cond_destroy(&m_PassCond);
       pthread_mutex_destroy(&m_LSLock);
       pthread_mutex_destroy(&m_IDLock);
    #else
-      if (NULL != m_WorkerThread)
-         WaitForSingleObject(m_ExitCond, INFINITE);
-      CloseHandle(m_WorkerThread);
       CloseHandle(m_PassLock);
       CloseHandle(m_PassCond);
       CloseHandle(m_LSLock);
@@ -923,6 +1371,7 @@ CRcvQueue::~CRcvQueue()
    delete m_pRcvUList;
    delete m_pHash;
    delete m_pRendezvousQueue;
+   delete m_pReactor;
 
    // remove all queued messages
    for (map<int32_t, std::queue<CPacket*> >::iterator i = m_mBuffer.begin(); i != m_mBuffer.end(); ++ i)
@@ -937,11 +1386,17 @@ CRcvQueue::~CRcvQueue()
    }
 }
 
-void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* cc, CTimer* t)
+void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* cc, CTimer* t, int batch, CMemBudget* budget)
 {
    m_iPayloadSize = payload;
 
-   m_UnitQueue.init(qsize, payload, version);
+   m_iBatchSize = batch;
+   if (m_iBatchSize < 1)
+      m_iBatchSize = 1;
+   else if (m_iBatchSize > CChannel::m_iMaxBatchSize)
+      m_iBatchSize = CChannel::m_iMaxBatchSize;
+
+   m_UnitQueue.init(qsize, payload, version, budget);
 
    m_pHash = new CHash;
    m_pHash->init(hsize);
@@ -952,6 +1407,10 @@ void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* c
    m_pRcvUList = new CRcvUList;
    m_pRendezvousQueue = new CRendezvousQueue;
 
+   #ifdef LINUX
+      m_pReactor = new CTimer;
+   #endif
+
    #ifndef WIN32
       if (0 != pthread_create(&m_WorkerThread, NULL, CRcvQueue::worker, this))
       {
@@ -974,13 +1433,22 @@ void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* c
 {
    CRcvQueue* self = (CRcvQueue*)param;
 
-   sockaddr* addr = (AF_INET == self->m_UnitQueue.m_iIPversion) ? (sockaddr*) new sockaddr_in : (sockaddr*) new sockaddr_in6;
+   int batch = self->m_iBatchSize;
+   sockaddr** addrs = new sockaddr*[batch];
+   for (int i = 0; i < batch; ++ i)
+      addrs[i] = (AF_INET == self->m_UnitQueue.m_iIPversion) ? (sockaddr*) new sockaddr_in : (sockaddr*) new sockaddr_in6;
+   CUnit** units = new CUnit*[batch];
+   CPacket** packets = new CPacket*[batch];
    CUDT* u = NULL;
+   CRcvQueue* q = NULL;
    int32_t id;
+   int n;
+   int reserved;
+   uint64_t currtime;
 
    while (!self->m_bClosing)
    {
-      #ifdef NO_BUSY_WAITING
+      #if defined(NO_BUSY_WAITING) && !defined(LINUX)
          self->m_pTimer->tick();
       #endif
 
@@ -995,81 +1463,101 @@ void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* c
          }
       }
 
-      // find next available slot for incoming packet
-      CUnit* unit = self->m_UnitQueue.getNextAvailUnit();
-      if (NULL == unit)
+      // find next available slots for incoming packets
+      n = self->m_UnitQueue.getNextAvailUnits(units, batch);
+      if (0 == n)
       {
          // no space, skip this packet
          CPacket temp;
          temp.m_pcData = new char[self->m_iPayloadSize];
          temp.setLength(self->m_iPayloadSize);
-         self->m_pChannel->recvfrom(addr, temp);
+         n = self->m_pChannel->recvfrom(addrs[0], temp);
          delete [] temp.m_pcData;
          goto TIMER_CHECK;
       }
 
-      unit->m_Packet.setLength(self->m_iPayloadSize);
-
-      // reading next incoming packet, recvfrom returns -1 is nothing has been received
-      if (self->m_pChannel->recvfrom(addr, unit->m_Packet) < 0)
-         goto TIMER_CHECK;
+      reserved = n;
+      for (int i = 0; i < n; ++ i)
+      {
+         units[i]->m_Packet.setLength(self->m_iPayloadSize);
+         packets[i] = &units[i]->m_Packet;
+      }
 
-      id = unit->m_Packet.m_iID;
+      // reading next incoming packets, recvfrom returns -1 is nothing has been received
+      n = self->m_pChannel->recvfrom(addrs, packets, n);
 
-      // ID 0 is for connection request, which should be passed to the listening socket or rendezvous sockets
-      if (0 == id)
+      // dispatch the whole batch before the timing events are checked
+      for (int i = 0; i < n; ++ i)
       {
-         if (NULL != self->m_pListener)
-            self->m_pListener->listen(addr, unit->m_Packet);
-         else if (NULL != (u = self->m_pRendezvousQueue->retrieve(addr, id)))
+         CUnit* unit = units[i];
+         sockaddr* addr = addrs[i];
+
+         if (unit->m_Packet.getLength() < 0)
+            continue;
+
+         id = unit->m_Packet.m_iID;
+
+         // ID 0 is for connection request, which should be passed to the listening socket or rendezvous sockets
+         if (0 == id)
          {
-            // asynchronous connect: call connect here
-            // otherwise wait for the UDT socket to retrieve this packet
-            if (!u->m_bSynRecving)
-               u->connect(unit->m_Packet);
-            else
-               self->storePkt(id, unit->m_Packet.clone());
+            if (NULL != (u = self->getListener()))
+               u->listen(addr, unit->m_Packet);
+            else if (NULL != (u = self->retrieveConnector(addr, id, q)))
+            {
+               // asynchronous connect: call connect here
+               // otherwise wait for the UDT socket to retrieve this packet
+               if (!u->m_bSynRecving)
+                  u->connect(unit->m_Packet);
+               else
+                  q->storePkt(id, unit->m_Packet.clone());
+            }
          }
-      }
-      else if (id > 0)
-      {
-         if (NULL != (u = self->m_pHash->lookup(id)))
+         else if (id > 0)
          {
-            if (CIPAddress::ipcmp(addr, u->m_pPeerAddr, u->m_iIPversion))
+            if (NULL != (u = self->m_pHash->lookup(id)))
             {
-               if (u->m_bConnected && !u->m_bBroken && !u->m_bClosing)
+               if (CIPAddress::ipcmp(addr, u->m_pPeerAddr, u->m_iIPversion))
                {
-                  if (0 == unit->m_Packet.getFlag())
-                     u->processData(unit);
-                  else
-                     u->processCtrl(unit->m_Packet);
-
-                  u->checkTimers();
-                  self->m_pRcvUList->update(u);
+                  if (u->m_bConnected && !u->m_bBroken && !u->m_bClosing)
+                  {
+                     if (0 == unit->m_Packet.getFlag())
+                        u->processData(unit);
+                     else
+                        u->processCtrl(unit->m_Packet);
+
+                     // the timers are only checked if one of them is due
+                     CTimer::rdtsc(currtime);
+                     if (u->isTimerDue(currtime))
+                        u->checkTimers();
+                     self->m_pRcvUList->update(u);
+                  }
                }
             }
-         }
-         else if (NULL != (u = self->m_pRendezvousQueue->retrieve(addr, id)))
-         {
-            if (!u->m_bSynRecving)
-               u->connect(unit->m_Packet);
-            else
-               self->storePkt(id, unit->m_Packet.clone());
+            else if (NULL != (u = self->retrieveConnector(addr, id, q)))
+            {
+               if (!u->m_bSynRecving)
+                  u->connect(unit->m_Packet);
+               else
+                  q->storePkt(id, unit->m_Packet.clone());
+            }
          }
       }
 
+      // the units not taken by any receiving buffer are free again
+      self->m_UnitQueue.returnUnits(units, reserved);
+
 TIMER_CHECK:
-      // take care of the timing event for all UDT sockets
+      #ifdef LINUX
+         // the socket is non-blocking, sleep until a packet arrives or the next socket is due for its timers
+         if (n <= 0)
+            self->m_pReactor->waitfor(self->m_pChannel->getSocket(), self->getNextTime());
+      #endif
 
-      uint64_t currtime;
+      // take care of the timing event for all UDT sockets, only those whose deadlines have passed are visited
       CTimer::rdtsc(currtime);
 
-      CRNode* ul = self->m_pRcvUList->m_pUList;
-      uint64_t ctime = currtime - 100000 * CTimer::getCPUFrequency();
-      while ((NULL != ul) && (ul->m_llTimeStamp < ctime))
+      while (NULL != (u = self->m_pRcvUList->due(currtime)))
       {
-         CUDT* u = ul->m_pUDT;
-
          if (u->m_bConnected && !u->m_bBroken && !u->m_bClosing)
          {
             u->checkTimers();
@@ -1082,18 +1570,26 @@ TIMER_CHECK:
             self->m_pRcvUList->remove(u);
             u->m_pRNode->m_bOnList = false;
          }
-
-         ul = self->m_pRcvUList->m_pUList;
       }
 
       // Check connection requests status for all sockets in the RendezvousQueue.
       self->m_pRendezvousQueue->updateConnStatus();
+
+      // release the extra units when the queue is idle
+      if (n <= 0)
+         self->m_UnitQueue.shrink();
    }
 
-   if (AF_INET == self->m_UnitQueue.m_iIPversion)
-      delete (sockaddr_in*)addr;
-   else
-      delete (sockaddr_in6*)addr;
+   for (int i = 0; i < batch; ++ i)
+   {
+      if (AF_INET == self->m_UnitQueue.m_iIPversion)
+         delete (sockaddr_in*)addrs[i];
+      else
+         delete (sockaddr_in6*)addrs[i];
+   }
+   delete [] addrs;
+   delete [] units;
+   delete [] packets;
 
    #ifndef WIN32
       return NULL;
@@ -1103,6 +1599,29 @@ TIMER_CHECK:
    #endif
 }
 
+void CRcvQueue::stop()
+{
+   m_bClosing = true;
+
+   if (NULL != m_pReactor)
+      m_pReactor->interrupt();
+
+   #ifndef WIN32
+      if (0 != m_WorkerThread)
+      {
+         pthread_join(m_WorkerThread, NULL);
+         m_WorkerThread = 0;
+      }
+   #else
+      if (NULL != m_WorkerThread)
+      {
+         WaitForSingleObject(m_ExitCond, INFINITE);
+         CloseHandle(m_WorkerThread);
+         m_WorkerThread = NULL;
+      }
+   #endif
+}
+
 int CRcvQueue::recvfrom(int32_t id, CPacket& packet)
 {
    CGuard bufferlock(m_PassLock);
@@ -1181,6 +1700,10 @@ void CRcvQueue::removeListener(const CUDT* u)
 void CRcvQueue::registerConnector(const UDTSOCKET& id, CUDT* u, int ipv, const sockaddr* addr, uint64_t ttl)
 {
    m_pRendezvousQueue->insert(id, u, ipv, addr, ttl);
+
+   // the worker may be sleeping without a deadline, it must start checking the connection status
+   if (NULL != m_pReactor)
+      m_pReactor->interrupt();
 }
 
 void CRcvQueue::removeConnector(const UDTSOCKET& id)
@@ -1202,10 +1725,67 @@ void CRcvQueue::removeConnector(const UDTSOCKET& id)
    }
 }
 
+CUDT* CRcvQueue::getListener()
+{
+   if ((NULL != m_pListener) || m_vShard.empty())
+      return m_pListener;
+
+   // the listening socket may be registered with another worker of the multiplexer
+   for (vector<CRcvQueue*>::iterator i = m_vShard.begin(); i != m_vShard.end(); ++ i)
+   {
+      if (NULL != (*i)->m_pListener)
+         return (*i)->m_pListener;
+   }
+
+   return NULL;
+}
+
+CUDT* CRcvQueue::retrieveConnector(const sockaddr* addr, int32_t& id, CRcvQueue*& q)
+{
+   q = this;
+
+   CUDT* u = m_pRendezvousQueue->retrieve(addr, id);
+   if ((NULL != u) || m_vShard.empty())
+      return u;
+
+   // handshakes with ID 0 are always delivered to the first worker, the connecting socket may belong to another one
+   for (vector<CRcvQueue*>::iterator i = m_vShard.begin(); i != m_vShard.end(); ++ i)
+   {
+      if ((*i == this) || (NULL == (u = (*i)->m_pRendezvousQueue->retrieve(addr, id))))
+         continue;
+
+      q = *i;
+      return u;
+   }
+
+   return NULL;
+}
+
+uint64_t CRcvQueue::getNextTime()
+{
+   // the earliest timer deadline of all sockets
+   uint64_t nexttime = m_pRcvUList->getNextTime();
+
+   // pending connection requests are checked every 10ms
+   if (!m_pRendezvousQueue->empty())
+   {
+      uint64_t currtime;
+      CTimer::rdtsc(currtime);
+      currtime += 10000 * CTimer::getCPUFrequency();
+      if ((0 == nexttime) || (currtime < nexttime))
+         nexttime = currtime;
+   }
+
+   return nexttime;
+}
+
 void CRcvQueue::setNewEntry(CUDT* u)
 {
    CGuard listguard(m_IDLock);
    m_vNewEntry.push_back(u);
+
+   if (NULL != m_pReactor)
+      m_pReactor->interrupt();
 }
 
 bool CRcvQueue::ifNewEntry()
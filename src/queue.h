@@ -55,7 +55,8 @@ class CUDT;
 struct CUnit
 {
    CPacket m_Packet;		// packet
-   int m_iFlag;			// 0: free, 1: occupied, 2: msg read but not freed (out-of-order), 3: msg dropped
+   int m_iFlag;			// 0: free, 1: occupied, 2: msg read but not freed (out-of-order), 3: msg dropped, 4: reserved for receiving
+   CUnit* m_pNextFree;		// next unit on the free list
 };
 
 class CUnitQueue
@@ -75,37 +76,74 @@ public:
       //    1) [in] size: queue size
       //    2) [in] mss: maximum segament size
       //    3) [in] version: IP version
+      //    4) [in] budget: memory budget to grow the queue from, NULL if unlimited
       // Returned value:
       //    0: success, -1: failure.
 
-   int init(int size, int mss, int version);
+   int init(int size, int mss, int version, CMemBudget* budget = NULL);
 
       // Functionality:
-      //    Increase (double) the unit queue size.
+      //    Add a new block of units, as large as the initial one, to the unit queue.
       // Parameters:
       //    None.
       // Returned value:
-      //    0: success, -1: failure.
+      //    0: success, -1: failure, or the memory budget is exhausted.
 
    int increase();
 
       // Functionality:
-      //    Decrease (halve) the unit queue size.
+      //    Release the blocks added by increase() whose units are all free, when few units are in use.
+      //    It is tried at most once a second, by the receiving worker only.
       // Parameters:
       //    None.
       // Returned value:
-      //    0: success, -1: failure.
+      //    Number of blocks released.
 
    int shrink();
 
       // Functionality:
-      //    find an available unit for incoming packet.
+      //    Reserve a number of distinct available units for a batch of incoming packets.
+      // Parameters:
+      //    0) [out] units: array to store the pointers to the available units.
+      //    1) [in] num: maximum number of units wanted.
+      // Returned value:
+      //    Number of units reserved, 0 if none is available.
+
+   int getNextAvailUnits(CUnit** units, int num);
+
+      // Functionality:
+      //    Return the reserved units that have not been taken by a receiving buffer.
       // Parameters:
+      //    0) [in] units: array of the units reserved by getNextAvailUnits.
+      //    1) [in] num: number of units in the array.
+      // Returned value:
       //    None.
+
+   void returnUnits(CUnit** units, int num);
+
+      // Functionality:
+      //    Release a unit held by a receiving buffer, from any thread.
+      // Parameters:
+      //    0) [in] unit: the unit.
       // Returned value:
-      //    Pointer to the available unit, NULL if not found.
+      //    None.
 
-   CUnit* getNextAvailUnit();
+   void makeUnitFree(CUnit* unit);
+
+      // Functionality:
+      //    Query how many more packets can be received, by the free units and those the memory budget can add.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    Number of packets, -1 if there is no memory budget.
+
+   int getAvailUnits() const;
+
+private:
+   void collectFreeUnits();
+
+   struct CQEntry;
+   static int findBlock(const std::vector<std::pair<CUnit*, CQEntry*> >& block, const CUnit* unit);
 
 private:
    struct CQEntry
@@ -117,28 +155,128 @@ private:
       CQEntry* m_pNext;
    }
    *m_pQEntry,			// pointer to the first unit queue
-   *m_pCurrQueue,		// pointer to the current available queue
    *m_pLastQueue;		// pointer to the last unit queue
 
-   CUnit* m_pAvailUnit;         // recent available unit
+   // Free units are taken from a list owned by the receiving worker. Units released by the other threads are
+   // pushed onto a shared stack, which the worker takes over as a whole when its own list is empty.
+   CUnit* m_pFreeUnit;          // free units, used by the receiving worker only
+   CUnit* volatile m_pReleased; // units released by the receiving buffers
 
    int m_iSize;			// total size of the unit queue, in number of packets
-   int m_iCount;		// total number of valid packets in the queue
+   int m_iCount;		// number of units not on the free list of the worker
+   int m_iInitSize;		// size of the first block of units
+   uint64_t m_ullShrinkTime;	// last time shrinking was tried
 
    int m_iMSS;			// unit buffer size
    int m_iIPversion;		// IP version
 
+   CMemBudget* m_pBudget;	// memory budget shared with the other buffers of the multiplexer
+
 private:
    CUnitQueue(const CUnitQueue&);
    CUnitQueue& operator=(const CUnitQueue&);
 };
 
-struct CSNode
+struct CWheelNode
 {
-   CUDT* m_pUDT;		// Pointer to the instance of CUDT socket
    uint64_t m_llTimeStamp;      // Time Stamp
+   int m_iSlot;			// location on the timing wheel, -1 means not on the wheel
+
+   CWheelNode* m_pPrev;		// previous node in the same slot
+   CWheelNode* m_pNext;		// next node in the same slot
+};
+
+class CTimerWheel
+{
+public:
+   CTimerWheel();
+
+public:
+
+      // Functionality:
+      //    Start the wheel from the current time.
+      // Parameters:
+      //    0) [in] time: current time.
+      //    1) [in] resolution: time span of each slot at the lowest level, in the same unit as the time.
+      // Returned value:
+      //    None.
+
+   void init(uint64_t time, uint64_t resolution);
+
+      // Functionality:
+      //    Schedule a node at its time stamp. A time stamp in the past is due immediately.
+      // Parameters:
+      //    0) [in] n: the node, which must not be on the wheel.
+      // Returned value:
+      //    None.
+
+   void insert(CWheelNode* n);
+
+      // Functionality:
+      //    Remove a node from the wheel.
+      // Parameters:
+      //    0) [in] n: the node, which must be on the wheel.
+      // Returned value:
+      //    None.
+
+   void remove(CWheelNode* n);
+
+      // Functionality:
+      //    Move the wheel to the given time and find a node that is due.
+      // Parameters:
+      //    0) [in] time: current time.
+      // Returned value:
+      //    a node whose time stamp is not later than "time", which is kept on the wheel, or NULL if none is due.
+
+   CWheelNode* due(uint64_t time);
+
+      // Functionality:
+      //    Find the earliest time when "due" should be called again, that is the earliest time stamp of the nodes
+      //    in the nearest slot, or the time when the nodes of a coarser slot are to be moved down the wheel.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    the next processing time, 0 if the wheel is empty.
+
+   uint64_t next() const;
+
+      // Functionality:
+      //    Query the number of nodes on the wheel.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    number of nodes.
+
+   int size() const {return m_iCount;}
+
+public:
+   static const int m_iLevels = 4;	// number of levels, each covering the whole range of the level below
+   static const int m_iSlotBits = 8;	// number of slots per level, in bits
+   static const int m_iSlots = 1 << m_iSlotBits;
+
+private:
+   uint64_t nextEvent(int& level) const;
+   int findSlot(int level, int from) const;
+   void place(CWheelNode* n);
+   void unlink(CWheelNode* n);
+   void moveTo(uint64_t tick);
+
+private:
+   CWheelNode* m_pSlot[m_iLevels][m_iSlots];		// circular list of the nodes in each slot
+   uint64_t m_pBitmap[m_iLevels][m_iSlots / 64];	// non-empty slots
+
+   uint64_t m_llResolution;	// time span of a slot at the lowest level
+   uint64_t m_llCurrTick;	// current position of the wheel, in units of resolution
+   int m_iCount;		// number of nodes on the wheel
 
-   int m_iHeapLoc;		// location on the heap, -1 means not on the heap
+private:
+   CTimerWheel(const CTimerWheel&);
+   CTimerWheel& operator=(const CTimerWheel&);
+};
+
+struct CSNode: public CWheelNode
+{
+   CUDT* m_pUDT;		// Pointer to the instance of CUDT socket
 };
 
 class CSndUList
@@ -181,6 +319,17 @@ public:
 
    int pop(sockaddr*& addr, CPacket& pkt);
 
+      // Functionality:
+      //    Retrieve packets from all the entries that are due now, up to a given number, and reschedule them.
+      // Parameters:
+      //    0) [out] addr: destination addresses of the packets
+      //    1) [out] pkt: the packets to be sent
+      //    2) [in] num: maximum number of packets to retrieve
+      // Returned value:
+      //    Number of packets retrieved, 0 if nothing is due.
+
+   int pop(sockaddr** addr, CPacket** pkt, int num);
+
       // Functionality:
       //    Remove UDT instance from the list.
       // Parameters:
@@ -204,9 +353,8 @@ private:
    void remove_(const CUDT* u);
 
 private:
-   CSNode** m_pHeap;			// The heap array
-   int m_iArrayLength;			// physical length of the array
-   int m_iLastEntry;			// position of last entry on the heap array
+   CTimerWheel m_Wheel;			// sockets scheduled by their next processing time
+   uint64_t m_llWakeTime;		// time the sending worker sleeps until, 0 if it is not sleeping on the timer
 
    pthread_mutex_t m_ListLock;
 
@@ -220,13 +368,9 @@ private:
    CSndUList& operator=(const CSndUList&);
 };
 
-struct CRNode
+struct CRNode: public CWheelNode
 {
    CUDT* m_pUDT;                // Pointer to the instance of CUDT socket
-   uint64_t m_llTimeStamp;      // Time Stamp
-
-   CRNode* m_pPrev;             // previous link
-   CRNode* m_pNext;             // next link
 
    bool m_bOnList;              // if the node is already on the list
 };
@@ -240,7 +384,7 @@ public:
 public:
 
       // Functionality:
-      //    Insert a new UDT instance to the list.
+      //    Insert a new UDT instance to the list, scheduled at its next timer deadline.
       // Parameters:
       //    1) [in] u: pointer to the UDT instance
       // Returned value:
@@ -258,7 +402,7 @@ public:
    void remove(const CUDT* u);
 
       // Functionality:
-      //    Move the UDT instance to the end of the list, if it already exists; otherwise, do nothing.
+      //    Reschedule the UDT instance at its next timer deadline, if it already exists; otherwise, do nothing.
       // Parameters:
       //    1) [in] u: pointer to the UDT instance
       // Returned value:
@@ -266,11 +410,26 @@ public:
 
    void update(const CUDT* u);
 
-public:
-   CRNode* m_pUList;		// the head node
+      // Functionality:
+      //    Find a UDT instance whose timer deadline has passed.
+      // Parameters:
+      //    1) [in] currtime: current time
+      // Returned value:
+      //    Pointer to the UDT instance, which is kept on the list, or NULL if none is due.
+
+   CUDT* due(uint64_t currtime);
+
+      // Functionality:
+      //    Retrieve the next time when any instance on the list is due.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    the next deadline, 0 if the list is empty.
+
+   uint64_t getNextTime() const;
 
 private:
-   CRNode* m_pLast;		// the last node
+   CTimerWheel m_Wheel;		// sockets scheduled by their next timer deadline
 
 private:
    CRcvUList(const CRcvUList&);
@@ -288,7 +447,7 @@ public:
       // Functionality:
       //    Initialize the hash table.
       // Parameters:
-      //    1) [in] size: hash table size
+      //    1) [in] size: initial hash table size, the table grows as sockets are inserted
       // Returned value:
       //    None.
 
@@ -301,7 +460,7 @@ public:
       // Returned value:
       //    Pointer to a UDT instance, or NULL if not found.
 
-   CUDT* lookup(int32_t id);
+   CUDT* lookup(int32_t id) const;
 
       // Functionality:
       //    Insert an entry to the hash table.
@@ -322,16 +481,32 @@ public:
 
    void remove(int32_t id);
 
+      // Functionality:
+      //    Query the number of entries in the hash table.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    number of sockets in the table.
+
+   int size() const {return m_iCount;}
+
 private:
    struct CBucket
    {
-      int32_t m_iID;		// Socket ID
-      CUDT* m_pUDT;		// Socket instance
+      int32_t m_iID;			// Socket ID, 0 if the bucket is empty, -1 if the entry has been removed
+      CUDT* m_pUDT;			// Socket instance
+   };
+
+   CBucket* m_pBucket;			// the buckets, in open addressing with linear probing
+   int m_iSize;				// number of buckets, power of 2
 
-      CBucket* m_pNext;		// next bucket
-   } **m_pBucket;		// list of buckets (the hash table)
+   int m_iCount;			// number of entries
+   int m_iUsed;				// number of non-empty buckets, including removed entries
+
+private:
+   static int hash(int32_t id, int size);
 
-   int m_iHashSize;		// size of hash table
+   void resize(int size);
 
 private:
    CHash(const CHash&);
@@ -348,6 +523,7 @@ public:
    void insert(const UDTSOCKET& id, CUDT* u, int ipv, const sockaddr* addr, uint64_t ttl);
    void remove(const UDTSOCKET& id);
    CUDT* retrieve(const sockaddr* addr, UDTSOCKET& id);
+   bool empty();
 
    void updateConnStatus();
 
@@ -381,10 +557,12 @@ public:
       // Parameters:
       //    1) [in] c: UDP channel to be associated to the queue
       //    2) [in] t: Timer
+      //    3) [in] batch: maximum number of packets sent to the channel at once
+      //    4) [in] budget: memory budget for the sending buffers of the sockets, NULL if unlimited
       // Returned value:
       //    None.
 
-   void init(CChannel* c, CTimer* t);
+   void init(CChannel* c, CTimer* t, int batch = 1, CMemBudget* budget = NULL);
 
       // Functionality:
       //    Send out a packet to a given address.
@@ -409,6 +587,8 @@ private:
    CSndUList* m_pSndUList;		// List of UDT instances for data sending
    CChannel* m_pChannel;                // The UDP channel for data sending
    CTimer* m_pTimer;			// Timing facility
+   int m_iBatchSize;			// maximum number of packets sent per system call
+   CMemBudget* m_pBudget;		// memory budget for the sending buffers
 
    pthread_mutex_t m_WindowLock;
    pthread_cond_t m_WindowCond;
@@ -441,10 +621,12 @@ public:
       //    4) [in] hsize: hash table size
       //    5) [in] c: UDP channel to be associated to the queue
       //    6) [in] t: timer
+      //    7) [in] batch: maximum number of packets read from the channel at once
+      //    8) [in] budget: memory budget to grow the unit queue from, NULL if unlimited
       // Returned value:
       //    None.
 
-   void init(int size, int payload, int version, int hsize, CChannel* c, CTimer* t);
+   void init(int size, int payload, int version, int hsize, CChannel* c, CTimer* t, int batch = 1, CMemBudget* budget = NULL);
 
       // Functionality:
       //    Read a packet for a specific UDT socket id.
@@ -456,6 +638,15 @@ public:
 
    int recvfrom(int32_t id, CPacket& packet);
 
+      // Functionality:
+      //    Stop the worker thread and wait for it to exit.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void stop();
+
 private:
 #ifndef WIN32
    static void* worker(void* param);
@@ -472,8 +663,10 @@ private:
    CHash* m_pHash;			// Hash table for UDT socket looking up
    CChannel* m_pChannel;		// UDP channel for receving packets
    CTimer* m_pTimer;			// shared timer with the snd queue
+   CTimer* m_pReactor;			// waits for incoming packets or the next timing event, Linux only
 
    int m_iPayloadSize;                  // packet payload size
+   int m_iBatchSize;                    // maximum number of packets received per system call
 
    volatile bool m_bClosing;            // closing the workder
    pthread_cond_t m_ExitCond;
@@ -491,6 +684,11 @@ private:
 
    void storePkt(int32_t id, CPacket* pkt);
 
+   CUDT* getListener();
+   CUDT* retrieveConnector(const sockaddr* addr, int32_t& id, CRcvQueue*& q);
+
+   uint64_t getNextTime();
+
 private:
    pthread_mutex_t m_LSLock;
    CUDT* m_pListener;                                   // pointer to the (unique, if any) listening UDT entity
@@ -503,6 +701,8 @@ private:
    pthread_mutex_t m_PassLock;
    pthread_cond_t m_PassCond;
 
+   std::vector<CRcvQueue*> m_vShard;                    // all receiving queues of the same multiplexer, including this one
+
 private:
    CRcvQueue(const CRcvQueue&);
    CRcvQueue& operator=(const CRcvQueue&);
@@ -510,10 +710,12 @@ private:
 
 struct CMultiplexer
 {
-   CSndQueue* m_pSndQueue;	// The sending queue
-   CRcvQueue* m_pRcvQueue;	// The receiving queue
-   CChannel* m_pChannel;	// The UDP channel for sending and receiving
-   CTimer* m_pTimer;		// The timer
+   std::vector<CSndQueue*> m_vSndQueue;	// The sending queues, one per worker
+   std::vector<CRcvQueue*> m_vRcvQueue;	// The receiving queues, one per worker
+   std::vector<CChannel*> m_vChannel;	// The UDP channels for sending and receiving, one per worker
+   std::vector<CTimer*> m_vTimer;	// The timers, one per worker
+   int m_iWorkers;		// number of worker pairs, UDT sockets are sharded by socket ID
+   CMemBudget* m_pBudget;	// memory budget shared by the buffers of all sockets, NULL if unlimited
 
    int m_iPort;			// The UDP port number of this multiplexer
    int m_iIPversion;		// IP version
@@ -46,6 +46,7 @@ written by
    #include <sys/types.h>
    #include <sys/socket.h>
    #include <netinet/in.h>
+   #include <sys/uio.h>
 #else
    #ifdef __MINGW__
       #include <stdint.h>
@@ -108,6 +109,20 @@ written by
 typedef SYSSOCKET UDPSOCKET;
 typedef int UDTSOCKET;
 
+#ifdef WIN32
+   struct iovec
+   {
+      int iov_len;
+      char* iov_base;
+   };
+#endif
+
+// completion of a buffer lent to UDT::sendbuf: acked is false if the socket is released before delivery
+typedef void (*UDTSENDCB)(UDTSOCKET u, const char* buf, int len, bool acked, void* arg);
+
+// delivery of the events of a socket by an epoll set with UDT::epoll_set_callback, in place of epoll_wait
+typedef void (*UDTEPOLLCB)(int eid, UDTSOCKET u, int events, void* arg);
+
 ////////////////////////////////////////////////////////////////////////////////
 
 typedef std::set<UDTSOCKET> ud_set;
@@ -122,7 +137,25 @@ enum EPOLLOpt
    // so that if system values are used by mistake, they should have the same effect
    UDT_EPOLL_IN = 0x1,
    UDT_EPOLL_OUT = 0x4,
-   UDT_EPOLL_ERR = 0x8
+   UDT_EPOLL_ERR = 0x8,
+   UDT_EPOLL_ONESHOT = 0x40000000,
+   UDT_EPOLL_ET = 1u << 31
+};
+
+enum AIOOpt
+{
+   UDT_AIO_SEND = 1,
+   UDT_AIO_RECV,
+   UDT_AIO_SENDMSG,
+   UDT_AIO_RECVMSG
+};
+
+struct CAIOResult
+{
+   UDTSOCKET socket;                    // UDT socket of the operation
+   int op;                              // type of the operation, see AIOOpt
+   int result;                          // size of data sent or received, or the negative error code if the operation failed
+   void* arg;                           // user argument given when the operation was posted
 };
 
 enum UDTSTATUS {INIT = 1, OPENED, LISTENING, CONNECTING, CONNECTED, BROKEN, CLOSING, CLOSED, NONEXIST};
@@ -151,7 +184,15 @@ enum UDTOpt
    UDT_STATE,		// current socket state, see UDTSTATUS, read only
    UDT_EVENT,		// current avalable events associated with the socket
    UDT_SNDDATA,		// size of data in the sending buffer
-   UDT_RCVDATA		// size of data available for recv
+   UDT_RCVDATA,		// size of data available for recv
+   UDT_RCVBATCH,	// maximum number of UDP packets read by one system call
+   UDT_SNDBATCH,	// maximum number of UDP packets sent by one system call
+   UDT_GSO,		// use UDP segmentation offload for batched sending, if supported
+   UDT_GRO,		// use UDP receive offload for batched receiving, if supported
+   UDT_WORKERS,		// number of sending/receiving worker threads of a UDP port
+   UDT_DISKBUF,		// size of data recvfile2 keeps in flight to the disk, 0 means synchronous writes
+   UDT_MEMBUDGET,	// memory (bytes) shared by the buffers of all sockets of a UDP port, 0 means unlimited
+   UDT_IDLETIME		// idle time (ms) after which a connection releases its buffers, -1 means never
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -203,6 +244,7 @@ class UDT_API CUDTException
 public:
    CUDTException(int major = 0, int minor = 0, int err = -1);
    CUDTException(const CUDTException& e);
+   CUDTException& operator=(const CUDTException& e);
    virtual ~CUDTException();
 
       // Functionality:
@@ -282,16 +324,133 @@ public: // Error Code
    static const int EDUPLISTEN;
    static const int ELARGEMSG;
    static const int EINVPOLLID;
+   static const int EINVAIOID;
    static const int EASYNCFAIL;
    static const int EASYNCSND;
    static const int EASYNCRCV;
    static const int ETIMEOUT;
+   static const int EAIOFULL;
    static const int EPEERERR;
    static const int EUNKNOWN;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Data source of sendfile(): derive from this class to send data from any storage.
+class UDT_API CUDTSource
+{
+public:
+   virtual ~CUDTSource() {}
+
+      // Functionality:
+      //    Read data at a given offset into a list of buffers.
+      // Parameters:
+      //    0) [in] vec: the buffers to be filled, in order.
+      //    1) [in] num: number of buffers.
+      //    2) [in] offset: position of the data in the source.
+      // Returned value:
+      //    size of data read, less than requested only at the end of the source, or -1 on error.
+
+   virtual int read(const iovec* vec, int num, int64_t offset) = 0;
+
+      // Functionality:
+      //    Optionally expose the data in memory, so that it is sent without copying.
+      // Parameters:
+      //    0) [in] offset: position of the data in the source.
+      //    1) [in] len: size of the data.
+      //    2) [out] release: called when the data is acknowledged, possibly after the source is destroyed; NULL if
+      //       the memory belongs to the source, in which case sendfile() waits for the acknowledgement before it returns.
+      //    3) [out] arg: argument passed to "release".
+      // Returned value:
+      //    pointer to the data, or NULL if the data must be read.
+
+   virtual const char* lend(int64_t /*offset*/, int /*len*/, UDTSENDCB& /*release*/, void*& /*arg*/) {return NULL;}
+};
+
+// Data sink of recvfile(): derive from this class to store received data anywhere.
+class UDT_API CUDTSink
+{
+public:
+   virtual ~CUDTSink() {}
+
+      // Functionality:
+      //    Write data from a list of buffers at a given offset. The buffers are only valid during the call.
+      // Parameters:
+      //    0) [in] vec: the buffers to be written, in order.
+      //    1) [in] num: number of buffers.
+      //    2) [in] offset: position of the data in the sink.
+      // Returned value:
+      //    size of data written, or -1 on error.
+
+   virtual int write(const iovec* vec, int num, int64_t offset) = 0;
+
+      // Functionality:
+      //    Make sure all the data written is stored, called before recvfile() returns.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    0 on success, or -1 on error.
+
+   virtual int flush() {return 0;}
+};
+
+// Source of data in memory, sent without copying. The memory must stay unchanged during sendfile().
+class UDT_API CMemSource: public CUDTSource
+{
+public:
+   CMemSource(const char* data, int64_t size);
+
+   virtual int read(const iovec* vec, int num, int64_t offset);
+   virtual const char* lend(int64_t offset, int len, UDTSENDCB& release, void*& arg);
+
+private:
+   const char* m_pcData;
+   int64_t m_llSize;
+};
+
+// Sink of data in memory.
+class UDT_API CMemSink: public CUDTSink
+{
+public:
+   CMemSink(char* data, int64_t size);
+
+   virtual int write(const iovec* vec, int num, int64_t offset);
+
+private:
+   char* m_pcData;
+   int64_t m_llSize;
+};
+
+#ifndef WIN32
+// Source of data in a file, either read with pread or mapped into memory and sent without copying.
+class UDT_API CFileSource: public CUDTSource
+{
+public:
+   CFileSource(int fd, bool map = true);
+
+   virtual int read(const iovec* vec, int num, int64_t offset);
+   virtual const char* lend(int64_t offset, int len, UDTSENDCB& release, void*& arg);
+
+private:
+   int m_iFD;
+   bool m_bMap;
+};
+
+// Sink of data in a file, written with pwrite.
+class UDT_API CFileSink: public CUDTSink
+{
+public:
+   CFileSink(int fd);
+
+   virtual int write(const iovec* vec, int num, int64_t offset);
+
+private:
+   int m_iFD;
+};
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
 // If you need to export these APIs to be used by a different language,
 // declare extern "C" for them, and add a "udt_" prefix to each API.
 // The following APIs: sendfile(), recvfile(), epoll_wait(), geterrormsg(),
@@ -303,6 +462,7 @@ namespace UDT
 typedef CUDTException ERRORINFO;
 typedef UDTOpt SOCKOPT;
 typedef CPerfMon TRACEINFO;
+typedef CAIOResult AIORESULT;
 typedef ud_set UDSET;
 
 UDT_API extern const UDTSOCKET INVALID_SOCK;
@@ -326,8 +486,13 @@ UDT_API int send(UDTSOCKET u, const char* buf, int len, int flags);
 UDT_API int recv(UDTSOCKET u, char* buf, int len, int flags);
 UDT_API int sendmsg(UDTSOCKET u, const char* buf, int len, int ttl = -1, bool inorder = false);
 UDT_API int recvmsg(UDTSOCKET u, char* buf, int len);
+UDT_API int sendbuf(UDTSOCKET u, const char* buf, int len, UDTSENDCB callback, void* arg, int ttl = -1, bool inorder = false);
+UDT_API int recvbuf(UDTSOCKET u, iovec* vec, int num);
+UDT_API int recvrelease(UDTSOCKET u, int len);
 UDT_API int64_t sendfile(UDTSOCKET u, std::fstream& ifs, int64_t& offset, int64_t size, int block = 364000);
 UDT_API int64_t recvfile(UDTSOCKET u, std::fstream& ofs, int64_t& offset, int64_t size, int block = 7280000);
+UDT_API int64_t sendfile(UDTSOCKET u, CUDTSource& src, int64_t& offset, int64_t size, int block = 364000);
+UDT_API int64_t recvfile(UDTSOCKET u, CUDTSink& sink, int64_t& offset, int64_t size, int block = 7280000);
 UDT_API int64_t sendfile2(UDTSOCKET u, const char* path, int64_t* offset, int64_t size, int block = 364000);
 UDT_API int64_t recvfile2(UDTSOCKET u, const char* path, int64_t* offset, int64_t size, int block = 7280000);
 
@@ -346,6 +511,15 @@ UDT_API int epoll_wait(int eid, std::set<UDTSOCKET>* readfds, std::set<UDTSOCKET
 UDT_API int epoll_wait2(int eid, UDTSOCKET* readfds, int* rnum, UDTSOCKET* writefds, int* wnum, int64_t msTimeOut,
                         SYSSOCKET* lrfds = NULL, int* lrnum = NULL, SYSSOCKET* lwfds = NULL, int* lwnum = NULL);
 UDT_API int epoll_release(int eid);
+UDT_API int epoll_getfd(int eid);
+UDT_API int epoll_set_callback(int eid, UDTEPOLLCB callback, void* arg);
+UDT_API int aio_create(int depth = 1024);
+UDT_API int aio_send(int qid, UDTSOCKET u, const char* buf, int len, void* arg);
+UDT_API int aio_recv(int qid, UDTSOCKET u, char* buf, int len, void* arg);
+UDT_API int aio_sendmsg(int qid, UDTSOCKET u, const char* buf, int len, void* arg, int ttl = -1, bool inorder = false);
+UDT_API int aio_recvmsg(int qid, UDTSOCKET u, char* buf, int len, void* arg);
+UDT_API int aio_wait(int qid, AIORESULT* results, int num, int64_t msTimeOut);
+UDT_API int aio_release(int qid);
 UDT_API ERRORINFO& getlasterror();
 UDT_API int getlasterror_code();
 UDT_API const char* getlasterror_desc();
@@ -53,11 +53,6 @@ m_iSize(size),
 m_iHead(0),
 m_iTail(0)
 {
-   m_piACKSeqNo = new int32_t[m_iSize];
-   m_piACK = new int32_t[m_iSize];
-   m_pTimeStamp = new uint64_t[m_iSize];
-
-   m_piACKSeqNo[0] = -1;
 }
 
 CACKWindow::~CACKWindow()
@@ -69,6 +64,14 @@ CACKWindow::~CACKWindow()
 
 void CACKWindow::store(int32_t seq, int32_t ack)
 {
+   // the records are allocated when the first ACK is sent
+   if (NULL == m_piACKSeqNo)
+   {
+      m_piACKSeqNo = new int32_t[m_iSize];
+      m_piACK = new int32_t[m_iSize];
+      m_pTimeStamp = new uint64_t[m_iSize];
+   }
+
    m_piACKSeqNo[m_iHead] = seq;
    m_piACK[m_iHead] = ack;
    m_pTimeStamp[m_iHead] = CTimer::getTime();
@@ -142,6 +145,18 @@ int CACKWindow::acknowledge(int32_t seq, int32_t& ack)
    return -1;
 }
 
+void CACKWindow::compact()
+{
+   delete [] m_piACKSeqNo;
+   delete [] m_piACK;
+   delete [] m_pTimeStamp;
+   m_piACKSeqNo = NULL;
+   m_piACK = NULL;
+   m_pTimeStamp = NULL;
+
+   m_iHead = m_iTail = 0;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 CPktTimeWindow::CPktTimeWindow(int asize, int psize):
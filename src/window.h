@@ -75,6 +75,15 @@ public:
 
    int acknowledge(int32_t seq, int32_t& ack);
 
+      // Functionality:
+      //    Drop all the records and release their memory, it is allocated again by the next ACK.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void compact();
+
 private:
    int32_t* m_piACKSeqNo;       // Seq. No. for the ACK packet
    int32_t* m_piACK;            // Data Seq. No. carried by the ACK packet